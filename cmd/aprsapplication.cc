@@ -8,12 +8,14 @@
 using namespace sdr;
 
 APRSApplication::APRSApplication(http::Server &server)
-  : APRS(), _server(server), _messages()
+  : APRS(), _server(server), _messages(),
+    _events(64, LatencyMonitor::get().histogram("aprs.sse"))
 {
   // Register callbacks
   server.addStatic("/", std::string(index_html, index_html_size), "text/html");
   server.addJSON("/spots", this, &APRSApplication::spots);
-  server.addHandler("/update", this, &APRSApplication::update);
+  server.addHandler("/update", &_events, &http::EventStream::handle);
+  server.addHandler("/latency", &LatencyMonitor::get(), &LatencyMonitor::handle);
 }
 
 APRSApplication::~APRSApplication() {
@@ -42,9 +44,9 @@ APRSApplication::spots(const http::JSON &request, http::JSON &response) {
 void
 APRSApplication::handleAPRSMessage(const Message &message) {
   _messages.push_back(message);
-  // Serialize JSON message
-  std::string json_text;
-  if (_clients.size()) {
+  // Serialize JSON message once and publish it to all clients, the events get sent by the server
+  if (_events.numClients()) {
+    std::string json_text;
     std::map<std::string, http::JSON> msg;
     msg["call"] = http::JSON(message.from().call());
     if (message.hasLocation()) {
@@ -54,34 +56,8 @@ APRSApplication::handleAPRSMessage(const Message &message) {
     time_t time = message.time();
     msg["time"] = http::JSON(ctime(&time));
     http::JSON(msg).serialize(json_text);
+    // The latency from the reception of the frame until the event has been written to the socket
+    // of a client is recorded as "aprs.sse"
+    _events.publish(json_text, "", message.timestamp());
   }
-  // a list collecting the closed
-  // signal all clients connected
-  std::list<http::Connection>::iterator client = _clients.begin();
-  while (client != _clients.end()) {
-    if (client->isClosed()) {
-      // remove client from list
-      client = _clients.erase(client);
-    } else {
-      // send event
-      client->send("data: ");
-      client->send(json_text);
-      client->send("\n\n");
-    }
-  }
-}
-
-void
-APRSApplication::update(const http::Request &request, http::Response &response) {
-  // This call back implements a server side event stream, means the response will
-  // be blocked until the connection is closed
-  response.setHeader("Content-Type", "text/event-stream");
-  response.setHeader("Cache-Control", "no-cache");
-  response.setStatus(http::Response::STATUS_OK);
-  response.sendHeaders();
-  // Signal connection thread to exit without closing the connection
-  response.connection().setProtocolUpgrade();
-  // Store connection
-  _clients.push_back(response.connection());
 }
-
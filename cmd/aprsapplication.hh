@@ -3,6 +3,7 @@
 
 #include "http.hh"
 #include "aprs.hh"
+#include "latency.hh"
 
 
 namespace sdr {
@@ -14,14 +15,13 @@ public:
   ~APRSApplication();
 
   bool spots(const http::JSON &request, http::JSON &response);
-  void update(const http::Request &request, http::Response &response);
 
   void handleAPRSMessage(const Message &message);
 
 protected:
   http::Server      &_server;
   std::list<Message> _messages;
-  std::list<http::Connection> _clients;
+  http::EventStream _events;
 };
 
 }
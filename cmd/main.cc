@@ -14,7 +14,7 @@ using namespace sdr;
 static http::Server *server = 0;
 
 static void __sigint_handler(int signo) {
-  if (server) { server->stop(true); }
+  if (server) { server->stop(false); }
 }
 
 
@@ -101,7 +101,6 @@ int main(int argc, char *argv[])
 
   // nodes for RTL2832 input
   RTLSource *rtl_source=0;
-  AutoCast< std::complex<int16_t> > *rtl_cast=0;
   IQBaseBand<int16_t> *rtl_baseband=0;
   FMDemod<int16_t> *rtl_demod=0;
   FMDeemph<int16_t> *rtl_deemph=0;
@@ -113,13 +112,12 @@ int main(int argc, char *argv[])
       // Apply specified frequency correction.
       rtl_source->setFreqCorrection(opts.get("correction").toFloat());
     }
-    rtl_cast     = new AutoCast< std::complex<int16_t> >();
     rtl_baseband = new IQBaseBand<int16_t>(0, 15.0e3, 21, 0, 22050.0);
     rtl_demod    = new FMDemod<int16_t>();
     rtl_deemph   = new FMDeemph<int16_t>();
     // Connect nodes
-    rtl_source->connect(rtl_cast);
-    rtl_cast->connect(rtl_baseband, true);
+    // The base band node consumes the complex uint8 samples of the RTL2832 directly
+    rtl_source->connect(rtl_baseband);
     rtl_baseband->connect(rtl_demod);
     rtl_demod->connect(rtl_deemph);
     // FM deemph. is source for decoder
@@ -176,7 +174,6 @@ int main(int argc, char *argv[])
 
   // Free allocated nodes
   if (rtl_source) { delete rtl_source; }
-  if (rtl_cast) { delete rtl_cast; }
   if (rtl_baseband) { delete rtl_baseband; }
   if (rtl_demod) { delete rtl_demod; }
   if (rtl_deemph) { delete rtl_deemph; }
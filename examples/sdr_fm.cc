@@ -1,7 +1,6 @@
 #include "demod.hh"
 #include "rtlsource.hh"
 #include "baseband.hh"
-#include "autocast.hh"
 #include "portaudio.hh"
 #include "wavfile.hh"
 
@@ -36,7 +35,6 @@ int main(int argc, char *argv[]) {
   PortAudio::init();
 
   RTLSource src(freq-100e3, 1e6);
-  AutoCast< std::complex<int16_t> > cast;
   IQBaseBand<int16_t> baseband(100e3, 12.5e3, 21, 1, 8000.0);
   baseband.setCenterFrequency(100e3);
   baseband.setFilterFrequency(100e3);
@@ -46,8 +44,7 @@ int main(int argc, char *argv[]) {
   WavSink<int16_t>    *wav_sink = 0;
 
   // Assemble processing chain:
-  src.connect(&cast, true);
-  cast.connect(&baseband);
+  src.connect(&baseband);
   baseband.connect(&demod, true);
   demod.connect(&deemph, true);
   deemph.connect(&audio);
@@ -0,0 +1,50 @@
+#include "rtlsource.hh"
+#include "iqfile.hh"
+
+#include <iostream>
+#include <csignal>
+
+using namespace sdr;
+
+static void __sigint_handler(int signo) {
+  std::cerr << "Stop Queue..." << std::endl;
+  // On SIGINT -> stop queue properly
+  Queue::get().stop();
+  Queue::get().wait();
+}
+
+
+int main(int argc, char *argv[]) {
+  if (3 > argc) {
+    std::cout << "USAGE: sdr_iqrec FREQUENCY OUTPUT [SAMPLE_RATE]" << std::endl; return -1;
+  }
+
+  // get frequency, output file and sample rate
+  double freq = atof(argv[1]);
+  std::string outFile = argv[2];
+  double rate = 1e6;
+  if (4 <= argc) { rate = atof(argv[3]); }
+
+  sdr::Logger::get().addHandler(
+        new sdr::StreamLogHandler(std::cerr, sdr::LOG_DEBUG));
+
+  // Register handler:
+  signal(SIGINT, __sigint_handler);
+
+  // Record the raw complex uint8 samples
+  RTLSource src(freq, rate);
+  IQFileSink< std::complex<uint8_t> > sink(outFile, src.frequency());
+  src.connect(&sink, true);
+
+  Queue::get().addStart(&src, &RTLSource::start);
+  Queue::get().addStop(&src, &RTLSource::stop);
+
+  std::cerr << "Start recording at " << src.frequency()
+            << "Hz. Press CTRL-C to stop recoding." << std::endl;
+
+  Queue::get().start();
+  Queue::get().wait();
+
+  sink.close();
+  return 0;
+}
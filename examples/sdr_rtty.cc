@@ -37,7 +37,9 @@ int main(int argc, char *argv[])
   WavSource src(argv[1]);
   PortSink sink;
   AutoCast<int16_t> cast;
-  FSKDetector fsk(90.90, 930., 1100.);
+  // 45.45 baud RTTY with 170Hz shift, mark is the upper tone. The detector emits a 1 for mark as
+  // the Baudot decoder expects (start bit space, stop bits mark).
+  FSKDetector fsk(90.90, 1100., 930.);
   BitStream bits(90.90, BitStream::NORMAL);
   Baudot decoder;
   TextDump dump;
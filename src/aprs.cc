@@ -109,7 +109,7 @@ APRS::Message::Message()
 APRS::Message::Message(const AX25::Message &msg)
   : AX25::Message(msg),
     _hasLocation(false), _latitude(0), _longitude(0), _symbol(NONE),
-    _hasTime(false), _time(::time(0))
+    _hasTime(false), _time(msg.timestamp() ? time_t(msg.timestamp()/1000000000) : ::time(0))
 {
   size_t offset = 2;
   // Dispatch by message type
@@ -152,11 +152,24 @@ APRS::Message::Message(const AX25::Message &msg)
 APRS::Message::Message(const Message &msg)
   : AX25::Message(msg), _hasLocation(msg._hasLocation), _latitude(msg._latitude),
     _longitude(msg._longitude), _symbol(msg._symbol), _hasTime(msg._hasTime),
-    _time(msg._hasTime)
+    _time(msg._time), _comment(msg._comment)
 {
   // pass...
 }
 
+APRS::Message &
+APRS::Message::operator =(const Message &other) {
+  AX25::Message::operator =(other);
+  _hasLocation = other._hasLocation;
+  _latitude = other._latitude;
+  _longitude = other._longitude;
+  _symbol = other._symbol;
+  _hasTime = other._hasTime;
+  _time = other._time;
+  _comment = other._comment;
+  return *this;
+}
+
 
 bool
 APRS::Message::_readLocation(size_t &offset) {
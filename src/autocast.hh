@@ -4,6 +4,7 @@
 #include "node.hh"
 #include "traits.hh"
 #include "logger.hh"
+#include "convert.hh"
 
 namespace sdr {
 
@@ -116,10 +117,7 @@ protected:
   /** uint8_t -> int8_t */
   static size_t _uint8_int8(const RawBuffer &in, const RawBuffer &out) {
     size_t N = in.bytesLen();
-    for (size_t i=0; i<N; i++) {
-      reinterpret_cast<int8_t *>(out.data())[i] =
-          int16_t(reinterpret_cast<uint8_t *>(in.data())[i]) - 127;
-    }
+    Convert::uint8ToInt8((uint8_t *)in.data(), (int8_t *)out.data(), N);
     return N;
   }
 
@@ -186,30 +184,21 @@ protected:
   /** uint8 -> int16. */
   static size_t _uint8_int16(const RawBuffer &in, const RawBuffer &out) {
     size_t N = in.bytesLen();
-    int8_t *values = reinterpret_cast<int8_t *>(in.data());
-    for (size_t i=0; i<N; i++) {
-      reinterpret_cast<int16_t *>(out.data())[i] = (int16_t(values[i])-127)<<8;
-    }
+    Convert::uint8ToInt16((uint8_t *)in.data(), (int16_t *)out.data(), N);
     return 2*N;
   }
 
   /** int8 -> int16. */
   static size_t _int8_int16(const RawBuffer &in, const RawBuffer &out) {
     size_t N = in.bytesLen();
-    int8_t *values = reinterpret_cast<int8_t *>(in.data());
-    for (size_t i=0; i<N; i++) {
-      reinterpret_cast<int16_t *>(out.data())[i] = int16_t(values[i])<<8;
-    }
+    Convert::int8ToInt16((int8_t *)in.data(), (int16_t *)out.data(), N);
     return 2*N;
   }
 
   /** uint16 -> int16. */
   static size_t _uint16_int16(const RawBuffer &in, const RawBuffer &out) {
     size_t N = in.bytesLen()/2;
-    uint16_t *values = reinterpret_cast<uint16_t *>(in.data());
-    for (size_t i=0; i<N; i++) {
-      reinterpret_cast<int16_t *>(out.data())[i] = int32_t(values[i])-((2<<15)-1);
-    }
+    Convert::uint16ToInt16((uint16_t *)in.data(), (int16_t *)out.data(), N);
     return 2*N;
   }
 
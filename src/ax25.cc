@@ -2,6 +2,7 @@
 #include "logger.hh"
 #include "traits.hh"
 #include <ctime>
+#include <cmath>
 
 
 using namespace sdr;
@@ -42,15 +43,113 @@ static const uint16_t crc_ccitt_table[] = {
     0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
 };
 
-static inline bool check_crc_ccitt(const uint8_t *buf, int cnt)
+/** Slicing-by-8 tables of the CRC-CCITT, the first one is @c crc_ccitt_table. */
+class CRCCCITTSlices
 {
-    uint32_t crc = 0xffff;
-    for (; cnt > 0; cnt--, buf++) {
-        crc = (crc >> 8) ^ crc_ccitt_table[(crc ^ (*buf)) & 0xff];
+public:
+  CRCCCITTSlices() {
+    for (size_t i=0; i<256; i++) { table[0][i] = crc_ccitt_table[i]; }
+    for (size_t k=1; k<8; k++) {
+      for (size_t i=0; i<256; i++) {
+        table[k][i] = (table[k-1][i] >> 8) ^ table[0][table[k-1][i] & 0xff];
+      }
     }
-    return (crc & 0xffff) == 0xf0b8;
+  }
+
+  uint16_t table[8][256];
+};
+
+static const CRCCCITTSlices crc_ccitt_slices;
+
+static inline bool check_crc_ccitt(const uint8_t *buf, int cnt)
+{
+  const uint16_t (*T)[256] = crc_ccitt_slices.table;
+  uint32_t crc = 0xffff;
+  // Process 8 bytes per step
+  for (; cnt >= 8; cnt -= 8, buf += 8) {
+    uint32_t lo = crc ^ (uint32_t(buf[0]) | (uint32_t(buf[1])<<8));
+    crc = T[7][lo & 0xff] ^ T[6][lo >> 8] ^ T[5][buf[2]] ^ T[4][buf[3]] ^
+        T[3][buf[4]] ^ T[2][buf[5]] ^ T[1][buf[6]] ^ T[0][buf[7]];
+  }
+  // Process remaining bytes
+  for (; cnt > 0; cnt--, buf++) {
+    crc = (crc >> 8) ^ T[0][(crc ^ (*buf)) & 0xff];
+  }
+  return (crc & 0xffff) == 0xf0b8;
 }
 
+
+/** HDLC deframer events. */
+typedef enum {
+  HDLC_NONE = 0, HDLC_FLAG, HDLC_ABORT
+} HDLCEvent;
+
+/** Result of a single deframer step on 8 bits. At most one complete frame can be contained in a
+ * step, hence only the data bits before the first event and after the last event are relevant. */
+typedef struct {
+  /** Number of consecutive ones after the step. */
+  uint8_t ones;
+  /** The first event within the step. */
+  uint8_t first;
+  /** The last event within the step. */
+  uint8_t last;
+  /** Number of destuffed data bits before the first event (or all if there is no event). */
+  uint8_t npre;
+  /** Destuffed data bits before the first event, first bit is LSB. */
+  uint8_t pre;
+  /** Number of destuffed data bits after the last event. */
+  uint8_t npost;
+  /** Destuffed data bits after the last event, first bit is LSB. */
+  uint8_t post;
+} HDLCStep;
+
+/** The deframer state table, indexed by the number of consecutive ones received (0-7) and the
+ * next 8 bits (first received bit is MSB). */
+class HDLCTable
+{
+public:
+  HDLCTable() {
+    for (size_t ones=0; ones<8; ones++) {
+      for (size_t bits=0; bits<256; bits++) {
+        HDLCStep &step = table[(ones<<8) | bits];
+        uint8_t o = ones, data = 0, n = 0;
+        step.first = step.last = HDLC_NONE;
+        for (int k=7; k>=0; k--) {
+          uint8_t event = HDLC_NONE;
+          if ((bits >> k) & 0x01) {
+            // 7 ones in a row -> abort
+            o = std::min(7, o+1);
+            if (7 == o) { event = HDLC_ABORT; }
+            else { data |= (1 << n); n++; }
+          } else {
+            // 0 after exactly six ones -> flag, 0 after five ones -> stuffed bit
+            if (6 == o) { event = HDLC_FLAG; }
+            else if (5 != o) { n++; }
+            o = 0;
+          }
+          if (HDLC_NONE != event) {
+            if (HDLC_NONE == step.first) { step.first = event; step.npre = n; step.pre = data; }
+            step.last = event; data = 0; n = 0;
+          }
+        }
+        step.ones = o;
+        if (HDLC_NONE == step.first) {
+          step.npre = n; step.pre = data; step.npost = 0; step.post = 0;
+        } else {
+          step.npost = n; step.post = data;
+        }
+      }
+    }
+  }
+
+  HDLCStep table[8*256];
+};
+
+static const HDLCTable hdlc_table;
+
+/** Minimum frame length (destination & source address and FCS). */
+#define AX25_MIN_FRAME_LENGTH 16
+
 void
 unpackCall(const uint8_t *buffer, std::string &call, int &ssid, bool &addrExt) {
   size_t length = 0; call.resize(6);
@@ -67,7 +166,8 @@ unpackCall(const uint8_t *buffer, std::string &call, int &ssid, bool &addrExt) {
 /* ******************************************************************************************** *
  * Implementation of AX25 decoder
  * ******************************************************************************************** */
-AX25::AX25() : Sink<uint8_t>()
+AX25::AX25()
+  : BitSink(), _rxmeta(), _rxbit(0)
 {
   // pass...
 }
@@ -80,89 +180,204 @@ void
 AX25::config(const Config &src_cfg) {
   if (! src_cfg.hasType()) { return; }
   // Check if buffer type matches
-  if (Config::typeId<uint8_t>() != src_cfg.type()) {
-    ConfigError err;
-    err << "Can not configure AX25: Invalid type " << src_cfg.type()
-        << ", expected " << Config::typeId<uint8_t>();
-    throw err;
-  }
+  configBits(src_cfg, "AX25");
 
-  _bitstream = 0;
-  _bitbuffer = 0;
-  _state     = 0;
-  _ptr       = _rxbuffer;
+  _ones    = 0;
+  _inbits  = 0;
+  _incount = 0;
+  _acc     = 0;
+  _nacc    = 0;
+  _state   = 0;
+  _rxlen   = 0;
 
   LogMessage msg(LOG_DEBUG);
   msg << "Config AX.25 node.";
   Logger::get().log(msg);
 }
 
+inline void
+AX25::_push(uint32_t bits, size_t n) {
+  _inbits = ((_inbits << n) | bits); _incount += n;
+  while (_incount >= 8) {
+    _incount -= 8;
+    _step((_inbits >> _incount) & 0xff);
+  }
+}
+
+inline void
+AX25::_append(uint8_t bits, size_t n) {
+  _acc |= (uint32_t(bits) << _nacc); _nacc += n;
+  // At most 15 bits are pending, hence at most one byte is completed
+  if (_nacc >= 8) {
+    _rxbuffer[(_rxlen++) & 0x1ff] = (_acc & 0xff);
+    _acc >>= 8; _nacc -= 8;
+  }
+}
+
+inline void
+AX25::_step(uint8_t bits) {
+  const HDLCStep &step = hdlc_table.table[(size_t(_ones)<<8) | bits];
+  _ones = step.ones;
+  // Data bits of current frame
+  if (_state) { _append(step.pre, step.npre); }
+  if (HDLC_NONE == step.first) { return; }
+  // Frame ends with the first flag
+  if (HDLC_FLAG == step.first) { _frameEnd(); }
+  // The last event determines the state
+  if (HDLC_FLAG == step.last) {
+    // Receive data
+    _state = 1; _rxlen = 0; _acc = 0; _nacc = 0;
+    _append(step.post, step.npost);
+  } else {
+    // Abort, wait for next flag
+    _state = 0;
+  }
+}
+
+void
+AX25::_frameEnd() {
+  if ((1 != _state) || (AX25_MIN_FRAME_LENGTH > _rxlen)) { return; }
+  if (sizeof(_rxbuffer) < _rxlen) {
+    Logger::get().log(LogMessage(LOG_DEBUG, "AX.25 packet too long."));
+    return;
+  }
+  if (! check_crc_ccitt(_rxbuffer, _rxlen)) {
+    /*LogMessage msg(LOG_DEBUG);
+    msg << "AX.25: Received invalid buffer: " << _rxbuffer;
+    Logger::get().log(msg); */
+    return;
+  }
+  // The frame ends with the byte just processed
+  this->handleAX25Frame(_rxbuffer, _rxlen, _rxmeta.advance(_rxbit-_incount).time());
+}
+
 void
 AX25::process(const Buffer<uint8_t> &buffer, bool allow_overwrite)
 {
+  _rxmeta = buffer.meta();
   for (size_t i=0; i<buffer.size(); i++) {
-    // Store bit in stream
-    _bitstream = ((_bitstream << 1) | (buffer[i] & 0x01));
-
-    // Check for sync byte
-    if ((_bitstream & 0xff) == 0x7e) {
-      if ((1==_state) && ((_ptr - _rxbuffer) > 2)) {
-        *_ptr = 0;
-        if (! check_crc_ccitt(_rxbuffer, _ptr-_rxbuffer)) {
-          /*LogMessage msg(LOG_DEBUG);
-          msg << "AX.25: Received invalid buffer: " << _rxbuffer;
-          Logger::get().log(msg); */
-        } else {
-          // Assemble message
-          Message msg(_rxbuffer, _ptr-_rxbuffer-2);
-          this->handleAX25Message(msg);
-        }
-      }
-      // Receive data
-      _state = 1;
-      _ptr = _rxbuffer;
-      _bitbuffer = 0x80;
-      continue;
-    }
+    _rxbit = i+1;
+    _push(buffer[i] & 0x01, 1);
+  }
+}
 
-    // If 7 ones are received in a row -> error, wait or sync byte
-    if ((_bitstream & 0x7f) == 0x7f) { _state = 0; continue; }
+void
+AX25::processBits(const BitBuffer &buffer, bool allow_overwrite)
+{
+  size_t N = buffer.size();
+  _rxmeta = buffer.meta();
+  for (size_t w=0; w<buffer.numWords(); w++) {
+    size_t n = std::min(size_t(32), N-32*w);
+    _rxbit = 32*w+n;
+    _push(buffer.word(w) >> (32-n), n);
+  }
+}
 
-    // If state == wait for sync byte -> receive next bit
-    if (!_state) { continue; }
+void
+AX25::handleAX25Message(const Message &message) {
+  // pass...
+}
 
-    /* stuffed bit */
-    if ((_bitstream & 0x3f) == 0x3e) { continue; }
+void
+AX25::handleAX25Frame(uint8_t *frame, size_t length, int64_t time) {
+  // Assemble message
+  Message msg(frame, length-2);
+  msg.setTimestamp(time);
+  this->handleAX25Message(msg);
+}
 
-    // prepend bit to bitbuffer
-    /// @todo Double check this!!!
-    _bitbuffer |= ((_bitstream & 0x01) << 8);
 
-    // If 8 bits have been received (stored in b8-b1 of _bitbuffer)
-    if (_bitbuffer & 0x01) {
-      // Check for buffer overrun
-      if ((_ptr-_rxbuffer) >= 512) {
-        Logger::get().log(LogMessage(LOG_DEBUG, "AX.25 packet too long."));
-        // Wait for next sync byte
-        _state = 0;
-        continue;
-      }
+/* ******************************************************************************************** *
+ * Implementation of AX25Diversity
+ * ******************************************************************************************** */
+AX25Diversity::Variant::Variant(AX25Diversity *parent, size_t index, float spaceGain)
+  : AX25(), _parent(parent), _index(index), _spaceGain(spaceGain),
+    _bits(parent->_baud, BitStream::TRANSITION, true)
+{
+  _bits.connect(this, true);
+}
+
+AX25Diversity::Variant::~Variant() {
+  // pass...
+}
+
+void
+AX25Diversity::Variant::handleAX25Frame(uint8_t *frame, size_t length, int64_t time) {
+  _parent->_handleFrame(_index, frame, length, time);
+}
 
-      // Store received byte and ...
-      *_ptr++ = (_bitbuffer >> 1);
-      // reset bit buffer
-      _bitbuffer = 0x80;
-      continue;
-    }
 
-    // Shift bitbuffer one to the left
-    _bitbuffer >>= 1;
+AX25Diversity::AX25Diversity(AX25 *receiver, float baud, float Fmark, float Fspace, double window)
+  : Sink<int16_t>(), _receiver(receiver), _baud(baud), _Fmark(Fmark), _Fspace(Fspace),
+    _window(window), _bank(), _frames(0), _Fs(0), _samples(0)
+{
+  // pass...
+}
+
+AX25Diversity::~AX25Diversity() {
+  for (size_t i=0; i<_variants.size(); i++) { delete _variants[i]; }
+}
+
+size_t
+AX25Diversity::addVariant(float spaceGain) {
+  size_t idx = _variants.size();
+  _variants.push_back(new Variant(this, idx, spaceGain));
+  _decoded.push_back(0); _wins.push_back(0);
+  _bank.addModem(_baud, _Fmark, _Fspace, spaceGain)->connect(&(_variants.back()->_bits), true);
+  return idx;
+}
+
+void
+AX25Diversity::config(const Config &src_cfg) {
+  // Check if config is complete
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
+
+  // Use default variants if none are specified
+  if (0 == _variants.size()) {
+    addVariant(0.5); addVariant(M_SQRT1_2); addVariant(1); addVariant(M_SQRT2); addVariant(2);
   }
+
+  _Fs = src_cfg.sampleRate();
+  _samples = 0;
+  _recent.clear();
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Config AX25Diversity node: " << std::endl
+      << " variants: " << _variants.size() << std::endl
+      << " de-duplication window: " << _window << "s";
+  Logger::get().log(msg);
+
+  // Configure front-end & variants
+  _bank.config(src_cfg);
 }
 
 void
-AX25::handleAX25Message(const Message &message) {
-  // pass...
+AX25Diversity::process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
+  _bank.process(buffer, allow_overwrite);
+  _samples += buffer.size();
+}
+
+void
+AX25Diversity::_handleFrame(size_t variant, uint8_t *frame, size_t length, int64_t time) {
+  double now = _samples/_Fs;
+  uint16_t fcs = (uint16_t(frame[length-1]) << 8) | frame[length-2];
+  std::string content((char *)frame, length);
+
+  _decoded[variant]++;
+
+  // Remove expired frames
+  while (_recent.size() && ((now - _recent.front().time) > _window)) { _recent.pop_front(); }
+  // Check for duplicates
+  std::list<RecentFrame>::iterator item = _recent.begin();
+  for (; item != _recent.end(); item++) {
+    if ((fcs == item->fcs) && (content == item->frame)) { return; }
+  }
+
+  // First copy -> remember and forward frame
+  RecentFrame recent; recent.fcs = fcs; recent.frame = content; recent.time = now;
+  _recent.push_back(recent);
+  _wins[variant]++; _frames++;
+  _receiver->handleAX25Frame(frame, length, time);
 }
 
 
@@ -220,22 +435,25 @@ sdr::operator <<(std::ostream &stream, const AX25::Address &addr) {
  * Implementation of AX25 Message
  * ******************************************************************************************** */
 AX25::Message::Message()
-  : _from(), _to(), _via(), _payload()
+  : _from(), _to(), _via(), _payload(), _timestamp(0)
 {
   // pass...
 }
 
 AX25::Message::Message(uint8_t *buffer, size_t length)
-  : _via(), _payload()
+  : _via(), _payload(), _timestamp(0)
 {
   std::string call; int ssid; bool addrExt;
+  // A frame holds at least the destination and source address
+  if (14 > length) { return; }
   // Get destination address
   unpackCall(buffer, call, ssid, addrExt); buffer+=7; length -= 7;
   _to   = Address(call, ssid);
   // Get source address
   unpackCall(buffer, call, ssid, addrExt); buffer+=7; length -= 7;
   _from = Address(call, ssid);
-  while (addrExt) {
+  // Get repeater addresses, stop at the end of a malformed (unterminated) address field
+  while (addrExt && (7 <= length)) {
     unpackCall(buffer, call, ssid, addrExt); buffer+=7; length -= 7;
     _via.push_back(Address(call, ssid));
   }
@@ -246,7 +464,7 @@ AX25::Message::Message(uint8_t *buffer, size_t length)
 
 AX25::Message::Message(const Message &other)
   : _from(other._from), _to(other._to), _via(other._via),
-    _payload(other._payload)
+    _payload(other._payload), _timestamp(other._timestamp)
 {
   // pass...
 }
@@ -257,6 +475,7 @@ AX25::Message::operator =(const Message &other) {
   _to   = other._to;
   _via  = other._via;
   _payload = other._payload;
+  _timestamp = other._timestamp;
   return *this;
 }
 
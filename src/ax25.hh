@@ -2,6 +2,8 @@
 #define __SDR_AX25_HH__
 
 #include "node.hh"
+#include "fsk.hh"
+#include <list>
 
 namespace sdr {
 
@@ -15,8 +17,11 @@ namespace sdr {
  * The node does not process the actual AX.25 packages, it only checks the frame check sequence and
  * forwards the AX.25 datagram to all connected sinks on success. The receiving node is responsible
  * for unpacking and handling the received datagram.
+ *
+ * The bit stream may be passed as one bit per @c uint8_t sample or as packed bits. Internally,
+ * the HDLC deframing is driven by a precomputed state table that processes 8 bits per step.
  * @ingroup datanodes */
-class AX25: public Sink<uint8_t>
+class AX25: public BitSink
 {
 public:
   class Address
@@ -52,11 +57,18 @@ public:
 
     inline const std::string &payload() const { return _payload; }
 
+    /** Returns the capture time of the end of the frame in ns since the epoch (0 if unknown). */
+    inline int64_t timestamp() const { return _timestamp; }
+    /** Sets the capture time of the end of the frame. */
+    inline void setTimestamp(int64_t time) { _timestamp = time; }
+
   protected:
     Address _from;
     Address _to;
     std::vector<Address> _via;
     std::string _payload;
+    /** The capture time of the end of the frame. */
+    int64_t _timestamp;
   };
 
 public:
@@ -69,21 +81,171 @@ public:
   virtual void config(const Config &src_cfg);
   /** Processes the bit stream. */
   virtual void process(const Buffer<uint8_t> &buffer, bool allow_overwrite);
+  /** Processes the packed bit stream. */
+  virtual void processBits(const BitBuffer &buffer, bool allow_overwrite);
 
   virtual void handleAX25Message(const Message &message);
 
+  /** Gets called for every received frame with a valid frame check sequence. The default
+   * implementation unpacks the frame and calls @c handleAX25Message.
+   * @param frame The received frame.
+   * @param length The length of the frame including the 2 FCS bytes.
+   * @param time The capture time of the end of the frame in ns since the epoch (0 if unknown),
+   *        see @c BufferMeta. */
+  virtual void handleAX25Frame(uint8_t *frame, size_t length, int64_t time=0);
+
+protected:
+  /** Appends @c n (<=32) bits to the input bits and processes all complete bytes. */
+  inline void _push(uint32_t bits, size_t n);
+  /** Performs a deframer step on 8 bits (first received bit is the MSB). */
+  inline void _step(uint8_t bits);
+  /** Appends @c n destuffed bits (first received bit is the LSB) to the current frame. */
+  inline void _append(uint8_t bits, size_t n);
+  /** Gets called on a flag, checks and forwards the received frame (if any). */
+  void _frameEnd();
+
 protected:
-  /** The last bits. */
-  uint32_t _bitstream;
-  /** A buffer of received bits. */
-  uint32_t _bitbuffer;
-  /** The current state. */
+  /** The number of consecutive ones received (saturates at 7). */
+  uint8_t _ones;
+  /** Received bits not processed yet. */
+  uint64_t _inbits;
+  /** Number of received bits not processed yet. */
+  size_t _incount;
+  /** Destuffed bits not stored yet (first received bit is the LSB). */
+  uint32_t _acc;
+  /** Number of destuffed bits not stored yet. */
+  size_t _nacc;
+  /** The current state (1 if receiving a frame, 0 if waiting for a flag). */
   uint32_t _state;
 
   /** Message buffer. */
   uint8_t _rxbuffer[512];
-  /** Insert-pointer to the buffer. */
-  uint8_t *_ptr;
+  /** Number of bytes received for the current frame. The index into @c _rxbuffer wraps around,
+   * frames longer than the buffer are dropped once completed. */
+  size_t _rxlen;
+  /** The metadata of the buffer being processed. */
+  BufferMeta _rxmeta;
+  /** The number of bits of the current buffer pushed so far. */
+  size_t _rxbit;
+};
+
+
+/** Multi-decoder (diversity) AX25 receiver.
+ * The decode yield improves if several slicers with different settings process the same signal.
+ * This node shares the mark/space correlators (see @c FSKDetectorBank) between all variants, each
+ * variant consists of a slicer with a different space tone gain, a @c BitStream and an AX25
+ * deframer. Frames received by several variants within a short time window are de-duplicated by
+ * their FCS and content, hence only the first copy of a frame is forwarded to the
+ * @c AX25::handleAX25Message method of the receiver (e.g. an @c APRS instance).
+ *
+ * For every variant, the number of frames decoded and the number of frames won (i.e. received
+ * first) are counted.
+ * @ingroup demods */
+class AX25Diversity: public Sink<int16_t>
+{
+protected:
+  /** The deframer of a single variant, forwards frames to the diversity receiver. */
+  class Variant: public AX25
+  {
+  public:
+    /** Constructor. */
+    Variant(AX25Diversity *parent, size_t index, float spaceGain);
+    /** Destructor. */
+    virtual ~Variant();
+
+    /** Returns the space tone gain of the slicer. */
+    inline float spaceGain() const { return _spaceGain; }
+
+    /** Forwards the frame to the diversity receiver. */
+    void handleAX25Frame(uint8_t *frame, size_t length, int64_t time=0);
+
+  protected:
+    /** The diversity receiver. */
+    AX25Diversity *_parent;
+    /** The index of the variant. */
+    size_t _index;
+    /** The space tone gain of the slicer. */
+    float _spaceGain;
+    /** The bit-clock recovery of this variant. */
+    BitStream _bits;
+
+    friend class AX25Diversity;
+  };
+
+  /** A recently received frame. */
+  typedef struct {
+    /** The FCS of the frame. */
+    uint16_t fcs;
+    /** The frame content. */
+    std::string frame;
+    /** Time of reception in seconds (stream time). */
+    double time;
+  } RecentFrame;
+
+public:
+  /** Constructor.
+   * @param receiver Specifies the AX25 instance receiving the de-duplicated frames.
+   * @param baud Specifies the baud rate.
+   * @param Fmark Specifies the mark frequency.
+   * @param Fspace Specifies the space frequency.
+   * @param window Specifies the de-duplication time window in seconds. */
+  AX25Diversity(AX25 *receiver, float baud=1200, float Fmark=1200, float Fspace=2200,
+                double window=1.0);
+  /** Destructor. */
+  virtual ~AX25Diversity();
+
+  /** Adds a slicer/deframer variant with the given space tone gain and returns its index.
+   * If no variants are added before the node gets configured, a default set of variants with
+   * gains between 1/2 and 2 (in steps of sqrt(2)) is used. Larger gains (or smaller ones) rarely
+   * help, as the bit-length correlators hardly separate the tones of single-bit symbols, which
+   * get suppressed by such a slicer. */
+  size_t addVariant(float spaceGain);
+
+  /** Returns the number of variants. */
+  inline size_t numVariants() const { return _variants.size(); }
+  /** Returns the space tone gain of the i-th variant. */
+  inline float spaceGain(size_t i) const { return _variants[i]->spaceGain(); }
+  /** Returns the number of frames decoded by the i-th variant (including duplicates). */
+  inline size_t decoded(size_t i) const { return _decoded[i]; }
+  /** Returns the number of frames first received by the i-th variant. */
+  inline size_t wins(size_t i) const { return _wins[i]; }
+  /** Returns the number of unique frames received. */
+  inline size_t frames() const { return _frames; }
+
+  virtual void config(const Config &src_cfg);
+  virtual void process(const Buffer<int16_t> &buffer, bool allow_overwrite);
+
+protected:
+  /** Gets called by the variants on reception of a valid frame. */
+  void _handleFrame(size_t variant, uint8_t *frame, size_t length, int64_t time);
+
+protected:
+  /** The receiver of the frames. */
+  AX25 *_receiver;
+  /** The baud rate. */
+  float _baud;
+  /** The mark frequency. */
+  float _Fmark;
+  /** The space frequency. */
+  float _Fspace;
+  /** The de-duplication time window in seconds. */
+  double _window;
+  /** The shared front-end. */
+  FSKDetectorBank _bank;
+  /** The variants. */
+  std::vector<Variant *> _variants;
+  /** The frames decoded by each variant. */
+  std::vector<size_t> _decoded;
+  /** The frames won by each variant. */
+  std::vector<size_t> _wins;
+  /** The number of unique frames. */
+  size_t _frames;
+  /** The sample rate. */
+  double _Fs;
+  /** The number of samples processed. */
+  size_t _samples;
+  /** Recently received frames. */
+  std::list<RecentFrame> _recent;
 };
 
 
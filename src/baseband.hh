@@ -17,6 +17,13 @@ namespace sdr {
  * resulting stream. This node can be used to select a portion of the input spectrum and for the
  * reduction of the stream rate, allowing for some more expensive operations to be performed on the
  * output stream.
+ *
+ * Besides @c std::complex<Scalar>, a node with a wider scalar type (e.g. @c int16_t) also accepts
+ * 8bit complex input directly, i.e. @c Config::Type_cs8 and the native @c Config::Type_cu8 format
+ * of the @c RTLSource. The sign conversion and the scaling to the output scalar are then fused
+ * into the filter stage, hence the full-rate stream stays at 2 bytes per sample and no cast node
+ * is needed in front of this node. The output is identical to the one obtained by casting the
+ * input with @c AutoCast first.
  * @ingroup filters */
 template <class Scalar>
 class IQBaseBand: public Sink< std::complex<Scalar> >, public Source, public FreqShiftBase<Scalar>
@@ -36,7 +43,7 @@ public:
     : Sink<CScalar>(), Source(), FreqShiftBase<Scalar>(Fc, 0),
       _Fc(Fc), _Ff(Fc), _Fs(0), _width(width), _order(std::max(size_t(1), order)),
       _sub_sample(sub_sample), _oFs(oFs), _ring_offset(0), _sample_count(0),
-      _last(0), _kernel(_order)
+      _last(0), _inputType(Config::typeId<CScalar>()), _kernel(_order)
   {
     // Allocate and reset ring buffer:
     _ring = Buffer<CSScalar>(_order);
@@ -48,7 +55,7 @@ public:
     : Sink<CScalar>(), Source(), FreqShiftBase<Scalar>(Fc, 0),
       _Fc(Fc), _Ff(Ff), _Fs(0), _width(width), _order(std::max(size_t(1), order)),
       _sub_sample(sub_sample), _oFs(oFs), _ring_offset(0), _sample_count(0),
-      _last(0), _kernel(_order)
+      _last(0), _inputType(Config::typeId<CScalar>()), _kernel(_order)
   {
     // Allocate and reset ring buffer:
     _ring = Buffer<CSScalar>(_order);
@@ -116,13 +123,16 @@ public:
   {
     // Requires type, sample rate & buffer size
     if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
-    // Check buffer type
-    if (Config::typeId<CScalar>() != src_cfg.type()) {
+    // Check buffer type, 8bit complex input is accepted by wider scalar types
+    bool narrow = (sizeof(Scalar) > 1) &&
+        ((Config::Type_cs8 == src_cfg.type()) || (Config::Type_cu8 == src_cfg.type()));
+    if ((Config::typeId<CScalar>() != src_cfg.type()) && (! narrow)) {
       ConfigError err;
       err << "Can not configure IQBaseBand: Invalid type " << src_cfg.type()
           << ", expected " << Config::typeId<CScalar>();
       throw err;
     }
+    _inputType = src_cfg.type();
     // Store sample rate
     _Fs = src_cfg.sampleRate();
     // Store source buffer size
@@ -150,6 +160,30 @@ public:
     }
   }
 
+  /** Dispatches 8bit complex input, forwards all other buffers to @c process. */
+  virtual void handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+    if ((Config::Type_cs8 != _inputType) && (Config::Type_cu8 != _inputType)) {
+      Sink<CScalar>::handleBuffer(buffer, allow_overwrite); return;
+    }
+    // The output samples are larger than the input ones, hence never in-place
+    if (! _buffer.isUnused()) {
+#ifdef SDR_DEBUG
+      LogMessage msg(LOG_WARNING);
+      msg << "IQBaseBand: Drop buffer: Output buffer still in use.";
+      Logger::get().log(msg);
+#endif
+      return;
+    }
+    // Scale 8bit samples to the output scalar type, e.g. x<<8 for int16_t
+    if (Config::Type_cs8 == _inputType) {
+      _process<int8_t, 0, 8*(sizeof(Scalar)-1)>(
+            Buffer< std::complex<int8_t> >(buffer), _buffer);
+    } else {
+      _process<uint8_t, 128, 8*(sizeof(Scalar)-1)>(
+            Buffer< std::complex<uint8_t> >(buffer), _buffer);
+    }
+  }
+
 
 protected:
   /** Reconfigures the node. */
@@ -178,7 +212,7 @@ protected:
 
     LogMessage msg(LOG_DEBUG);
     msg << "Configured IQBaseBand node:" << std::endl
-        << " type " << Traits< std::complex<Scalar> >::scalarId << std::endl
+        << " type " << _inputType << " -> " << Traits< std::complex<Scalar> >::scalarId << std::endl
         << " sample-rate " << _Fs << "Hz" << std::endl
         << " center freq " << _Fc << "Hz" << std::endl
         << " width " << _width << "Hz" << std::endl
@@ -196,10 +230,19 @@ protected:
   /** Performs the base-band selection, frequency shift and sub-sampling. Stores the
    * results into @c out. The input and output buffer may overlapp. */
   inline void _process(const Buffer<CScalar> &in, const Buffer<CScalar> &out) {
-    size_t i=0, j=0;
+    _process<Scalar, 0, 0>(in, out);
+  }
+
+  /** Performs the base-band selection, frequency shift and sub-sampling on input samples of type
+   * @c iScalar. The input samples are converted to the compute type as @c (x-offset)<<shift while
+   * being stored into the ring buffer. */
+  template <class iScalar, int offset, int shift>
+  inline void _process(const Buffer< std::complex<iScalar> > &in, const Buffer<CScalar> &out) {
+    size_t i=0, j=0, first=0;
     for (; i<in.size(); i++, _sample_count++) {
-      // Store sample in ring buffer
-      _ring[_ring_offset] = in[i];
+      // Store (converted) sample in ring buffer
+      _ring[_ring_offset] = CSScalar((SScalar(in[i].real())-offset)*(1<<shift),
+                                     (SScalar(in[i].imag())-offset)*(1<<shift));
 
       // Apply filter on ring-buffer and shift freq
       _last += this->applyFrequencyShift(_filter_ring());
@@ -210,6 +253,7 @@ protected:
 
       // If _sample_count samples have been averaged:
       if (_sub_sample == _sample_count) {
+        if (0 == j) { first = i; }
         // Store average in output buffer
         CSScalar value = _last/CSScalar(_sub_sample);
         out[j] = value;
@@ -219,7 +263,9 @@ protected:
         out[j] = _last; _last = 0; _sample_count = 0; j++;
       }
     }
-    this->send(out.head(j), true);
+    Buffer<CScalar> res = out.head(j);
+    res.setMeta(in.meta().resample(1, _sub_sample, first));
+    this->send(res, true);
   }
 
   /** Applies the filter on the data stored in the ring buffer. */
@@ -284,6 +330,8 @@ protected:
   CSScalar _last;
   /** Buffer size of the source. */
   size_t _sourceBs;
+  /** The input type, either @c std::complex<Scalar> or a 8bit complex type. */
+  Config::Type _inputType;
 
   /** The filter kernel of order _order. */
   Buffer<CSScalar> _kernel;
@@ -423,7 +471,7 @@ protected:
    * is shifted and finally the signal gets averaged over @c _sub_sample samples, implementing the
    * averaging sub-sampling. */
   inline void _process(const Buffer<Scalar> &in, const Buffer<CScalar> &out) {
-    size_t i=0, j=0;
+    size_t i=0, j=0, first=0;
     for (; i<in.size(); i++) {
       // Store sample in ring buffer
       _ring[_ring_offset] = in[i];
@@ -437,13 +485,16 @@ protected:
 
       // If _sample_count samples have been averaged:
       if (_sub_sample == _sample_count) {
+        if (0 == j) { first = i; }
         // Store average in output buffer
         out[j] = _last/CSScalar(_sub_sample);;
         // reset average, sample count and increment output buffer index j
         _last = 0; _sample_count=0; j++;
       }
     }
-    this->send(out.head(j), true);
+    Buffer<CScalar> res = out.head(j);
+    res.setMeta(in.meta().resample(1, _sub_sample, first));
+    this->send(res, true);
   }
 
   /** Applies the filter on the data stored in the ring buffer. */
@@ -21,34 +21,36 @@ char Baudot::_figure[32] = {  0, '3','\n', '-', ' ','\a', '8', '7','\n', '?', '4
 
 
 Baudot::Baudot(StopBits stopBits)
-  : Sink<uint8_t>(), Source(), _mode(LETTERS)
+  : Sink<uint8_t>(), Source(), _mode(LETTERS), _frames(0), _framingErrors(0)
 {
   switch (stopBits) {
   case STOP1:
-    // Pattern xx11 xxxx xxxx xx00
+    // Pattern xx00 xxxx xxxx xx11
     // Mask    0011 0000 0000 0011
     _stopHBits     = 2;
     _bitsPerSymbol = 14;
-    _pattern       = 0x3000;
+    _pattern       = 0x0003;
     _mask          = 0x3003;
     break;
   case STOP15:
-    // Pattern x11x xxxx xxxx x000
+    // Pattern x00x xxxx xxxx x111
     // Mask    0110 0000 0000 0111
     _stopHBits     = 3;
     _bitsPerSymbol = 15;
-    _pattern       = 0x6000;
+    _pattern       = 0x0007;
     _mask          = 0x6007;
     break;
   case STOP2:
-    // Pattern 11xx xxxx xxxx 0000
+    // Pattern 00xx xxxx xxxx 1111
     // Mask    1100 0000 0000 1111
     _stopHBits     = 4;
     _bitsPerSymbol = 16;
-    _pattern       = 0xC000;
+    _pattern       = 0x000F;
     _mask          = 0xC00F;
     break;
   }
+  // The start bit is formed by the 2 leading half bits of the frame
+  _startMask = (3 << (_bitsPerSymbol-2));
 }
 
 void
@@ -65,9 +67,11 @@ Baudot::config(const Config &src_cfg) {
   // Init (half) bit stream and counter
   _bitstream = 0;
   _bitcount  = 0;
+  _frames = _framingErrors = 0;
 
   // Compute buffer size.
-  size_t buffer_size = (src_cfg.bufferSize()/(2*_bitsPerSymbol))+1;
+  // _bitsPerSymbol is given in half bits, hence a buffer may contain that many symbols at most
+  size_t buffer_size = (src_cfg.bufferSize()/_bitsPerSymbol)+1;
   _buffer  = Buffer<uint8_t>(buffer_size);
 
   LogMessage msg(LOG_DEBUG);
@@ -88,13 +92,20 @@ Baudot::process(const Buffer<uint8_t> &buffer, bool allow_overwrite)
   size_t o=0;
   for (size_t i=0; i<buffer.size(); i++) {
     _bitstream = (_bitstream << 1) | (buffer[i] & 0x1); _bitcount++;
+    // A start bit where the next frame is expected but no stop bits -> framing error
+    if ((_bitsPerSymbol == _bitcount) && (_pattern != (_bitstream & _mask)) &&
+        (0 == (_bitstream & _startMask))) {
+      _framingErrors++;
+    }
     // Check if symbol as received:
     if ((_bitsPerSymbol <= _bitcount) && (_pattern == (_bitstream & _mask))) {
+      // Count frames following the previous one, allow for one half bit of a longer stop bit
+      if (_bitcount <= size_t(_bitsPerSymbol+1)) { _frames++; }
       _bitcount = 0;
-      // Unpack 5bit baudot code
+      // Unpack 5bit baudot code, the LSB is send first
       uint8_t code = 0;
       for (int j=0; j<5; j++) {
-        int shift = _stopHBits + 2*j;
+        int shift = _stopHBits + 2*(4-j);
         code |= (((_bitstream>>shift)&0x01)<<j);
       }
       // Decode to ASCII
@@ -41,6 +41,13 @@ public:
   /** Processes the bit-stream. */
   virtual void process(const Buffer<uint8_t> &buffer, bool allow_overwrite);
 
+  /** Returns the number of frames received right after the previous one. Frames found after an
+   * idle period or after hunting for the frame pattern are not counted. */
+  inline size_t frames() const { return _frames; }
+  /** Returns the number of framing errors, i.e. the number of times a start bit was received
+   * where the next frame was expected but the stop bits were missing. */
+  inline size_t framingErrors() const { return _framingErrors; }
+
 protected:
   /** Code table for letters. */
   static char _letter[32];
@@ -62,6 +69,12 @@ protected:
   uint16_t _mask;
   /** Number of half bits forming the stop bit. */
   uint16_t _stopHBits;
+  /** Specifies the mask of the start bit. */
+  uint16_t _startMask;
+  /** The number of frames received right after the previous one. */
+  size_t _frames;
+  /** The number of framing errors. */
+  size_t _framingErrors;
 
   /** The output buffer. */
   Buffer<uint8_t> _buffer;
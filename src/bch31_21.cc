@@ -1,6 +1,5 @@
 #include "bch31_21.hh"
-#include "stdlib.h"
-#include "string.h"
+#include <cstring>
 
 using namespace sdr;
 
@@ -29,8 +28,9 @@ static inline unsigned char even_parity(uint32_t data)
     return temp & 1;
 }
 
-static unsigned int
-pocsag_syndrome(uint32_t data)
+/* BCH remainder of the 31 code bits (the parity bit is thrown away). */
+static uint32_t
+bch_remainder(uint32_t data)
 {
     uint32_t shreg = data >> 1; /* throw away parity bit */
     uint32_t mask = 1L << (BCH_N-1), coeff = BCH_POLY << (BCH_K-1);
@@ -39,175 +39,81 @@ pocsag_syndrome(uint32_t data)
     for(; n > 0; mask >>= 1, coeff >>= 1, n--) {
       if (shreg & mask) { shreg ^= coeff; }
     }
-    if (even_parity(data)) {
-      shreg |= (1 << (BCH_N - BCH_K));
-    }
     return shreg;
 }
 
-static void
-bitslice_syndrome(uint32_t *slices)
+/*
+ * The BCH remainder is linear in the data, hence it can be obtained as the XOR of the remainders
+ * of the 4 bytes of the code word (byte tables). The 2^10 possible remainders (syndromes) are
+ * mapped to the error pattern of all single and double bit errors of the 31 code bits
+ * (syndrome table). An entry of 0 means, that the error is not correctable.
+ */
+class BCHTables
 {
-    const int firstBit = BCH_N - 1;
-    int i, n;
-    uint32_t paritymask = slices[0];
-
-    // do the parity and shift together
-    for (i = 1; i < 32; ++i) {
-        paritymask ^= slices[i];
-        slices[i-1] = slices[i];
-    }
-    slices[31] = 0;
-
-    // BCH_POLY << (BCH_K - 1) is
-    //                                                              20   21 22 23
-    //  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ONE, 0, 0, ONE,
-    //  24 25   26  27  28   29   30   31
-    //  0, ONE, ONE, 0, ONE, ONE, ONE, 0
-
-    for (n = 0; n < BCH_K; ++n) {
-        // one line here for every '1' bit in coeff (above)
-        const int bit = firstBit - n;
-        slices[20 - n] ^= slices[bit];
-        slices[23 - n] ^= slices[bit];
-        slices[25 - n] ^= slices[bit];
-        slices[26 - n] ^= slices[bit];
-        slices[28 - n] ^= slices[bit];
-        slices[29 - n] ^= slices[bit];
-        slices[30 - n] ^= slices[bit];
-        slices[31 - n] ^= slices[bit];
+public:
+  BCHTables() {
+    for (int k=0; k<4; k++) {
+      for (uint32_t b=0; b<256; b++) { byte[k][b] = bch_remainder(b << (8*k)); }
     }
-
-    // apply the parity mask we built up
-    slices[BCH_N - BCH_K] |= paritymask;
-}
-
-static uint32_t
-transpose_n(int n, uint32_t *matrix)
-{
-  uint32_t out = 0;
-  int j;
-
-  for (j = 0; j < 32; ++j) {
-    if (matrix[j] & (1<<n)) {
-      out |= (1<<j);
+    memset(syndrome, 0, sizeof(syndrome));
+    for (int b1=1; b1<32; b1++) {
+      syndrome[bch_remainder(1u<<b1)] = (1u<<b1);
+      for (int b2=b1+1; b2<32; b2++) {
+        syndrome[bch_remainder((1u<<b1) | (1u<<b2))] = ((1u<<b1) | (1u<<b2));
+      }
     }
   }
 
-  return out;
-}
-
-static uint32_t *
-transpose_clone(uint32_t src, uint32_t *out)
-{
-  int i;
-  if (!out) { out = (uint32_t *)malloc(sizeof(uint32_t)*32); }
-  for (i = 0; i < 32; ++i) {
-    if (src & (1<<i)) {
-      out[i] = 0xffffffff;
-    } else {
-      out[i] = 0;
-    }
+  /** Returns the BCH remainder of the given code word. */
+  inline uint32_t remainder(uint32_t data) const {
+    return byte[0][data & 0xff] ^ byte[1][(data>>8) & 0xff] ^
+        byte[2][(data>>16) & 0xff] ^ byte[3][data>>24];
   }
 
-  return out;
-}
+  /** Remainder of each byte of the code word. */
+  uint16_t byte[4][256];
+  /** Syndrome -> error pattern table. */
+  uint32_t syndrome[1<<(BCH_N-BCH_K)];
+};
+
+static const BCHTables bch_tables;
 
 
-// This might not be elegant, yet effective!
-// Error correction via bruteforce ;)
-//
-// It's a pragmatic solution since this was much faster to implement
-// than understanding the math to solve it while being as effective.
-// Besides that the overhead is neglectable.
 int
 sdr::pocsag_repair(uint32_t &data)
 {
-  // Check if data is correct
-  if (0 == pocsag_syndrome(data)) { return 0; }
-
-  int i, n, b1, b2;
-  uint32_t res;
-  uint32_t *xpose = 0, *in = 0;
-
-  // check for single bit errors
-  xpose = (uint32_t *) malloc(sizeof(uint32_t)*32);
-  in = (uint32_t *) malloc(sizeof(uint32_t)*32);
-
-  transpose_clone(data, xpose);
-  for (i = 0; i < 32; ++i) { xpose[i] ^= (1<<i); }
-  bitslice_syndrome(xpose);
-
-  res = 0;
-  for (i = 0; i < 32; ++i) { res |= xpose[i]; }
-  res = ~res;
-
-  if (res) {
-    int n = 0;
-    while (res) { ++n; res >>= 1; }
-    --n;
-    data ^= (1<<n);
-    goto returnfree;
-  }
+  uint32_t s = bch_tables.remainder(data);
+  unsigned char p = even_parity(data);
 
-  //check for two bit errors
-  n = 0;
-  transpose_clone(data, xpose);
-
-  for (b1 = 0; b1 < 32; ++b1) {
-    for (b2 = b1; b2 < 32; ++b2) {
-      xpose[b1] ^= (1<<n);
-      xpose[b2] ^= (1<<n);
-
-      if (++n == 32) {
-        memcpy(in, xpose, sizeof(uint32_t)*32);
-        bitslice_syndrome(xpose);
-        res = 0;
-        for (i = 0; i < 32; ++i) { res |= xpose[i]; }
-        res = ~res;
-        if (res) {
-          int n = 0;
-          while (res) { ++n; res >>= 1; }
-          --n;
-
-          data = transpose_n(n, in);
-          goto returnfree;
-        }
-
-        transpose_clone(data, xpose);
-        n = 0;
-      }
-    }
+  // Check if data is correct
+  if ((0 == s) && (0 == p)) { return 0; }
+  // Only the parity bit is wrong
+  if (0 == s) { data ^= 1; return 0; }
+
+  // Lookup error pattern of code bits
+  uint32_t error = bch_tables.syndrome[s];
+  if (0 == error) { return 1; }
+  // Single bit error of the code bits: parity must be odd, otherwise the parity bit is wrong too
+  if (0 == (error & (error-1))) {
+    data ^= error;
+    if (! p) { data ^= 1; }
+    return 0;
   }
+  // Double bit error of the code bits: parity must be even, otherwise there are > 2 errors
+  if (p) { return 1; }
+  data ^= error;
+  return 0;
+}
 
-  if (n > 0) {
-    memcpy(in, xpose, sizeof(uint32_t)*32);
-
-    bitslice_syndrome(xpose);
-
-    res = 0;
-    for (i = 0; i < 32; ++i) { res |= xpose[i]; }
-    res = ~res;
-
-    if (res) {
-      int n = 0;
-      while (res) { ++n; res >>= 1; }
-      --n;
 
-      data = transpose_n(n, in);
-      goto returnfree;
-    }
+size_t
+sdr::pocsag_repair(uint32_t *data, size_t n, uint8_t *failed)
+{
+  size_t count = 0;
+  for (size_t i=0; i<n; i++) {
+    int res = pocsag_repair(data[i]);
+    if (failed) { failed[i] = res; }
+    count += res;
   }
-
-  if (xpose) { free(xpose); }
-  if (in) { free(in); }
-  return 1;
-
-returnfree:
-  if (xpose)
-    free(xpose);
-  if (in)
-    free(in);
-  return 0;
+  return count;
 }
-
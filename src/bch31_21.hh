@@ -2,13 +2,23 @@
 #define __SDR_BCH31_21_HH__
 
 #include <inttypes.h>
+#include <cstddef>
 
 namespace sdr {
 
 /** Checks and repairs a POCSAG message with its
- * BCH(31,21) ECC. */
+ * BCH(31,21) ECC. Up to two bit errors (including the parity bit) are corrected by means of a
+ * syndrome table. Returns 0 if the code word is valid or has been repaired and 1 otherwise. */
 int pocsag_repair(uint32_t &data);
 
+/** Checks and repairs a batch of @c n POCSAG code words in-place.
+ * @param data The code words.
+ * @param n The number of code words.
+ * @param failed If not 0, for each code word 0 (valid or repaired) or 1 (not correctable) is
+ *        stored here.
+ * @returns The number of code words that could not be repaired. */
+size_t pocsag_repair(uint32_t *data, size_t n, uint8_t *failed=0);
+
 }
 
 #endif // __SDR_BCH31_21_HH__
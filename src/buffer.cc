@@ -1,28 +1,62 @@
 #include "buffer.hh"
 #include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
 
 using namespace sdr;
 
 
+/* ********************************************************************************************* *
+ * Implementation of BufferMeta
+ * ********************************************************************************************* */
+/** Invalid metadata. */
+static const BufferMeta _buffermeta_invalid;
+/** The metadata of the buffer processed by the calling thread. */
+static __thread const BufferMeta *_buffermeta_current = 0;
+
+BufferMeta::Scope::Scope(const BufferMeta &meta)
+  : _prev(_buffermeta_current)
+{
+  _buffermeta_current = &meta;
+}
+
+BufferMeta::Scope::~Scope() {
+  _buffermeta_current = _prev;
+}
+
+int64_t
+BufferMeta::now() {
+  struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
+  return int64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+const BufferMeta &
+BufferMeta::current() {
+  if (0 == _buffermeta_current) { return _buffermeta_invalid; }
+  return *_buffermeta_current;
+}
+
+
 /* ********************************************************************************************* *
  * Implementation of RawBuffer
  * ********************************************************************************************* */
 RawBuffer::RawBuffer()
-  : _ptr(0), _storage_size(0), _b_offset(0), _b_length(0), _refcount(0), _owner(0)
+  : _ptr(0), _storage_size(0), _b_offset(0), _b_length(0), _refcount(0), _owner(0),
+    _mapped(false), _meta()
 {
   // pass...
 }
 
 RawBuffer::RawBuffer(char *data, size_t offset, size_t len)
   : _ptr(data), _storage_size(offset+len), _b_offset(offset), _b_length(len),
-    _refcount(0), _owner(0)
+    _refcount(0), _owner(0), _mapped(false), _meta()
 {
   // pass...
 }
 
 RawBuffer::RawBuffer(size_t N, BufferOwner *owner)
   : _ptr((char *)malloc(N)), _storage_size(N), _b_offset(0), _b_length(N),
-    _refcount((int *)malloc(sizeof(int))), _owner(owner)
+    _refcount((int *)malloc(sizeof(int))), _owner(owner), _mapped(false), _meta()
 {
   // Check if data could be allocated
   if ((0 == _ptr) && (0 != _refcount)) {
@@ -35,7 +69,7 @@ RawBuffer::RawBuffer(size_t N, BufferOwner *owner)
 RawBuffer::RawBuffer(const RawBuffer &other)
   : _ptr(other._ptr), _storage_size(other._storage_size),
     _b_offset(other._b_offset), _b_length(other._b_length),
-    _refcount(other._refcount), _owner(other._owner)
+    _refcount(other._refcount), _owner(other._owner), _mapped(other._mapped), _meta(other._meta)
 {
   // pass...
 }
@@ -43,11 +77,26 @@ RawBuffer::RawBuffer(const RawBuffer &other)
 RawBuffer::RawBuffer(const RawBuffer &other, size_t offset, size_t len)
   : _ptr(other._ptr), _storage_size(other._storage_size),
     _b_offset(other._b_offset+offset), _b_length(len),
-    _refcount(other._refcount), _owner(other._owner)
+    _refcount(other._refcount), _owner(other._owner), _mapped(other._mapped), _meta(other._meta)
 {
   // pass...
 }
 
+RawBuffer
+RawBuffer::map(int fd, size_t size) {
+  RawBuffer buffer;
+  if (0 == size) { return buffer; }
+  char *data = (char *)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (MAP_FAILED == data) { return buffer; }
+  if (0 == (buffer._refcount = (int *)malloc(sizeof(int)))) {
+    munmap(data, size); return buffer;
+  }
+  (*buffer._refcount) = 1;
+  buffer._ptr = data; buffer._storage_size = buffer._b_length = size;
+  buffer._mapped = true;
+  return buffer;
+}
+
 RawBuffer::~RawBuffer()
 {
   // pass...
@@ -55,7 +104,7 @@ RawBuffer::~RawBuffer()
 
 /** Increment reference counter. */
 void RawBuffer::ref() const {
-  if (0 != _refcount) { (*_refcount)++; }
+  if (0 != _refcount) { __sync_add_and_fetch(_refcount, 1); }
 }
 
 
@@ -63,14 +112,17 @@ void RawBuffer::ref() const {
 void RawBuffer::unref() {
   // If empty -> skip...
   if ((0 == _ptr) || (0 == _refcount)) { return; }
-  // Decrement refcount
-  (*_refcount)--;
+  // Decrement refcount, buffers may be released by several threads (e.g. the queue and a device
+  // thread)
+  int refcount = __sync_sub_and_fetch(_refcount, 1);
   // If there is only one reference left and the buffer is owned -> notify owner, who holds the last
   // reference.
-  if ((1 == (*_refcount)) && (_owner)) { _owner->bufferUnused(*this); }
+  if ((1 == refcount) && (_owner)) { _owner->bufferUnused(*this); }
   // If the buffer is unreachable -> free
-  if (0 == (*_refcount)) {
-    free(_ptr); free(_refcount);
+  if (0 == refcount) {
+    if (_mapped) { munmap(_ptr, _storage_size); }
+    else { free(_ptr); }
+    free(_refcount);
     // mark as empty
     _ptr = 0; _refcount=0;
   }
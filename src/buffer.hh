@@ -7,8 +7,11 @@
 #include <ostream>
 #include <complex>
 #include <inttypes.h>
+#include <pthread.h>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <cmath>
 
 #include "config.hh"
 #include "exception.hh"
@@ -28,6 +31,91 @@ public:
 };
 
 
+/** Optional metadata of a buffer: The absolute index of the first sample, its capture time and
+ * the sample rate of the buffer. The metadata is passed along with the buffer (view) through the
+ * processing network. Sources receiving samples from a device stamp their buffers, nodes changing
+ * the sample rate update the metadata accordingly. All other nodes pass the metadata of their
+ * input on implicitly (see @c Source::send). This allows to timestamp decoded messages exactly
+ * and to measure the latency of the processing network.
+ *
+ * The metadata is valid if the sample rate is set. */
+class BufferMeta
+{
+public:
+  /** Helper to set the metadata of the buffer processed by the calling thread, the previous
+   * metadata is restored once the scope is left. */
+  class Scope
+  {
+  public:
+    /** Sets the given metadata as the current one. */
+    Scope(const BufferMeta &meta);
+    /** Restores the previous metadata. */
+    ~Scope();
+
+  protected:
+    /** The previous metadata. */
+    const BufferMeta *_prev;
+  };
+
+public:
+  /** Empty constructor, constructs an invalid metadata. */
+  BufferMeta() : _index(0), _time(0), _sampleRate(0) { }
+  /** Constructor.
+   * @param index Specifies the absolute index of the first sample.
+   * @param time Specifies the capture time of the first sample in ns since the epoch.
+   * @param sampleRate Specifies the sample rate. */
+  BufferMeta(uint64_t index, int64_t time, double sampleRate)
+    : _index(index), _time(time), _sampleRate(sampleRate) { }
+
+  /** Returns @c true if the metadata is valid. */
+  inline bool isValid() const { return 0 < _sampleRate; }
+  /** Returns the absolute index of the first sample. */
+  inline uint64_t index() const { return _index; }
+  /** Returns the capture time of the first sample in ns since the epoch (0 if unknown). */
+  inline int64_t time() const { return _time; }
+  /** Returns the sample rate. */
+  inline double sampleRate() const { return _sampleRate; }
+
+  /** Returns the metadata of the sample at the given offset. */
+  inline BufferMeta advance(int64_t offset) const {
+    if ((! isValid()) || (0 == offset)) { return *this; }
+    return BufferMeta(_index+offset, _time ? _time+int64_t(1e9*offset/_sampleRate) : 0,
+                      _sampleRate);
+  }
+  /** Returns the metadata of a stream derived with the given rate ratio (output/input rate),
+   * whose first sample corresponds to the input sample at the given offset. Indices within a
+   * rounding error of an integer are not truncated to the one below. */
+  inline BufferMeta resample(double factor, double offset=0) const {
+    if (! isValid()) { return *this; }
+    double index = (_index+offset)*factor, nearest = std::floor(index+0.5);
+    if (std::abs(index-nearest) < 1e-9*std::max(1.0, index)) { index = nearest; }
+    return BufferMeta(uint64_t(index),
+                      _time ? _time+int64_t(1e9*offset/_sampleRate) : 0, _sampleRate*factor);
+  }
+  /** Like @c resample above, but for the rational rate ratio L/M (e.g. 1/n for a decimation by
+   * n), the output index is computed exactly in integer arithmetic. */
+  inline BufferMeta resample(uint64_t L, uint64_t M, uint64_t offset) const {
+    if (! isValid()) { return *this; }
+    uint64_t index = _index+offset;
+    return BufferMeta((index/M)*L + ((index%M)*L)/M,
+                      _time ? _time+int64_t(1e9*offset/_sampleRate) : 0, (_sampleRate*L)/M);
+  }
+
+  /** Returns the current time in ns since the epoch. */
+  static int64_t now();
+  /** Returns the metadata of the buffer processed by the calling thread, if any. */
+  static const BufferMeta &current();
+
+protected:
+  /** The absolute index of the first sample. */
+  uint64_t _index;
+  /** The capture time of the first sample in ns. */
+  int64_t _time;
+  /** The sample rate. */
+  double _sampleRate;
+};
+
+
 /** Base class of all buffers, represents an untyped array of bytes. */
 class RawBuffer
 {
@@ -47,6 +135,12 @@ public:
   /** Creates a new view on the buffer. */
   RawBuffer(const RawBuffer &other, size_t offset, size_t len);
 
+  /** Maps @c size bytes of the given file read-only into memory. The returned buffer is reference
+   * counted like an allocated one, i.e. views into the mapping keep it alive while they are
+   * referenced (e.g. by a queue). The file gets unmapped once the last reference is released.
+   * Returns an empty buffer on error. */
+  static RawBuffer map(int fd, size_t size);
+
   /** Destructor. */
   virtual ~RawBuffer();
 
@@ -59,6 +153,8 @@ public:
     _b_length = other._b_length;
     _refcount = other._refcount;
     _owner = other._owner;
+    _mapped = other._mapped;
+    _meta = other._meta;
     // done.
     return *this;
   }
@@ -76,6 +172,11 @@ public:
   /** Returns true if the buffer is invalid/empty. */
   inline bool isEmpty() const { return 0 == _ptr; }
 
+  /** Returns the metadata of the buffer (view). */
+  inline const BufferMeta &meta() const { return _meta; }
+  /** Sets the metadata of the buffer (view). */
+  inline void setMeta(const BufferMeta &meta) { _meta = meta; }
+
   /** Increment reference counter. */
   void ref() const;
   /** Dereferences the buffer. */
@@ -102,6 +203,10 @@ protected:
   int *_refcount;
   /** Holds a weak reference the buffer owner. */
   BufferOwner *_owner;
+  /** If @c true, the data is a memory mapped file, which gets unmapped instead of freed. */
+  bool _mapped;
+  /** The metadata of the view. */
+  BufferMeta _meta;
 };
 
 
@@ -230,7 +335,9 @@ public:
   /** Returns a new view on this buffer. */
   inline Buffer<T> sub(size_t offset, size_t len) const {
     if ((offset+len) > _size) { return Buffer<T>(); }
-    return Buffer<T>(RawBuffer(*this, offset*sizeof(T), len*sizeof(T)));
+    Buffer<T> view(RawBuffer(*this, offset*sizeof(T), len*sizeof(T)));
+    if (offset) { view._meta = _meta.advance(offset); }
+    return view;
   }
 
   /** Returns a new view on this buffer. */
@@ -250,6 +357,102 @@ protected:
   size_t _size;
 };
 
+/** A buffer of packed bits.
+ * The bits are stored MSB first in 32-bit words, i.e. the first bit is the MSB of the first word.
+ * The words are preceded by a small header holding the number of valid bits. Hence, the buffer
+ * can be passed as a @c RawBuffer through the processing network without loosing its size
+ * (see @c Config::Type_bits). Unused bits of the last word are always 0. */
+class BitBuffer: public RawBuffer
+{
+public:
+  /** Empty constructor. */
+  BitBuffer() : RawBuffer() {
+    // pass...
+  }
+
+  /** Creates a buffer with a capacity of @c N bits. */
+  BitBuffer(size_t N, BufferOwner *owner=0)
+    : RawBuffer(storageBytes(N), owner) {
+    clear();
+  }
+
+  /** Create a new reference to the buffer. */
+  BitBuffer(const BitBuffer &other)
+    : RawBuffer(other) {
+    // pass...
+  }
+
+  /** Explicit type cast. */
+  explicit BitBuffer(const RawBuffer &other)
+    : RawBuffer(other) {
+    // pass...
+  }
+
+  /** Assignment operator, turns this buffer into a reference to the @c other buffer. */
+  const BitBuffer &operator= (const BitBuffer &other) {
+    RawBuffer::operator =(other);
+    return *this;
+  }
+
+  /** Returns the number of bytes needed to store @c N bits (including the header). This allows
+   * to hold packed bits in plain byte buffers (e.g. of a @c BufferSet). */
+  static inline size_t storageBytes(size_t N) { return 8+4*((N+31)/32); }
+
+  /** Returns the number of bits in the buffer. */
+  inline size_t size() const {
+    if (0 == _ptr) { return 0; }
+    return *reinterpret_cast<uint32_t *>(_ptr+_b_offset);
+  }
+  /** Returns the max. number of bits, the buffer can hold. */
+  inline size_t capacity() const {
+    if (0 == _ptr) { return 0; }
+    return 32*((_b_length-8)/4);
+  }
+  /** Returns the number of (partially) used words. */
+  inline size_t numWords() const { return (size()+31)/32; }
+  /** Returns a pointer to the words. */
+  inline uint32_t *words() const { return reinterpret_cast<uint32_t *>(_ptr+_b_offset+8); }
+  /** Returns the i-th word. */
+  inline uint32_t word(size_t i) const { return words()[i]; }
+
+  /** Returns the i-th bit. */
+  inline bool operator[] (size_t i) const {
+    return (words()[i>>5] >> (31-(i&31))) & 0x01;
+  }
+
+  /** Returns @c n (<=64) bits starting at bit @c offset. The first bit is the MSB of the
+   * result. */
+  inline uint64_t bits(size_t offset, size_t n) const {
+    uint64_t value = 0;
+    while (n) {
+      size_t b = (offset & 31), k = std::min(n, 32-b);
+      uint32_t chunk = (words()[offset>>5] << b);
+      value = (value << k) | (chunk >> (32-k));
+      offset += k; n -= k;
+    }
+    return value;
+  }
+
+  /** Clears the buffer. */
+  inline void clear() { *reinterpret_cast<uint32_t *>(_ptr+_b_offset) = 0; }
+
+  /** Appends a bit. */
+  inline void append(bool bit) {
+    uint32_t &n = *reinterpret_cast<uint32_t *>(_ptr+_b_offset);
+#ifdef SDR_DEBUG
+    if (n >= capacity()) {
+      RuntimeError err;
+      err << "Can not append bit: Buffer capacity " << capacity() << " exceeded.";
+      throw err;
+    }
+#endif
+    if (0 == (n & 31)) { words()[n>>5] = 0; }
+    words()[n>>5] |= (uint32_t(bit) << (31-(n&31)));
+    n++;
+  }
+};
+
+
 /** Pretty printing of a buffer. */
 template <class Scalar>
 std::ostream &
@@ -283,7 +486,10 @@ operator<< (std::ostream &stream, const sdr::Buffer<Scalar> &buffer)
  * several buffer in advance. In this case, it is important to track which buffer is still in use
  * efficiently. This class implements this functionality. A @c BufferSet pre-allocates several
  * buffers. Once a buffer is requested from the set, it gets marked as "in-use". Once the buffer
- * gets ununsed, it will be marked as "unused" and will be available again. */
+ * gets ununsed, it will be marked as "unused" and will be available again.
+ *
+ * The list of unused buffers is guarded by a mutex, hence buffers may be obtained in one thread
+ * (e.g. a device thread) while they get released in another (e.g. the queue). */
 template <class Scalar>
 class BufferSet: public BufferOwner
 {
@@ -292,6 +498,7 @@ public:
   BufferSet(size_t N, size_t size)
     : _bufferSize(size)
   {
+    pthread_mutex_init(&_lock, 0);
     _free_buffers.reserve(N);
     for (size_t i=0; i<N; i++) {
       Buffer<Scalar> buffer(size, this);
@@ -309,23 +516,36 @@ public:
     }
     _buffers.clear();
     _free_buffers.clear();
+    pthread_mutex_destroy(&_lock);
   }
 
+  /** Returns the number of buffers in the set. */
+  inline size_t numBuffers() const { return _buffers.size(); }
+
   /** Returns true if there is a free buffer. */
-  inline bool hasBuffer() { return _free_buffers.size(); }
+  inline bool hasBuffer() {
+    pthread_mutex_lock(&_lock);
+    bool has = _free_buffers.size();
+    pthread_mutex_unlock(&_lock);
+    return has;
+  }
 
   /** Obtains a free buffer. */
   inline Buffer<Scalar> getBuffer() {
+    pthread_mutex_lock(&_lock);
     void *id = _free_buffers.back(); _free_buffers.pop_back();
+    pthread_mutex_unlock(&_lock);
     return _buffers[id];
   }
 
   /** Callback gets called once the buffer gets unused. */
   virtual void bufferUnused(const RawBuffer &buffer) {
     // Add buffer to list of free buffers if they are still owned
+    pthread_mutex_lock(&_lock);
     if (0 != _buffers.count(buffer.ptr())) {
       _free_buffers.push_back(buffer.ptr());
     }
+    pthread_mutex_unlock(&_lock);
   }
 
   /** Resize the buffer set. */
@@ -334,10 +554,13 @@ public:
     if (_buffers.size() < numBuffers) {
       // add some buffers
       size_t N = (numBuffers - _buffers.size());
+      pthread_mutex_lock(&_lock);
       for (size_t i=0; i<N; i++) {
         Buffer<Scalar> buffer(_bufferSize, this);
         _buffers[buffer.ptr()] = buffer;
+        _free_buffers.push_back(buffer.ptr());
       }
+      pthread_mutex_unlock(&_lock);
     }
   }
 
@@ -349,6 +572,8 @@ protected:
   std::map<void *, Buffer<Scalar> > _buffers;
   /** A vector of all unused buffers. */
   std::vector<void *> _free_buffers;
+  /** Guards the list of unused buffers. */
+  pthread_mutex_t _lock;
 };
 
 
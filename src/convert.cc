@@ -0,0 +1,688 @@
+#include "convert.hh"
+#include "logger.hh"
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SDR_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace sdr;
+
+
+/* ********************************************************************************************* *
+ * Generic kernels
+ * ********************************************************************************************* */
+/** Holds the lookup tables of the generic 8bit -> 16bit conversions. */
+class ConvertTables
+{
+public:
+  /** Constructor, assembles the tables. */
+  ConvertTables() {
+    for (size_t i=0; i<256; i++) {
+      widen[i]  = int16_t(uint16_t(i)<<8);
+      widenU[i] = int16_t(uint16_t(i^0x80)<<8);
+    }
+  }
+
+public:
+  /** int8 -> int16, indexed by the unsigned representation. */
+  int16_t widen[256];
+  /** uint8 -> int16. */
+  int16_t widenU[256];
+};
+
+/** The global conversion tables. */
+static ConvertTables _convert_tables;
+
+static void
+_generic_flip8(const uint8_t *in, uint8_t *out, size_t N) {
+  for (size_t i=0; i<N; i++) { out[i] = in[i] ^ 0x80; }
+}
+
+static void
+_generic_flip16(const uint16_t *in, uint16_t *out, size_t N) {
+  for (size_t i=0; i<N; i++) { out[i] = in[i] ^ 0x8000; }
+}
+
+static void
+_generic_widen8(const uint8_t *in, int16_t *out, size_t N, uint8_t mask) {
+  if ((0x80 == mask) || (0x00 == mask)) {
+    const int16_t *table = (0x80 == mask) ? _convert_tables.widenU : _convert_tables.widen;
+    for (size_t i=0; i<N; i++) { out[i] = table[in[i]]; }
+  } else {
+    for (size_t i=0; i<N; i++) { out[i] = int16_t(uint16_t(in[i]^mask)<<8); }
+  }
+}
+
+static void
+_generic_int16ToFloat(const int16_t *in, float *out, size_t N, float scale, float offset) {
+  for (size_t i=0; i<N; i++) { out[i] = scale*in[i] + offset; }
+}
+
+static void
+_generic_floatToInt16(const float *in, int16_t *out, size_t N, float scale, float offset) {
+  for (size_t i=0; i<N; i++) {
+    out[i] = int16_t(std::min(32767.f, std::max(-32768.f, scale*in[i] + offset)));
+  }
+}
+
+static void
+_generic_lookup8(const uint8_t *in, float *out, size_t N, const float *table) {
+  for (size_t i=0; i<N; i++) { out[i] = table[in[i]]; }
+}
+
+static float
+_generic_dot(const float *a, const float *b, size_t N) {
+  float res = 0;
+  for (size_t i=0; i<N; i++) { res += a[i]*b[i]; }
+  return res;
+}
+
+static void
+_generic_cdot(const float *a, const float *b, size_t N, float *re, float *im) {
+  float r = 0, j = 0;
+  for (size_t i=0; i<N; i++) { r += a[i]*b[2*i]; j += a[i]*b[2*i+1]; }
+  *re = r; *im = j;
+}
+
+static float
+_generic_absSum(const float *in, size_t N) {
+  float res = 0;
+  for (size_t i=0; i<N; i++) { res += std::abs(in[i]); }
+  return res;
+}
+
+static float
+_generic_cabsSum(const float *in, size_t N) {
+  float res = 0;
+  for (size_t i=0; i<N; i++) { res += std::sqrt(in[2*i]*in[2*i] + in[2*i+1]*in[2*i+1]); }
+  return res;
+}
+
+static void
+_generic_ramp(const float *in, float *out, size_t N, float gain, float dgain) {
+  for (size_t i=0; i<N; i++) { out[i] = (gain+(i+1)*dgain)*in[i]; }
+}
+
+static void
+_generic_cramp(const float *in, float *out, size_t N, float gain, float dgain) {
+  for (size_t i=0; i<N; i++) {
+    float g = gain+(i+1)*dgain; out[2*i] = g*in[2*i]; out[2*i+1] = g*in[2*i+1];
+  }
+}
+
+/** The generic kernels. */
+static const Convert::Kernels _generic_kernels = {
+  _generic_flip8, _generic_flip16, _generic_widen8, _generic_int16ToFloat,
+  _generic_floatToInt16, _generic_lookup8, _generic_dot, _generic_cdot,
+  _generic_absSum, _generic_cabsSum, _generic_ramp, _generic_cramp };
+
+
+#ifdef SDR_CONVERT_X86
+/* ********************************************************************************************* *
+ * SSE2 kernels
+ * ********************************************************************************************* */
+__attribute__((target("sse2"))) static void
+_sse2_flip8(const uint8_t *in, uint8_t *out, size_t N) {
+  const __m128i mask = _mm_set1_epi8(char(0x80));
+  size_t i=0;
+  for (; (i+16)<=N; i+=16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in+i));
+    _mm_storeu_si128((__m128i *)(out+i), _mm_xor_si128(x, mask));
+  }
+  _generic_flip8(in+i, out+i, N-i);
+}
+
+__attribute__((target("sse2"))) static void
+_sse2_flip16(const uint16_t *in, uint16_t *out, size_t N) {
+  const __m128i mask = _mm_set1_epi16(short(0x8000));
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in+i));
+    _mm_storeu_si128((__m128i *)(out+i), _mm_xor_si128(x, mask));
+  }
+  _generic_flip16(in+i, out+i, N-i);
+}
+
+__attribute__((target("sse2"))) static void
+_sse2_widen8(const uint8_t *in, int16_t *out, size_t N, uint8_t mask) {
+  const __m128i m = _mm_set1_epi8(char(mask)), zero = _mm_setzero_si128();
+  size_t i=0;
+  for (; (i+16)<=N; i+=16) {
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in+i)), m);
+    // Interleaving zeros as lower bytes gives x<<8
+    _mm_storeu_si128((__m128i *)(out+i), _mm_unpacklo_epi8(zero, x));
+    _mm_storeu_si128((__m128i *)(out+i+8), _mm_unpackhi_epi8(zero, x));
+  }
+  _generic_widen8(in+i, out+i, N-i, mask);
+}
+
+__attribute__((target("sse2"))) static void
+_sse2_int16ToFloat(const int16_t *in, float *out, size_t N, float scale, float offset) {
+  const __m128 a = _mm_set1_ps(scale), b = _mm_set1_ps(offset);
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in+i));
+    // Sign extend to 32bit
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(out+i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), a), b));
+    _mm_storeu_ps(out+i+4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), a), b));
+  }
+  _generic_int16ToFloat(in+i, out+i, N-i, scale, offset);
+}
+
+__attribute__((target("sse2"))) static void
+_sse2_floatToInt16(const float *in, int16_t *out, size_t N, float scale, float offset) {
+  const __m128 a = _mm_set1_ps(scale), b = _mm_set1_ps(offset);
+  const __m128 lo = _mm_set1_ps(-32768.f), hi = _mm_set1_ps(32767.f);
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    __m128 x0 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in+i), a), b);
+    __m128 x1 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in+i+4), a), b);
+    x0 = _mm_min_ps(hi, _mm_max_ps(lo, x0));
+    x1 = _mm_min_ps(hi, _mm_max_ps(lo, x1));
+    __m128i y = _mm_packs_epi32(_mm_cvttps_epi32(x0), _mm_cvttps_epi32(x1));
+    _mm_storeu_si128((__m128i *)(out+i), y);
+  }
+  _generic_floatToInt16(in+i, out+i, N-i, scale, offset);
+}
+
+__attribute__((target("sse2"))) static float
+_sse2_dot(const float *a, const float *b, size_t N) {
+  __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a+i+4), _mm_loadu_ps(b+i+4)));
+  }
+  float tmp[4]; _mm_storeu_ps(tmp, _mm_add_ps(acc0, acc1));
+  return (tmp[0]+tmp[1]) + (tmp[2]+tmp[3]) + _generic_dot(a+i, b+i, N-i);
+}
+
+__attribute__((target("sse2"))) static void
+_sse2_cdot(const float *a, const float *b, size_t N, float *re, float *im) {
+  __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+  size_t i=0;
+  for (; (i+4)<=N; i+=4) {
+    // Duplicate real taps for the real and imaginary parts
+    __m128 t = _mm_loadu_ps(a+i);
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_unpacklo_ps(t, t), _mm_loadu_ps(b+2*i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_unpackhi_ps(t, t), _mm_loadu_ps(b+2*i+4)));
+  }
+  float tmp[4]; _mm_storeu_ps(tmp, _mm_add_ps(acc0, acc1));
+  _generic_cdot(a+i, b+2*i, N-i, re, im);
+  *re += tmp[0]+tmp[2]; *im += tmp[1]+tmp[3];
+}
+
+__attribute__((target("sse2"))) static float
+_sse2_absSum(const float *in, size_t N) {
+  const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    acc0 = _mm_add_ps(acc0, _mm_and_ps(_mm_loadu_ps(in+i), mask));
+    acc1 = _mm_add_ps(acc1, _mm_and_ps(_mm_loadu_ps(in+i+4), mask));
+  }
+  float tmp[4]; _mm_storeu_ps(tmp, _mm_add_ps(acc0, acc1));
+  return (tmp[0]+tmp[1]) + (tmp[2]+tmp[3]) + _generic_absSum(in+i, N-i);
+}
+
+__attribute__((target("sse2"))) static float
+_sse2_cabsSum(const float *in, size_t N) {
+  __m128 acc = _mm_setzero_ps();
+  size_t i=0;
+  for (; (i+4)<=N; i+=4) {
+    // Deinterleave real and imaginary parts
+    __m128 x0 = _mm_loadu_ps(in+2*i), x1 = _mm_loadu_ps(in+2*i+4);
+    __m128 re = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2,0,2,0));
+    __m128 im = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3,1,3,1));
+    acc = _mm_add_ps(acc, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))));
+  }
+  float tmp[4]; _mm_storeu_ps(tmp, acc);
+  return (tmp[0]+tmp[1]) + (tmp[2]+tmp[3]) + _generic_cabsSum(in+2*i, N-i);
+}
+
+__attribute__((target("sse2"))) static void
+_sse2_ramp(const float *in, float *out, size_t N, float gain, float dgain) {
+  const __m128 g = _mm_set1_ps(gain), dg = _mm_set1_ps(dgain), step = _mm_set1_ps(4);
+  __m128 k = _mm_setr_ps(1, 2, 3, 4);
+  size_t i=0;
+  for (; (i+4)<=N; i+=4) {
+    __m128 gi = _mm_add_ps(g, _mm_mul_ps(k, dg));
+    _mm_storeu_ps(out+i, _mm_mul_ps(gi, _mm_loadu_ps(in+i)));
+    k = _mm_add_ps(k, step);
+  }
+  _generic_ramp(in+i, out+i, N-i, gain+i*dgain, dgain);
+}
+
+__attribute__((target("sse2"))) static void
+_sse2_cramp(const float *in, float *out, size_t N, float gain, float dgain) {
+  const __m128 g = _mm_set1_ps(gain), dg = _mm_set1_ps(dgain), step = _mm_set1_ps(2);
+  // Same gain for the real and imaginary part
+  __m128 k = _mm_setr_ps(1, 1, 2, 2);
+  size_t i=0;
+  for (; (i+2)<=N; i+=2) {
+    __m128 gi = _mm_add_ps(g, _mm_mul_ps(k, dg));
+    _mm_storeu_ps(out+2*i, _mm_mul_ps(gi, _mm_loadu_ps(in+2*i)));
+    k = _mm_add_ps(k, step);
+  }
+  _generic_cramp(in+2*i, out+2*i, N-i, gain+i*dgain, dgain);
+}
+
+/** The SSE2 kernels, SSE2 provides no gather, hence the lookup is generic. */
+static const Convert::Kernels _sse2_kernels = {
+  _sse2_flip8, _sse2_flip16, _sse2_widen8, _sse2_int16ToFloat,
+  _sse2_floatToInt16, _generic_lookup8, _sse2_dot, _sse2_cdot,
+  _sse2_absSum, _sse2_cabsSum, _sse2_ramp, _sse2_cramp };
+
+
+/* ********************************************************************************************* *
+ * AVX2 kernels
+ *
+ * The generic tails are SSE code, hence the upper halves of the AVX registers get cleared before
+ * calling them to avoid the costly AVX/SSE transition penalties.
+ * ********************************************************************************************* */
+__attribute__((target("avx2"))) static void
+_avx2_flip8(const uint8_t *in, uint8_t *out, size_t N) {
+  const __m256i mask = _mm256_set1_epi8(char(0x80));
+  size_t i=0;
+  for (; (i+32)<=N; i+=32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(in+i));
+    _mm256_storeu_si256((__m256i *)(out+i), _mm256_xor_si256(x, mask));
+  }
+  _mm256_zeroupper();
+  _generic_flip8(in+i, out+i, N-i);
+}
+
+__attribute__((target("avx2"))) static void
+_avx2_flip16(const uint16_t *in, uint16_t *out, size_t N) {
+  const __m256i mask = _mm256_set1_epi16(short(0x8000));
+  size_t i=0;
+  for (; (i+16)<=N; i+=16) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(in+i));
+    _mm256_storeu_si256((__m256i *)(out+i), _mm256_xor_si256(x, mask));
+  }
+  _mm256_zeroupper();
+  _generic_flip16(in+i, out+i, N-i);
+}
+
+__attribute__((target("avx2"))) static void
+_avx2_widen8(const uint8_t *in, int16_t *out, size_t N, uint8_t mask) {
+  const __m128i m = _mm_set1_epi8(char(mask));
+  size_t i=0;
+  for (; (i+16)<=N; i+=16) {
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in+i)), m);
+    __m256i y = _mm256_slli_epi16(_mm256_cvtepu8_epi16(x), 8);
+    _mm256_storeu_si256((__m256i *)(out+i), y);
+  }
+  _mm256_zeroupper();
+  _generic_widen8(in+i, out+i, N-i, mask);
+}
+
+__attribute__((target("avx2"))) static void
+_avx2_int16ToFloat(const int16_t *in, float *out, size_t N, float scale, float offset) {
+  const __m256 a = _mm256_set1_ps(scale), b = _mm256_set1_ps(offset);
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in+i)));
+    _mm256_storeu_ps(out+i, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(x), a), b));
+  }
+  _mm256_zeroupper();
+  _generic_int16ToFloat(in+i, out+i, N-i, scale, offset);
+}
+
+__attribute__((target("avx2"))) static void
+_avx2_floatToInt16(const float *in, int16_t *out, size_t N, float scale, float offset) {
+  const __m256 a = _mm256_set1_ps(scale), b = _mm256_set1_ps(offset);
+  const __m256 lo = _mm256_set1_ps(-32768.f), hi = _mm256_set1_ps(32767.f);
+  size_t i=0;
+  for (; (i+16)<=N; i+=16) {
+    __m256 x0 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in+i), a), b);
+    __m256 x1 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in+i+8), a), b);
+    x0 = _mm256_min_ps(hi, _mm256_max_ps(lo, x0));
+    x1 = _mm256_min_ps(hi, _mm256_max_ps(lo, x1));
+    // Pack works per 128bit lane, restore order of 64bit blocks
+    __m256i y = _mm256_packs_epi32(_mm256_cvttps_epi32(x0), _mm256_cvttps_epi32(x1));
+    _mm256_storeu_si256((__m256i *)(out+i), _mm256_permute4x64_epi64(y, 0xd8));
+  }
+  _mm256_zeroupper();
+  _generic_floatToInt16(in+i, out+i, N-i, scale, offset);
+}
+
+__attribute__((target("avx2"))) static void
+_avx2_lookup8(const uint8_t *in, float *out, size_t N, const float *table) {
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in+i)));
+    _mm256_storeu_ps(out+i, _mm256_i32gather_ps(table, idx, 4));
+  }
+  _mm256_zeroupper();
+  _generic_lookup8(in+i, out+i, N-i, table);
+}
+
+__attribute__((target("avx2"))) static float
+_avx2_dot(const float *a, const float *b, size_t N) {
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+  size_t i=0;
+  for (; (i+16)<=N; i+=16) {
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i)));
+    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8)));
+  }
+  acc0 = _mm256_add_ps(acc0, acc1);
+  __m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+  float tmp[4]; _mm_storeu_ps(tmp, acc);
+  _mm256_zeroupper();
+  return (tmp[0]+tmp[1]) + (tmp[2]+tmp[3]) + _generic_dot(a+i, b+i, N-i);
+}
+
+__attribute__((target("avx2"))) static void
+_avx2_cdot(const float *a, const float *b, size_t N, float *re, float *im) {
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    // Duplicate real taps for the real and imaginary parts
+    __m256 t = _mm256_loadu_ps(a+i);
+    __m256 lo = _mm256_unpacklo_ps(t, t), hi = _mm256_unpackhi_ps(t, t);
+    // unpack works per 128bit lane, restore order of taps
+    __m256 t0 = _mm256_permute2f128_ps(lo, hi, 0x20), t1 = _mm256_permute2f128_ps(lo, hi, 0x31);
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(t0, _mm256_loadu_ps(b+2*i)));
+    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(t1, _mm256_loadu_ps(b+2*i+8)));
+  }
+  acc0 = _mm256_add_ps(acc0, acc1);
+  __m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+  float tmp[4]; _mm_storeu_ps(tmp, acc);
+  _mm256_zeroupper();
+  _generic_cdot(a+i, b+2*i, N-i, re, im);
+  *re += tmp[0]+tmp[2]; *im += tmp[1]+tmp[3];
+}
+
+__attribute__((target("avx2"))) static float
+_avx2_absSum(const float *in, size_t N) {
+  const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+  size_t i=0;
+  for (; (i+16)<=N; i+=16) {
+    acc0 = _mm256_add_ps(acc0, _mm256_and_ps(_mm256_loadu_ps(in+i), mask));
+    acc1 = _mm256_add_ps(acc1, _mm256_and_ps(_mm256_loadu_ps(in+i+8), mask));
+  }
+  acc0 = _mm256_add_ps(acc0, acc1);
+  __m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+  float tmp[4]; _mm_storeu_ps(tmp, acc);
+  _mm256_zeroupper();
+  return (tmp[0]+tmp[1]) + (tmp[2]+tmp[3]) + _generic_absSum(in+i, N-i);
+}
+
+__attribute__((target("avx2"))) static float
+_avx2_cabsSum(const float *in, size_t N) {
+  __m256 acc0 = _mm256_setzero_ps();
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    // Deinterleave real and imaginary parts, shuffle works per 128bit lane but the order of the
+    // magnitudes does not matter for the sum
+    __m256 x0 = _mm256_loadu_ps(in+2*i), x1 = _mm256_loadu_ps(in+2*i+8);
+    __m256 re = _mm256_shuffle_ps(x0, x1, _MM_SHUFFLE(2,0,2,0));
+    __m256 im = _mm256_shuffle_ps(x0, x1, _MM_SHUFFLE(3,1,3,1));
+    __m256 p = _mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im));
+    acc0 = _mm256_add_ps(acc0, _mm256_sqrt_ps(p));
+  }
+  __m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+  float tmp[4]; _mm_storeu_ps(tmp, acc);
+  _mm256_zeroupper();
+  return (tmp[0]+tmp[1]) + (tmp[2]+tmp[3]) + _generic_cabsSum(in+2*i, N-i);
+}
+
+__attribute__((target("avx2"))) static void
+_avx2_ramp(const float *in, float *out, size_t N, float gain, float dgain) {
+  const __m256 g = _mm256_set1_ps(gain), dg = _mm256_set1_ps(dgain), step = _mm256_set1_ps(8);
+  __m256 k = _mm256_setr_ps(1, 2, 3, 4, 5, 6, 7, 8);
+  size_t i=0;
+  for (; (i+8)<=N; i+=8) {
+    __m256 gi = _mm256_add_ps(g, _mm256_mul_ps(k, dg));
+    _mm256_storeu_ps(out+i, _mm256_mul_ps(gi, _mm256_loadu_ps(in+i)));
+    k = _mm256_add_ps(k, step);
+  }
+  _mm256_zeroupper();
+  _generic_ramp(in+i, out+i, N-i, gain+i*dgain, dgain);
+}
+
+__attribute__((target("avx2"))) static void
+_avx2_cramp(const float *in, float *out, size_t N, float gain, float dgain) {
+  const __m256 g = _mm256_set1_ps(gain), dg = _mm256_set1_ps(dgain), step = _mm256_set1_ps(4);
+  // Same gain for the real and imaginary part
+  __m256 k = _mm256_setr_ps(1, 1, 2, 2, 3, 3, 4, 4);
+  size_t i=0;
+  for (; (i+4)<=N; i+=4) {
+    __m256 gi = _mm256_add_ps(g, _mm256_mul_ps(k, dg));
+    _mm256_storeu_ps(out+2*i, _mm256_mul_ps(gi, _mm256_loadu_ps(in+2*i)));
+    k = _mm256_add_ps(k, step);
+  }
+  _mm256_zeroupper();
+  _generic_cramp(in+2*i, out+2*i, N-i, gain+i*dgain, dgain);
+}
+
+/** The AVX2 kernels. */
+static const Convert::Kernels _avx2_kernels = {
+  _avx2_flip8, _avx2_flip16, _avx2_widen8, _avx2_int16ToFloat,
+  _avx2_floatToInt16, _avx2_lookup8, _avx2_dot, _avx2_cdot,
+  _avx2_absSum, _avx2_cabsSum, _avx2_ramp, _avx2_cramp };
+#endif
+
+
+/* ********************************************************************************************* *
+ * Implementation of Convert
+ * ********************************************************************************************* */
+Convert::Kernels Convert::_kernels = _generic_kernels;
+Convert::Implementation Convert::_implementation = Convert::GENERIC;
+
+/** Number of samples per calibration run. */
+#define CONVERT_CALIB_SIZE 4096
+/** Number of timed calibration runs per kernel, the fastest one counts. */
+#define CONVERT_CALIB_TRIALS 16
+/** A SIMD kernel is only selected if it takes less than this fraction of the time of the
+ * generic (or a narrower SIMD) kernel. */
+#define CONVERT_CALIB_GAIN 0.9
+
+/** The kernels selected by the calibration (@c Convert::AUTO). */
+static Convert::Kernels _auto_kernels = _generic_kernels;
+
+/** Assembles the @c AUTO kernels at startup by timing every kernel of every supported
+ * implementation against the generic one. */
+class ConvertSelector
+{
+public:
+  /** Constructor. */
+  ConvertSelector() {
+    _u8 = new uint8_t[CONVERT_CALIB_SIZE]; _o8 = new uint8_t[CONVERT_CALIB_SIZE];
+    _u16 = new uint16_t[CONVERT_CALIB_SIZE]; _s16 = new int16_t[CONVERT_CALIB_SIZE];
+    _a = new float[CONVERT_CALIB_SIZE]; _b = new float[2*CONVERT_CALIB_SIZE];
+    for (size_t i=0; i<CONVERT_CALIB_SIZE; i++) {
+      _u8[i] = 7*i; _u16[i] = 2053*i; _a[i] = float(int(i%512)-256); _b[2*i] = _b[2*i+1] = 0.5;
+    }
+    Convert::uint8Table(_table, 1./128, -1);
+
+    // Candidates, the generic implementation first
+    Convert::Implementation impls[] = { Convert::GENERIC, Convert::SSE2, Convert::AVX2 };
+    const Convert::Kernels *kernels[3]; size_t N = 0;
+    for (size_t j=0; j<3; j++) {
+      const Convert::Kernels *table = _table_of(impls[j]);
+      if (table && Convert::isSupported(impls[j])) { impls[N] = impls[j]; kernels[N++] = table; }
+    }
+    for (int k=0; k<NUM_KERNELS; k++) {
+      // Interleave the runs of the candidates, hence a changing clock frequency affects all alike
+      double dt[3] = { 1e9, 1e9, 1e9 };
+      for (size_t j=0; j<N; j++) { _run(*kernels[j], k); }
+      for (size_t i=0; i<CONVERT_CALIB_TRIALS; i++) {
+        for (size_t j=0; j<N; j++) { dt[j] = std::min(dt[j], _time(*kernels[j], k)); }
+      }
+      size_t selected = 0;
+      for (size_t j=1; j<N; j++) {
+        if (dt[j] < CONVERT_CALIB_GAIN*dt[selected]) { selected = j; }
+      }
+      _assign(_auto_kernels, *kernels[selected], k);
+      LogMessage msg(LOG_DEBUG);
+      msg << "Convert: Use " << Convert::name(impls[selected]) << " " << _kernel_name(k)
+          << " kernel.";
+      Logger::get().log(msg);
+    }
+    Convert::setImplementation(Convert::AUTO);
+
+    delete[] _u8; delete[] _o8; delete[] _u16; delete[] _s16; delete[] _a; delete[] _b;
+  }
+
+protected:
+  /** The kernels in the order of @c Convert::Kernels. */
+  typedef enum {
+    FLIP8 = 0, FLIP16, WIDEN8, INT16_TO_FLOAT, FLOAT_TO_INT16, LOOKUP8, DOT, CDOT,
+    ABS_SUM, CABS_SUM, RAMP, CRAMP, NUM_KERNELS
+  } Kernel;
+
+  /** Returns the kernel table of the given implementation or 0 if it was not compiled in. */
+  static const Convert::Kernels *_table_of(Convert::Implementation impl) {
+    switch (impl) {
+    case Convert::GENERIC: return &_generic_kernels;
+#ifdef SDR_CONVERT_X86
+    case Convert::SSE2: return &_sse2_kernels;
+    case Convert::AVX2: return &_avx2_kernels;
+#endif
+    default: break;
+    }
+    return 0;
+  }
+
+  /** Returns the name of the given kernel. */
+  static const char *_kernel_name(int k) {
+    static const char *names[] = { "flip8", "flip16", "widen8", "int16ToFloat", "floatToInt16",
+                                   "lookup8", "dot", "cdot", "absSum", "cabsSum", "ramp",
+                                   "cramp" };
+    return names[k];
+  }
+
+  /** Copies the kernel @c k from @c src to @c dst. */
+  static void _assign(Convert::Kernels &dst, const Convert::Kernels &src, int k) {
+    switch (k) {
+    case FLIP8: dst.flip8 = src.flip8; break;
+    case FLIP16: dst.flip16 = src.flip16; break;
+    case WIDEN8: dst.widen8 = src.widen8; break;
+    case INT16_TO_FLOAT: dst.int16ToFloat = src.int16ToFloat; break;
+    case FLOAT_TO_INT16: dst.floatToInt16 = src.floatToInt16; break;
+    case LOOKUP8: dst.lookup8 = src.lookup8; break;
+    case DOT: dst.dot = src.dot; break;
+    case CDOT: dst.cdot = src.cdot; break;
+    case ABS_SUM: dst.absSum = src.absSum; break;
+    case CABS_SUM: dst.cabsSum = src.cabsSum; break;
+    case RAMP: dst.ramp = src.ramp; break;
+    case CRAMP: dst.cramp = src.cramp; break;
+    }
+  }
+
+  /** Runs the kernel @c k of the given table once on the calibration buffers. */
+  void _run(const Convert::Kernels &kernels, int k) {
+    const size_t N = CONVERT_CALIB_SIZE;
+    float re, im;
+    switch (k) {
+    case FLIP8: kernels.flip8(_u8, _o8, N); break;
+    case FLIP16: kernels.flip16(_u16, (uint16_t *)_s16, N); break;
+    case WIDEN8: kernels.widen8(_u8, _s16, N, 0x80); break;
+    case INT16_TO_FLOAT: kernels.int16ToFloat(_s16, _b, N, 0.5, 1); break;
+    case FLOAT_TO_INT16: kernels.floatToInt16(_a, _s16, N, 0.5, 0); break;
+    case LOOKUP8: kernels.lookup8(_u8, _b, N, _table); break;
+    case DOT: _sink = kernels.dot(_a, _a, N); break;
+    case CDOT: kernels.cdot(_a, _b, N, &re, &im); _sink = re+im; break;
+    case ABS_SUM: _sink = kernels.absSum(_a, N); break;
+    case CABS_SUM: _sink = kernels.cabsSum(_b, N); break;
+    case RAMP: kernels.ramp(_a, _b, N, 0.5, 1e-3); break;
+    case CRAMP: kernels.cramp(_b, _b, N, 1, 0); break;
+    }
+  }
+
+  /** Returns the time in seconds of a few runs of the kernel @c k. */
+  double _time(const Convert::Kernels &kernels, int k) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t i=0; i<4; i++) { _run(kernels, k); }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec-t0.tv_sec) + 1e-9*(t1.tv_nsec-t0.tv_nsec);
+  }
+
+protected:
+  /** Calibration buffers. */
+  uint8_t *_u8, *_o8;
+  /** Calibration buffers. */
+  uint16_t *_u16;
+  /** Calibration buffer. */
+  int16_t *_s16;
+  /** Calibration buffers. */
+  float *_a, *_b;
+  /** Lookup table of the @c lookup8 kernels. */
+  float _table[256];
+  /** Keeps the inner products from being optimized away. */
+  volatile float _sink;
+};
+
+/** The global implementation selector. */
+static ConvertSelector _convert_selector;
+
+
+Convert::Implementation
+Convert::implementation() {
+  return _implementation;
+}
+
+bool
+Convert::isSupported(Implementation impl) {
+  switch (impl) {
+  case GENERIC:
+  case AUTO: return true;
+#ifdef SDR_CONVERT_X86
+  case SSE2: return __builtin_cpu_supports("sse2");
+  case AVX2: return __builtin_cpu_supports("avx2");
+#endif
+  default: break;
+  }
+  return false;
+}
+
+bool
+Convert::setImplementation(Implementation impl) {
+  if (! isSupported(impl)) { return false; }
+  switch (impl) {
+  case GENERIC: _kernels = _generic_kernels; break;
+#ifdef SDR_CONVERT_X86
+  case SSE2: _kernels = _sse2_kernels; break;
+  case AVX2: _kernels = _avx2_kernels; break;
+#endif
+  case AUTO: _kernels = _auto_kernels; break;
+  default: return false;
+  }
+  _implementation = impl;
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Convert: Use " << name(impl) << " conversion kernels.";
+  Logger::get().log(msg);
+  return true;
+}
+
+const char *
+Convert::name(Implementation impl) {
+  switch (impl) {
+  case GENERIC: return "generic";
+  case SSE2: return "SSE2";
+  case AVX2: return "AVX2";
+  case AUTO: return "auto";
+  }
+  return "unknown";
+}
+
+void
+Convert::uint8Table(float *table, float scale, float offset) {
+  for (size_t i=0; i<256; i++) { table[i] = scale*i + offset; }
+}
+
+void
+Convert::int8Table(float *table, float scale, float offset) {
+  for (size_t i=0; i<256; i++) { table[i] = scale*int8_t(i) + offset; }
+}
@@ -0,0 +1,218 @@
+#ifndef __SDR_CONVERT_HH__
+#define __SDR_CONVERT_HH__
+
+#include "buffer.hh"
+#include <complex>
+#include <inttypes.h>
+
+
+namespace sdr {
+
+/** Collection of sample conversion kernels used by the cast nodes (e.g. @c AutoCast,
+ * @c UnsignedToSigned or @c Cast) and of the inner products used by the polyphase filters of the
+ * @c Resampler and of the envelope & gain kernels of the @c AGC. These kernels touch every raw
+ * sample at the full input rate, hence there are several implementations of each kernel. At
+ * startup, every kernel of the implementations supported by the CPU is timed on a small block
+ * and the SIMD version is only selected if it is clearly faster than the generic one (the
+ * compiler may auto-vectorize the generic loops at -O3). The resulting mix is the @c AUTO
+ * implementation, it may be overridden with @c setImplementation (e.g. for benchmarks).
+ *
+ * All kernels process the input front to back and may be performed in-place as long as the
+ * output scalar is not larger than the input scalar. Conversions from 8bit integers are
+ * performed with 256-entry lookup tables by the generic implementation.
+ * @ingroup datanodes */
+class Convert
+{
+public:
+  /** The possible kernel implementations. */
+  typedef enum {
+    GENERIC = 0, ///< Portable scalar loops & lookup tables.
+    SSE2,        ///< x86 SSE2 kernels.
+    AVX2,        ///< x86 AVX2 kernels.
+    AUTO         ///< The fastest kernel of each kind, as calibrated at startup.
+  } Implementation;
+
+  /** Table of kernels of an implementation. */
+  typedef struct {
+    /** Flips the sign bit of 8bit integers (offset binary <-> two's complement). */
+    void (*flip8)(const uint8_t *in, uint8_t *out, size_t N);
+    /** Flips the sign bit of 16bit integers (offset binary <-> two's complement). */
+    void (*flip16)(const uint16_t *in, uint16_t *out, size_t N);
+    /** Widens 8bit integers to 16bit by shifting them into the upper byte. The input is XORed
+     * with @c mask first. */
+    void (*widen8)(const uint8_t *in, int16_t *out, size_t N, uint8_t mask);
+    /** Converts 16bit integers to float as @c scale*x+offset. */
+    void (*int16ToFloat)(const int16_t *in, float *out, size_t N, float scale, float offset);
+    /** Converts floats to saturated 16bit integers as @c scale*x+offset. */
+    void (*floatToInt16)(const float *in, int16_t *out, size_t N, float scale, float offset);
+    /** Maps 8bit integers to floats using a 256-entry lookup table. */
+    void (*lookup8)(const uint8_t *in, float *out, size_t N, const float *table);
+    /** Inner product of two real vectors. */
+    float (*dot)(const float *a, const float *b, size_t N);
+    /** Inner product of a real vector and an interleaved complex vector. */
+    void (*cdot)(const float *a, const float *b, size_t N, float *re, float *im);
+    /** Sum of the absolute values of a real vector. */
+    float (*absSum)(const float *in, size_t N);
+    /** Sum of the magnitudes of an interleaved complex vector. */
+    float (*cabsSum)(const float *in, size_t N);
+    /** Scales a real vector by a linear gain ramp @c gain+(i+1)*dgain. */
+    void (*ramp)(const float *in, float *out, size_t N, float gain, float dgain);
+    /** Scales an interleaved complex vector by a linear gain ramp @c gain+(i+1)*dgain. */
+    void (*cramp)(const float *in, float *out, size_t N, float gain, float dgain);
+  } Kernels;
+
+public:
+  /** Returns the currently selected implementation, @c AUTO unless overridden. */
+  static Implementation implementation();
+  /** Returns @c true if the given implementation is supported by the CPU. */
+  static bool isSupported(Implementation impl);
+  /** Selects the given implementation, returns @c false if it is not supported. @c AUTO
+   * restores the calibrated selection. */
+  static bool setImplementation(Implementation impl);
+  /** Returns the name of the given implementation. */
+  static const char *name(Implementation impl);
+
+  /** uint8 -> int8 (x-128). */
+  static inline void uint8ToInt8(const uint8_t *in, int8_t *out, size_t N) {
+    _kernels.flip8(in, (uint8_t *)out, N);
+  }
+  /** int8 -> uint8 (x+128). */
+  static inline void int8ToUint8(const int8_t *in, uint8_t *out, size_t N) {
+    _kernels.flip8((const uint8_t *)in, out, N);
+  }
+  /** uint16 -> int16 (x-32768). */
+  static inline void uint16ToInt16(const uint16_t *in, int16_t *out, size_t N) {
+    _kernels.flip16(in, (uint16_t *)out, N);
+  }
+  /** int16 -> uint16 (x+32768). */
+  static inline void int16ToUint16(const int16_t *in, uint16_t *out, size_t N) {
+    _kernels.flip16((const uint16_t *)in, out, N);
+  }
+  /** uint8 -> int16 ((x-128)<<8). */
+  static inline void uint8ToInt16(const uint8_t *in, int16_t *out, size_t N) {
+    _kernels.widen8(in, out, N, 0x80);
+  }
+  /** int8 -> int16 (x<<8). */
+  static inline void int8ToInt16(const int8_t *in, int16_t *out, size_t N) {
+    _kernels.widen8((const uint8_t *)in, out, N, 0x00);
+  }
+  /** int16 -> float (scale*x+offset). */
+  static inline void int16ToFloat(const int16_t *in, float *out, size_t N,
+                                  float scale=1, float offset=0) {
+    _kernels.int16ToFloat(in, out, N, scale, offset);
+  }
+  /** float -> int16 (scale*x+offset), saturated and truncated towards zero. */
+  static inline void floatToInt16(const float *in, int16_t *out, size_t N,
+                                  float scale=1, float offset=0) {
+    _kernels.floatToInt16(in, out, N, scale, offset);
+  }
+  /** uint8 -> float using the given 256-entry lookup table (see @c uint8Table). */
+  static inline void lookup(const uint8_t *in, float *out, size_t N, const float *table) {
+    _kernels.lookup8(in, out, N, table);
+  }
+  /** int8 -> float using the given 256-entry lookup table (see @c int8Table). */
+  static inline void lookup(const int8_t *in, float *out, size_t N, const float *table) {
+    _kernels.lookup8((const uint8_t *)in, out, N, table);
+  }
+
+  /** Returns the inner product of the real vectors @c a and @c b of length @c N. */
+  static inline float dot(const float *a, const float *b, size_t N) {
+    return _kernels.dot(a, b, N);
+  }
+  /** Returns the inner product of the real vector @c a and the complex vector @c b, both of
+   * length @c N. */
+  static inline std::complex<float> dot(const float *a, const std::complex<float> *b, size_t N) {
+    float re, im; _kernels.cdot(a, (const float *)b, N, &re, &im);
+    return std::complex<float>(re, im);
+  }
+
+  /** Returns the sum of the absolute values of the real vector @c in of length @c N. */
+  static inline float absSum(const float *in, size_t N) {
+    return _kernels.absSum(in, N);
+  }
+  /** Returns the sum of the magnitudes of the complex vector @c in of length @c N. */
+  static inline float absSum(const std::complex<float> *in, size_t N) {
+    return _kernels.cabsSum((const float *)in, N);
+  }
+  /** Scales the real vector @c in of length @c N by the linear gain ramp
+   * @c out[i]=(gain+(i+1)*dgain)*in[i], may be performed in-place. */
+  static inline void ramp(const float *in, float *out, size_t N, float gain, float dgain) {
+    _kernels.ramp(in, out, N, gain, dgain);
+  }
+  /** Scales the complex vector @c in of length @c N by the linear gain ramp
+   * @c out[i]=(gain+(i+1)*dgain)*in[i], may be performed in-place. */
+  static inline void ramp(const std::complex<float> *in, std::complex<float> *out, size_t N,
+                          float gain, float dgain) {
+    _kernels.cramp((const float *)in, (float *)out, N, gain, dgain);
+  }
+
+  /** Fills the 256-entry lookup table with @c scale*x+offset for every uint8 value x. */
+  static void uint8Table(float *table, float scale, float offset);
+  /** Fills the 256-entry lookup table with @c scale*x+offset for every int8 value x, indexed by
+   * the unsigned representation of x. */
+  static void int8Table(float *table, float scale, float offset);
+
+  /** Performs the scaled type-cast @c out[i]=scale*(in[i]+shift) with a conversion kernel if
+   * there is one for the given types. Returns @c false otherwise. */
+  template <class iScalar, class oScalar>
+  static inline bool scaled(const Buffer<iScalar> &in, const Buffer<oScalar> &out,
+                            const oScalar &scale, const iScalar &shift) {
+    return false;
+  }
+  /** int16 -> float. */
+  static inline bool scaled(const Buffer<int16_t> &in, const Buffer<float> &out,
+                            const float &scale, const int16_t &shift) {
+    int16ToFloat((const int16_t *)in.data(), (float *)out.data(), in.size(), scale, scale*shift);
+    return true;
+  }
+  /** complex int16 -> complex float with real scale and no shift. */
+  static inline bool scaled(const Buffer< std::complex<int16_t> > &in,
+                            const Buffer< std::complex<float> > &out,
+                            const std::complex<float> &scale, const std::complex<int16_t> &shift) {
+    if ((0 != scale.imag()) || (std::complex<int16_t>(0) != shift)) { return false; }
+    int16ToFloat((const int16_t *)in.data(), (float *)out.data(), 2*in.size(), scale.real(), 0);
+    return true;
+  }
+  /** uint8 -> float, via a lookup table. */
+  static inline bool scaled(const Buffer<uint8_t> &in, const Buffer<float> &out,
+                            const float &scale, const uint8_t &shift) {
+    float table[256]; uint8Table(table, scale, scale*shift);
+    lookup((const uint8_t *)in.data(), (float *)out.data(), in.size(), table);
+    return true;
+  }
+  /** int8 -> float, via a lookup table. */
+  static inline bool scaled(const Buffer<int8_t> &in, const Buffer<float> &out,
+                            const float &scale, const int8_t &shift) {
+    float table[256]; int8Table(table, scale, scale*shift);
+    lookup((const int8_t *)in.data(), (float *)out.data(), in.size(), table);
+    return true;
+  }
+  /** complex uint8 -> complex float with real scale and no shift, via a lookup table. */
+  static inline bool scaled(const Buffer< std::complex<uint8_t> > &in,
+                            const Buffer< std::complex<float> > &out,
+                            const std::complex<float> &scale, const std::complex<uint8_t> &shift) {
+    if ((0 != scale.imag()) || (std::complex<uint8_t>(0) != shift)) { return false; }
+    float table[256]; uint8Table(table, scale.real(), 0);
+    lookup((const uint8_t *)in.data(), (float *)out.data(), 2*in.size(), table);
+    return true;
+  }
+  /** complex int8 -> complex float with real scale and no shift, via a lookup table. */
+  static inline bool scaled(const Buffer< std::complex<int8_t> > &in,
+                            const Buffer< std::complex<float> > &out,
+                            const std::complex<float> &scale, const std::complex<int8_t> &shift) {
+    if ((0 != scale.imag()) || (std::complex<int8_t>(0) != shift)) { return false; }
+    float table[256]; int8Table(table, scale.real(), 0);
+    lookup((const int8_t *)in.data(), (float *)out.data(), 2*in.size(), table);
+    return true;
+  }
+
+protected:
+  /** The kernels of the selected implementation. */
+  static Kernels _kernels;
+  /** The selected implementation. */
+  static Implementation _implementation;
+};
+
+}
+
+#endif // __SDR_CONVERT_HH__
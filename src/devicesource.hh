@@ -0,0 +1,126 @@
+#ifndef __SDR_DEVICESOURCE_HH__
+#define __SDR_DEVICESOURCE_HH__
+
+#include "node.hh"
+#include "config.hh"
+#include "logger.hh"
+
+#include <cstring>
+#include <inttypes.h>
+
+
+namespace sdr {
+
+/** Base class of sources receiving their samples from a device driver callback (e.g. the
+ * @c RTLSource).
+ *
+ * Drivers usually pass their own transfer buffers to the callback and recycle them as soon as
+ * the callback returns. Hence these buffers can not be sent through the queue. Instead, the
+ * received samples are copied into a ring of preallocated buffers owned by the source. A buffer
+ * gets available again once all sinks released it. If there is no free buffer when samples are
+ * received, the consumers fell behind. Then, the samples get dropped and an overrun is counted,
+ * like a device would do.
+ *
+ * The buffers are stamped with the absolute sample index and the capture time (see
+ * @c BufferMeta). Dropped samples are counted by the index.
+ * @ingroup sources */
+template <class Scalar>
+class DeviceSource: public Source
+{
+public:
+  /** Constructor.
+   * @param buffer_size Specifies the size of the buffers in samples.
+   * @param num_buffers Specifies the number of buffers in the ring.
+   * @param sample_rate Specifies the sample rate, if known. */
+  DeviceSource(size_t buffer_size, size_t num_buffers=15, double sample_rate=0)
+    : Source(), _buffer_size(buffer_size), _buffers(num_buffers, buffer_size),
+      _samples_received(0), _overruns(0), _samples_dropped(0)
+  {
+    // Propergate type & buffer size, the sample rate may be set by the device later
+    _configure(sample_rate);
+  }
+
+  /** Destructor. */
+  virtual ~DeviceSource() {
+    // pass...
+  }
+
+  /** Returns the buffer size. */
+  inline size_t bufferSize() const { return _buffer_size; }
+  /** Returns the number of buffers in the ring. */
+  inline size_t numBuffers() const { return _buffers.numBuffers(); }
+  /** Extends the ring to the given number of buffers, the ring can not be shrinked. */
+  void setNumBuffers(size_t num_buffers) {
+    _buffers.resize(num_buffers);
+    _configure(_config.sampleRate());
+  }
+
+  /** Returns the number of samples received. */
+  inline uint64_t samplesReceived() const { return _samples_received; }
+  /** Returns the number of overruns, i.e. the number of times no free buffer was available. */
+  inline uint64_t overruns() const { return _overruns; }
+  /** Returns the number of samples dropped due to overruns. */
+  inline uint64_t samplesDropped() const { return _samples_dropped; }
+  /** Resets the counters, may be called from any thread. */
+  inline void resetCounters() {
+    __sync_lock_test_and_set(&_samples_received, 0);
+    __sync_lock_test_and_set(&_overruns, 0);
+    __sync_lock_test_and_set(&_samples_dropped, 0);
+  }
+
+  /** Copies the received samples into buffers of the ring and sends them. Must be called from the
+   * driver callback. Samples that do not fit into a free buffer are dropped. */
+  void receive(const Scalar *data, size_t N) {
+    // Count and stamp the samples, the first one got captured N samples ago
+    uint64_t index = __sync_fetch_and_add(&_samples_received, N);
+    BufferMeta meta;
+    if (_config.hasSampleRate()) {
+      meta = BufferMeta(index, BufferMeta::now() - int64_t(1e9*N/_config.sampleRate()),
+                        _config.sampleRate());
+    }
+    while (N) {
+      if (! _buffers.hasBuffer()) {
+        __sync_fetch_and_add(&_overruns, 1); __sync_fetch_and_add(&_samples_dropped, N);
+#ifdef SDR_DEBUG
+        LogMessage msg(LOG_WARNING);
+        msg << "DeviceSource: Overrun, " << N << " samples dropped.";
+        Logger::get().log(msg);
+#endif
+        return;
+      }
+      size_t n = std::min(N, _buffer_size);
+      Buffer<Scalar> buffer = _buffers.getBuffer();
+      memcpy(buffer.data(), data, n*sizeof(Scalar));
+      // Hold a reference while sending, this returns the buffer to the ring if it is only
+      // processed by directly connected sinks.
+      buffer.ref();
+      Buffer<Scalar> out = buffer.head(n); out.setMeta(meta);
+      this->send(out);
+      buffer.unref();
+      data += n; N -= n; meta = meta.advance(n);
+    }
+  }
+
+protected:
+  /** Propagates the config for the given sample rate. */
+  inline void _configure(double sample_rate) {
+    this->setConfig(Config(Config::typeId<Scalar>(), sample_rate, _buffer_size,
+                           _buffers.numBuffers()));
+  }
+
+protected:
+  /** The buffer size. */
+  size_t _buffer_size;
+  /** The ring of buffers. */
+  BufferSet<Scalar> _buffers;
+  /** The number of samples received, updated atomically by the driver thread. */
+  volatile uint64_t _samples_received;
+  /** The number of overruns, updated atomically by the driver thread. */
+  volatile uint64_t _overruns;
+  /** The number of samples dropped, updated atomically by the driver thread. */
+  volatile uint64_t _samples_dropped;
+};
+
+}
+
+#endif // __SDR_DEVICESOURCE_HH__
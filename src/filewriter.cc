@@ -0,0 +1,146 @@
+#include "filewriter.hh"
+#include "exception.hh"
+#include "logger.hh"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace sdr;
+
+
+/* ********************************************************************************************* *
+ * Implementation of FileWriter
+ * ********************************************************************************************* */
+FileWriter::FileWriter(size_t ringSize)
+  : _fd(-1), _interval(1), _dataSize(0), _dropped(0), _ring(0), _ringSize(ringSize),
+    _head(0), _tail(0), _running(false)
+{
+  // pass...
+}
+
+FileWriter::~FileWriter() {
+  // The file must be closed by the implementation
+  if (_ring) { free(_ring); }
+}
+
+void
+FileWriter::_open(const std::string &filename, size_t offset) {
+  _fd = ::open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (0 > _fd) {
+    ConfigError err;
+    err << "Can not open file for output: " << filename;
+    throw err;
+  }
+  if (0 == (_ring = (char *)malloc(_ringSize))) {
+    ::close(_fd); _fd = -1;
+    ConfigError err;
+    err << "Can not allocate ring buffer for file " << filename;
+    throw err;
+  }
+
+  // Write an empty header, the data follows the header
+  _update(false);
+  lseek(_fd, offset, SEEK_SET);
+
+  // Start writer thread
+  pthread_mutex_init(&_lock, NULL);
+  pthread_cond_init(&_cond, NULL);
+  _running = true;
+  pthread_create(&_thread, 0, FileWriter::__thread_start, this);
+}
+
+bool
+FileWriter::write(const char *data, size_t len) {
+  if (! isOpen()) { return false; }
+
+  uint64_t head = _head, tail = _tail;
+  if (len > (_ringSize-(head-tail))) {
+    __sync_fetch_and_add(&_dropped, uint64_t(len));
+    LogMessage msg(LOG_WARNING);
+    msg << "FileWriter: Ring buffer overflow, drop " << len << " bytes.";
+    Logger::get().log(msg);
+    return false;
+  }
+
+  // Copy data into ring, may wrap around
+  size_t offset = head % _ringSize, n = std::min(len, _ringSize-offset);
+  memcpy(_ring+offset, data, n);
+  memcpy(_ring, data+n, len-n);
+  // Publish data after it has been copied
+  __sync_synchronize();
+  _head = head + len;
+
+  pthread_cond_signal(&_cond);
+  return true;
+}
+
+void
+FileWriter::close() {
+  if (! isOpen()) { return; }
+
+  // Stop thread, it writes all pending data first
+  _running = false;
+  pthread_cond_signal(&_cond);
+  void *p; pthread_join(_thread, &p);
+  pthread_mutex_destroy(&_lock);
+  pthread_cond_destroy(&_cond);
+
+  _update(true);
+  ::close(_fd); _fd = -1;
+  free(_ring); _ring = 0;
+}
+
+void
+FileWriter::_update(bool) {
+  // pass...
+}
+
+void
+FileWriter::_main() {
+  time_t last = time(0);
+  while (true) {
+    uint64_t head = _head; __sync_synchronize();
+    uint64_t tail = _tail;
+
+    if (head == tail) {
+      // Quit once all data is written
+      if (! _running) { break; }
+      // Wait for data, a missed signal only delays the writer
+      struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += 100000000;
+      if (ts.tv_nsec >= 1000000000) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+      pthread_mutex_lock(&_lock);
+      pthread_cond_timedwait(&_cond, &_lock, &ts);
+      pthread_mutex_unlock(&_lock);
+    } else {
+      // Write contiguous part of the pending data
+      size_t offset = tail % _ringSize, n = std::min(head-tail, uint64_t(_ringSize-offset));
+      ssize_t ret = ::write(_fd, _ring+offset, n);
+      if ((0 > ret) && (EINTR == errno)) { continue; }
+      if (0 > ret) {
+        LogMessage msg(LOG_ERROR);
+        msg << "FileWriter: Can not write " << n << " bytes: " << strerror(errno);
+        Logger::get().log(msg);
+        __sync_fetch_and_add(&_dropped, uint64_t(n)); ret = n;
+      } else {
+        _dataSize += ret;
+      }
+      __sync_synchronize();
+      _tail = tail + ret;
+    }
+
+    // Keep header up-to-date
+    time_t now = time(0);
+    if ((now-last) >= time_t(_interval)) { _update(false); last = now; }
+  }
+}
+
+void *
+FileWriter::__thread_start(void *ptr) {
+  reinterpret_cast<FileWriter *>(ptr)->_main();
+  return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef __SDR_FILEWRITER_HH__
+#define __SDR_FILEWRITER_HH__
+
+#include <string>
+#include <inttypes.h>
+#include <pthread.h>
+
+
+namespace sdr {
+
+/** Base class of asynchronous file writers (e.g. @c WavWriter). The data passed to @c write is
+ * copied into a lock-free ring buffer and written to the disk by a separate thread. Hence the
+ * caller (usually the queue thread) never blocks on the disk. If the ring buffer overflows, the
+ * data is dropped and a warning is issued.
+ *
+ * Implementations may reserve some space for a header in front of the data and keep it
+ * up-to-date by implementing @c _update, which gets called periodically by the writer thread and
+ * once the file gets closed. Implementations must call @c _open once they are constructed and
+ * @c close in their destructor.
+ * @ingroup sinks */
+class FileWriter
+{
+protected:
+  /** Constructor.
+   * @param ringSize Specifies the size of the ring buffer in bytes. */
+  FileWriter(size_t ringSize);
+
+public:
+  /** Destructor. */
+  virtual ~FileWriter();
+
+  /** Returns @c true if the file is open. */
+  inline bool isOpen() const { return 0 <= _fd; }
+  /** Queues some data to be written. Returns @c false if the data was dropped. */
+  bool write(const char *data, size_t len);
+  /** Writes all pending data, updates the header and closes the file. */
+  void close();
+
+  /** Returns the number of bytes dropped due to ring buffer overflows or write errors. */
+  inline uint64_t dropped() const { return _dropped; }
+
+protected:
+  /** Opens the file and starts the writer thread. The data is written after @c offset bytes
+   * reserved for the header.
+   * @throws ConfigError If the file can not be opened for output. */
+  void _open(const std::string &filename, size_t offset);
+  /** Gets called periodically by the writer thread, once at opening and once at closing the file
+   * (@c final=true) to update the header. */
+  virtual void _update(bool final);
+
+  /** The writer loop. */
+  void _main();
+
+protected:
+  /** The file descriptor. */
+  int _fd;
+  /** The interval in seconds, @c _update gets called. */
+  unsigned int _interval;
+  /** The number of data bytes written to the file. */
+  uint64_t _dataSize;
+  /** The number of bytes dropped, updated atomically by the caller of @c write and the writer
+   * thread. */
+  volatile uint64_t _dropped;
+  /** The ring buffer. */
+  char *_ring;
+  /** The size of the ring buffer. */
+  size_t _ringSize;
+  /** Total number of bytes put into the ring, only modified by @c write. */
+  volatile uint64_t _head;
+  /** Total number of bytes taken from the ring, only modified by the writer thread. */
+  volatile uint64_t _tail;
+  /** While @c true, the writer thread runs. */
+  volatile bool _running;
+  /** The writer thread. */
+  pthread_t _thread;
+  /** The mutex of the condition. */
+  pthread_mutex_t _lock;
+  /** Signals the writer thread that there is some data. */
+  pthread_cond_t _cond;
+
+private:
+  /** The pthread function. */
+  static void *__thread_start(void *ptr);
+};
+
+}
+
+#endif // __SDR_FILEWRITER_HH__
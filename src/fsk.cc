@@ -9,12 +9,17 @@ using namespace sdr;
 /* ******************************************************************************************** *
  * Implementation of FSKDetector
  * ******************************************************************************************** */
-FSKDetector::FSKDetector(float baud, float Fmark, float Fspace)
-  : Sink<int16_t>(), Source(), _baud(baud), _corrLen(0), _Fmark(Fmark), _Fspace(Fspace)
+FSKDetector::FSKDetector(float baud, float Fmark, float Fspace, bool packed)
+  : Sink<int16_t>(), Source(), _baud(baud), _corrLen(0), _Fmark(Fmark), _Fspace(Fspace),
+    _packed(packed), _buffers(0)
 {
   // pass...
 }
 
+FSKDetector::~FSKDetector() {
+  if (_buffers) { delete _buffers; }
+}
+
 void
 FSKDetector::config(const Config &src_cfg)
 {
@@ -50,18 +55,23 @@ FSKDetector::config(const Config &src_cfg)
   // Ring buffer index
   _lutIdx = 0;
 
-  // Allocate output buffer
-  _buffer = Buffer<int8_t>(src_cfg.bufferSize());
+  // Allocate output buffers, packed bits are stored in plain byte buffers
+  size_t bufSize = src_cfg.bufferSize();
+  if (_buffers) { delete _buffers; }
+  _buffers = new BufferSet<uint8_t>(std::max(size_t(1), src_cfg.numBuffers()),
+                                    _packed ? BitBuffer::storageBytes(bufSize) : bufSize);
 
   LogMessage msg(LOG_DEBUG);
   msg << "Config FSKDetector node: " << std::endl
       << " sample/symbol rate: " << src_cfg.sampleRate() << " Hz" << std::endl
       << " target baud rate: " << _baud << std::endl
-      << " approx. samples per bit: " << _corrLen;
+      << " approx. samples per bit: " << _corrLen << std::endl
+      << " packed: " << (_packed ? "yes" : "no");
   Logger::get().log(msg);
 
   // Forward config.
-  this->setConfig(Config(Traits<uint8_t>::scalarId, src_cfg.sampleRate(), src_cfg.bufferSize(), 1));
+  this->setConfig(Config(_packed ? Config::Type_bits : Traits<uint8_t>::scalarId,
+                         src_cfg.sampleRate(), src_cfg.bufferSize(), 1));
 }
 
 
@@ -88,36 +98,232 @@ FSKDetector::_process(int16_t sample) {
 
 void
 FSKDetector::process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
-  for (size_t i=0; i<buffer.size(); i++) {
-    _buffer[i] = _process(buffer[i]);
+  // Get a free output buffer, add one if all buffers are still in use by the receivers
+  if (! _buffers->hasBuffer()) { _buffers->resize(_buffers->numBuffers()+1); }
+  Buffer<uint8_t> out = _buffers->getBuffer();
+  // Hold the buffer while sending, it returns to the set once released by all receivers
+  out.ref();
+  if (_packed) {
+    BitBuffer bits(out); bits.clear();
+    for (size_t i=0; i<buffer.size(); i++) {
+      bits.append(_process(buffer[i]));
+    }
+    this->send(bits, false);
+  } else {
+    for (size_t i=0; i<buffer.size(); i++) {
+      out[i] = _process(buffer[i]);
+    }
+    this->send(out.head(buffer.size()), false);
   }
-  this->send(_buffer.head(buffer.size()), false);
+  out.unref();
 }
 
 
 
 /* ******************************************************************************************** *
- * Implementation of BitStream
+ * Implementation of FSKBankOutput
  * ******************************************************************************************** */
-BitStream::BitStream(float baud, Mode mode)
-  : Sink<uint8_t>(), Source(), _baud(baud), _mode(mode), _corrLen(0)
+FSKBankOutput::FSKBankOutput(float baud, float Fmark, float Fspace, float spaceGain, bool packed)
+  : Source(), _baud(baud), _Fmark(Fmark), _Fspace(Fspace), _spaceGain(spaceGain),
+    _mark(0), _space(0), _packed(packed), _buffers(0)
 {
   // pass...
 }
 
+FSKBankOutput::~FSKBankOutput() {
+  if (_buffers) { delete _buffers; }
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of FSKDetectorBank
+ * ******************************************************************************************** */
+FSKDetectorBank::FSKDetectorBank()
+  : Sink<int16_t>(), _lut(_lut_size), _Fs(0), _bufferSize(0), _numBuffers(1), _histLen(0),
+    _histIdx(0)
+{
+  for (size_t i=0; i<_lut_size; i++) {
+    _lut[i] = (1<<14)*std::sin((2*M_PI*i)/_lut_size);
+  }
+}
+
+FSKDetectorBank::~FSKDetectorBank() {
+  _lut.unref();
+  for (size_t i=0; i<_toneHist.size(); i++) { _toneHist[i].unref(); }
+  for (size_t i=0; i<_outputs.size(); i++) { delete _outputs[i]; }
+}
+
+FSKBankOutput *
+FSKDetectorBank::addModem(float baud, float Fmark, float Fspace, float spaceGain, bool packed) {
+  _outputs.push_back(new FSKBankOutput(baud, Fmark, Fspace, spaceGain, packed));
+  // If already configured -> re-configure bank
+  if (_Fs > 0) { _configure(); }
+  return _outputs.back();
+}
+
 void
-BitStream::config(const Config &src_cfg) {
+FSKDetectorBank::config(const Config &src_cfg)
+{
   // Check if config is complete
-  if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
 
   // Check if buffer type matches
-  if (Config::typeId<uint8_t>() != src_cfg.type()) {
+  if (Config::typeId<int16_t>() != src_cfg.type()) {
     ConfigError err;
-    err << "Can not configure BitStream: Invalid type " << src_cfg.type()
+    err << "Can not configure FSKDetectorBank: Invalid type " << src_cfg.type()
         << ", expected " << Config::typeId<int16_t>();
     throw err;
   }
 
+  _Fs = src_cfg.sampleRate();
+  _bufferSize = src_cfg.bufferSize();
+  _numBuffers = std::max(size_t(1), src_cfg.numBuffers());
+  _configure();
+}
+
+size_t
+FSKDetectorBank::_tone(float F) {
+  for (size_t i=0; i<_toneFreq.size(); i++) {
+    if (F == _toneFreq[i]) { return i; }
+  }
+  _toneFreq.push_back(F);
+  // Phase increment as fraction of 2^32 per sample
+  _toneInc.push_back(uint32_t(int64_t(std::ldexp(double(F)/_Fs, 32))));
+  _tonePhase.push_back(0);
+  return _toneFreq.size()-1;
+}
+
+size_t
+FSKDetectorBank::_correlator(size_t tone, size_t len) {
+  for (size_t i=0; i<_corrTone.size(); i++) {
+    if ((tone == _corrTone[i]) && (len == _corrLen[i])) { return i; }
+  }
+  _corrTone.push_back(tone); _corrLen.push_back(len);
+  _corrRe.push_back(0); _corrIm.push_back(0);
+  return _corrTone.size()-1;
+}
+
+void
+FSKDetectorBank::_configure()
+{
+  // Reset tones and correlators
+  for (size_t i=0; i<_toneHist.size(); i++) { _toneHist[i].unref(); }
+  _toneFreq.clear(); _tonePhase.clear(); _toneInc.clear(); _toneHist.clear();
+  _corrTone.clear(); _corrLen.clear(); _corrRe.clear(); _corrIm.clear();
+
+  // Assemble distinct tones and correlators
+  _histLen = 1;
+  for (size_t i=0; i<_outputs.size(); i++) {
+    FSKBankOutput *out = _outputs[i];
+    size_t len = std::max(1, int(_Fs/out->_baud));
+    _histLen = std::max(_histLen, len);
+    out->_mark  = _correlator(_tone(out->_Fmark), len);
+    out->_space = _correlator(_tone(out->_Fspace), len);
+    // Allocate output buffers, packed bits are stored in plain byte buffers
+    if (out->_buffers) { delete out->_buffers; }
+    out->_buffers = new BufferSet<uint8_t>(
+          _numBuffers, out->_packed ? BitBuffer::storageBytes(_bufferSize) : _bufferSize);
+  }
+
+  // Allocate & clear history of mixed input
+  for (size_t i=0; i<_toneFreq.size(); i++) {
+    _toneHist.push_back(Buffer<int32_t>(2*_histLen));
+    for (size_t j=0; j<2*_histLen; j++) { _toneHist.back()[j] = 0; }
+  }
+  _histIdx = 0;
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Config FSKDetectorBank node: " << std::endl
+      << " sample/symbol rate: " << _Fs << " Hz" << std::endl
+      << " modems: " << _outputs.size() << std::endl
+      << " distinct tones: " << _toneFreq.size() << std::endl
+      << " correlators: " << _corrTone.size();
+  Logger::get().log(msg);
+
+  // Forward config to all outputs
+  for (size_t i=0; i<_outputs.size(); i++) {
+    Config::Type type = _outputs[i]->_packed ? Config::Type_bits : Traits<uint8_t>::scalarId;
+    _outputs[i]->setConfig(Config(type, _Fs, _bufferSize, 1));
+  }
+}
+
+void
+FSKDetectorBank::process(const Buffer<int16_t> &buffer, bool allow_overwrite)
+{
+  size_t nTones = _toneFreq.size(), nCorr = _corrTone.size(), nOut = _outputs.size();
+  // Get a free buffer for every output, add one if all buffers are still in use by the receivers.
+  // The buffers are held while sending, they return to the sets once released by all receivers.
+  for (size_t o=0; o<nOut; o++) {
+    FSKBankOutput *out = _outputs[o];
+    if (! out->_buffers->hasBuffer()) { out->_buffers->resize(out->_buffers->numBuffers()+1); }
+    out->_out = out->_buffers->getBuffer();
+    out->_out.ref();
+    if (out->_packed) { out->_bits = BitBuffer(out->_out); out->_bits.clear(); }
+  }
+  for (size_t i=0; i<buffer.size(); i++) {
+    int32_t sample = buffer[i];
+    // Remove the samples leaving the correlator windows from the running sums. This must happen
+    // before the history gets updated as the longest window leaves at the current index.
+    for (size_t c=0; c<nCorr; c++) {
+      const Buffer<int32_t> &hist = _toneHist[_corrTone[c]];
+      size_t old = (_histIdx + _histLen - _corrLen[c]) % _histLen;
+      _corrRe[c] -= hist[2*old]; _corrIm[c] -= hist[2*old+1];
+    }
+    // Mix sample with every distinct tone, store result in history
+    for (size_t t=0; t<nTones; t++) {
+      size_t idx = _tonePhase[t] >> 22;
+      _toneHist[t][2*_histIdx]   = sample * _lut[(idx + _lut_size/4) % _lut_size];
+      _toneHist[t][2*_histIdx+1] = sample * _lut[idx];
+      _tonePhase[t] += _toneInc[t];
+    }
+    // Add newest mixed samples to running sums
+    for (size_t c=0; c<nCorr; c++) {
+      const Buffer<int32_t> &hist = _toneHist[_corrTone[c]];
+      _corrRe[c] += hist[2*_histIdx]; _corrIm[c] += hist[2*_histIdx+1];
+    }
+    // Make decisions
+    for (size_t o=0; o<nOut; o++) {
+      FSKBankOutput *out = _outputs[o];
+      uint8_t symbol = (_power(out->_mark) > out->_spaceGain*_power(out->_space));
+      if (out->_packed) { out->_bits.append(symbol); }
+      else { out->_out[i] = symbol; }
+    }
+    // Advance history index
+    _histIdx++; if (_histIdx == _histLen) { _histIdx = 0; }
+  }
+
+  for (size_t o=0; o<nOut; o++) {
+    FSKBankOutput *out = _outputs[o];
+    if (out->_packed) { out->send(out->_bits, false); }
+    else { out->send(out->_out.head(buffer.size()), false); }
+    // Drop the references to the buffer
+    out->_out.unref(); out->_out = Buffer<uint8_t>(); out->_bits = BitBuffer();
+  }
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of BitStream
+ * ******************************************************************************************** */
+BitStream::BitStream(float baud, Mode mode, bool packed)
+  : BitSink(), Source(), _baud(baud), _mode(mode), _corrLen(0), _packOutput(packed), _buffers(0),
+    _outIdx(0)
+{
+  // pass...
+}
+
+BitStream::~BitStream() {
+  if (_buffers) { delete _buffers; }
+}
+
+void
+BitStream::config(const Config &src_cfg) {
+  // Check if config is complete
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
+
+  // Check if buffer type matches
+  configBits(src_cfg, "BitStream");
+
   // # of symbols for each bit
   _corrLen = int(src_cfg.sampleRate()/_baud);
 
@@ -139,66 +345,158 @@ BitStream::config(const Config &src_cfg) {
   // Reset bit hist
   _lastBits = 0;
 
-  // Allocate output buffer
-  _buffer = Buffer<uint8_t>(1+src_cfg.bufferSize()/_corrLen);
+  // Allocate output buffers, packed bits are stored in plain byte buffers
+  size_t bufSize = 1+src_cfg.bufferSize()/_corrLen;
+  if (_buffers) { delete _buffers; }
+  _buffers = new BufferSet<uint8_t>(std::max(size_t(1), src_cfg.numBuffers()),
+                                    _packOutput ? BitBuffer::storageBytes(bufSize) : bufSize);
 
   LogMessage msg(LOG_DEBUG);
   msg << "Config BitStream node: " << std::endl
       << " symbol rate: " << src_cfg.sampleRate() << " Hz" << std::endl
       << " baud rate:   " << _baud << std::endl
       << " symbols/bit: " << 1./_omega << std::endl
-      << " bit mode:    " << ( (NORMAL == _mode) ? "normal" : "transition" );
+      << " bit mode:    " << ( (NORMAL == _mode) ? "normal" : "transition" ) << std::endl
+      << " packed:      " << ( _packOutput ? "yes" : "no" );
   Logger::get().log(msg);
 
   // Forward config.
-  this->setConfig(Config(Traits<uint8_t>::scalarId, _baud, _buffer.size(), 1));
+  this->setConfig(Config(_packOutput ? Config::Type_bits : Traits<uint8_t>::scalarId,
+                         _baud, bufSize, 1));
+}
+
+inline bool
+BitStream::_process(uint8_t symbol)
+{
+  bool sampled = false;
+  // store symbol & update _symSum and _lastSymSum
+  _lastSymSum = _symSum;
+  _symSum -= _symbols[_symIdx];
+  _symbols[_symIdx] = ( symbol ? 1 : -1 );
+  _symSum += _symbols[_symIdx];
+  _symIdx = ((_symIdx+1) % _corrLen);
+
+  // Advance phase
+  _phase += _omega;
+
+  // Sample bit ...
+  if (_phase >= 1) {
+    // Modulo "2 pi", phase is defined on the interval [0,1)
+    while (_phase>=1) { _phase -= 1; }
+    // Estimate bit by majority vote on all symbols (_symSum)
+    _lastBits = ((_lastBits<<1) | (_symSum>0));
+    // Decode bit
+    uint8_t bit;
+    if (TRANSITION == _mode) {
+      // transition -> 0; no transition -> 1
+      bit = ((_lastBits ^ (_lastBits >> 1) ^ 0x1) & 0x1);
+    } else {
+      // mark -> 1, space -> 0
+      bit = _lastBits & 0x1;
+    }
+    // Put decoded bit in output buffer
+    if (_packOutput) { _bitBuffer.append(bit); }
+    else { _buffer[_outIdx++] = bit; }
+    sampled = true;
+  }
+
+  // If there was a symbol transition
+  if (((_lastSymSum < 0) && (_symSum>=0)) || ((_lastSymSum >= 0) && (_symSum<0))) {
+    // Phase correction
+    // transition at [-pi,0] -> increase omega
+    if (_phase < 0.5) { _omega += _pllGain*(0.5-_phase); }
+    // transition at [0,pi]  -> decrease omega
+    else { _omega -= _pllGain*(_phase-0.5); }
+    // Limit omega
+    _omega = std::min(_omegaMax, std::max(_omegaMin, _omega));
+  }
+
+  return sampled;
+}
+
+void
+BitStream::_take() {
+  // Get a free output buffer, add one if all buffers are still in use by the receivers
+  if (! _buffers->hasBuffer()) { _buffers->resize(_buffers->numBuffers()+1); }
+  _buffer = _buffers->getBuffer();
+  // Hold the buffer while sending, it returns to the set once released by all receivers
+  _buffer.ref();
+  if (_packOutput) { _bitBuffer = BitBuffer(_buffer); _bitBuffer.clear(); }
+  _outIdx = 0;
+}
+
+void
+BitStream::_send(const BufferMeta &meta) {
+  if (_packOutput) {
+    if (_bitBuffer.size()) { _bitBuffer.setMeta(meta); this->send(_bitBuffer); }
+  } else {
+    if (_outIdx) {
+      Buffer<uint8_t> res = _buffer.head(_outIdx); res.setMeta(meta);
+      this->send(res);
+    }
+  }
+  _buffer.unref();
 }
 
 void
 BitStream::process(const Buffer<uint8_t> &buffer, bool allow_overwrite)
 {
-  size_t o=0;
-  for (size_t i=0; i<buffer.size(); i++)
-  {
-    // store symbol & update _symSum and _lastSymSum
-    _lastSymSum = _symSum;
-    _symSum -= _symbols[_symIdx];
-    _symbols[_symIdx] = ( buffer[i] ? 1 : -1 );
-    _symSum += _symbols[_symIdx];
-    _symIdx = ((_symIdx+1) % _corrLen);
-
-    // Advance phase
-    _phase += _omega;
-
-    // Sample bit ...
-    if (_phase >= 1) {
-      // Modulo "2 pi", phase is defined on the interval [0,1)
-      while (_phase>=1) { _phase -= 1; }
-      // Estimate bit by majority vote on all symbols (_symSum)
-      _lastBits = ((_lastBits<<1) | (_symSum>0));
-      // Put decoded bit in output buffer
-      if (TRANSITION == _mode) {
-        // transition -> 0; no transition -> 1
-        _buffer[o++] = ((_lastBits ^ (_lastBits >> 1) ^ 0x1) & 0x1);
-      } else {
-        // mark -> 1, space -> 0
-        _buffer[o++] = _lastBits & 0x1;
-      }
-    }
+  size_t first = 0; bool sampled = false;
+  _take();
+  for (size_t i=0; i<buffer.size(); i++) {
+    if (_process(buffer[i]) && (! sampled)) { first = i; sampled = true; }
+  }
+  _send(buffer.meta().resample(_baud/buffer.meta().sampleRate(), first));
+}
 
-    // If there was a symbol transition
-    if (((_lastSymSum < 0) && (_symSum>=0)) || ((_lastSymSum >= 0) && (_symSum<0))) {
-      // Phase correction
-      // transition at [-pi,0] -> increase omega
-      if (_phase < 0.5) { _omega += _pllGain*(0.5-_phase); }
-      // transition at [0,pi]  -> decrease omega
-      else { _omega -= _pllGain*(_phase-0.5); }
-      // Limit omega
-      _omega = std::min(_omegaMax, std::max(_omegaMin, _omega));
+void
+BitStream::processBits(const BitBuffer &buffer, bool allow_overwrite)
+{
+  size_t N = buffer.size(), first = 0; bool sampled = false;
+  _take();
+  for (size_t w=0; w<buffer.numWords(); w++) {
+    uint32_t word = buffer.word(w);
+    size_t n = std::min(size_t(32), N-32*w);
+    for (size_t i=0; i<n; i++, word <<= 1) {
+      if (_process(word >> 31) && (! sampled)) { first = 32*w+i; sampled = true; }
     }
   }
+  _send(buffer.meta().resample(_baud/buffer.meta().sampleRate(), first));
+}
 
-  if (o>0) { this->send(_buffer.head(o)); }
+
+/* ******************************************************************************************** *
+ * Implementation of SyncWordSearch
+ * ******************************************************************************************** */
+SyncWordSearch::SyncWordSearch(uint32_t word, int maxErrors)
+  : _word(word), _maxErrors(maxErrors), _hist(0)
+{
+  // pass...
+}
+
+bool
+SyncWordSearch::search(const BitBuffer &buffer, size_t &offset)
+{
+  size_t N = buffer.size();
+  while (offset < N) {
+    // Take up to 64 bits at once
+    size_t n = std::min(size_t(64), N-offset);
+    uint64_t chunk = buffer.bits(offset, n);
+    // Check all windows ending within the chunk
+    for (size_t k=0; k<n; k++) {
+      uint64_t hist = ((k < 63) ? (_hist << (k+1)) : 0);
+      uint32_t window = uint32_t(hist | (chunk >> (n-1-k)));
+      if (distance(window, _word) <= _maxErrors) {
+        _hist = window;
+        offset += k+1;
+        return true;
+      }
+    }
+    // Update history
+    _hist = ((64 == n) ? chunk : ((_hist << n) | chunk));
+    offset += n;
+  }
+  return false;
 }
 
 
@@ -4,6 +4,7 @@
 #include "node.hh"
 #include "traits.hh"
 #include "logger.hh"
+#include <vector>
 
 
 namespace sdr {
@@ -21,8 +22,11 @@ public:
   /** Constructor.
    * @param baud Specifies the baud-rate of the signal.
    * @param Fmark Specifies the mark frequency in Hz.
-   * @param Fspace Specifies the space frequency in Hz. */
-  FSKDetector(float baud, float Fmark, float Fspace);
+   * @param Fspace Specifies the space frequency in Hz.
+   * @param packed If @c true, the symbols are emitted as packed bits (@c Config::Type_bits). */
+  FSKDetector(float baud, float Fmark, float Fspace, bool packed=false);
+  /** Destructor. */
+  virtual ~FSKDetector();
 
   void config(const Config &src_cfg);
   void process(const Buffer<int16_t> &buffer, bool allow_overwrite);
@@ -51,8 +55,149 @@ protected:
   Buffer< std::complex<float> > _markHist;
   /** FIR filter buffer. */
   Buffer< std::complex<float> > _spaceHist;
-  /** Output buffer. */
-  Buffer<int8_t> _buffer;
+  /** If @c true, the symbols are emitted as packed bits. */
+  bool _packed;
+  /** The output buffers, a buffer is reused once it was released by all receivers. */
+  BufferSet<uint8_t> *_buffers;
+};
+
+
+class FSKDetectorBank;
+
+/** A single modem output of a @c FSKDetectorBank node. Do not create instances of this class
+ * directly, they are obtained by @c FSKDetectorBank::addModem.
+ * @ingroup demods */
+class FSKBankOutput: public Source
+{
+public:
+  /** Constructor. */
+  FSKBankOutput(float baud, float Fmark, float Fspace, float spaceGain, bool packed);
+  /** Destructor. */
+  virtual ~FSKBankOutput();
+
+  /** Returns the baud rate of this modem. */
+  inline float baud() const { return _baud; }
+  /** Returns the mark frequency of this modem. */
+  inline float markFrequency() const { return _Fmark; }
+  /** Returns the space frequency of this modem. */
+  inline float spaceFrequency() const { return _Fspace; }
+  /** Returns the gain of the space tone power used by the slicer. */
+  inline float spaceGain() const { return _spaceGain; }
+  /** Returns @c true if the symbols are emitted as packed bits. */
+  inline bool packed() const { return _packed; }
+
+protected:
+  /** Baudrate of the modem. */
+  float _baud;
+  /** Mark "tone" frequency. */
+  float _Fmark;
+  /** Space "tone" frequency. */
+  float _Fspace;
+  /** The gain of the space tone power. */
+  float _spaceGain;
+  /** Index of the mark correlator within the bank. */
+  size_t _mark;
+  /** Index of the space correlator within the bank. */
+  size_t _space;
+  /** If @c true, the symbols are emitted as packed bits. */
+  bool _packed;
+  /** The output buffers, a buffer is reused once it was released by all receivers. */
+  BufferSet<uint8_t> *_buffers;
+  /** The output buffer being filled. */
+  Buffer<uint8_t> _out;
+  /** The packed view of the output buffer being filled. */
+  BitBuffer _bits;
+
+  friend class FSKDetectorBank;
+};
+
+
+/** Implements the FSK/AFSK symbol detection for several modems sharing the same input signal.
+ * Like the @c FSKDetector, the mark and space tone powers are obtained by correlating the input
+ * signal with the tone over a bit-length. Here, however, every distinct tone is mixed only once
+ * per sample and every distinct (tone, bit-length) pair is maintained as a running sum, hence the
+ * costs of the node scale with the number of distinct tones rather than with the number of
+ * modems times the bit-length.
+ *
+ * Each modem added by @c addModem gets its own @c Source which emits the mark/space symbols
+ * (i.e. sub-bits) as @c uint8_t at the input sample rate and can be connected directly to a
+ * @c BitStream node. Modems may share the same tones and baud rate but differ in the gain of the
+ * space tone power used by the slicer. This allows to compensate for a tilted audio response
+ * (e.g. pre-/de-emphasis) at the costs of a comparison per sample.
+ *
+ * @ingroup demods */
+class FSKDetectorBank: public Sink<int16_t>
+{
+public:
+  /** Constructor. */
+  FSKDetectorBank();
+  /** Destructor, also destroys all modem outputs. */
+  virtual ~FSKDetectorBank();
+
+  /** Adds a modem to the bank and returns its output.
+   * @param baud Specifies the baud-rate of the signal.
+   * @param Fmark Specifies the mark frequency in Hz.
+   * @param Fspace Specifies the space frequency in Hz.
+   * @param spaceGain Specifies the gain of the space tone power, a symbol is considered a mark if
+   *        the mark tone power exceeds the weighted space tone power.
+   * @param packed If @c true, the symbols are emitted as packed bits (@c Config::Type_bits). */
+  FSKBankOutput *addModem(float baud, float Fmark, float Fspace, float spaceGain=1,
+                          bool packed=false);
+
+  /** Returns the number of modems. */
+  inline size_t numModems() const { return _outputs.size(); }
+  /** Returns the output of the i-th modem. */
+  inline FSKBankOutput *modem(size_t i) { return _outputs[i]; }
+
+  void config(const Config &src_cfg);
+  void process(const Buffer<int16_t> &buffer, bool allow_overwrite);
+
+protected:
+  /** Assembles tones and correlators for the given sample rate. */
+  void _configure();
+  /** Returns the index of the tone with the given frequency, adds it if needed. */
+  size_t _tone(float F);
+  /** Returns the index of the correlator of the given tone and length, adds it if needed. */
+  size_t _correlator(size_t tone, size_t len);
+  /** Returns the power of the i-th correlator. */
+  inline float _power(size_t i) const {
+    float re = _corrRe[i], im = _corrIm[i];
+    return re*re + im*im;
+  }
+
+protected:
+  /** The size of the mixer LUT. */
+  static const size_t _lut_size = 1024;
+  /** Sine LUT of the mixer, scaled by 2^14. */
+  Buffer<int16_t> _lut;
+  /** The current sample rate. */
+  double _Fs;
+  /** The input buffer size. */
+  size_t _bufferSize;
+  /** The initial number of output buffers per modem. */
+  size_t _numBuffers;
+  /** The frequencies of the distinct tones. */
+  std::vector<float> _toneFreq;
+  /** The phase of each tone. */
+  std::vector<uint32_t> _tonePhase;
+  /** The phase increment of each tone. */
+  std::vector<uint32_t> _toneInc;
+  /** History of the mixed input of each tone (interleaved re, im). */
+  std::vector< Buffer<int32_t> > _toneHist;
+  /** Length of the tone history (maximum correlator length). */
+  size_t _histLen;
+  /** Current index into the tone history. */
+  size_t _histIdx;
+  /** The tone of each correlator. */
+  std::vector<size_t> _corrTone;
+  /** The length of each correlator. */
+  std::vector<size_t> _corrLen;
+  /** The running sum (real part) of each correlator. */
+  std::vector<int64_t> _corrRe;
+  /** The running sum (imaginary part) of each correlator. */
+  std::vector<int64_t> _corrIm;
+  /** The modem outputs. */
+  std::vector<FSKBankOutput *> _outputs;
 };
 
 
@@ -70,13 +215,20 @@ template <class Scalar>
 class ASKDetector: public Sink<Scalar>, public Source
 {
 public:
-  /** Constructor. */
-  ASKDetector(bool invert=false)
-    : Sink<Scalar>(), Source(), _invert(invert)
+  /** Constructor.
+   * @param invert If @c true, the symbol logic is inverted.
+   * @param packed If @c true, the symbols are emitted as packed bits (@c Config::Type_bits). */
+  ASKDetector(bool invert=false, bool packed=false)
+    : Sink<Scalar>(), Source(), _invert(invert), _packed(packed), _buffers(0)
   {
     // pass...
   }
 
+  /** Destructor. */
+  virtual ~ASKDetector() {
+    if (_buffers) { delete _buffers; }
+  }
+
   void config(const Config &src_cfg) {
     // Check if config is complete
     if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
@@ -89,39 +241,61 @@ public:
       throw err;
     }
 
-    // Allocate output buffer
-    _buffer = Buffer<uint8_t>(src_cfg.bufferSize());
+    // Allocate output buffers, packed bits are stored in plain byte buffers
+    size_t bufSize = src_cfg.bufferSize();
+    if (_buffers) { delete _buffers; }
+    _buffers = new BufferSet<uint8_t>(std::max(size_t(1), src_cfg.numBuffers()),
+                                      _packed ? BitBuffer::storageBytes(bufSize) : bufSize);
 
     LogMessage msg(LOG_DEBUG);
     msg << "Config ASKDetector node: " << std::endl
         << " threshold:   " << 0 << std::endl
         << " invert:      " << ( _invert ? "yes" : "no" ) << std::endl
-        << " symbol rate: " << src_cfg.sampleRate() << " Hz";
+        << " symbol rate: " << src_cfg.sampleRate() << " Hz" << std::endl
+        << " packed:      " << ( _packed ? "yes" : "no" );
     Logger::get().log(msg);
 
     // Forward config.
-    this->setConfig(Config(Traits<uint8_t>::scalarId, src_cfg.sampleRate(), _buffer.size(), 1));
+    this->setConfig(Config(_packed ? Config::Type_bits : Traits<uint8_t>::scalarId,
+                           src_cfg.sampleRate(), src_cfg.bufferSize(), 1));
   }
 
   void process(const Buffer<Scalar> &buffer, bool allow_overwrite) {
-    for (size_t i=0; i<buffer.size(); i++) {
-      _buffer[i] = ((buffer[i]>0)^_invert);
+    // Get a free output buffer, add one if all buffers are still in use by the receivers
+    if (! _buffers->hasBuffer()) { _buffers->resize(_buffers->numBuffers()+1); }
+    Buffer<uint8_t> out = _buffers->getBuffer();
+    // Hold the buffer while sending, it returns to the set once released by all receivers
+    out.ref();
+    if (_packed) {
+      BitBuffer bits(out); bits.clear();
+      for (size_t i=0; i<buffer.size(); i++) {
+        bits.append((buffer[i]>0)^_invert);
+      }
+      this->send(bits, false);
+    } else {
+      for (size_t i=0; i<buffer.size(); i++) {
+        out[i] = ((buffer[i]>0)^_invert);
+      }
+      this->send(out.head(buffer.size()), false);
     }
-    this->send(_buffer.head(buffer.size()), false);
+    out.unref();
   }
 
 protected:
   /** If true the symbol logic is inverted. */
   bool _invert;
-  /** The output buffer. */
-  Buffer<uint8_t> _buffer;
+  /** If @c true, the symbols are emitted as packed bits. */
+  bool _packed;
+  /** The output buffers, a buffer is reused once it was released by all receivers. */
+  BufferSet<uint8_t> *_buffers;
 };
 
 
 /** Decodes a bitstream with the desired baud rate.
  * This node implements a simple PLL to syncronize the bit sampling with the transitions
- * of the input symbol sequence. */
-class BitStream: public Sink<uint8_t>, public Source
+ * of the input symbol sequence. The input symbols may be passed as @c uint8_t or as packed bits,
+ * the decoded bits are emitted either way, depending on the @c packed flag. */
+class BitStream: public BitSink, public Source
 {
 public:
   /** Possible bit decoding modes. */
@@ -133,11 +307,24 @@ public:
 public:
   /** Constructor.
    * @param baud Specifies the baud-rate of the input signal.
-   * @param mode Specifies the bit detection mode. */
-  BitStream(float baud, Mode mode = TRANSITION);
+   * @param mode Specifies the bit detection mode.
+   * @param packed If @c true, the bits are emitted as packed bits (@c Config::Type_bits). */
+  BitStream(float baud, Mode mode = TRANSITION, bool packed=false);
+  /** Destructor. */
+  virtual ~BitStream();
 
   void config(const Config &src_cfg);
   void process(const Buffer<uint8_t> &buffer, bool allow_overwrite);
+  void processBits(const BitBuffer &buffer, bool allow_overwrite);
+
+protected:
+  /** Takes a free output buffer for the bits decoded from the next input buffer. */
+  void _take();
+  /** Processes a single symbol and stores the sampled bit (if any) in the output buffer. Returns
+   * @c true if a bit has been sampled. */
+  inline bool _process(uint8_t symbol);
+  /** Sends the bits decoded so far with the given metadata and releases the output buffer. */
+  void _send(const BufferMeta &meta);
 
 protected:
   /** The baud rate. */
@@ -166,8 +353,74 @@ protected:
   float _pllGain;
   /** The last decoded bits (needed for transition mode). */
   uint8_t _lastBits;
-  /** Output buffer. */
+  /** If @c true, the bits are emitted as packed bits. Not to be confused with
+   * @c BitSink::_packed, which tells whether the received symbols are packed. */
+  bool _packOutput;
+  /** The output buffers, a buffer is reused once it was released by all receivers. */
+  BufferSet<uint8_t> *_buffers;
+  /** The current output buffer. */
   Buffer<uint8_t> _buffer;
+  /** Number of bits in the output buffer. */
+  size_t _outIdx;
+  /** The current output buffer, as packed bits. */
+  BitBuffer _bitBuffer;
+};
+
+
+/** Word-parallel search of a 32-bit sync word in a packed bit stream.
+ * Instead of shifting the bit stream through a register bit-by-bit, the bit stream is taken from
+ * the packed buffer up to 64 bits at once. All 32-bit windows ending within these bits are then
+ * compared against the sync word by their Hamming distance (popcount). A window matches, if it
+ * differs in at most @c maxErrors bits from the sync word. */
+class SyncWordSearch
+{
+public:
+  /** Constructor.
+   * @param word Specifies the sync word.
+   * @param maxErrors Specifies the max. number of bit errors accepted. */
+  SyncWordSearch(uint32_t word, int maxErrors=0);
+
+  /** Returns the sync word. */
+  inline uint32_t word() const { return _word; }
+  /** Returns the max. number of bit errors accepted. */
+  inline int maxErrors() const { return _maxErrors; }
+  /** Sets the max. number of bit errors accepted. */
+  inline void setMaxErrors(int maxErrors) { _maxErrors = maxErrors; }
+
+  /** Resets the bit history. */
+  inline void reset() { _hist = 0; }
+  /** Sets the bit history, i.e. the last bits received (the latest one as the LSB). This allows
+   * to resume the search on a stream, whose last bits were consumed elsewhere. */
+  inline void setHistory(uint64_t bits) { _hist = bits; }
+
+  /** Searches the bits [@c offset, @c buffer.size()) of the given buffer for the sync word. The
+   * last bits of the buffer are kept, hence the sync word may span several buffers.
+   * @returns @c true if the sync word was found. Then, @c offset is set to the index of the bit
+   *          following the sync word, otherwise it is set to @c buffer.size(). */
+  bool search(const BitBuffer &buffer, size_t &offset);
+
+  /** Returns @c true if the given word matches the sync word. */
+  inline bool matches(uint32_t word) const { return distance(word, _word) <= _maxErrors; }
+
+  /** Returns the Hamming distance of two words. */
+  static inline int distance(uint32_t a, uint32_t b) {
+#ifdef __GNUC__
+    return __builtin_popcount(a ^ b);
+#else
+    uint32_t x = a ^ b;
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (((x + (x >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+#endif
+  }
+
+protected:
+  /** The sync word. */
+  uint32_t _word;
+  /** The max. number of bit errors accepted. */
+  int _maxErrors;
+  /** The last bits received. */
+  uint64_t _hist;
 };
 
 
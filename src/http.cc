@@ -1,10 +1,18 @@
 #include "http.hh"
 #include "exception.hh"
 #include "logger.hh"
+#include "buffer.hh"
+#include "latency.hh"
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <strings.h>
+#include <errno.h>
 #include <iomanip>
+#include <cstdio>
+#include <cctype>
 
 using namespace sdr;
 using namespace sdr::http;
@@ -80,61 +88,162 @@ inline bool is_http_version_part(char c) {
   return ( is_alpha_num(c) || ('/'==c) || ('.'==c));
 }
 
-inline http::Method to_method(const std::string &method) {
-  if ("GET" == method) { return http::HTTP_GET; }
-  else if ("HEAD" == method) { return http::HTTP_HEAD; }
-  else if ("POST" == method) { return http::HTTP_POST; }
-  return http::HTTP_UNKNOWN;
-}
-
-inline http::Version to_version(const std::string &version) {
-  if ("HTTP/1.0" == version) { return http::HTTP_1_0; }
-  else if ("HTTP/1.1" == version) { return http::HTTP_1_1; }
-  return http::UNKNOWN_VERSION;
+/** Header names are case-insensitive, turns them into a canonical capitalization, i.e.
+ * "content-length" into "Content-Length". */
+inline std::string canonical_header_name(const std::string &name) {
+  std::string res(name);
+  for (size_t i=0; i<res.size(); i++) {
+    bool first = (0 == i) || ('-' == res[i-1]);
+    if (first && (res[i]>='a') && (res[i]<='z')) { res[i] += 'A'-'a'; }
+    else if ((! first) && (res[i]>='A') && (res[i]<='Z')) { res[i] += 'a'-'A'; }
+  }
+  return res;
 }
 
 
 /* ********************************************************************************************* *
  * Implementation of Server
  * ********************************************************************************************* */
-Server::Server(uint port)
-  : _port(port), _socket(-1), _queue()
+/** The maximum size of the received data of a connection, not processed yet. */
+static const size_t max_input_size = (1<<20);
+/** The maximum size of the data pending to be sent to a client. */
+static const size_t max_output_size = (4<<20);
+/** The size of the data pending to be sent, up to which posted messages are moved to it. */
+static const size_t max_posted_size = (64<<10);
+
+/** Returns the monotonic time in seconds. */
+static time_t monotonic_seconds() {
+  struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+/** Sends as much of the pending data of the connection as possible, the lock of the connection
+ * must be held. Returns @c false on error. */
+static bool flush_output(ConnectionObj *obj) {
+  size_t offset = 0;
+  while (offset < obj->output.size()) {
+    ssize_t res = ::send(obj->socket, obj->output.data()+offset, obj->output.size()-offset,
+                         MSG_NOSIGNAL);
+    if (res > 0) {
+      offset += res; obj->last_active = monotonic_seconds();
+    } else if ((res < 0) && (EINTR == errno)) {
+      continue;
+    } else if ((res < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+      break;
+    } else {
+      obj->output.clear(); obj->sending.clear();
+      return false;
+    }
+  }
+  obj->output.erase(0, offset); obj->flushed += offset;
+  // Record the latencies of the posted messages written completely
+  if (obj->sending.size() && (obj->sending.front().first <= obj->flushed)) {
+    int64_t now = BufferMeta::now();
+    while (obj->sending.size() && (obj->sending.front().first <= obj->flushed)) {
+      const PostedMessage &msg = obj->sending.front().second;
+      msg.latency->record(now - msg.timestamp);
+      obj->sending.pop_front();
+    }
+  }
+  return true;
+}
+
+/** Moves the posted messages of the connection to the output (while the client takes the data)
+ * and sends them. The lock of the connection must be held. Returns @c false on error. */
+static bool send_posted(ConnectionObj *obj) {
+  do {
+    while (obj->queued.size() && (obj->output.size() < max_posted_size)) {
+      PostedMessage &msg = obj->queued.front();
+      obj->output.append(msg.data);
+      if (msg.latency) {
+        msg.data.clear();
+        obj->sending.push_back(std::make_pair(obj->flushed + obj->output.size(), msg));
+      }
+      obj->queued.pop_front();
+    }
+    if (! flush_output(obj)) { return false; }
+  } while (obj->output.empty() && obj->queued.size());
+  return true;
+}
+
+
+Server::Server(uint port, size_t num_workers, int timeout)
+  : _port(port), _socket(-1), _epoll(-1), _wakeup(-1), _is_running(false), _started(false),
+    _workers(), _num_workers(std::max(num_workers, size_t(1))), _timeout(timeout), _handler(),
+    _connections(), _num_connections(0), _queue(), _posted()
 {
   pthread_mutex_init(&_queue_lock, 0);
+  pthread_cond_init(&_queue_cond, 0);
+  pthread_mutex_init(&_posted_lock, 0);
 }
 
 Server::~Server() {
-  _is_running = false;  
+  if (_started) { this->stop(true); }
   // Free all handler
   std::list<Handler *>::iterator item = _handler.begin();
   for (; item != _handler.end(); item++) { delete *item; }
+  pthread_cond_destroy(&_queue_cond);
+  pthread_mutex_destroy(&_queue_lock);
+  pthread_mutex_destroy(&_posted_lock);
 }
 
 void
 Server::start(bool wait) {
-  _socket = socket(AF_INET, SOCK_STREAM, 0);
+  _socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
   if (_socket < 0) {
     ConfigError err;
     err << "httpd: Error opening socket.";
     throw err;
   }
 
+  // Needs to be set before binding the socket
+  int reuseaddr = 1;
+  if (setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(reuseaddr))) {
+    LogMessage msg(LOG_WARNING);
+    msg << "httpd: Can not set SO_REUSEADDR flag for socket.";
+    Logger::get().log(msg);
+  }
+
   struct sockaddr_in serv_addr;
+  socklen_t serv_addr_len = sizeof(serv_addr);
   bzero((char *) &serv_addr, sizeof(serv_addr));
   serv_addr.sin_family = AF_INET;
   serv_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
   serv_addr.sin_port = htons(_port);
   if (bind(_socket, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
+    ::close(_socket); _socket = -1;
     ConfigError err;
-    err << "httpd: Can bind to address.";
+    err << "httpd: Can not bind to address.";
     throw err;
   }
+  // Get the port actually bound to (if any port was requested)
+  if (0 == getsockname(_socket, (struct sockaddr *) &serv_addr, &serv_addr_len)) {
+    _port = ntohs(serv_addr.sin_port);
+  }
 
-  int reuseaddr = 1;
-  if (setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(reuseaddr))) {
-    LogMessage msg(LOG_WARNING);
-    msg << "httpd: Can not set SO_REUSEADDR flag for socket.";
-    Logger::get().log(msg);
+  if (listen(_socket, SOMAXCONN) < 0) {
+    ::close(_socket); _socket = -1;
+    ConfigError err;
+    err << "httpd: Can not listen on port " << _port << ".";
+    throw err;
+  }
+
+  // Setup event loop, waiting for incomming connections and the wakeup signal
+  _epoll  = epoll_create1(EPOLL_CLOEXEC);
+  _wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLET; event.data.fd = _socket;
+  bool ok = (0 <= _epoll) && (0 <= _wakeup) &&
+      (0 == epoll_ctl(_epoll, EPOLL_CTL_ADD, _socket, &event));
+  event.events = EPOLLIN | EPOLLET; event.data.fd = _wakeup;
+  ok = ok && (0 == epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &event));
+  if (! ok) {
+    ::close(_socket); _socket = -1;
+    if (0 <= _epoll) { ::close(_epoll); _epoll = -1; }
+    if (0 <= _wakeup) { ::close(_wakeup); _wakeup = -1; }
+    ConfigError err;
+    err << "httpd: Can not setup event loop.";
+    throw err;
   }
 
   _is_running = true;
@@ -143,6 +252,18 @@ Server::start(bool wait) {
     err << "Can not create listen thread.";
     throw err;
   }
+  _started = true;
+
+  for (size_t i=0; i<_num_workers; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, 0, &Server::_worker_main, this)) {
+      this->stop(true);
+      ConfigError err;
+      err << "Can not create worker thread.";
+      throw err;
+    }
+    _workers.push_back(thread);
+  }
 
   if (wait) { this->wait(); }
 }
@@ -150,21 +271,30 @@ Server::start(bool wait) {
 void
 Server::stop(bool wait) {
   _is_running = false;
-  // Close the socket we listen on
-  ::close(_socket); _socket = -1;
+  // Wake up the event loop, it closes all connections and stops the workers
+  if (0 <= _wakeup) {
+    uint64_t value = 1;
+    if (sizeof(value) != ::write(_wakeup, &value, sizeof(value))) {
+      // pass...
+    }
+  }
   // wait for server to join
   if (wait) { this->wait(); }
 }
 
 void
 Server::wait() {
+  if (! _started) { return; }
   void *ret=0;
   pthread_join(_thread, &ret);
-  // wait for all handlers to join
-  while (_threads.size()) {
-    void *ret = 0;
-    pthread_join(*_threads.begin(), &ret);
+  // wait for all workers to join
+  for (size_t i=0; i<_workers.size(); i++) {
+    pthread_join(_workers[i], &ret);
   }
+  _workers.clear();
+  _started = false;
+  ::close(_epoll); _epoll = -1;
+  ::close(_wakeup); _wakeup = -1;
 }
 
 void *
@@ -172,45 +302,284 @@ Server::_listen_main(void *ctx)
 {
   // Get server instance
   Server *self = (Server *)ctx;
-  // Whil server is running
-  while (self->_is_running)
-  {
-    // Wait for incomming connections
-    listen(self->_socket, 5);
-
-    // Create socket to client
-    struct sockaddr_in cli_addr;
-    socklen_t clilen = sizeof(cli_addr);
-    int socket = accept(self->_socket, (struct sockaddr *) &cli_addr, &clilen);
-    if (socket < 0) { continue; }
-
-    // Construct connection object from socket
-    try {
-      pthread_mutex_lock(&self->_queue_lock);
-      self->_queue.push_back(Connection(self, socket));
-      pthread_t thread;
-      pthread_create(&thread, 0, &Server::_connection_main, self);
-      self->_threads.insert(thread);
-      pthread_mutex_unlock(&self->_queue_lock);
-    } catch (...) {
-      pthread_mutex_unlock(&self->_queue_lock);
+  struct epoll_event events[64];
+  time_t last_check = monotonic_seconds();
+  // While server is running
+  while (self->_is_running) {
+    int n = epoll_wait(self->_epoll, events, 64, 1000);
+    for (int i=0; i<n; i++) {
+      int socket = events[i].data.fd;
+      if (socket == self->_socket) {
+        // Incomming connections
+        self->_accept();
+      } else if (socket == self->_wakeup) {
+        // Wakeup signal, send posted messages
+        uint64_t value;
+        while (0 < ::read(self->_wakeup, &value, sizeof(value))) { }
+        self->_sendPosted();
+      } else {
+        std::map<int, Connection>::iterator item = self->_connections.find(socket);
+        if (self->_connections.end() == item) { continue; }
+        Connection con = item->second;
+        bool keep = (0 == (events[i].events & EPOLLERR));
+        if (keep && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+          keep = self->_read(con);
+        }
+        if (keep && (events[i].events & EPOLLOUT)) { keep = self->_flush(con); }
+        if (! keep) { self->_close(socket); }
+      }
     }
+    // Check for idle connections (once a second)
+    time_t now = monotonic_seconds();
+    if (now != last_check) {
+      self->_timeouts();
+      // Retry pending connections, in case we ran out of file descriptors before
+      self->_accept();
+      last_check = now;
+    }
+  }
+
+  // Close all connections
+  while (self->_connections.size()) {
+    self->_close(self->_connections.begin()->first);
   }
+  ::close(self->_socket); self->_socket = -1;
+  pthread_mutex_lock(&self->_posted_lock);
+  self->_posted.clear();
+  pthread_mutex_unlock(&self->_posted_lock);
+  // Stop workers
+  pthread_mutex_lock(&self->_queue_lock);
+  self->_queue.clear();
+  pthread_cond_broadcast(&self->_queue_cond);
+  pthread_mutex_unlock(&self->_queue_lock);
   return 0;
 }
 
 void *
-Server::_connection_main(void *ctx) {
+Server::_worker_main(void *ctx) {
   Server *self = (Server *)ctx;
-  pthread_mutex_lock(&self->_queue_lock);
-  Connection con = self->_queue.front(); self->_queue.pop_front();
-  pthread_mutex_unlock(&self->_queue_lock);
-  con.main();
-  // Remove thread from list of running threads
-  self->_threads.erase(pthread_self());
+  while (true) {
+    // Wait for the next connection with a pending request
+    pthread_mutex_lock(&self->_queue_lock);
+    while (self->_queue.empty() && self->_is_running) {
+      pthread_cond_wait(&self->_queue_cond, &self->_queue_lock);
+    }
+    if (! self->_is_running) {
+      pthread_mutex_unlock(&self->_queue_lock);
+      break;
+    }
+    Connection con = self->_queue.front(); self->_queue.pop_front();
+    pthread_mutex_unlock(&self->_queue_lock);
+    // Process the request
+    self->_process(con);
+  }
   return 0;
 }
 
+void
+Server::_process(Connection &con) {
+  ConnectionObj *obj = con._object;
+  // Contstruct request & reponse instances
+  Request request(con);
+  Response response(con);
+  bool keep_alive = false;
+  // Take parsed request, on success -> dispatch request
+  if (request.parse()) {
+    this->dispatch(request, response);
+    keep_alive = request.isKeepAlive();
+  }
+
+  bool enqueue = false;
+  pthread_mutex_lock(&obj->lock);
+  if (obj->protocol_upgrade) {
+    // The connection has been taken over by the handler
+    obj->state = ConnectionObj::STATE_UPGRADED;
+    obj->input.clear();
+  } else {
+    obj->state = ConnectionObj::STATE_READ;
+    obj->last_active = monotonic_seconds();
+    if ((! keep_alive) || obj->closing || (-1 == obj->socket) ||
+        (RequestParser::INVALID == obj->parser.parse(obj->input.data(), obj->input.size()))) {
+      // Close connection once the response has been sent
+      obj->closing = true;
+      if ((-1 != obj->socket) && obj->output.empty()) { ::shutdown(obj->socket, SHUT_RDWR); }
+    } else if (RequestParser::COMPLETE == obj->parser.status()) {
+      // Process next (pipelined) request
+      obj->state = ConnectionObj::STATE_PENDING;
+      enqueue = true;
+    }
+  }
+  pthread_mutex_unlock(&obj->lock);
+  if (enqueue) { _enqueue(con); }
+}
+
+void
+Server::_enqueue(const Connection &con) {
+  pthread_mutex_lock(&_queue_lock);
+  _queue.push_back(con);
+  pthread_cond_signal(&_queue_cond);
+  pthread_mutex_unlock(&_queue_lock);
+}
+
+void
+Server::_accept() {
+  while (_is_running) {
+    int socket = accept4(_socket, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (socket < 0) {
+      if (EINTR == errno) { continue; }
+      if ((EAGAIN != errno) && (EWOULDBLOCK != errno)) {
+        LogMessage msg(LOG_DEBUG);
+        msg << "httpd: Can not accept connection: " << strerror(errno);
+        Logger::get().log(msg);
+      }
+      return;
+    }
+    // Wait for incomming data and for the socket to become writeable
+    Connection con(this, socket);
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET; event.data.fd = socket;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, socket, &event)) { continue; }
+    _connections[socket] = con;
+    _num_connections = _connections.size();
+  }
+}
+
+bool
+Server::_read(Connection &con) {
+  ConnectionObj *obj = con._object;
+  char buffer[4096];
+  bool eof = false, keep = true, enqueue = false;
+
+  pthread_mutex_lock(&obj->lock);
+  // Read all available data (edge triggered)
+  while (true) {
+    ssize_t res = ::read(obj->socket, buffer, sizeof(buffer));
+    if (res > 0) {
+      // Data received on upgraded connections is ignored
+      if (ConnectionObj::STATE_UPGRADED != obj->state) { obj->input.append(buffer, res); }
+    } else if ((res < 0) && (EINTR == errno)) {
+      continue;
+    } else if ((res < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+      break;
+    } else {
+      eof = true;
+      break;
+    }
+  }
+  obj->last_active = monotonic_seconds();
+
+  if (obj->input.size() > max_input_size) {
+    LogMessage msg(LOG_DEBUG);
+    msg << "httpd: Request too large on connection " << obj->socket << ".";
+    Logger::get().log(msg);
+    keep = false;
+  } else {
+    // Continue parsing the request, queue complete request
+    RequestParser::Status status = RequestParser::INCOMPLETE;
+    if ((ConnectionObj::STATE_READ == obj->state) && (! obj->closing)) {
+      status = obj->parser.parse(obj->input.data(), obj->input.size());
+    }
+    if (RequestParser::COMPLETE == status) {
+      obj->state = ConnectionObj::STATE_PENDING;
+      enqueue = true;
+    } else if (RequestParser::INVALID == status) {
+      eof = true;
+    }
+    // If a request is being processed, close the connection once the response has been sent
+    if (eof && (ConnectionObj::STATE_PENDING == obj->state)) {
+      obj->closing = true;
+    } else if (eof) {
+      keep = false;
+    }
+  }
+  pthread_mutex_unlock(&obj->lock);
+
+  if (enqueue) { _enqueue(con); }
+  return keep;
+}
+
+bool
+Server::_flush(Connection &con) {
+  ConnectionObj *obj = con._object;
+  pthread_mutex_lock(&obj->lock);
+  bool keep = (-1 != obj->socket) && send_posted(obj);
+  // Close the connection once everything has been sent
+  if (obj->closing && obj->output.empty() && (ConnectionObj::STATE_PENDING != obj->state)) {
+    keep = false;
+  }
+  pthread_mutex_unlock(&obj->lock);
+  return keep;
+}
+
+void
+Server::_close(int socket) {
+  std::map<int, Connection>::iterator item = _connections.find(socket);
+  if (_connections.end() == item) { return; }
+  ConnectionObj *obj = item->second._object;
+  pthread_mutex_lock(&obj->lock);
+  epoll_ctl(_epoll, EPOLL_CTL_DEL, socket, 0);
+  ::close(socket); obj->socket = -1;
+  obj->closing = true;
+  obj->input.clear(); obj->output.clear(); obj->sending.clear();
+  pthread_mutex_unlock(&obj->lock);
+  _connections.erase(item);
+  _num_connections = _connections.size();
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "httpd: Close connection " << socket << ".";
+  Logger::get().log(msg);
+}
+
+void
+Server::_post(const Connection &con) {
+  pthread_mutex_lock(&_posted_lock);
+  _posted.push_back(con);
+  pthread_mutex_unlock(&_posted_lock);
+  // Wake up the event loop
+  uint64_t value = 1;
+  if (sizeof(value) != ::write(_wakeup, &value, sizeof(value))) {
+    // pass...
+  }
+}
+
+void
+Server::_sendPosted() {
+  std::list<Connection> posted;
+  pthread_mutex_lock(&_posted_lock);
+  posted.swap(_posted);
+  pthread_mutex_unlock(&_posted_lock);
+
+  for (std::list<Connection>::iterator con = posted.begin(); con != posted.end(); con++) {
+    ConnectionObj *obj = con->_object;
+    pthread_mutex_lock(&obj->lock);
+    obj->posted = false;
+    int socket = obj->socket;
+    bool keep = (-1 == socket) || send_posted(obj);
+    pthread_mutex_unlock(&obj->lock);
+    if (! keep) { _close(socket); }
+  }
+}
+
+void
+Server::_timeouts() {
+  time_t now = monotonic_seconds();
+  std::list<int> idle;
+  std::map<int, Connection>::iterator item = _connections.begin();
+  for (; item != _connections.end(); item++) {
+    ConnectionObj *obj = item->second._object;
+    pthread_mutex_lock(&obj->lock);
+    bool timeout = (now - obj->last_active) > _timeout;
+    // Close connections waiting for a request and clients not taking the pending data
+    if (timeout && ((ConnectionObj::STATE_READ == obj->state) || obj->output.size())) {
+      idle.push_back(item->first);
+    }
+    pthread_mutex_unlock(&obj->lock);
+  }
+  for (std::list<int>::iterator socket = idle.begin(); socket != idle.end(); socket++) {
+    _close(*socket);
+  }
+}
+
 void
 Server::dispatch(const Request &request, Response &response)
 {
@@ -246,25 +615,35 @@ Server::addHandler(Handler *handler) {
 /* ********************************************************************************************* *
  * Implementation of http::Connection & http::ConnectionObj
  * ********************************************************************************************* */
-ConnectionObj::ConnectionObj(Server *server, int cli_socket)
-  : server(server), socket(cli_socket), refcount(1)
+PostedMessage::PostedMessage(const std::string &data, LatencyHistogram *latency,
+                             int64_t timestamp)
+  : data(data), latency(latency), timestamp(timestamp)
 {
   // pass...
 }
 
+
+ConnectionObj::ConnectionObj(Server *server, int cli_socket)
+  : server(server), socket(cli_socket), protocol_upgrade(false), state(STATE_READ),
+    closing(false), input(), parser(), output(), flushed(0), queued(), sending(), dropped(0),
+    posted(false), last_active(monotonic_seconds()), refcount(1)
+{
+  pthread_mutex_init(&lock, 0);
+}
+
 ConnectionObj::~ConnectionObj() {
-  ::close(socket); socket=-1;
+  if (-1 != socket) { ::close(socket); socket=-1; }
+  pthread_mutex_destroy(&lock);
 }
 
 ConnectionObj *
 ConnectionObj::ref() {
-  refcount++; return this;
+  __sync_add_and_fetch(&refcount, 1); return this;
 }
 
 void
 ConnectionObj::unref() {
-  refcount--;
-  if (0 == refcount) {
+  if (0 == __sync_sub_and_fetch(&refcount, 1)) {
     delete this;
   }
 }
@@ -294,9 +673,9 @@ Connection::~Connection() {
 
 Connection &
 Connection::operator =(const Connection &other) {
+  if (other._object) { other._object->ref(); }
   if (_object) { _object->unref(); }
   _object = other._object;
-  if (_object) { _object->ref(); }
   return *this;
 }
 
@@ -304,60 +683,223 @@ Connection::operator =(const Connection &other) {
 void
 Connection::close(bool wait) {
   if (0 == _object) { return; }
-  if (-1 != _object->socket) {
-    int socket = _object->socket; _object->socket = -1;
-    LogMessage msg(LOG_DEBUG);
-    msg << "httpd: Close connection " << socket << ".";
-    Logger::get().log(msg);
-    ::close(socket);
+  pthread_mutex_lock(&_object->lock);
+  if ((-1 != _object->socket) && (! _object->closing)) {
+    _object->closing = true;
+    // Shutdown the socket now, if there is nothing left to send and no request is being
+    // processed. Otherwise, the server closes the connection later.
+    if (_object->output.empty() && (ConnectionObj::STATE_PENDING != _object->state)) {
+      ::shutdown(_object->socket, SHUT_RDWR);
+    }
   }
+  pthread_mutex_unlock(&_object->lock);
 }
 
 bool
 Connection::isClosed() const {
   if (0 == _object) { return true; }
-  return (-1 == _object->socket);
+  pthread_mutex_lock(&_object->lock);
+  bool closed = (-1 == _object->socket) || _object->closing;
+  pthread_mutex_unlock(&_object->lock);
+  return closed;
+}
+
+ssize_t
+Connection::write(const void *data, size_t n) const {
+  if (! send(std::string((const char *)data, n))) { return -1; }
+  return n;
+}
+
+ssize_t
+Connection::read(void *data, size_t n) const {
+  if (0 == _object) { return -1; }
+  pthread_mutex_lock(&_object->lock);
+  n = std::min(n, _object->input.size());
+  if (n) {
+    memcpy(data, _object->input.data(), n);
+    _object->input.erase(0, n);
+  }
+  pthread_mutex_unlock(&_object->lock);
+  return n ? ssize_t(n) : -1;
+}
+
+bool
+Connection::post(const std::string &message, size_t max_queued, LatencyHistogram *latency,
+                 int64_t timestamp) const {
+  if (0 == _object) { return false; }
+  if (latency && (0 == timestamp)) { timestamp = BufferMeta::now(); }
+  bool notify = false;
+  pthread_mutex_lock(&_object->lock);
+  bool ok = (-1 != _object->socket) && (! _object->closing);
+  if (ok) {
+    _object->queued.push_back(PostedMessage(message, latency, timestamp));
+    // Drop oldest messages
+    while (_object->queued.size() > max_queued) {
+      _object->queued.pop_front(); _object->dropped++;
+    }
+    notify = ! _object->posted;
+    _object->posted = true;
+  }
+  pthread_mutex_unlock(&_object->lock);
+  if (notify) { _object->server->_post(*this); }
+  return ok;
+}
+
+size_t
+Connection::queued() const {
+  if (0 == _object) { return 0; }
+  pthread_mutex_lock(&_object->lock);
+  size_t n = _object->queued.size();
+  pthread_mutex_unlock(&_object->lock);
+  return n;
+}
+
+uint64_t
+Connection::dropped() const {
+  if (0 == _object) { return 0; }
+  pthread_mutex_lock(&_object->lock);
+  uint64_t n = _object->dropped;
+  pthread_mutex_unlock(&_object->lock);
+  return n;
+}
+
+size_t
+Connection::pending() const {
+  if (0 == _object) { return 0; }
+  pthread_mutex_lock(&_object->lock);
+  size_t n = _object->output.size();
+  pthread_mutex_unlock(&_object->lock);
+  return n;
 }
 
 bool
 Connection::send(const std::string &data) const {
-  const char *ptr = data.c_str();
-  size_t count = data.size();
-  while (count) {
-    int c = this->write(ptr, count);
-    if (c < 0) { return false; }
-    count -= c; ptr += c;
+  if (0 == _object) { return false; }
+  pthread_mutex_lock(&_object->lock);
+  bool ok = (-1 != _object->socket);
+  if (ok) {
+    _object->output.append(data);
+    ok = flush_output(_object);
   }
-  return true;
+  if (ok && (_object->output.size() > max_output_size)) {
+    // Client does not take the data fast enough
+    LogMessage msg(LOG_DEBUG);
+    msg << "httpd: Client too slow on connection " << _object->socket << ".";
+    Logger::get().log(msg);
+    ok = false;
+  }
+  if ((! ok) && (-1 != _object->socket)) {
+    // Let the server close the connection
+    _object->closing = true; _object->output.clear(); _object->sending.clear();
+    ::shutdown(_object->socket, SHUT_RDWR);
+  }
+  pthread_mutex_unlock(&_object->lock);
+  return ok;
 }
 
 
-void
-Connection::main()
+/* ********************************************************************************************* *
+ * Implementation of http::EventStream
+ * ********************************************************************************************* */
+EventStream::EventStream(size_t queue_size, LatencyHistogram *latency)
+  : _queue_size(queue_size), _latency(latency), _clients()
 {
-  int error = 0; socklen_t errorlen = sizeof(error);
-  // While socket is open
-  while (0 == getsockopt(_object->socket, SOL_SOCKET, SO_ERROR, &error, &errorlen)) {
-    // Contstruct request & reponse instances
-    Request request(*this);
-    Response response(*this);
-    // try to parse request
-    if (! request.parse()) {
-      // On parser error close connection -> exit
-      this->close(false); return;
-    }
-    // on success -> dispatch request by server
-    _object->server->dispatch(request, response);
-    // on protocol update
-    if (this->protocolUpgrade()) { return; }
-    // If the connection is keep-alive -> continue
-    if (! request.isKeepAlive()) {
-      // close connection -> exit
-      this->close(false); return;
+  pthread_mutex_init(&_lock, 0);
+}
+
+EventStream::~EventStream() {
+  std::list<Connection>::iterator client = _clients.begin();
+  for (; client != _clients.end(); client++) {
+    client->close();
+  }
+  _clients.clear();
+  pthread_mutex_destroy(&_lock);
+}
+
+void
+EventStream::handle(const Request &request, Response &response) {
+  // Start the event stream, the server keeps the connection open
+  response.setHeader("Content-Type", "text/event-stream");
+  response.setHeader("Cache-Control", "no-cache");
+  response.setStatus(http::Response::STATUS_OK);
+  if (! response.sendHeaders()) { return; }
+  response.connection().setProtocolUpgrade();
+  // Store connection
+  pthread_mutex_lock(&_lock);
+  _clients.push_back(response.connection());
+  pthread_mutex_unlock(&_lock);
+}
+
+void
+EventStream::publish(const std::string &data, const std::string &event, int64_t timestamp) {
+  // Serialize event once
+  std::string message;
+  if (event.size()) { message.append("event: ").append(event).append("\n"); }
+  size_t offset = 0;
+  while (offset <= data.size()) {
+    size_t end = data.find('\n', offset);
+    if (std::string::npos == end) { end = data.size(); }
+    message.append("data: ").append(data, offset, end-offset).append("\n");
+    offset = end+1;
+  }
+  message.append("\n");
+
+  // Post to all clients, remove closed ones
+  pthread_mutex_lock(&_lock);
+  std::list<Connection>::iterator client = _clients.begin();
+  while (client != _clients.end()) {
+    if (client->post(message, _queue_size, _latency, timestamp)) {
+      client++;
+    } else {
+      client = _clients.erase(client);
     }
   }
-  // Close connection
-  this->close(false);
+  pthread_mutex_unlock(&_lock);
+}
+
+size_t
+EventStream::numClients() {
+  pthread_mutex_lock(&_lock);
+  // Remove closed clients
+  std::list<Connection>::iterator client = _clients.begin();
+  while (client != _clients.end()) {
+    if (client->isClosed()) { client = _clients.erase(client); }
+    else { client++; }
+  }
+  size_t n = _clients.size();
+  pthread_mutex_unlock(&_lock);
+  return n;
+}
+
+std::vector<EventStream::ClientStats>
+EventStream::clientStats() {
+  std::vector<ClientStats> stats;
+  pthread_mutex_lock(&_lock);
+  std::list<Connection>::iterator client = _clients.begin();
+  for (; client != _clients.end(); client++) {
+    if (client->isClosed()) { continue; }
+    ClientStats item;
+    item.queued  = client->queued();
+    item.dropped = client->dropped();
+    item.pending = client->pending();
+    stats.push_back(item);
+  }
+  pthread_mutex_unlock(&_lock);
+  return stats;
+}
+
+void
+EventStream::toJSON(JSON &obj) {
+  std::vector<ClientStats> stats = clientStats();
+  std::list<JSON> clients;
+  for (size_t i=0; i<stats.size(); i++) {
+    std::map<std::string, JSON> item;
+    item["queued"]  = JSON(double(stats[i].queued));
+    item["dropped"] = JSON(double(stats[i].dropped));
+    item["pending"] = JSON(double(stats[i].pending));
+    clients.push_back(JSON(item));
+  }
+  obj = JSON(clients);
 }
 
 
@@ -501,165 +1043,207 @@ URL::decode(const std::string &str) {
 
 
 /* ********************************************************************************************* *
- * Implementation of HTTPD::Request
+ * Implementation of HTTPD::RequestParser
  * ********************************************************************************************* */
-typedef enum {
-  READ_METHOD,
-  START_URL, READ_URL,
-  START_HTTP_VERSION, READ_HTTP_VERSION,
-  REQUEST_END,
-  START_HEADER, READ_HEADER, START_HEADER_VALUE, READ_HEADER_VALUE, END_HEADER,
-  END_HEADERS
-} HttpRequestParserState;
-
+bool
+RequestParser::Slice::equals(const char *data, const char *str) const {
+  return (strlen(str) == length) && (0 == strncasecmp(data+offset, str, length));
+}
 
-Request::Request(const Connection &connection)
-  : _connection(connection), _method(HTTP_UNKNOWN)
+RequestParser::RequestParser()
+  : _headers()
 {
-  // pass...
+  reset();
+}
+
+void
+RequestParser::reset() {
+  _state = READ_METHOD; _status = INCOMPLETE; _offset = 0;
+  _token = _value = _url = _body = Slice();
+  _method = HTTP_UNKNOWN; _version = UNKNOWN_VERSION;
+  _headers.clear();
+  _length = 0;
+}
+
+RequestParser::Status
+RequestParser::_invalid(const char *data, const char *what) {
+  LogMessage msg(LOG_DEBUG);
+  msg << "http: Got invalid " << what << " '"
+      << std::string(data+_token.offset, _offset-_token.offset) << "'.";
+  Logger::get().log(msg);
+  return _status = INVALID;
 }
 
 bool
-Request::parse() {
-  char c;
-  std::stringstream buffer;
-  std::string current_header_name;
-  HttpRequestParserState state = READ_METHOD;
+RequestParser::_parseContentLength(const char *data) {
+  // Only plain decimal numbers are accepted, the body must fit into the input buffer
+  if (0 == _value.length) { return false; }
+  size_t length = 0;
+  for (size_t i=0; i<_value.length; i++) {
+    char c = data[_value.offset+i];
+    if (('0' > c) || ('9' < c)) { return false; }
+    length = 10*length + (c-'0');
+    if (length > max_input_size) { return false; }
+  }
+  _body.length = length;
+  return true;
+}
+
+RequestParser::Status
+RequestParser::parse(const char *data, size_t size) {
+  if (INCOMPLETE != _status) { return _status; }
 
-  // while getting a char from stream
-  while (_connection.read(&c, 1)) {
-    switch (state) {
+  // Continue with the next byte not parsed yet
+  for (; (_offset < size) && (READ_BODY != _state); _offset++) {
+    char c = data[_offset];
+    switch (_state) {
     case READ_METHOD:
       if (is_space(c)) {
-        // Get method enum
-        _method = to_method(buffer.str());
-        if (HTTP_UNKNOWN == _method) {
-          LogMessage msg(LOG_DEBUG);
-          msg << "http: Got unexpected method '"<<buffer.str() << "'.";
-          Logger::get().log(msg);
-          return false;
-        }
-        state = START_URL; buffer.str("");
-      } else if (is_alpha_num(c)) {
-        buffer << c;
-      } else {
-        return false;
+        _token.length = _offset-_token.offset;
+        if (_token.equals(data, "GET")) { _method = HTTP_GET; }
+        else if (_token.equals(data, "HEAD")) { _method = HTTP_HEAD; }
+        else if (_token.equals(data, "POST")) { _method = HTTP_POST; }
+        else { return _invalid(data, "method"); }
+        _state = START_URL;
+      } else if (! is_alpha_num(c)) {
+        return _invalid(data, "method");
       }
       break;
 
     case START_URL:
-      if (is_space(c)) {
-        continue;
-      } else if (is_url_part(c)) {
-        state = READ_URL; buffer << c;
-      } else {
-        return false;
+      if (is_url_part(c)) {
+        _url.offset = _offset; _state = READ_URL;
+      } else if (! is_space(c)) {
+        return _invalid(data, "URL");
       }
       break;
 
     case READ_URL:
       if (is_space(c)) {
-        state = START_HTTP_VERSION;
-        _url = URL::fromString(buffer.str()); buffer.str("");
-      } else if (is_url_part(c)) {
-        buffer << c;
-      } else {
-        return false;
+        _url.length = _offset-_url.offset; _state = START_HTTP_VERSION;
+      } else if (! is_url_part(c)) {
+        return _invalid(data, "URL");
       }
       break;
 
     case START_HTTP_VERSION:
-      if (is_space(c)) {
-        continue;
-      } else if (is_http_version_part(c)) {
-        buffer << c; state = READ_HTTP_VERSION;
-      } else {
-        return false;
+      if (is_http_version_part(c)) {
+        _token.offset = _offset; _state = READ_HTTP_VERSION;
+      } else if (! is_space(c)) {
+        return _invalid(data, "version");
       }
       break;
 
     case READ_HTTP_VERSION:
       if (is_cr(c)) {
-        _version = to_version(buffer.str()); buffer.str();
-        if (UNKNOWN_VERSION == _version) {
-          LogMessage msg(LOG_DEBUG);
-          msg << "http: Got invalid version '"<< buffer.str() << "'.";
-          Logger::get().log(msg);
-          return false;
-        }
-        state = REQUEST_END;
-      } else if (is_http_version_part(c)) {
-        buffer << c;
-      } else {
-        return false;
+        _token.length = _offset-_token.offset;
+        if (_token.equals(data, "HTTP/1.0")) { _version = HTTP_1_0; }
+        else if (_token.equals(data, "HTTP/1.1")) { _version = HTTP_1_1; }
+        else { return _invalid(data, "version"); }
+        _state = REQUEST_END;
+      } else if (! is_http_version_part(c)) {
+        return _invalid(data, "version");
       }
       break;
 
     case REQUEST_END:
-      if (is_nl(c)) {
-        state = START_HEADER;
-      } else {
-        return false;
-      }
+    case END_HEADER:
+      if (! is_nl(c)) { return _status = INVALID; }
+      _state = START_HEADER;
       break;
 
     case START_HEADER:
       if (is_cr(c)) {
-        state = END_HEADERS;
+        _state = END_HEADERS;
       } else if (is_header_part(c)) {
-        buffer << c;
-        state = READ_HEADER;
+        _token.offset = _offset; _state = READ_HEADER;
       } else {
-        return false;
+        return _status = INVALID;
       }
       break;
 
     case READ_HEADER:
-      if (is_header_part(c)) {
-        buffer << c;
-      } else if (is_colon(c)) {
-        current_header_name = buffer.str(); buffer.str("");
-        state = START_HEADER_VALUE;
-      } else {
-        return false;
+      if (is_colon(c)) {
+        _token.length = _offset-_token.offset; _state = START_HEADER_VALUE;
+      } else if (! is_header_part(c)) {
+        return _invalid(data, "header");
       }
       break;
 
     case START_HEADER_VALUE:
-      if (is_space(c)) {
+    case READ_HEADER_VALUE:
+      if (is_cr(c)) {
+        // Store header, strip trailing white spaces
+        if (START_HEADER_VALUE == _state) { _value.offset = _offset; }
+        _value.length = _offset-_value.offset;
+        while (_value.length && is_space(data[_value.offset+_value.length-1])) { _value.length--; }
+        _headers.push_back(std::make_pair(_token, _value));
+        if (_token.equals(data, "Content-Length") && (! _parseContentLength(data))) {
+          return _invalid(data, "content length");
+        }
+        _state = END_HEADER;
+      } else if ((START_HEADER_VALUE == _state) && is_space(c)) {
         continue;
       } else if (is_header_value_part(c)) {
-        buffer << c; state = READ_HEADER_VALUE;
+        if (START_HEADER_VALUE == _state) { _value.offset = _offset; _state = READ_HEADER_VALUE; }
       } else {
-        return false;
+        return _status = INVALID;
       }
       break;
 
-    case READ_HEADER_VALUE:
-      if (is_header_value_part(c)) {
-        buffer << c;
-      } else if (is_cr(c)) {
-        state = END_HEADER;
-      } else {
-        return false;
-      }
+    case END_HEADERS:
+      if (! is_nl(c)) { return _status = INVALID; }
+      _body.offset = _offset+1; _state = READ_BODY;
       break;
 
-    case END_HEADER:
-      if (is_nl(c)) {
-        _headers[current_header_name] = buffer.str(); buffer.str("");
-        state = START_HEADER;
-      } else {
-        return false;
-      }
+    case READ_BODY:
       break;
+    }
+  }
 
-    case END_HEADERS:
-      if (is_nl(c)) { return true; }
-      return false;
+  // The body is complete once enough data has been received
+  if ((READ_BODY == _state) && (size >= (_body.offset+_body.length))) {
+    _length = _body.offset + _body.length;
+    _offset = _length;
+    _status = COMPLETE;
+  }
+  return _status;
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of HTTPD::Request
+ * ********************************************************************************************* */
+Request::Request(const Connection &connection)
+  : _connection(connection), _method(HTTP_UNKNOWN)
+{
+  // pass...
+}
+
+bool
+Request::parse() {
+  ConnectionObj *obj = _connection._object;
+  if (0 == obj) { return false; }
+
+  pthread_mutex_lock(&obj->lock);
+  RequestParser &parser = obj->parser;
+  bool ok = (RequestParser::COMPLETE == parser.status());
+  if (ok) {
+    const char *data = obj->input.data();
+    _method  = parser.method();
+    _version = parser.version();
+    _url     = URL::fromString(parser.url().str(data));
+    for (size_t i=0; i<parser.numHeaders(); i++) {
+      _headers[canonical_header_name(parser.headerName(i).str(data))] =
+          parser.headerValue(i).str(data);
     }
+    _body = parser.body().str(data);
+    // Remove request from received data
+    obj->input.erase(0, parser.length());
+    parser.reset();
   }
-  return false;
+  pthread_mutex_unlock(&obj->lock);
+  return ok;
 }
 
 bool
@@ -675,25 +1259,20 @@ Request::isKeepAlive() const {
 
 bool
 Request::hasHeader(const std::string &name) const {
-  return (0 != _headers.count(name));
+  return (0 != _headers.count(canonical_header_name(name)));
 }
 
 std::string
 Request::header(const std::string &name) const {
-  std::map<std::string, std::string>::const_iterator item = _headers.find(name);
+  std::map<std::string, std::string>::const_iterator item =
+      _headers.find(canonical_header_name(name));
   return item->second;
 }
 
 bool
 Request::readBody(std::string &body) const {
   if (! hasContentLength()) { return false; }
-  size_t N = contentLength(); body.reserve(N);
-  char buffer[65536];
-  while (N>0) {
-    int res = _connection.read(buffer, std::min(N, size_t(65536)));
-    if (res>=0) { body.append(buffer, size_t(res)); N -= res; }
-    else { return false; }
-  }
+  body = _body;
   return true;
 }
 
@@ -822,12 +1401,14 @@ JSONHandler::handle(const http::Request &request, http::Response &response) {
     response.setStatus(http::Response::STATUS_BAD_REQUEST);
     response.setContentLength(0);
     response.sendHeaders();
+    return;
   }
   JSON obj;
   if (!JSON::parse(body, obj)) {
     response.setStatus(http::Response::STATUS_BAD_REQUEST);
     response.setContentLength(0);
     response.sendHeaders();
+    return;
   }
 
   JSON result;
@@ -930,6 +1511,8 @@ JSON::clear() {
   _type = EMPTY;
 }
 
+void _json_serialize_string(std::ostream &stream, const std::string &str);
+
 void
 JSON::serialize(std::ostream &stream) const {
   switch (_type) {
@@ -942,17 +1525,15 @@ JSON::serialize(std::ostream &stream) const {
     else { stream << "false"; }
     break;
 
-  case NUMBER:
-    stream << *_value.number;
-    break;
+  case NUMBER: {
+    // Use as few digits as needed to restore the number exactly
+    char buffer[32]; snprintf(buffer, 32, "%.15g", *_value.number);
+    if (strtod(buffer, 0) != *_value.number) { snprintf(buffer, 32, "%.17g", *_value.number); }
+    stream << buffer;
+  } break;
 
   case STRING:
-    stream << "\"";
-    for (size_t i=0; i<_value.string->size(); i++) {
-      if ('"' == _value.string->at(i)) { stream << "\\\""; }
-      else { stream << _value.string->at(i); }
-    }
-    stream << "\"";
+    _json_serialize_string(stream, *_value.string);
     break;
 
   case ARRAY:
@@ -971,9 +1552,11 @@ JSON::serialize(std::ostream &stream) const {
     stream << "{";
     if (0 < _value.table->size()) {
       std::map<std::string, JSON>::iterator item = _value.table->begin();
-      stream << item->first << ":"; item->second.serialize(stream); item++;
+      _json_serialize_string(stream, item->first);
+      stream << ":"; item->second.serialize(stream); item++;
       for (; item != _value.table->end(); item++) {
-        stream << "," << item->first << ":"; item->second.serialize(stream);
+        stream << ","; _json_serialize_string(stream, item->first);
+        stream << ":"; item->second.serialize(stream);
       }
     }
     stream << "}";
@@ -981,6 +1564,22 @@ JSON::serialize(std::ostream &stream) const {
   }
 }
 
+void
+_json_serialize_string(std::ostream &stream, const std::string &str) {
+  stream << "\"";
+  for (size_t i=0; i<str.size(); i++) {
+    if (('"' == str[i]) || ('\\' == str[i])) { stream << "\\" << str[i]; }
+    else if ('\n' == str[i]) { stream << "\\n"; }
+    else if (0x20 > (unsigned char)str[i]) {
+      // Other control characters must be escaped too
+      char code[7]; snprintf(code, sizeof(code), "\\u%04x", (unsigned int)str[i]);
+      stream << code;
+    }
+    else { stream << str[i]; }
+  }
+  stream << "\"";
+}
+
 void
 _json_skip_ws(const char *&text, size_t &n) {
   while ((n>0) && is_ws(*text)) { text++; n--; }
@@ -1012,9 +1611,9 @@ bool
 _json_parse_false(const char *&text, size_t &n, JSON &obj) {
   if ((n<5) || (0 != strncmp(text, "false", 5))) { return false; }
   text+=5; n-=5;
+  obj = JSON(false);
   if (0 == n) { return true; }
   if (! is_alpha_num(*text)) { return true; }
-  obj = JSON(false);
   return false;
 }
 
@@ -1024,7 +1623,24 @@ _json_parse_string(const char *&text, size_t &n, JSON &obj) {
   text++; n--; // skip '"'
   bool escape = false;
   while (n > 0) {
-    if (escape) { buffer << *text; escape = false; }
+    if (escape && ('u' == *text)) {
+      // Unicode escape, the code point gets stored UTF-8 encoded
+      unsigned int code = 0;
+      for (size_t i=0; i<4; i++) {
+        text++; n--;
+        if ((0 == n) || (! isxdigit(*text))) { return false; }
+        code = 16*code + (is_num(*text) ? (*text-'0') : ((*text|0x20)-'a'+10));
+      }
+      if (code < 0x80) {
+        buffer << char(code);
+      } else if (code < 0x800) {
+        buffer << char(0xc0|(code>>6)) << char(0x80|(code&0x3f));
+      } else {
+        buffer << char(0xe0|(code>>12)) << char(0x80|((code>>6)&0x3f)) << char(0x80|(code&0x3f));
+      }
+      escape = false;
+    }
+    else if (escape) { buffer << (('n' == *text) ? '\n' : *text); escape = false; }
     else if (('\\' == *text) && (!escape)) { escape = true; }
     else if ('"' == *text) { text++; n--; obj = JSON(buffer.str()); return true;}
     else { buffer << *text; }
@@ -1080,7 +1696,11 @@ _json_parse_table(const char *&text, size_t &n, JSON &obj) {
   std::string name;
   JSON tmp;
   while (n>0) {
-    if (! _json_parse_identifier(text, n, name)) { return false; }
+    // Keys are strings, bare identifiers are accepted too
+    if ('"' == *text) {
+      if (! _json_parse_string(text, n, tmp)) { return false; }
+      name = tmp.asString();
+    } else if (! _json_parse_identifier(text, n, name)) { return false; }
     _json_skip_ws(text, n);
     if (0 == n) { return false; }
     if (':' != *text) { return false; }
@@ -1089,7 +1709,7 @@ _json_parse_table(const char *&text, size_t &n, JSON &obj) {
     table[name] = tmp;
     _json_skip_ws(text, n);
     if (0 == n) { return false; }
-    if (']'==*text) { text++; n--; obj = JSON(table); return true; }
+    if ('}'==*text) { text++; n--; obj = JSON(table); return true; }
     if (',' != *text) { return false; }
     text++; n--; _json_skip_ws(text, n);
   }
@@ -1099,9 +1719,9 @@ _json_parse_table(const char *&text, size_t &n, JSON &obj) {
 bool
 _json_parse_number(const char *&text, size_t &n, JSON &obj) {
   const char *ptr = text;
-  double value = strtof(text, (char **)&ptr);
+  double value = strtod(text, (char **)&ptr);
   if (text == ptr) { return false; }
-  obj = JSON(value); text=ptr; n-=(ptr-text);
+  obj = JSON(value); n-=(ptr-text); text=ptr;
   return true;
 }
 
@@ -66,14 +66,22 @@
 #include <map>
 #include <set>
 #include <list>
+#include <deque>
+#include <vector>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <pthread.h>
+#include <time.h>
 
 
 namespace sdr {
+
+// Forward declarations
+class LatencyHistogram;
+
 namespace http {
 
 // Forward declarations
@@ -251,8 +259,145 @@ protected:
 };
 
 
+/** Incremental parser of HTTP requests.
+ *
+ * The parser works on the buffer of the data received from a client and can be resumed after
+ * more data has been appended to the buffer. Hence it never waits for data and examines each
+ * byte only once, which allows an event loop to detect complete requests. The parts of the
+ * request (URL, headers and body) are not copied but referenced as slices of the buffer.
+ * @ingroup http */
+class RequestParser
+{
+public:
+  /** The possible parser states. */
+  typedef enum {
+    INCOMPLETE,  ///< More data is needed.
+    COMPLETE,    ///< A complete request has been parsed.
+    INVALID      ///< The request is invalid.
+  } Status;
+
+  /** References a part of the buffer by offset and length (like a string view). The offset
+   * remains valid if the buffer gets reallocated while data is appended. */
+  class Slice
+  {
+  public:
+    /** Constructor. */
+    Slice(size_t offset=0, size_t length=0) : offset(offset), length(length) { }
+    /** Returns a copy of the referenced part of the buffer. */
+    inline std::string str(const char *data) const { return std::string(data+offset, length); }
+    /** Returns @c true if the referenced part equals the given string, ignoring the case. */
+    bool equals(const char *data, const char *str) const;
+
+  public:
+    /** The offset within the buffer. */
+    size_t offset;
+    /** The length of the slice. */
+    size_t length;
+  };
+
+public:
+  /** Constructor. */
+  RequestParser();
+
+  /** Resets the parser to parse the next request at the beginning of the buffer. */
+  void reset();
+  /** Continues parsing the given buffer. The buffer must start with the data passed to
+   * previous calls. */
+  Status parse(const char *data, size_t size);
+
+  /** Returns the parser status. */
+  inline Status status() const { return _status; }
+  /** Returns the size of the complete request in bytes, including the body. */
+  inline size_t length() const { return _length; }
+  /** Returns the request method. */
+  inline Method method() const { return _method; }
+  /** Returns the HTTP version. */
+  inline Version version() const { return _version; }
+  /** Returns the request URL. */
+  inline const Slice &url() const { return _url; }
+  /** Returns the number of headers. */
+  inline size_t numHeaders() const { return _headers.size(); }
+  /** Returns the name of the i-th header. */
+  inline const Slice &headerName(size_t i) const { return _headers[i].first; }
+  /** Returns the value of the i-th header. */
+  inline const Slice &headerValue(size_t i) const { return _headers[i].second; }
+  /** Returns the body of the request. */
+  inline const Slice &body() const { return _body; }
+
+protected:
+  /** The states of the parser. */
+  typedef enum {
+    READ_METHOD,
+    START_URL, READ_URL,
+    START_HTTP_VERSION, READ_HTTP_VERSION,
+    REQUEST_END,
+    START_HEADER, READ_HEADER, START_HEADER_VALUE, READ_HEADER_VALUE, END_HEADER,
+    END_HEADERS, READ_BODY
+  } State;
+
+  /** Signals an invalid request. */
+  Status _invalid(const char *data, const char *what);
+  /** Parses the value of the Content-Length header into the length of the body. Returns
+   * @c false if the value is not a decimal number or exceeds the size of the input buffer. */
+  bool _parseContentLength(const char *data);
+
+protected:
+  /** The current state. */
+  State _state;
+  /** The parser status. */
+  Status _status;
+  /** The offset of the next byte to parse. */
+  size_t _offset;
+  /** The current token (method, version or header name). */
+  Slice _token;
+  /** The current header value. */
+  Slice _value;
+  /** The request method. */
+  Method _method;
+  /** The HTTP version. */
+  Version _version;
+  /** The request URL. */
+  Slice _url;
+  /** The headers. */
+  std::vector< std::pair<Slice, Slice> > _headers;
+  /** The request body. */
+  Slice _body;
+  /** The size of the complete request. */
+  size_t _length;
+};
+
+
+/** The shared state of a connection.
+ * @ingroup http */
+/** A message posted to a connection (see @c Connection::post).
+ * @ingroup http */
+class PostedMessage
+{
+public:
+  /** Constructor. */
+  PostedMessage(const std::string &data, LatencyHistogram *latency, int64_t timestamp);
+
+public:
+  /** The message. */
+  std::string data;
+  /** If set, the time from @c timestamp until the message has been written to the socket is
+   * recorded into this histogram. */
+  LatencyHistogram *latency;
+  /** The reference time of the latency in ns since the epoch (see @c BufferMeta::now). */
+  int64_t timestamp;
+};
+
+
 struct ConnectionObj
 {
+public:
+  /** The possible states of a connection. */
+  typedef enum {
+    STATE_READ,     ///< Waiting for a complete request.
+    STATE_PENDING,  ///< A request has been queued or is being processed by a worker.
+    STATE_UPGRADED  ///< The connection has been taken over by a handler.
+  } State;
+
 public:
   ConnectionObj(Server *server, int cli_socket);
   ~ConnectionObj();
@@ -263,18 +408,48 @@ public:
 public:
   /** A weak reference to the server instance. */
   Server *server;
-  /** The connection socket. */
+  /** The connection socket, -1 if closed. */
   int socket;
-  /** If @c true (i.e. set by a handler), the http parser thread will exit without closing
-   * the connection. This allows to "take-over" the tcp connection to the client by the request
-   * handler. */
+  /** If @c true (i.e. set by a handler), the connection will not be closed nor read after the
+   * request has been processed. This allows to "take-over" the tcp connection to the client by
+   * the request handler. */
   bool protocol_upgrade;
+  /** The state of the connection. */
+  State state;
+  /** If @c true, the connection gets closed once all pending data has been sent. */
+  bool closing;
+  /** Received data, not processed yet. */
+  std::string input;
+  /** Parses the received data. */
+  RequestParser parser;
+  /** Data to be sent, once the socket gets writeable. */
+  std::string output;
+  /** The number of bytes taken from the output, i.e. written to the socket. */
+  uint64_t flushed;
+  /** Messages posted to the connection, not moved to the output yet. */
+  std::deque<PostedMessage> queued;
+  /** Posted messages with a latency histogram, moved to the output but not sent completely yet,
+   * by the position of their end in the output stream (see @c flushed). */
+  std::deque< std::pair<uint64_t, PostedMessage> > sending;
+  /** The number of posted messages dropped. */
+  uint64_t dropped;
+  /** If @c true, the connection has been scheduled for sending the posted messages. */
+  bool posted;
+  /** The time of the last activity (monotonic, in seconds). */
+  time_t last_active;
+  /** Guards the state, buffers and socket. */
+  pthread_mutex_t lock;
   /** Reference counter. */
   size_t refcount;
 };
 
 
 /** Implements a HTTP connection to a client.
+ *
+ * The socket is non-blocking. Received data gets buffered and parsed by the server, @c read takes
+ * the data following the request being processed from that buffer. Data sent is written
+ * immediately if possible, otherwise it gets buffered and is sent by the server once the socket
+ * becomes writeable again. Hence, sending to a slow client never blocks.
  * @c ingroup http */
 class Connection
 {
@@ -290,34 +465,45 @@ public:
 
   Connection &operator=(const Connection &other);
 
-  /** Closes the connection.
-   * If @c wait is @c true, the method will wait until the thread listening for incomming
-   * request joined. */
+  /** Closes the connection once all pending data has been sent. */
   void close(bool wait=false);
-  /** Returns @c true if the connection is closed. */
+  /** Returns @c true if the connection is closed or being closed. */
   bool isClosed() const;
 
   /** Sets the protocol-update flag. */
   inline void setProtocolUpgrade() const { _object->protocol_upgrade = true; }
   inline bool protocolUpgrade() const { return _object->protocol_upgrade; }
 
-  inline ssize_t write(const void *data, size_t n) const {
-    if (0 == _object) { return -1; }
-    return ::write(_object->socket, data, n);
-  }
-
-  inline ssize_t read(void *data, size_t n) const {
-    if (0 == _object) { return -1; }
-    return ::read(_object->socket, data, n);
-  }
+  /** Sends the given data, returns the number of bytes or -1 on error. */
+  ssize_t write(const void *data, size_t n) const;
+  /** Reads up to @c n bytes of the received data. Returns the number of bytes or -1 if no data
+   * is available. */
+  ssize_t read(void *data, size_t n) const;
 
+  /** Sends the given data, returns @c false if the connection is closed or the client does not
+   * take the data fast enough. */
   bool send(const std::string &data) const;
-
-  /** Main loop for incomming requests. */
-  void main();
+  /** Posts a message to the connection. The message gets sent by the server thread, hence this
+   * call never touches the socket. If more than @c max_queued messages are waiting to be sent
+   * (i.e. the client is slow), the oldest one is dropped. If @c latency is given, the time from
+   * @c timestamp (in ns since the epoch, 0 means now) until the message has been written to the
+   * socket gets recorded. Returns @c false if the connection is closed. */
+  bool post(const std::string &message, size_t max_queued=64, LatencyHistogram *latency=0,
+            int64_t timestamp=0) const;
+
+  /** Returns the number of posted messages waiting to be sent. */
+  size_t queued() const;
+  /** Returns the number of posted messages dropped. */
+  uint64_t dropped() const;
+  /** Returns the number of bytes waiting to be sent. */
+  size_t pending() const;
 
 protected:
   ConnectionObj *_object;
+
+  /* Allow the server and requests to access the connection state. */
+  friend class Server;
+  friend class Request;
 };
 
 
@@ -329,7 +515,8 @@ public:
   /** Constructor. */
   Request(const Connection &connection);
 
-  /** Parses the HTTP request header, returns @c true on success. */
+  /** Takes the request parsed from the data received by the connection (see @c RequestParser)
+   * and removes it from the received data. Returns @c true on success. */
   bool parse();
 
   /** Return the connection to the client. */
@@ -339,7 +526,7 @@ public:
      * has been send. */
   bool isKeepAlive() const;
 
-  /** Returns @c true if the given header is present. */
+  /** Returns @c true if the given header is present. Header names are case-insensitive. */
   bool hasHeader(const std::string &name) const;
   /** Returns the value of the given header. */
   std::string header(const std::string &name) const;
@@ -353,7 +540,7 @@ public:
   inline Method method() const { return _method; }
   /** Returns the request URL. */
   inline const URL &url() const { return _url; }
-  /** Reads the complete body (if Content-Length header is present).
+  /** Returns the complete body (if Content-Length header is present).
    * Retruns @c true on success.*/
   bool readBody(std::string &body) const;
 
@@ -368,6 +555,8 @@ protected:
   URL _url;
   /** The request headers. */
   std::map<std::string, std::string> _headers;
+  /** The request body. */
+  std::string _body;
 };
 
 
@@ -547,13 +736,22 @@ protected:
 
 
 /** Implements a trivial HTTP/1.1 server.
+ *
+ * A single thread waits for incoming connections and data on all connections (using an
+ * edge-triggered epoll event loop). Once a complete request has been received, it gets processed
+ * by one of a fixed number of worker threads. Hence the number of threads does not depend on the
+ * number of clients. Connections are kept alive between requests, idle connections get closed
+ * after a timeout. Connections taken over by a handler (e.g. server-sent events, see
+ * @c Connection::setProtocolUpgrade) are kept open until the client or the handler closes them.
  * @ingroup http */
 class Server
 {
 public:
   /** Constructor.
-   * @param port Specifies the port number to listen on. */
-  Server(uint port);
+   * @param port Specifies the port number to listen on. If 0, any free port is used.
+   * @param num_workers Specifies the number of worker threads processing the requests.
+   * @param timeout Specifies the time in seconds, after which idle connections get closed. */
+  Server(uint port, size_t num_workers=4, int timeout=30);
   /** Destructor. */
   ~Server();
 
@@ -568,6 +766,11 @@ public:
   /** Wait for the server thread to join. */
   void wait();
 
+  /** Returns the port the server listens on. */
+  inline uint port() const { return _port; }
+  /** Returns the number of open connections. */
+  inline size_t numConnections() const { return _num_connections; }
+
   /** Adds a generic handler to the dispatcher. */
   void addHandler(Handler *handler);
   /** Adds a delegate to the dispatcher. */
@@ -594,33 +797,138 @@ public:
 protected:
   /** Dispatches a request. */
   void dispatch(const Request &request, Response &response);
-  /** The thread waiting for incomming connections. */
+  /** Processes the next request of the given connection (called by the workers). */
+  void _process(Connection &con);
+  /** Queues the connection for processing of the next request. */
+  void _enqueue(const Connection &con);
+  /** Accepts all pending connections (called by the event loop). */
+  void _accept();
+  /** Reads all available data from the connection (called by the event loop). Returns
+   * @c false if the connection has to be closed. */
+  bool _read(Connection &con);
+  /** Sends the pending data of the connection (called by the event loop). Returns @c false if
+   * the connection has to be closed. */
+  bool _flush(Connection &con);
+  /** Closes the connection and removes it from the event loop. */
+  void _close(int socket);
+  /** Schedules sending the posted messages of the connection and wakes the event loop. */
+  void _post(const Connection &con);
+  /** Sends the posted messages of all scheduled connections (called by the event loop). */
+  void _sendPosted();
+  /** Closes idle connections. */
+  void _timeouts();
+  /** The event loop. */
   static void *_listen_main(void *ctx);
-  /** The thread handling connections. */
-  static void *_connection_main(void *ctx);
+  /** The worker threads processing requests. */
+  static void *_worker_main(void *ctx);
 
 protected:
   /** Port to bind to. */
   uint _port;
   /** The socket to listen on. */
   int _socket;
+  /** The epoll instance. */
+  int _epoll;
+  /** An event fd to wake up the event loop. */
+  int _wakeup;
   /** While true, the server is listening on the port for incomming connections. */
-  bool _is_running;
+  volatile bool _is_running;
+  /** If @c true, the threads have been started and need to be joined. */
+  bool _started;
   /** The listen thread. */
   pthread_t _thread;
+  /** The worker threads. */
+  std::vector<pthread_t> _workers;
+  /** The number of worker threads. */
+  size_t _num_workers;
+  /** The timeout for idle connections in seconds. */
+  int _timeout;
   /** All registered handler. */
   std::list<Handler *> _handler;
-  /** The connection queue. */
+  /** All open connections by socket (only accessed by the event loop). */
+  std::map<int, Connection> _connections;
+  /** The number of open connections. */
+  volatile size_t _num_connections;
+  /** The queue of connections with pending requests. */
   std::list<Connection> _queue;
   /** The queue lock. */
   pthread_mutex_t _queue_lock;
-  /** The set of handler threads. */
-  std::set<pthread_t> _threads;
-
-  /* Allow Connection to access dispatch(). */
+  /** Signals the workers that there are pending requests. */
+  pthread_cond_t _queue_cond;
+  /** Connections with posted messages. */
+  std::list<Connection> _posted;
+  /** Guards the list of connections with posted messages. */
+  pthread_mutex_t _posted_lock;
+
+  /* Allow Connection to schedule posted messages. */
   friend class Connection;
 };
 
+
+/** A hub of server-sent events (SSE).
+ *
+ * Clients subscribe by a GET request to the handler (@c handle). Events published by the
+ * application are serialized once and posted to all clients (see @c Connection::post). Hence,
+ * publishing never blocks nor touches a socket, the events are sent by the server thread. Each
+ * client has a bounded queue of events. If a client does not take the events fast enough, the
+ * oldest events get dropped.
+ * @code
+ * http::EventStream events;
+ * server.addHandler("/update", &events, &http::EventStream::handle);
+ * ...
+ * events.publish("{\"call\": \"DM3MAT\"}");
+ * @endcode
+ * @ingroup http */
+class EventStream
+{
+public:
+  /** The lag metrics of a client. */
+  class ClientStats {
+  public:
+    /** The number of events waiting to be sent. */
+    size_t queued;
+    /** The number of events dropped. */
+    uint64_t dropped;
+    /** The number of bytes waiting to be sent. */
+    size_t pending;
+  };
+
+public:
+  /** Constructor.
+   * @param queue_size Specifies the maximum number of events queued for each client.
+   * @param latency If given, the delay of each event until it has been written to the socket of
+   *        a client gets recorded into this histogram. */
+  EventStream(size_t queue_size=64, LatencyHistogram *latency=0);
+  /** Destructor, closes the connections to all clients. */
+  virtual ~EventStream();
+
+  /** Handler accepting a new client, starts the event stream. */
+  void handle(const Request &request, Response &response);
+  /** Publishes an event to all clients. Multi-line data gets split into several data lines.
+   * @param data Specifies the data of the event.
+   * @param event Specifies the optional event type.
+   * @param timestamp Specifies the reference time of the latency in ns since the epoch (e.g. the
+   *        capture time of the decoded signal), 0 means now. */
+  void publish(const std::string &data, const std::string &event="", int64_t timestamp=0);
+
+  /** Returns the number of connected clients. */
+  size_t numClients();
+  /** Returns the lag metrics of all connected clients. */
+  std::vector<ClientStats> clientStats();
+  /** Serializes the lag metrics of all clients as a JSON list. */
+  void toJSON(JSON &obj);
+
+protected:
+  /** The maximum number of queued events per client. */
+  size_t _queue_size;
+  /** The histogram of the event latencies, may be 0. */
+  LatencyHistogram *_latency;
+  /** The connected clients. */
+  std::list<Connection> _clients;
+  /** Guards the list of clients. */
+  pthread_mutex_t _lock;
+};
+
 }
 
 }
@@ -0,0 +1,413 @@
+#include "iqfile.hh"
+#include "http.hh"
+#include "logger.hh"
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace sdr;
+
+
+/** Returns the current time in seconds since 1970-01-01 UTC. */
+static double
+_iqfile_now() {
+  struct timeval tv; gettimeofday(&tv, 0);
+  return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+/** Formats the given time as ISO 8601 (UTC). */
+static std::string
+_iqfile_format_time(double t) {
+  time_t sec = std::floor(t); struct tm tm; gmtime_r(&sec, &tm);
+  char buffer[64]; strftime(buffer, 64, "%Y-%m-%dT%H:%M:%S", &tm);
+  char frac[16]; snprintf(frac, 16, ".%06dZ", int(1e6*(t-sec)));
+  return std::string(buffer) + frac;
+}
+
+/** Parses the given ISO 8601 (UTC) time, returns 0 on error. */
+static double
+_iqfile_parse_time(const std::string &str) {
+  struct tm tm; memset(&tm, 0, sizeof(tm)); double sec = 0;
+  if (6 != sscanf(str.c_str(), "%d-%d-%dT%d:%d:%lf", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                  &tm.tm_hour, &tm.tm_min, &sec)) { return 0; }
+  tm.tm_year -= 1900; tm.tm_mon -= 1; tm.tm_sec = 0;
+  return timegm(&tm) + sec;
+}
+
+/** Returns the named entry of the given JSON table or null. */
+static http::JSON
+_iqfile_get(const http::JSON &table, const std::string &key) {
+  if (! table.isTable()) { return http::JSON(); }
+  std::map<std::string, http::JSON>::const_iterator item = table.asTable().find(key);
+  if (table.asTable().end() == item) { return http::JSON(); }
+  return item->second;
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of IQFileMeta
+ * ********************************************************************************************* */
+IQFileMeta::IQFileMeta()
+  : type(Config::Type_UNDEFINED), sampleRate(0), frequency(0), startTime(0), interval(0), index()
+{
+  // pass...
+}
+
+std::string
+IQFileMeta::basename(const std::string &filename) {
+  const char *ext[] = { ".sigmf-data", ".sigmf-meta", ".sigmf" };
+  for (size_t i=0; i<3; i++) {
+    size_t n = strlen(ext[i]);
+    if ((filename.size() > n) && (0 == filename.compare(filename.size()-n, n, ext[i]))) {
+      return filename.substr(0, filename.size()-n);
+    }
+  }
+  return filename;
+}
+
+std::string
+IQFileMeta::datatype(Config::Type type) {
+  switch (type) {
+  case Config::Type_cu8: return "cu8";
+  case Config::Type_cs16: return "ci16_le";
+  case Config::Type_cf32: return "cf32_le";
+  default: break;
+  }
+  return "";
+}
+
+Config::Type
+IQFileMeta::typeId(const std::string &datatype) {
+  if ("cu8" == datatype) { return Config::Type_cu8; }
+  if ("ci16_le" == datatype) { return Config::Type_cs16; }
+  if ("cf32_le" == datatype) { return Config::Type_cf32; }
+  return Config::Type_UNDEFINED;
+}
+
+void
+IQFileMeta::load(const std::string &filename) {
+  std::ifstream file(filename.c_str());
+  if (! file.is_open()) {
+    RuntimeError err;
+    err << "Can not open metadata file '" << filename << "'.";
+    throw err;
+  }
+  std::stringstream buffer; buffer << file.rdbuf();
+  http::JSON meta;
+  if ((! http::JSON::parse(buffer.str(), meta)) || (! meta.isTable())) {
+    RuntimeError err;
+    err << "Invalid metadata file '" << filename << "'.";
+    throw err;
+  }
+
+  // Global section
+  http::JSON global = _iqfile_get(meta, "global");
+  http::JSON value = _iqfile_get(global, "core:datatype");
+  type = value.isString() ? IQFileMeta::typeId(value.asString()) : Config::Type_UNDEFINED;
+  if (Config::Type_UNDEFINED == type) {
+    RuntimeError err;
+    err << "Unsupported or missing datatype in metadata file '" << filename << "'.";
+    throw err;
+  }
+  value = _iqfile_get(global, "core:sample_rate");
+  sampleRate = value.isNumber() ? value.asNumber() : 0;
+  if (0 >= sampleRate) {
+    RuntimeError err;
+    err << "Invalid or missing sample rate in metadata file '" << filename << "'.";
+    throw err;
+  }
+  value = _iqfile_get(global, "libsdr:index_interval");
+  interval = value.isNumber() ? value.asNumber() : 0;
+
+  // First capture segment
+  http::JSON captures = _iqfile_get(meta, "captures");
+  frequency = 0; startTime = 0;
+  if (captures.isArray() && captures.asArray().size()) {
+    value = _iqfile_get(captures.asArray().front(), "core:frequency");
+    if (value.isNumber()) { frequency = value.asNumber(); }
+    value = _iqfile_get(captures.asArray().front(), "core:datetime");
+    if (value.isString()) { startTime = _iqfile_parse_time(value.asString()); }
+  }
+
+  // Timestamp index
+  index.clear();
+  http::JSON annotations = _iqfile_get(meta, "annotations");
+  if (annotations.isArray()) {
+    std::list<http::JSON>::const_iterator item = annotations.asArray().begin();
+    for (; item != annotations.asArray().end(); item++) {
+      http::JSON time = _iqfile_get(*item, "libsdr:time");
+      http::JSON start = _iqfile_get(*item, "core:sample_start");
+      if (time.isNumber() && start.isNumber()) {
+        index.push_back(std::make_pair(time.asNumber(), uint64_t(start.asNumber())));
+      }
+    }
+  }
+}
+
+bool
+IQFileMeta::save(const std::string &filename) const {
+  std::map<std::string, http::JSON> global, capture, annotation;
+  global["core:datatype"] = datatype(type);
+  global["core:sample_rate"] = sampleRate;
+  global["core:version"] = std::string("1.0.0");
+  global["core:recorder"] = std::string("libsdr");
+  global["libsdr:index_interval"] = interval;
+
+  capture["core:sample_start"] = 0.0;
+  capture["core:frequency"] = frequency;
+  capture["core:datetime"] = _iqfile_format_time(startTime);
+
+  std::list<http::JSON> annotations;
+  for (size_t i=0; i<index.size(); i++) {
+    annotation["core:sample_start"] = double(index[i].second);
+    annotation["core:label"] = std::string("time");
+    annotation["libsdr:time"] = index[i].first;
+    annotations.push_back(annotation);
+  }
+
+  std::map<std::string, http::JSON> meta;
+  meta["global"] = global;
+  meta["captures"] = std::list<http::JSON>(1, capture);
+  meta["annotations"] = annotations;
+
+  // Write into a temporary file and replace the metadata
+  std::string tmp = filename + ".tmp";
+  std::ofstream file(tmp.c_str());
+  if (! file.is_open()) { return false; }
+  http::JSON(meta).serialize(file); file << std::endl;
+  file.close();
+  if (file.fail()) { return false; }
+  return 0 == rename(tmp.c_str(), filename.c_str());
+}
+
+uint64_t
+IQFileMeta::sample(double offset) const {
+  if (offset <= 0) { return 0; }
+  // Without index, assume there are no gaps
+  if ((0 >= interval) || (0 == index.size())) {
+    return offset*sampleRate;
+  }
+  // The i-th entry of the index holds the time (and sample) at about startTime+i*interval
+  size_t i = std::min(size_t(offset/interval), index.size()-1);
+  // The entries are not exactly on the grid, pick the last one before the given time
+  double t = startTime + offset;
+  while ((i > 0) && (index[i].first > t)) { i--; }
+  return index[i].second + std::max(0.0, (t-index[i].first)*sampleRate);
+}
+
+
+double
+IQFileMeta::time(uint64_t sample) const {
+  if (0 >= sampleRate) { return 0; }
+  if (0 == index.size()) { return sample/sampleRate; }
+  // Find the last entry before the given sample
+  size_t a = 0, b = index.size();
+  while ((b-a) > 1) {
+    size_t c = (a+b)/2;
+    if (index[c].second > sample) { b = c; } else { a = c; }
+  }
+  if (index[a].second > sample) { return sample/sampleRate; }
+  return (index[a].first-startTime) + (sample-index[a].second)/sampleRate;
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of IQFileWriter
+ * ********************************************************************************************* */
+IQFileWriter::IQFileWriter(const std::string &filename, Config::Type type, double frequency,
+                           double interval, size_t ringSize)
+  : FileWriter(ringSize), _metaFile(IQFileMeta::basename(filename)+".sigmf-meta"),
+    _sampleSize(0), _meta(), _count(0), _next(0), _modified(true)
+{
+  switch (type) {
+  case Config::Type_cu8: _sampleSize = 2; break;
+  case Config::Type_cs16: _sampleSize = 4; break;
+  case Config::Type_cf32: _sampleSize = 8; break;
+  default: {
+    ConfigError err;
+    err << "Can not configure IQFileWriter: Unsupported type " << type
+        << ", expected complex uint8, complex int16 or complex float.";
+    throw err;
+  }
+  }
+  _meta.type = type; _meta.frequency = frequency; _meta.interval = interval;
+  pthread_mutex_init(&_metaLock, NULL);
+  _open(IQFileMeta::basename(filename)+".sigmf-data", 0);
+}
+
+IQFileWriter::~IQFileWriter() {
+  close();
+  pthread_mutex_destroy(&_metaLock);
+}
+
+void
+IQFileWriter::setSampleRate(double rate) {
+  pthread_mutex_lock(&_metaLock);
+  _meta.sampleRate = rate; _modified = true;
+  pthread_mutex_unlock(&_metaLock);
+}
+
+bool
+IQFileWriter::writeSamples(const char *data, size_t len) {
+  if (! write(data, len)) { return false; }
+
+  // Update timestamp index, the buffer was received just now
+  double now = _iqfile_now();
+  size_t n = len/_sampleSize;
+  if ((0 == _count) || (now >= _next)) {
+    pthread_mutex_lock(&_metaLock);
+    if (0 == _count) {
+      // Time of the first sample
+      _meta.startTime = now - (_meta.sampleRate ? n/_meta.sampleRate : 0);
+      _meta.index.push_back(std::make_pair(_meta.startTime, uint64_t(0)));
+      _next = _meta.startTime + _meta.interval;
+    }
+    _count += n;
+    // Add an entry for every grid point passed
+    while ((0 < _meta.interval) && (_next <= now)) {
+      uint64_t sample = _count - std::min(double(_count), (now-_next)*_meta.sampleRate);
+      sample = std::max(sample, _meta.index.back().second);
+      _meta.index.push_back(std::make_pair(_next, sample));
+      _next += _meta.interval;
+    }
+    _modified = true;
+    pthread_mutex_unlock(&_metaLock);
+  } else {
+    _count += n;
+  }
+  return true;
+}
+
+void
+IQFileWriter::_update(bool final) {
+  pthread_mutex_lock(&_metaLock);
+  if (_modified || final) {
+    if (! _meta.save(_metaFile)) {
+      LogMessage msg(LOG_ERROR);
+      msg << "IQFileWriter: Can not write metadata file " << _metaFile << ".";
+      Logger::get().log(msg);
+    }
+    _modified = false;
+  }
+  pthread_mutex_unlock(&_metaLock);
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of IQFileSource
+ * ********************************************************************************************* */
+IQFileSource::IQFileSource(size_t buffer_size)
+  : Source(), _meta(), _buffer_size(buffer_size), _sampleSize(1), _count(0),
+    _map(), _map_size(0), _offset(0)
+{
+  // pass...
+}
+
+IQFileSource::IQFileSource(const std::string &filename, size_t buffer_size)
+  : Source(), _meta(), _buffer_size(buffer_size), _sampleSize(1), _count(0),
+    _map(), _map_size(0), _offset(0)
+{
+  open(filename);
+}
+
+IQFileSource::~IQFileSource() {
+  close();
+}
+
+void
+IQFileSource::open(const std::string &filename) {
+  close();
+
+  std::string base = IQFileMeta::basename(filename);
+  _meta.load(base + ".sigmf-meta");
+  switch (_meta.type) {
+  case Config::Type_cu8: _sampleSize = 2; break;
+  case Config::Type_cs16: _sampleSize = 4; break;
+  default: _sampleSize = 8; break;
+  }
+
+  // Map data file
+  std::string dataFile = base + ".sigmf-data";
+  struct stat info; int fd = ::open(dataFile.c_str(), O_RDONLY);
+  if ((0 > fd) || (0 != fstat(fd, &info))) {
+    if (0 <= fd) { ::close(fd); }
+    RuntimeError err;
+    err << "Can not open I/Q file '" << dataFile << "': " << strerror(errno);
+    throw err;
+  }
+  if (size_t(info.st_size) < _sampleSize) {
+    // Nothing to replay and an empty file can not be mapped
+    ::close(fd);
+    RuntimeError err;
+    err << "I/Q file '" << dataFile << "' contains no samples.";
+    throw err;
+  }
+  _map_size = info.st_size; _count = _map_size/_sampleSize; _offset = 0;
+  _map = RawBuffer::map(fd, _map_size);
+  ::close(fd);
+  if (_map.isEmpty()) {
+    _map_size = 0; _count = 0;
+    RuntimeError err;
+    err << "Can not map I/Q file '" << dataFile << "': " << strerror(errno);
+    throw err;
+  }
+  madvise(_map.ptr(), _map_size, MADV_SEQUENTIAL);
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured IQFileSource:" << std::endl
+      << " file: " << dataFile << std::endl
+      << " type: "  << _meta.type << std::endl
+      << " sample-rate: " << _meta.sampleRate << std::endl
+      << " frequency: " << _meta.frequency << std::endl
+      << " sample-count: " << _count << std::endl
+      << " duration: " << _count/_meta.sampleRate << "s" << std::endl
+      << " buffer-size: " << _buffer_size;
+  Logger::get().log(msg);
+
+  this->setConfig(Config(_meta.type, _meta.sampleRate, _buffer_size, 1));
+}
+
+void
+IQFileSource::close() {
+  // The file gets unmapped once all views sent are released
+  if (isOpen()) { _map.unref(); _map = RawBuffer(); _map_size = 0; }
+  _count = 0; _offset = 0;
+}
+
+bool
+IQFileSource::seek(double offset) {
+  uint64_t sample = _meta.sample(offset);
+  if ((! isOpen()) || (sample >= _count)) { return false; }
+  _offset = sample*_sampleSize;
+  // The data will be read from here on
+  madvise(_map.ptr() + (_offset & ~size_t(sysconf(_SC_PAGESIZE)-1)),
+          std::min(_map_size-_offset, size_t(8u<<20)), MADV_WILLNEED);
+  return true;
+}
+
+void
+IQFileSource::next() {
+  if ((! isOpen()) || (_offset >= _map_size)) {
+    signalEOS();
+    return;
+  }
+  size_t n = std::min(_buffer_size*_sampleSize, ((_map_size-_offset)/_sampleSize)*_sampleSize);
+  if (0 == n) { _offset = _map_size; signalEOS(); return; }
+  // Send a view into the mapping stamped with the time of recording, the view keeps the mapping
+  // alive
+  RawBuffer buffer(_map, _offset, n);
+  uint64_t sample = _offset/_sampleSize;
+  buffer.setMeta(BufferMeta(sample, int64_t(1e9*(_meta.startTime+_meta.time(sample))),
+                            _meta.sampleRate));
+  this->send(buffer, false);
+  _offset += n;
+}
@@ -0,0 +1,229 @@
+#ifndef __SDR_IQFILE_HH__
+#define __SDR_IQFILE_HH__
+
+#include "node.hh"
+#include "filewriter.hh"
+#include <vector>
+#include <string>
+
+
+namespace sdr {
+
+/** The metadata of a raw I/Q recording, stored in a SigMF-style JSON sidecar next to the data
+ * file. For a recording @c name, the data is stored in @c name.sigmf-data and the metadata in
+ * @c name.sigmf-meta.
+ *
+ * Besides the sample type, sample rate, center frequency and start time of the recording, the
+ * metadata contains an index of timestamps (stored as annotations), mapping wall-clock times on a
+ * regular grid to sample positions within the data file. This allows to seek to a point in time
+ * in O(1), even if the recording has gaps (e.g. due to dropped buffers).
+ * @ingroup sources */
+class IQFileMeta
+{
+public:
+  /** Constructor. */
+  IQFileMeta();
+
+  /** Returns the base name of a recording, i.e. the file name without the SigMF extension. */
+  static std::string basename(const std::string &filename);
+  /** Returns the SigMF datatype of the given sample type or an empty string if the type is not
+   * supported. */
+  static std::string datatype(Config::Type type);
+  /** Returns the sample type of the given SigMF datatype or @c Config::Type_UNDEFINED if the
+   * datatype is not supported. */
+  static Config::Type typeId(const std::string &datatype);
+
+  /** Reads the metadata from the given file.
+   * @throws RuntimeError If the file can not be read or is invalid. */
+  void load(const std::string &filename);
+  /** Writes the metadata into the given file. The file gets replaced atomically.
+   * Returns @c false on error. */
+  bool save(const std::string &filename) const;
+
+  /** Returns the index of the sample recorded @c offset seconds after the start of the
+   * recording. */
+  uint64_t sample(double offset) const;
+  /** Returns the time in seconds after the start of the recording, the given sample was
+   * recorded at. */
+  double time(uint64_t sample) const;
+
+public:
+  /** The sample type. */
+  Config::Type type;
+  /** The sample rate. */
+  double sampleRate;
+  /** The center frequency. */
+  double frequency;
+  /** The time of the first sample (seconds since 1970-01-01 UTC). */
+  double startTime;
+  /** The interval of the timestamp index in seconds. */
+  double interval;
+  /** The timestamp index, pairs of time and sample index. The i-th entry holds the sample
+   * recorded at about @c startTime+i*interval. */
+  std::vector< std::pair<double, uint64_t> > index;
+};
+
+
+/** Asynchronous writer of raw I/Q recordings, used by @c IQFileSink. The metadata sidecar is
+ * rewritten whenever the timestamp index grows, hence the recording remains usable if the
+ * process gets killed.
+ * @ingroup sinks */
+class IQFileWriter: public FileWriter
+{
+public:
+  /** Constructor.
+   * @param filename Specifies the name of the recording.
+   * @param type Specifies the sample type.
+   * @param frequency Specifies the center frequency.
+   * @param interval Specifies the interval of the timestamp index in seconds.
+   * @param ringSize Specifies the size of the ring buffer in bytes.
+   * @throws ConfigError If the files can not be opened for output. */
+  IQFileWriter(const std::string &filename, Config::Type type, double frequency=0,
+               double interval=10, size_t ringSize=(32u<<20));
+  /** Destructor, closes the file if not done yet. */
+  virtual ~IQFileWriter();
+
+  /** Sets the sample rate. */
+  void setSampleRate(double rate);
+  /** Queues some samples to be written and updates the timestamp index.
+   * Returns @c false if the data was dropped. */
+  bool writeSamples(const char *data, size_t len);
+
+protected:
+  /** Rewrites the metadata if needed. */
+  virtual void _update(bool final);
+
+protected:
+  /** The name of the metadata file. */
+  std::string _metaFile;
+  /** The size of a sample in bytes. */
+  size_t _sampleSize;
+  /** The metadata. */
+  IQFileMeta _meta;
+  /** The number of samples written. */
+  uint64_t _count;
+  /** The time of the next index entry. */
+  double _next;
+  /** If @c true, the metadata has been modified since it was saved. */
+  bool _modified;
+  /** Protects the metadata. */
+  pthread_mutex_t _metaLock;
+};
+
+
+/** Stores the received I/Q buffers into a raw SigMF-style recording. The data is written
+ * asynchronously by a @c IQFileWriter. Supported sample types are @c std::complex<uint8_t>
+ * (RTL native), @c std::complex<int16_t> and @c std::complex<float>.
+ * @ingroup sinks */
+template <class Scalar>
+class IQFileSink: public Sink<Scalar>
+{
+public:
+  /** Constructor.
+   * @param filename Specifies the name of the recording.
+   * @param frequency Specifies the center frequency stored in the metadata.
+   * @param interval Specifies the interval of the timestamp index in seconds.
+   * @throws ConfigError If the files can not be opened or the type is not supported. */
+  IQFileSink(const std::string &filename, double frequency=0, double interval=10)
+    : Sink<Scalar>(), _writer(filename, Config::typeId<Scalar>(), frequency, interval)
+  {
+    // pass...
+  }
+
+  /** Destructor, closes the file if not done yet. */
+  virtual ~IQFileSink() {
+    this->close();
+  }
+
+  /** Configures the sink. */
+  virtual void config(const Config &src_cfg) {
+    // Requires type, samplerate
+    if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
+    // Check if type matches
+    if (Config::typeId<Scalar>() != src_cfg.type()) {
+      ConfigError err;
+      err << "Can not configure IQFileSink: Invalid buffer type " << src_cfg.type()
+          << ", expected " << Config::typeId<Scalar>();
+      throw err;
+    }
+    // Store sample rate
+    _writer.setSampleRate(src_cfg.sampleRate());
+  }
+
+  /** Completes the metadata and closes the files. */
+  void close() {
+    _writer.close();
+  }
+
+  /** Writes some data into the recording. */
+  virtual void process(const Buffer<Scalar> &buffer, bool allow_overwrite) {
+    _writer.writeSamples(buffer.data(), buffer.size()*sizeof(Scalar));
+  }
+
+protected:
+  /** The asynchronous writer. */
+  IQFileWriter _writer;
+};
+
+
+/** Replays a raw SigMF-style I/Q recording. The data file gets mapped into memory and the
+ * buffers emitted by @c next are views into the mapping. Hence, these buffers are only valid until
+ * the recording gets closed and they are sent with @c allow_overwrite=false. The source gets
+ * configured from the metadata.
+ * @ingroup sources */
+class IQFileSource: public Source
+{
+public:
+  /** Constructor, @c buffer_size specified the output buffer size. */
+  IQFileSource(size_t buffer_size=1024);
+  /** Constructor with file name, @c buffer_size specified the output buffer size. */
+  IQFileSource(const std::string &filename, size_t buffer_size=1024);
+  /** Destructor. */
+  virtual ~IQFileSource();
+
+  /** Returns @c true if the recording is open. */
+  inline bool isOpen() const { return ! _map.isEmpty(); }
+  /** Opens the given recording.
+   * @throws RuntimeError If the recording can not be opened. */
+  void open(const std::string &filename);
+  /** Closes the recording. */
+  void close();
+
+  /** Returns the metadata of the recording. */
+  inline const IQFileMeta &meta() const { return _meta; }
+  /** Returns the center frequency of the recording. */
+  inline double frequency() const { return _meta.frequency; }
+  /** Returns the time of the first sample (seconds since 1970-01-01 UTC). */
+  inline double startTime() const { return _meta.startTime; }
+  /** Returns the number of samples of the recording. */
+  inline uint64_t sampleCount() const { return _count; }
+  /** Returns the index of the next sample. */
+  inline uint64_t position() const { return _offset/_sampleSize; }
+
+  /** Seeks to the sample recorded @c offset seconds after the start of the recording. Returns
+   * @c false if the offset is outside of the recording. */
+  bool seek(double offset);
+
+  /** Sends the next buffer. */
+  void next();
+
+protected:
+  /** The metadata. */
+  IQFileMeta _meta;
+  /** The output buffer size in samples. */
+  size_t _buffer_size;
+  /** The size of a sample in bytes. */
+  size_t _sampleSize;
+  /** The number of samples. */
+  uint64_t _count;
+  /** The memory mapping of the data file, empty if not open. */
+  RawBuffer _map;
+  /** The size of the mapping. */
+  size_t _map_size;
+  /** The offset of the next sample within the mapping. */
+  size_t _offset;
+};
+
+}
+
+#endif // __SDR_IQFILE_HH__
@@ -0,0 +1,187 @@
+#include "latency.hh"
+#include "http.hh"
+#include <cmath>
+
+using namespace sdr;
+
+
+/* ********************************************************************************************* *
+ * Implementation of LatencyHistogram
+ * ********************************************************************************************* */
+LatencyHistogram::LatencyHistogram()
+  : _count(0), _sum(0), _min(~uint64_t(0)), _max(0)
+{
+  for (size_t i=0; i<NumBuckets; i++) { _buckets[i] = 0; }
+}
+
+size_t
+LatencyHistogram::bucket(uint64_t value) {
+  // Values below 64 get their own bucket
+  if (value < 64) { return value; }
+  // Otherwise, 32 buckets per power of two
+  size_t msb = 63 - __builtin_clzll(value);
+  size_t shift = msb-5;
+  return 64 + (msb-6)*32 + ((value>>shift)-32);
+}
+
+uint64_t
+LatencyHistogram::lowerBound(size_t bucket) {
+  if (bucket < 64) { return bucket; }
+  size_t shift = (bucket-64)/32 + 1;
+  return uint64_t(32 + (bucket-64)%32) << shift;
+}
+
+uint64_t
+LatencyHistogram::upperBound(size_t bucket) {
+  if (bucket < 64) { return bucket; }
+  size_t shift = (bucket-64)/32 + 1;
+  return lowerBound(bucket) + ((uint64_t(1)<<shift)-1);
+}
+
+void
+LatencyHistogram::record(int64_t ns) {
+  uint64_t value = (ns > 0) ? uint64_t(ns) : 0;
+  __sync_fetch_and_add(&_buckets[bucket(value)], 1);
+  __sync_fetch_and_add(&_sum, value);
+  __sync_fetch_and_add(&_count, 1);
+  uint64_t old = _min;
+  while ((value < old) && !__sync_bool_compare_and_swap(&_min, old, value)) { old = _min; }
+  old = _max;
+  while ((value > old) && !__sync_bool_compare_and_swap(&_max, old, value)) { old = _max; }
+}
+
+void
+LatencyHistogram::reset() {
+  for (size_t i=0; i<NumBuckets; i++) { _buckets[i] = 0; }
+  _count = _sum = _max = 0; _min = ~uint64_t(0);
+  __sync_synchronize();
+}
+
+uint64_t
+LatencyHistogram::percentile(double p) const {
+  uint64_t count = 0;
+  for (size_t i=0; i<NumBuckets; i++) { count += _buckets[i]; }
+  if (0 == count) { return 0; }
+  // Rank of the requested value
+  uint64_t rank = std::ceil(std::max(0.0, std::min(1.0, p))*count);
+  if (0 == rank) { rank = 1; }
+  for (size_t i=0; i<NumBuckets; i++) {
+    if (_buckets[i] >= rank) { return std::min(upperBound(i), uint64_t(_max)); }
+    rank -= _buckets[i];
+  }
+  return _max;
+}
+
+void
+LatencyHistogram::toJSON(http::JSON &obj) const {
+  std::map<std::string, http::JSON> table;
+  table["count"] = http::JSON(double(count()));
+  table["min"]   = http::JSON(double(min()));
+  table["max"]   = http::JSON(double(max()));
+  table["mean"]  = http::JSON(mean());
+  table["p50"]   = http::JSON(double(percentile(0.5)));
+  table["p90"]   = http::JSON(double(percentile(0.9)));
+  table["p99"]   = http::JSON(double(percentile(0.99)));
+  table["p999"]  = http::JSON(double(percentile(0.999)));
+  // Non-empty buckets as [upper bound, count] pairs
+  std::list<http::JSON> buckets;
+  for (size_t i=0; i<NumBuckets; i++) {
+    uint64_t n = _buckets[i];
+    if (0 == n) { continue; }
+    std::list<http::JSON> item;
+    item.push_back(http::JSON(double(upperBound(i))));
+    item.push_back(http::JSON(double(n)));
+    buckets.push_back(http::JSON(item));
+  }
+  table["buckets"] = http::JSON(buckets);
+  obj = http::JSON(table);
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of LatencyMonitor
+ * ********************************************************************************************* */
+LatencyMonitor *LatencyMonitor::_instance = 0;
+
+LatencyMonitor::LatencyMonitor()
+  : _histograms()
+{
+  pthread_mutex_init(&_lock, 0);
+}
+
+LatencyMonitor::~LatencyMonitor() {
+  std::map<std::string, LatencyHistogram *>::iterator item = _histograms.begin();
+  for (; item != _histograms.end(); item++) {
+    delete item->second;
+  }
+  _histograms.clear();
+  pthread_mutex_destroy(&_lock);
+}
+
+LatencyMonitor &
+LatencyMonitor::get() {
+  if (0 == _instance) { _instance = new LatencyMonitor(); }
+  return *_instance;
+}
+
+LatencyHistogram *
+LatencyMonitor::histogram(const std::string &name) {
+  pthread_mutex_lock(&_lock);
+  LatencyHistogram *hist = 0;
+  std::map<std::string, LatencyHistogram *>::iterator item = _histograms.find(name);
+  if (item != _histograms.end()) {
+    hist = item->second;
+  } else {
+    hist = new LatencyHistogram();
+    _histograms[name] = hist;
+  }
+  pthread_mutex_unlock(&_lock);
+  return hist;
+}
+
+std::vector<std::string>
+LatencyMonitor::names() {
+  std::vector<std::string> names;
+  pthread_mutex_lock(&_lock);
+  std::map<std::string, LatencyHistogram *>::iterator item = _histograms.begin();
+  for (; item != _histograms.end(); item++) {
+    names.push_back(item->first);
+  }
+  pthread_mutex_unlock(&_lock);
+  return names;
+}
+
+void
+LatencyMonitor::reset() {
+  pthread_mutex_lock(&_lock);
+  std::map<std::string, LatencyHistogram *>::iterator item = _histograms.begin();
+  for (; item != _histograms.end(); item++) {
+    item->second->reset();
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+void
+LatencyMonitor::toJSON(http::JSON &obj) {
+  std::map<std::string, http::JSON> table;
+  pthread_mutex_lock(&_lock);
+  std::map<std::string, LatencyHistogram *>::iterator item = _histograms.begin();
+  for (; item != _histograms.end(); item++) {
+    item->second->toJSON(table[item->first]);
+  }
+  pthread_mutex_unlock(&_lock);
+  obj = http::JSON(table);
+}
+
+void
+LatencyMonitor::handle(const http::Request &, http::Response &response) {
+  http::JSON result;
+  std::string result_string;
+  toJSON(result);
+  result.serialize(result_string);
+  response.setStatus(http::Response::STATUS_OK);
+  response.setHeader("Content-Type", "application/json");
+  response.setContentLength(result_string.size());
+  response.sendHeaders();
+  response.connection().send(result_string);
+}
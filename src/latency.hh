@@ -0,0 +1,127 @@
+#ifndef __SDR_LATENCY_HH__
+#define __SDR_LATENCY_HH__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <inttypes.h>
+#include <pthread.h>
+
+
+namespace sdr {
+
+// Forward declarations
+namespace http {
+class JSON;
+class Request;
+class Response;
+}
+
+
+/** A latency histogram with logarithmic buckets (like a HDR histogram).
+ *
+ * Values up to 63ns are counted exactly, larger values are counted in 32 linear sub-buckets per
+ * power of two. Hence the relative error of the percentiles is at most 1/32 (about 3%). Values
+ * are recorded lock-free, hence a histogram can be updated by any thread (e.g. the queue, a
+ * device thread or the HTTP server) while it is read by another one. All values are in ns.
+ * @ingroup datanodes */
+class LatencyHistogram
+{
+public:
+  /** Constructor. */
+  LatencyHistogram();
+
+  /** Records the given latency in ns, negative values are counted as 0. */
+  void record(int64_t ns);
+  /** Resets the histogram. */
+  void reset();
+
+  /** Returns the number of recorded values. */
+  inline uint64_t count() const { return _count; }
+  /** Returns the smallest value recorded (0 if empty). */
+  inline uint64_t min() const { return _count ? _min : 0; }
+  /** Returns the largest value recorded. */
+  inline uint64_t max() const { return _max; }
+  /** Returns the mean of the recorded values. */
+  inline double mean() const { return _count ? double(_sum)/_count : 0; }
+  /** Returns the value below or equal to which the given fraction (0..1) of the values fall.
+   * The value is the upper bound of the bucket, i.e. it overestimates by at most 1/32. */
+  uint64_t percentile(double p) const;
+
+  /** Serializes the histogram summary (count, min, max, mean and some percentiles) and the
+   * non-empty buckets as a JSON table. */
+  void toJSON(http::JSON &obj) const;
+
+  /** The number of buckets. */
+  static const size_t NumBuckets = 58*32+64;
+  /** Returns the bucket index of the given value. */
+  static size_t bucket(uint64_t value);
+  /** Returns the smallest value of the given bucket. */
+  static uint64_t lowerBound(size_t bucket);
+  /** Returns the largest value of the given bucket. */
+  static uint64_t upperBound(size_t bucket);
+
+protected:
+  /** The number of values per bucket. */
+  volatile uint64_t _buckets[NumBuckets];
+  /** The number of recorded values. */
+  volatile uint64_t _count;
+  /** The sum of the recorded values. */
+  volatile uint64_t _sum;
+  /** The smallest recorded value. */
+  volatile uint64_t _min;
+  /** The largest recorded value. */
+  volatile uint64_t _max;
+};
+
+
+/** Registry of named latency histograms.
+ *
+ * Sinks can be monitored with @c SinkBase::monitorLatency, which records the capture-to-sink
+ * latency (see @c BufferMeta) and the residence time of the buffers at the sink in the histograms
+ * "<name>.latency" and "<name>.residence". Other parts of an application may record their own
+ * latencies (e.g. the delay of pushing a decoded message to a client).
+ *
+ * The histograms can be exported through the HTTP server by
+ * @code
+ * server.addHandler("/latency", &LatencyMonitor::get(), &LatencyMonitor::handle);
+ * @endcode
+ * @ingroup datanodes */
+class LatencyMonitor
+{
+protected:
+  /** Hidden constructor. Use @c get to obtain an instance. */
+  LatencyMonitor();
+
+public:
+  /** Destructor. */
+  virtual ~LatencyMonitor();
+
+  /** Returns the singleton instance of the monitor. */
+  static LatencyMonitor &get();
+
+  /** Returns the histogram with the given name, it is created if it does not exist. The
+   * histogram remains valid for the lifetime of the monitor. */
+  LatencyHistogram *histogram(const std::string &name);
+  /** Returns the names of all histograms. */
+  std::vector<std::string> names();
+  /** Resets all histograms. */
+  void reset();
+
+  /** Serializes all histograms as a JSON table. */
+  void toJSON(http::JSON &obj);
+  /** HTTP handler serving all histograms as a JSON table. */
+  void handle(const http::Request &request, http::Response &response);
+
+protected:
+  /** The singleton instance. */
+  static LatencyMonitor *_instance;
+  /** The histograms by name. */
+  std::map<std::string, LatencyHistogram *> _histograms;
+  /** Guards the table of histograms. */
+  pthread_mutex_t _lock;
+};
+
+}
+
+#endif // __SDR_LATENCY_HH__
@@ -42,7 +42,9 @@ Config::operator ==(const Config &other) const {
 /* ********************************************************************************************* *
  * Implementation of SinkBase
  * ********************************************************************************************* */
-SinkBase::SinkBase() {
+SinkBase::SinkBase()
+  : _latency(0), _residence(0)
+{
   // pass...
 }
 
@@ -50,6 +52,26 @@ SinkBase::~SinkBase() {
   // pass...
 }
 
+void
+SinkBase::monitorLatency(const std::string &name) {
+  _latency   = LatencyMonitor::get().histogram(name + ".latency");
+  _residence = LatencyMonitor::get().histogram(name + ".residence");
+}
+
+void
+SinkBase::deliver(const RawBuffer &buffer, bool allow_overwrite, int64_t received) {
+  BufferMeta::Scope scope(buffer.meta());
+  if (0 == _latency) {
+    handleBuffer(buffer, allow_overwrite);
+    return;
+  }
+  int64_t now = BufferMeta::now();
+  if (buffer.meta().isValid()) { _latency->record(now - buffer.meta().time()); }
+  if (0 == received) { received = now; }
+  handleBuffer(buffer, allow_overwrite);
+  _residence->record(BufferMeta::now() - received);
+}
+
 /* ********************************************************************************************* *
  * Implementation of Source class
  * ********************************************************************************************* */
@@ -65,6 +87,17 @@ Source::~Source() {
 
 void
 Source::send(const RawBuffer &buffer, bool allow_overwrite) {
+  RawBuffer out(buffer);
+  // If the buffer has no metadata, take the one of the buffer being processed by this node
+  const BufferMeta &current = BufferMeta::current();
+  if ((! out.meta().isValid()) && current.isValid()) {
+    if (_config.hasSampleRate() && (_config.sampleRate() != current.sampleRate())) {
+      out.setMeta(current.resample(_config.sampleRate()/current.sampleRate()));
+    } else {
+      out.setMeta(current);
+    }
+  }
+
   std::map<SinkBase *, bool>::iterator item = _sinks.begin();
   for (; item != _sinks.end(); item++) {
     // If connected directly, call directly
@@ -74,11 +107,11 @@ Source::send(const RawBuffer &buffer, bool allow_overwrite) {
       // connection is direct.
       allow_overwrite = allow_overwrite && (1 == _sinks.size());
       // Call sink directly
-      item->first->handleBuffer(buffer, allow_overwrite);
+      item->first->deliver(out, allow_overwrite);
     } else {
       // otherwise, queue buffer
       allow_overwrite = allow_overwrite && (1 == _sinks.size());
-      Queue::get().send(buffer, item->first, allow_overwrite);
+      Queue::get().send(out, item->first, allow_overwrite);
     }
   }
 }
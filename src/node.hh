@@ -27,6 +27,7 @@
 #include "buffer.hh"
 #include "queue.hh"
 #include "exception.hh"
+#include "latency.hh"
 
 namespace sdr {
 
@@ -49,7 +50,8 @@ public:
     Type_cu16, ///< Complex (aka I/Q) type of unsigned 16b ints.
     Type_cs16, ///< Complex (aka I/Q) type of signed 16b ints.
     Type_cf32, ///< Complex (aka I/Q) type of 32bit floats aka. std::complex<float>.
-    Type_cf64  ///< Complex (aka I/Q) type of 64bit floats aka. std::complex<double>.
+    Type_cf64, ///< Complex (aka I/Q) type of 64bit floats aka. std::complex<double>.
+    Type_bits  ///< Packed bits (see @c BitBuffer), the buffer size is given in bits.
   } Type;
 
 public:
@@ -158,6 +160,7 @@ inline const char *typeName(Config::Type type) {
   case Config::Type_cs16: return "complex int16";
   case Config::Type_cf32: return "complex float";
   case Config::Type_cf64: return "complex double";
+  case Config::Type_bits: return "packed bits";
   }
   return "unknown";
 }
@@ -183,6 +186,25 @@ public:
   virtual void handleBuffer(const RawBuffer &buffer, bool allow_overwrite) = 0;
   /** Needs to be implemented by any sub-type to check and perform the configuration of the node. */
   virtual void config(const Config &src_cfg) = 0;
+
+  /** Enables the latency monitoring of this sink. The capture-to-sink latency and the residence
+   * time of the buffers (from arrival until @c handleBuffer returns) get recorded in the
+   * histograms "<name>.latency" and "<name>.residence" of the @c LatencyMonitor. */
+  void monitorLatency(const std::string &name);
+  /** Returns @c true if the latency of this sink is monitored. */
+  inline bool isMonitored() const { return 0 != _latency; }
+  /** Passes the buffer to @c handleBuffer and records the latencies if monitored.
+   * @param buffer Specifies the buffer.
+   * @param allow_overwrite If @c true, the sink may overwrite the buffer.
+   * @param received Specifies the arrival time of the buffer (e.g. when it was queued) in ns, see
+   *        @c BufferMeta::now. If 0, the buffer arrives now. */
+  void deliver(const RawBuffer &buffer, bool allow_overwrite, int64_t received=0);
+
+protected:
+  /** The capture-to-sink latency histogram, 0 if not monitored. */
+  LatencyHistogram *_latency;
+  /** The residence time histogram, 0 if not monitored. */
+  LatencyHistogram *_residence;
 };
 
 
@@ -209,6 +231,48 @@ public:
 
 
 
+/** A sink of a bit-stream. Bit-streams are either passed as one bit per @c uint8_t sample
+ * (@c Config::Type_u8) or packed (@c Config::Type_bits). This sink accepts both and dispatches
+ * received buffers to @c process or @c processBits, respectively. */
+class BitSink: public Sink<uint8_t>
+{
+public:
+  /** Constructor. */
+  BitSink() : Sink<uint8_t>(), _packed(false) { }
+  /** Destructor. */
+  virtual ~BitSink() { }
+
+  /** Needs to be implemented by any sub-type to process packed bits. */
+  virtual void processBits(const BitBuffer &buffer, bool allow_overwrite) = 0;
+
+  /** Re-implemented from @c Sink. Forwards the buffer to @c processBits if the source emits
+   * packed bits and to @c process otherwise. */
+  virtual void handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+    if (_packed) { this->processBits(BitBuffer(buffer), allow_overwrite); }
+    else { this->process(Buffer<uint8_t>(buffer), allow_overwrite); }
+  }
+
+protected:
+  /** Checks if the given source type is a bit-stream and throws a @c ConfigError otherwise.
+   * @param src_cfg Specifies the source configuration.
+   * @param name Specifies the node name used in the error message. */
+  inline void configBits(const Config &src_cfg, const char *name) {
+    if ((Config::Type_u8 != src_cfg.type()) && (Config::Type_bits != src_cfg.type())) {
+      ConfigError err;
+      err << "Can not configure " << name << ": Invalid type " << src_cfg.type()
+          << ", expected " << Config::Type_u8 << " or " << Config::Type_bits;
+      throw err;
+    }
+    _packed = (Config::Type_bits == src_cfg.type());
+  }
+
+protected:
+  /** If @c true, the source emits packed bits. */
+  bool _packed;
+};
+
+
+
 /** Generic source class. */
 class Source
 {
@@ -75,6 +75,21 @@ inline std::complex<double> cast<std::complex<int16_t>, std::complex<double> >(c
   return std::complex<double>(std::real(a), std::imag(a));
 }
 
+template<>
+inline std::complex<float> cast<std::complex<uint8_t>, std::complex<float> >(const std::complex<uint8_t> &a) {
+  return std::complex<float>(std::real(a), std::imag(a));
+}
+
+template<>
+inline std::complex<float> cast<std::complex<int8_t>, std::complex<float> >(const std::complex<int8_t> &a) {
+  return std::complex<float>(std::real(a), std::imag(a));
+}
+
+template<>
+inline std::complex<float> cast<std::complex<int16_t>, std::complex<float> >(const std::complex<int16_t> &a) {
+  return std::complex<float>(std::real(a), std::imag(a));
+}
+
 
 /** Mulitplication by a power of two. */
 inline uint8_t mul2(uint8_t a, int n) {
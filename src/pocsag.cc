@@ -12,8 +12,8 @@ inline bool is_address(uint32_t word) {
 /* ********************************************************************************************* *
  * Implementation of POCSAG
  * ********************************************************************************************* */
-POCSAG::POCSAG()
-  : Sink<uint8_t>()
+POCSAG::POCSAG(int syncErrors)
+  : BitSink(), _baud(0), _sync(0x7cd215d8, syncErrors), _rxmeta(), _rxbit(0)
 {
   // pass...
 }
@@ -22,12 +22,10 @@ void
 POCSAG::config(const Config &src_cfg) {
   if (! src_cfg.hasType()) { return; }
   // Check if buffer type matches
-  if (Config::typeId<uint8_t>() != src_cfg.type()) {
-    ConfigError err;
-    err << "Can not configure POCSAG: Invalid type " << src_cfg.type()
-        << ", expected " << Config::typeId<uint8_t>();
-    throw err;
-  }
+  configBits(src_cfg, "POCSAG");
+
+  // The sample rate of a bit stream is the baud rate
+  _baud = src_cfg.sampleRate();
 
   LogMessage msg(LOG_DEBUG);
   msg << "Config POCSAG node.";
@@ -35,65 +33,100 @@ POCSAG::config(const Config &src_cfg) {
 
   _state = WAIT;
   _bits  = 0;
+  _sync.reset();
 }
 
 void
 POCSAG::process(const Buffer<uint8_t> &buffer, bool allow_overwrite)
 {
+  _rxmeta = buffer.meta();
   for (size_t i=0; i<buffer.size(); i++)
   {
+    _rxbit = i+1;
     // put bit into shift register
     _bits = ( (_bits<<1) | (buffer[i] & 0x01) );
 
     // Dispatch by state
     if (WAIT == _state) {
       // Wait for the sync word to appear
-      uint32_t word = (_bits & 0xffffffff);
-      if ( (0 == pocsag_repair(word)) && (0x7cd215d8 == word)) {
-        // init messages
-        _reset_message();
-        _state = RECEIVE; _bitcount = 0; _slot = 0;
-      }
+      _check_sync();
     } else if (RECEIVE == _state) {
       // Receive 64 bit (2 words)
       _bitcount++;
-      if (64 == _bitcount) {
-        _bitcount=0;
-
-        // get and check 1st word bits
-        uint32_t word = ( (_bits>>32) & 0xffffffff );
-        if (0 == pocsag_repair(word)) { _process_word(word); }
-
-        // get and check 2nd word bits
-        word = ( _bits & 0xffffffff );
-        if (0 == pocsag_repair(word)) { _process_word(word); }
-
-        // Advance slot counter
-        _slot++;
-        if (8 == _slot) {
-          // If all slots (8) has been processed -> wait for continuation
-          _state = CHECK_CONTINUE;
-        }
-      }
+      if (64 == _bitcount) { _process_batch(); }
     } else if (CHECK_CONTINUE == _state) {
       // Wait for an immediate sync word
       _bitcount++;
-      if (32 == _bitcount) {
-        uint32_t word = (_bits&0xffffffff);
-        if ( (0 == pocsag_repair(word)) && (0x7cd215d8 == word)) {
-          // If a sync word has been received -> continue with reception of slot 0
-          _state = RECEIVE; _slot = 0; _bitcount = 0;
-        } else {
-          // Otherwise -> end of transmission, wait for next sync
-          _finish_message(); _state = WAIT;
-          // Process received messages
-          this->handleMessages();
-        }
-      }
+      if (32 == _bitcount) { _check_continue(); }
     }
   }
 }
 
+void
+POCSAG::processBits(const BitBuffer &buffer, bool allow_overwrite)
+{
+  size_t N = buffer.size(), i = 0;
+  _rxmeta = buffer.meta();
+  while (i < N) {
+    if (WAIT == _state) {
+      // Search sync word word-parallel
+      if (_sync.search(buffer, i)) { _bits = _sync.word(); _start_batch(); }
+      continue;
+    }
+    // Otherwise, take all bits needed to complete the batch or continuation word at once
+    size_t n = std::min(N-i, size_t((RECEIVE == _state) ? 64 : 32) - _bitcount);
+    _bits = ( (64 == n) ? buffer.bits(i, n) : ((_bits<<n) | buffer.bits(i, n)) );
+    _bitcount += n; i += n; _rxbit = i;
+    if ((RECEIVE == _state) && (64 == _bitcount)) { _process_batch(); }
+    else if ((CHECK_CONTINUE == _state) && (32 == _bitcount)) { _check_continue(); }
+  }
+}
+
+void
+POCSAG::_check_sync() {
+  if (_sync.matches(_bits & 0xffffffff)) { _start_batch(); }
+}
+
+void
+POCSAG::_start_batch() {
+  // init messages
+  _reset_message();
+  _state = RECEIVE; _bitcount = 0; _slot = 0;
+}
+
+void
+POCSAG::_process_batch() {
+  _bitcount=0;
+
+  // get and check both words
+  uint32_t words[2] = { uint32_t(_bits>>32), uint32_t(_bits & 0xffffffff) };
+  uint8_t failed[2];
+  pocsag_repair(words, 2, failed);
+  if (! failed[0]) { _process_word(words[0]); }
+  if (! failed[1]) { _process_word(words[1]); }
+
+  // Advance slot counter
+  _slot++;
+  if (8 == _slot) {
+    // If all slots (8) has been processed -> wait for continuation
+    _state = CHECK_CONTINUE;
+  }
+}
+
+void
+POCSAG::_check_continue() {
+  if (_sync.matches(_bits & 0xffffffff)) {
+    // If a sync word has been received -> continue with reception of slot 0
+    _state = RECEIVE; _slot = 0; _bitcount = 0;
+  } else {
+    // Otherwise -> end of transmission, wait for next sync. The word-parallel search continues
+    // on the latest bits, as the next sync word may have started within the checked word.
+    _finish_message(); _state = WAIT; _sync.setHistory(_bits);
+    // Process received messages
+    this->handleMessages();
+  }
+}
+
 
 void
 POCSAG::_process_word(uint32_t word)
@@ -111,8 +144,9 @@ POCSAG::_process_word(uint32_t word)
     // Assemble address
     uint32_t addr = ((((word>>13) & 0x03ffff)<<3) + _slot );
     uint8_t  func = ((word>>11) & 0x03);
-    // init new message
-    _message = Message(addr, func);
+    // init new message, stamped with the time of the end of the batch slot
+    _message = Message(addr, func, _baud);
+    _message.setTimestamp(_rxmeta.advance(_rxbit).time());
   } else {
     // on data word
     if (_message.isEmpty()) {
@@ -145,6 +179,90 @@ POCSAG::handleMessages() {
 }
 
 
+/* ********************************************************************************************* *
+ * Implementation of POCSAGMultiRate
+ * ********************************************************************************************* */
+POCSAGMultiRate::Channel::Channel(POCSAGMultiRate *parent, float baud)
+  : POCSAG(), _parent(parent), _bits(baud, BitStream::NORMAL, true)
+{
+  _bits.connect(this, true);
+}
+
+POCSAGMultiRate::Channel::~Channel() {
+  // pass...
+}
+
+void
+POCSAGMultiRate::Channel::handleMessages() {
+  _parent->_forward(this);
+}
+
+
+POCSAGMultiRate::POCSAGMultiRate(POCSAG *receiver, bool invert)
+  : Sink<int16_t>(), _receiver(receiver), _invert(invert)
+{
+  _channels.push_back(new Channel(this, 512));
+  _channels.push_back(new Channel(this, 1200));
+  _channels.push_back(new Channel(this, 2400));
+}
+
+POCSAGMultiRate::~POCSAGMultiRate() {
+  _symbols.unref();
+  for (size_t i=0; i<_channels.size(); i++) { delete _channels[i]; }
+}
+
+void
+POCSAGMultiRate::config(const Config &src_cfg) {
+  // Check if config is complete
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+
+  // Check if buffer type matches
+  if (Config::typeId<int16_t>() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure POCSAGMultiRate: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId<int16_t>();
+    throw err;
+  }
+
+  _symbols = BitBuffer(src_cfg.bufferSize());
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Config POCSAGMultiRate node: " << std::endl
+      << " symbol rate: " << src_cfg.sampleRate() << " Hz" << std::endl
+      << " invert:      " << ( _invert ? "yes" : "no" ) << std::endl
+      << " baud rates:  512, 1200, 2400";
+  Logger::get().log(msg);
+
+  // Configure bit-clock recovery and decoders
+  Config sym_cfg(Config::Type_bits, src_cfg.sampleRate(), src_cfg.bufferSize(), 1);
+  for (size_t i=0; i<_channels.size(); i++) {
+    _channels[i]->_bits.config(sym_cfg);
+  }
+}
+
+void
+POCSAGMultiRate::process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
+  // Detect symbols once
+  _symbols.clear();
+  for (size_t i=0; i<buffer.size(); i++) {
+    _symbols.append((buffer[i]>0)^_invert);
+  }
+  // and decode all rates
+  for (size_t i=0; i<_channels.size(); i++) {
+    _channels[i]->_bits.processBits(_symbols, false);
+  }
+}
+
+void
+POCSAGMultiRate::_forward(Channel *channel) {
+  while (channel->_queue.size()) {
+    _receiver->_queue.push_back(channel->_queue.front());
+    channel->_queue.pop_front();
+  }
+  _receiver->handleMessages();
+}
+
+
 /* ********************************************************************************************* *
  * Implementation of POCSAGDump
  * ********************************************************************************************* */
@@ -162,6 +280,7 @@ POCSAGDump::handleMessages() {
     std::cerr << "POCSAG: @" << msg.address()
               << ", F=" << int(msg.function())
               << ", bits=" << msg.bits();
+    if (msg.baud()) { std::cerr << ", baud=" << msg.baud(); }
     if (0 == msg.bits()) {
       std::cerr << " (alert)" << std::endl;
     } else if (msg.estimateText() >= msg.estimateNumeric()) {
@@ -252,20 +371,21 @@ pocsag_numeric_weight(char cp, size_t pos) {
 
 
 POCSAG::Message::Message()
-  : _address(0), _function(0), _empty(true), _bits(0)
+  : _address(0), _function(0), _empty(true), _bits(0), _baud(0), _timestamp(0)
 {
   // pass...
 }
 
-POCSAG::Message::Message(uint32_t addr, uint8_t func)
-  : _address(addr), _function(func), _empty(false), _bits(0)
+POCSAG::Message::Message(uint32_t addr, uint8_t func, float baud)
+  : _address(addr), _function(func), _empty(false), _bits(0), _baud(baud), _timestamp(0)
 {
   // pass...
 }
 
 POCSAG::Message::Message(const Message &other)
   : _address(other._address), _function(other._function), _empty(other._empty),
-    _bits(other._bits), _payload(other._payload)
+    _bits(other._bits), _baud(other._baud), _timestamp(other._timestamp),
+    _payload(other._payload)
 {
   // pass...
 }
@@ -276,6 +396,8 @@ POCSAG::Message::operator =(const Message &other) {
   _function = other._function;
   _empty = other._empty;
   _bits = other._bits;
+  _baud = other._baud;
+  _timestamp = other._timestamp;
   _payload = other._payload;
   return *this;
 }
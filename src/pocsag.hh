@@ -2,6 +2,7 @@
 #define __SDR_POSAG_HH__
 
 #include "node.hh"
+#include "fsk.hh"
 
 namespace sdr {
 
@@ -22,8 +23,13 @@ namespace sdr {
  * In order to process the received message you need to override the @c handleMessages() method
  * which gets called once a batch of messages has been received.
  *
+ * The bit stream may be passed as one bit per @c uint8_t sample or as packed bits. In the latter
+ * case, the sync word is searched word-parallel (see @c SyncWordSearch) and the code words are
+ * taken from the packed buffer up to 64 bits at once. A sync word is accepted if it differs in at
+ * most @c syncErrors bits from 0x7CD215D8.
+ *
  * @ingroup datanodes */
-class POCSAG: public Sink<uint8_t>
+class POCSAG: public BitSink
 {
 public:
   /** A pocsag message.
@@ -41,8 +47,8 @@ public:
   public:
     /** Empty constructor. */
     Message();
-    /** Constructor from address and function. */
-    Message(uint32_t addr, uint8_t func);
+    /** Constructor from address, function and baud rate. */
+    Message(uint32_t addr, uint8_t func, float baud=0);
     /** Copy constructor. */
     Message(const Message &other);
 
@@ -57,6 +63,12 @@ public:
     inline uint8_t function() const { return _function; }
     /** Returns the number of data bits. */
     inline uint32_t bits() const { return _bits; }
+    /** Returns the baud rate, the message was received with (0 if unknown). */
+    inline float baud() const { return _baud; }
+    /** Returns the capture time of the address word in ns since the epoch (0 if unknown). */
+    inline int64_t timestamp() const { return _timestamp; }
+    /** Sets the capture time of the address word. */
+    inline void setTimestamp(int64_t time) { _timestamp = time; }
 
     /** Adds some payload from the given POGSAC word. */
     void addPayload(uint32_t word);
@@ -83,6 +95,10 @@ public:
     bool                 _empty;
     /** The number of payload bits in the message. */
     uint32_t             _bits;
+    /** The baud rate. */
+    float                _baud;
+    /** The capture time. */
+    int64_t              _timestamp;
     /** The actual payload. */
     std::vector<uint8_t> _payload;
   };
@@ -96,17 +112,33 @@ protected:
   } State;
 
 public:
-  /** Constructor. */
-  POCSAG();
+  /** Constructor.
+   * @param syncErrors Specifies the max. number of bit errors accepted in the sync word. */
+  POCSAG(int syncErrors=2);
+
+  /** Returns the max. number of bit errors accepted in the sync word. */
+  inline int syncErrors() const { return _sync.maxErrors(); }
+  /** Sets the max. number of bit errors accepted in the sync word. */
+  inline void setSyncErrors(int errors) { _sync.setMaxErrors(errors); }
 
   void config(const Config &src_cfg);
   void process(const Buffer<uint8_t> &buffer, bool allow_overwrite);
+  void processBits(const BitBuffer &buffer, bool allow_overwrite);
 
   /** Can be overwritten by any other implementation to process the received messages
    * stored in @c _queue. */
   virtual void handleMessages();
 
 protected:
+  /** Checks if the last 32 bits received form a sync word and starts the reception. */
+  void _check_sync();
+  /** Starts the reception of a batch after the sync word. */
+  void _start_batch();
+  /** Processes the last 64 bits received (2 words) once a complete batch has been received. */
+  void _process_batch();
+  /** Checks if the batch continues with a sync word once 32 bits have been received
+   * after a complete batch. */
+  void _check_continue();
   /** Process a POGSAC word. */
   void _process_word(uint32_t word);
   /** Clear the message. */
@@ -115,6 +147,10 @@ protected:
   void _finish_message();
 
 protected:
+  /** The baud rate of the bit stream. */
+  float    _baud;
+  /** The sync word search. */
+  SyncWordSearch _sync;
   /** The current state. */
   State    _state;
   /** The last received bits. */
@@ -127,6 +163,72 @@ protected:
   Message _message;
   /** The completed messages. */
   std::list<Message> _queue;
+  /** The metadata of the buffer being processed. */
+  BufferMeta _rxmeta;
+  /** The number of bits of the current buffer processed so far. */
+  size_t _rxbit;
+
+  friend class POCSAGMultiRate;
+};
+
+
+/** A POCSAG receiver for mixed baud rates.
+ * Paging channels may carry POCSAG transmissions at 512, 1200 and 2400 baud. This node takes the
+ * demodulated (i.e. FM demodulated) audio signal, detects the symbols once by their amplitude
+ * (see @c ASKDetector) and runs the bit-clock recovery (@c BitStream) and the POCSAG decoder for
+ * all three rates in parallel on the same packed symbol buffer. Received messages are forwarded
+ * to the receiver, a @c POCSAG instance (e.g. @c POCSAGDump), and carry the baud rate they were
+ * received with.
+ *
+ * @ingroup datanodes */
+class POCSAGMultiRate: public Sink<int16_t>
+{
+protected:
+  /** A POCSAG decoder for a single baud rate. */
+  class Channel: public POCSAG
+  {
+  public:
+    /** Constructor. */
+    Channel(POCSAGMultiRate *parent, float baud);
+    /** Destructor. */
+    virtual ~Channel();
+
+    /** Forwards the received messages to the receiver. */
+    void handleMessages();
+
+  protected:
+    /** The multi-rate node. */
+    POCSAGMultiRate *_parent;
+    /** The bit-clock recovery for this baud rate. */
+    BitStream _bits;
+
+    friend class POCSAGMultiRate;
+  };
+
+public:
+  /** Constructor.
+   * @param receiver Specifies the POCSAG instance receiving the messages.
+   * @param invert If @c true, the symbol logic is inverted. */
+  POCSAGMultiRate(POCSAG *receiver, bool invert=false);
+  /** Destructor. */
+  virtual ~POCSAGMultiRate();
+
+  void config(const Config &src_cfg);
+  void process(const Buffer<int16_t> &buffer, bool allow_overwrite);
+
+protected:
+  /** Moves the messages received by the given channel to the receiver. */
+  void _forward(Channel *channel);
+
+protected:
+  /** The receiver. */
+  POCSAG *_receiver;
+  /** If @c true, the symbol logic is inverted. */
+  bool _invert;
+  /** The detected symbols. */
+  BitBuffer _symbols;
+  /** The decoders for 512, 1200 and 2400 baud. */
+  std::vector<Channel *> _channels;
 };
 
 
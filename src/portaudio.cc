@@ -1,4 +1,5 @@
 #include "portaudio.hh"
+#include <sstream>
 
 using namespace sdr;
 
@@ -54,8 +55,18 @@ PortAudio::deviceName(int idx) {
 /* ******************************************************************************************* *
  * PortSink implementation
  * ******************************************************************************************* */
-PortSink::PortSink()
-  : SinkBase(), _stream(0), _frame_size(0)
+/** Returns the given name or a unique default name of a PortSink instance. */
+static std::string portsink_name(const std::string &name) {
+  static uint32_t count = 0;
+  if (! name.empty()) { return name; }
+  std::stringstream buffer;
+  buffer << "portsink" << __sync_fetch_and_add(&count, 1);
+  return buffer.str();
+}
+
+PortSink::PortSink(const std::string &name)
+  : SinkBase(), _stream(0), _frame_size(0),
+    _playback(LatencyMonitor::get().histogram(portsink_name(name) + ".playback"))
 {
   // pass...
 }
@@ -151,5 +162,12 @@ PortSink::config(const Config &src_cfg) {
 void
 PortSink::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
   // Bug, check if data was send properly
-  Pa_WriteStream(_stream, buffer.data(), buffer.bytesLen()/_frame_size);
+  size_t frames = buffer.bytesLen()/_frame_size;
+  Pa_WriteStream(_stream, buffer.data(), frames);
+  // The last frame gets audible after the output latency of the stream
+  if (buffer.meta().isValid() && frames) {
+    const PaStreamInfo *info = Pa_GetStreamInfo(_stream);
+    int64_t played = BufferMeta::now() + (info ? int64_t(1e9*info->outputLatency) : 0);
+    _playback->record(played - buffer.meta().advance(frames-1).time());
+  }
 }
@@ -38,8 +38,10 @@ public:
 class PortSink: public SinkBase
 {
 public:
-  /** Constructor. */
-  PortSink();
+  /** Constructor.
+   * @param name Specifies the name of the latency histogram, see @c playbackLatency. If empty,
+   * a unique name "portsink<N>" is chosen, where N counts the instances. */
+  explicit PortSink(const std::string &name="");
   /** Destructor. */
   virtual ~PortSink();
 
@@ -48,11 +50,18 @@ public:
   /** Playback. */
   virtual void handleBuffer(const RawBuffer &buffer, bool allow_overwrite);
 
+  /** Returns the histogram of the capture-to-playback latency, i.e. the time from the capture of
+   * the last sample of a buffer until it gets audible, including the output latency of the
+   * device. The histogram is registered as "<name>.playback" at the @c LatencyMonitor. */
+  inline const LatencyHistogram &playbackLatency() const { return *_playback; }
+
 protected:
   /** The PortAudio stream. */
   PaStream *_stream;
   /** The frame-size. */
   size_t _frame_size;
+  /** The capture-to-playback latency histogram. */
+  LatencyHistogram *_playback;
 };
 
 
@@ -64,7 +73,8 @@ class PortSource: public Source
 public:
   /** Constructor. */
   PortSource(double sampleRate, size_t bufferSize, int dev=-1):
-    Source(), _streamIsOpen(false), _stream(0), _sampleRate(sampleRate), _is_real(true)
+    Source(), _streamIsOpen(false), _stream(0), _sampleRate(sampleRate), _is_real(true),
+    _sampleCount(0)
   {
     // Allocate buffer
     _buffer = Buffer<Scalar>(bufferSize);
@@ -85,6 +95,10 @@ public:
     /// @todo Signal loss of samples in debug mode.
     /// @bug Drop data if output buffer is in use.
     Pa_ReadStream(_stream, _buffer.ptr(), _buffer.size());
+    // Stamp the buffer, the first sample got captured a buffer ago
+    double dt = _buffer.size()/_sampleRate;
+    _buffer.setMeta(BufferMeta(_sampleCount, BufferMeta::now()-int64_t(1e9*dt), _sampleRate));
+    _sampleCount += _buffer.size();
     this->send(_buffer);
   }
 
@@ -202,6 +216,8 @@ protected:
   bool _is_real;
   /** The output buffer. */
   Buffer<Scalar> _buffer;
+  /** The number of samples read. */
+  uint64_t _sampleCount;
 };
 
 }
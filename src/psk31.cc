@@ -4,44 +4,156 @@
 using namespace sdr;
 
 
+/* ********************************************************************************************* *
+ * Implementation of BPSK31Demod
+ * ********************************************************************************************* */
+/** Size of the NCO LUT, indexed by the upper 10 bits of the phase. */
+#define BPSK31_LUT_SIZE 1024
+
+/** Holds the NCO LUT and matched filter shared by all BPSK31 demodulators. */
+class BPSK31Tables
+{
+public:
+  /** Constructor, assembles the tables. */
+  BPSK31Tables() {
+    for (size_t i=0; i<BPSK31_LUT_SIZE; i++) {
+      lut[i] = std::exp(std::complex<float>(0, (2*M_PI*i)/BPSK31_LUT_SIZE));
+    }
+
+    // Matched filter: cosine shaped pulse over 2 symbols
+    float sum = 0;
+    for (size_t i=0; i<SDR_BPSK31_MF_LENGTH; i++) {
+      mf[i] = 1 - std::cos((2*M_PI*(i+0.5))/SDR_BPSK31_MF_LENGTH); sum += mf[i];
+    }
+    for (size_t i=0; i<SDR_BPSK31_MF_LENGTH; i++) { mf[i] /= sum; }
+  }
+
+public:
+  /** The exp(i phi) LUT. */
+  std::complex<float> lut[BPSK31_LUT_SIZE];
+  /** The matched filter taps. */
+  float mf[SDR_BPSK31_MF_LENGTH];
+};
+
+/** The global BPSK31 tables. */
+static BPSK31Tables _bpsk31_tables;
+
+
+BPSK31Demod::BPSK31Demod(double dF)
+  : _lut(_bpsk31_tables.lut), _mfTaps(_bpsk31_tables.mf), _F0(0), _F(0), _Fmin(-dF), _Fmax(dF),
+    _phase(0), _inc(0), _sps(0), _decim(1), _norm(1), _omega(_superSample), _gain_omega(0.05),
+    _gain_F(0.1)
+{
+  // Assemble carrier PLL gains (updated once per symbol):
+  double damping = std::sqrt(2)/2;
+  double bw = M_PI/50;
+  double tmp = 1. + 2*damping*bw + bw*bw;
+  _alpha = 4*damping*bw/tmp;
+  _beta  = 4*bw*bw/tmp;
+  reset();
+}
+
+void
+BPSK31Demod::config(double Fs) {
+  // Check input sample rate
+  if (minSampleRate() > Fs) {
+    ConfigError err;
+    err << "Can not configure BPSK31: Input sample rate too low! The BPSK31 node requires at "
+        << "least a sample rate of " << minSampleRate() << "Hz, got " << Fs << "Hz";
+    throw err;
+  }
+
+  // Decimation factor and (decimated) samples per symbol
+  _decim = std::max(1, int(Fs/minSampleRate()));
+  _norm  = 1./(float(_decim)*_decim);
+  _omega = Fs/(_decim*31.25);
+  // Input samples per symbol
+  _sps = Fs/31.25;
+  reset(carrier());
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Config BPSK31 demodulator: " << std::endl
+      << " input sample rate: " << Fs << "Hz" << std::endl
+      << " decimation: " << _decim << std::endl
+      << " samples per symbol: " << _omega;
+  Logger::get().log(msg);
+}
+
+void
+BPSK31Demod::reset(double carrier) {
+  // Reset NCO & PLL
+  _F0 = -carrier; _F = 0; _phase = 0; _fll = 0;
+  _inc = int32_t(_F0*(double(1u<<31)/M_PI));
+  // Reset decimator
+  _sum = _wsum = _tail = 0; _j = 0;
+  // Reset timing loop
+  _half = _omega/2; _count = 0; _mid = false;
+  _prev = _last = _midSample = 0;
+  // Reset matched filter
+  for (size_t i=0; i<2*SDR_BPSK31_MF_LENGTH; i++) { _mfHist[i] = 0; }
+  _mfIdx = 0;
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of Varicode
+ * ********************************************************************************************* */
+/** Holds the varicode table shared by all decoders. */
+class VaricodeTable
+{
+public:
+  /** Constructor, assembles the table. */
+  VaricodeTable() {
+    for (size_t i=0; i<SDR_VARICODE_TABLE_SIZE; i++) { table[i] = 0; }
+    table[1023] = '!';  table[87]   = '.';  table[895]  = '\'';
+    table[367]  = '*';  table[495]  = '\\'; table[687]  = '?';
+    table[475]  = '$';  table[701]  = '@';  table[365]  = '_';
+    table[735]  = '`';  table[351]  = '"';  table[493]  = '<';
+    table[727]  = '~';  table[699]  = '&';  table[703]  = '^';
+    table[507]  = ']';  table[117]  = '-';  table[445]  = ';';
+    table[1013] = '#';  table[695]  = '{';  table[245]  = ':';
+    table[693]  = '}';  table[503]  = ')';  table[1749] = '%';
+    table[471]  = '>';  table[991]  = '+';  table[251]  = '[';
+    table[85]   = '=';  table[943]  = '/';  table[29]   = '\n';
+    table[31]   = '\r'; table[747]  = '\n';
+    //                  ^- Encode EOT as LN
+    table[443]  = '|';  table[1]    = ' ';  table[125]  = 'A';
+    table[235]  = 'B';  table[173]  = 'C';  table[181]  = 'D';
+    table[119]  = 'E';  table[219]  = 'F';  table[253]  = 'G';
+    table[341]  = 'H';  table[127]  = 'I';  table[509]  = 'J';
+    table[381]  = 'K';  table[215]  = 'L';  table[187]  = 'M';
+    table[221]  = 'N';  table[171]  = 'O';  table[213]  = 'P';
+    table[477]  = 'Q';  table[175]  = 'R';  table[111]  = 'S';
+    table[109]  = 'T';  table[343]  = 'U';  table[437]  = 'V';
+    table[349]  = 'W';  table[373]  = 'X';  table[379]  = 'Y';
+    table[685]  = 'Z';  table[11]   = 'a';  table[95]   = 'b';
+    table[47]   = 'c';  table[45]   = 'd';  table[3]    = 'e';
+    table[61]   = 'f';  table[91]   = 'g';  table[43]   = 'h';
+    table[13]   = 'i';  table[491]  = 'j';  table[191]  = 'k';
+    table[27]   = 'l';  table[59]   = 'm';  table[15]   = 'n';
+    table[7]    = 'o';  table[63]   = 'p';  table[447]  = 'q';
+    table[21]   = 'r';  table[23]   = 's';  table[5]    = 't';
+    table[55]   = 'u';  table[123]  = 'v';  table[107]  = 'w';
+    table[223]  = 'x';  table[93]   = 'y';  table[469]  = 'z';
+    table[183]  = '0';  table[189]  = '1';  table[237]  = '2';
+    table[511]  = '3';  table[375]  = '4';  table[859]  = '5';
+    table[363]  = '6';  table[941]  = '7';  table[427]  = '8';
+    table[951]  = '9';
+  }
+
+public:
+  /** The code table, indexed by the code. */
+  char table[SDR_VARICODE_TABLE_SIZE];
+};
+
+/** The global varicode table. */
+static VaricodeTable _varicode_table;
+
+
 Varicode::Varicode()
-  : Sink<uint8_t>(), Source()
+  : BitSink(), Source(), _value(0), _code_table(_varicode_table.table)
 {
-  // Fill code table
-  _code_table[1023] = '!';  _code_table[87]   = '.';  _code_table[895]  = '\'';
-  _code_table[367]  = '*';  _code_table[495]  = '\\'; _code_table[687]  = '?';
-  _code_table[475]  = '$';  _code_table[701]  = '@';  _code_table[365]  = '_';
-  _code_table[735]  = '`';  _code_table[351]  = '"';  _code_table[493]  = '<';
-  _code_table[727]  = '~';  _code_table[699]  = '&';  _code_table[703]  = '^';
-  _code_table[507]  = ']';  _code_table[117]  = '-';  _code_table[445]  = ';';
-  _code_table[1013] = '#';  _code_table[695]  = '{';  _code_table[245]  = ':';
-  _code_table[693]  = '}';  _code_table[503]  = ')';  _code_table[1749] = '%';
-  _code_table[471]  = '>';  _code_table[991]  = '+';  _code_table[251]  = '[';
-  _code_table[85]   = '=';  _code_table[943]  = '/';  _code_table[29]   = '\n';
-  _code_table[31]   = '\r'; _code_table[747]  = '\n';
-  //                        ^- Encode EOT as LN
-  _code_table[443]  = '|';  _code_table[1]    = ' ';  _code_table[125]  = 'A';
-  _code_table[235]  = 'B';  _code_table[173]  = 'C';  _code_table[181]  = 'D';
-  _code_table[119]  = 'E';  _code_table[219]  = 'F';  _code_table[253]  = 'G';
-  _code_table[341]  = 'H';  _code_table[127]  = 'I';  _code_table[509]  = 'J';
-  _code_table[381]  = 'K';  _code_table[215]  = 'L';  _code_table[187]  = 'M';
-  _code_table[221]  = 'N';  _code_table[171]  = 'O';  _code_table[213]  = 'P';
-  _code_table[477]  = 'Q';  _code_table[175]  = 'R';  _code_table[111]  = 'S';
-  _code_table[109]  = 'T';  _code_table[343]  = 'U';  _code_table[437]  = 'V';
-  _code_table[349]  = 'W';  _code_table[373]  = 'X';  _code_table[379]  = 'Y';
-  _code_table[685]  = 'Z';  _code_table[11]   = 'a';  _code_table[95]   = 'b';
-  _code_table[47]   = 'c';  _code_table[45]   = 'd';  _code_table[3]    = 'e';
-  _code_table[61]   = 'f';  _code_table[91]   = 'g';  _code_table[43]   = 'h';
-  _code_table[13]   = 'i';  _code_table[491]  = 'j';  _code_table[191]  = 'k';
-  _code_table[27]   = 'l';  _code_table[59]   = 'm';  _code_table[15]   = 'n';
-  _code_table[7]    = 'o';  _code_table[63]   = 'p';  _code_table[447]  = 'q';
-  _code_table[21]   = 'r';  _code_table[23]   = 's';  _code_table[5]    = 't';
-  _code_table[55]   = 'u';  _code_table[123]  = 'v';  _code_table[107]  = 'w';
-  _code_table[223]  = 'x';  _code_table[93]   = 'y';  _code_table[469]  = 'z';
-  _code_table[183]  = '0';  _code_table[189]  = '1';  _code_table[237]  = '2';
-  _code_table[511]  = '3';  _code_table[375]  = '4';  _code_table[859]  = '5';
-  _code_table[363]  = '6';  _code_table[941]  = '7';  _code_table[427]  = '8';
-  _code_table[951]  = '9';
+  // pass...
 }
 
 Varicode::~Varicode() {
@@ -50,43 +162,71 @@ Varicode::~Varicode() {
 
 void
 Varicode::config(const Config &src_cfg) {
-  // Requires type, sample rate & buffer size
+  // Requires type & buffer size
   if (!src_cfg.hasType() || !src_cfg.hasBufferSize()) { return; }
   // Check buffer type
-  if (Config::typeId<uint8_t>() != src_cfg.type()) {
-    ConfigError err;
-    err << "Can not configure Varicode: Invalid type " << src_cfg.type()
-        << ", expected " << Config::typeId<uint8_t>();
-    throw err;
-  }
+  configBits(src_cfg, "Varicode");
 
+  // Every char takes at least 3 bits
+  size_t bsize = 1 + src_cfg.bufferSize()/3;
   _value = 0;
-  _buffer = Buffer<uint8_t>(18);
-  this->setConfig(Config(Traits<uint8_t>::scalarId, 0, 18, 1));
+  _buffer = Buffer<uint8_t>(bsize);
+  this->setConfig(Config(Traits<uint8_t>::scalarId, 0, bsize, 1));
 }
 
 void
 Varicode::process(const Buffer<uint8_t> &buffer, bool allow_overwrite) {
-  size_t oidx = 0;
-  for (size_t i=0; i<buffer.size(); i++) {
-    _value = (_value << 1) | (buffer[i]&0x01);
-    if (0 == (_value&0x03)) {
-      _value >>= 2;
-      if (_value) {
-        std::map<uint16_t, char>::iterator item = _code_table.find(_value);
-        if (item != _code_table.end()) {
-          _buffer[oidx++] = item->second;
-        } else {
-          LogMessage msg(LOG_INFO);
-          msg << "Can not decode varicode " << _value << ": Unkown symbol.";
-          Logger::get().log(msg);
-        }
-      }
-      _value = 0;
-    }
+  if (size_t n = decode(buffer, (char *)_buffer.ptr())) {
+    this->send(_buffer.head(n));
+  }
+}
+
+void
+Varicode::processBits(const BitBuffer &buffer, bool allow_overwrite) {
+  if (size_t n = decode(buffer, (char *)_buffer.ptr())) {
+    this->send(_buffer.head(n));
   }
-  if (oidx) {
-    this->send(_buffer.head(oidx));
+}
+
+std::string
+Varicode::decode(const Buffer<uint8_t> &bits) {
+  std::string text(1+bits.size()/3, 0);
+  text.resize(decode(bits, &text[0]));
+  return text;
+}
+
+std::string
+Varicode::decode(const BitBuffer &bits) {
+  std::string text(1+bits.size()/3, 0);
+  text.resize(decode(bits, &text[0]));
+  return text;
+}
+
+size_t
+Varicode::decode(const Buffer<uint8_t> &bits, char *out) {
+  size_t n = 0;
+  for (size_t i=0; i<bits.size(); i++) {
+    if (char c = decode(_value, bits[i])) { out[n++] = c; }
   }
+  return n;
 }
 
+size_t
+Varicode::decode(const BitBuffer &bits, char *out) {
+  size_t n = 0, N = bits.size();
+  for (size_t w=0; w<bits.numWords(); w++) {
+    uint32_t word = bits.word(w);
+    size_t nbits = std::min(size_t(32), N-32*w);
+    for (size_t j=0; j<nbits; j++, word <<= 1) {
+      if (char c = decode(_value, word>>31)) { out[n++] = c; }
+    }
+  }
+  return n;
+}
+
+void
+Varicode::_unknown(uint16_t value) const {
+  LogMessage msg(LOG_INFO);
+  msg << "Can not decode varicode " << value << ": Unkown symbol.";
+  Logger::get().log(msg);
+}
@@ -3,13 +3,202 @@
 
 #include "node.hh"
 #include "traits.hh"
-#include "interpolate.hh"
+#include "convert.hh"
+#include <string>
+
+/** Size of the varicode table, all codes are shorter than 12 bits. */
+#define SDR_VARICODE_TABLE_SIZE 2048
+/** Length of the BPSK31 matched filter, 2 symbols at 16 samples per symbol. */
+#define SDR_BPSK31_MF_LENGTH 32
 
 
 namespace sdr {
 
+/** The core of the BPSK31 demodulator. This class is not a processing node, it implements the
+ * demodulation of a single BPSK31 signal sample-by-sample and is used by the @c BPSK31 node and
+ * the @c PSK31Skimmer.
+ *
+ * The input signal is first down-converted using a phase-accumulator NCO that is controlled by
+ * the carrier PLL. The down-converted signal is then decimated to approx. 16 samples per symbol
+ * using a 2nd order CIC (triangular FIR) filter and passed through a filter matched to the
+ * cosine-shaped BPSK31 symbols, which also suppresses neighbouring signals. Strong signals
+ * several hundred Hz away may alias into the decimated signal, hence the input should be
+ * filtered reasonably well. The symbol timing is recovered from the decimated signal
+ * using a Gardner timing loop and the carrier frequency is tracked using a Costas loop on the
+ * symbols. A frequency detector on the decimated signal pulls the loop in from offsets of up to
+ * the PLL range (@c dF), far beyond the capture range of the Costas loop alone. Finally, the
+ * BPSK31 bit stream is decoded by detecting a phase-change (0) or not (1) between consecutive
+ * symbols.
+ * @ingroup demods */
+class BPSK31Demod
+{
+public:
+  /** Constructor.
+   * @param dF Specfies the (relative anglular) frequency range of the PLL around the carrier
+   *        frequency. */
+  BPSK31Demod(double dF=0.1);
+
+  /** (Re-) Configures the demodulator for the given sample rate. Throws a @c ConfigError if the
+   * sample rate is too low. */
+  void config(double Fs);
+  /** Resets the demodulator and tunes it to the given carrier frequency (relative angular
+   * frequency). */
+  void reset(double carrier=0);
+
+  /** Returns the current estimate of the carrier frequency (relative angular frequency). */
+  inline double carrier() const { return -(_F0 + _F); }
+  /** Returns the minimum sample rate. */
+  static inline double minSampleRate() { return _superSample*31.25; }
+  /** Returns the input samples per symbol. */
+  inline float samplesPerSymbol() const { return _sps; }
+
+  /** Processes a single input sample. Returns @c true and stores the decoded bit in @c bit,
+   * if a symbol has been received. */
+  inline bool process(const std::complex<float> &in, uint8_t &bit) {
+    // Down-convert sample using NCO
+    std::complex<float> value = _lut[_phase >> 22] * in;
+    _phase += uint32_t(_inc);
+    // Update decimator sums
+    _sum += value; _wsum += float(_j)*value; _j++;
+    if (_j < _decim) { return false; }
+    // Decimator output: 2nd order CIC as triangular FIR, i.e. rising weights over the current
+    // block and falling weights over the previous one.
+    std::complex<float> sample = (_wsum + _sum + _tail)*_norm;
+    _tail = float(_decim-1)*_sum - _wsum;
+    _sum = _wsum = 0; _j = 0;
+
+    // Matched filter, the samples are stored twice to obtain a contiguous history.
+    _mfHist[_mfIdx] = _mfHist[_mfIdx+SDR_BPSK31_MF_LENGTH] = sample;
+    _mfIdx = (_mfIdx+1) % SDR_BPSK31_MF_LENGTH;
+    sample = Convert::dot(_mfTaps, _mfHist+_mfIdx, SDR_BPSK31_MF_LENGTH);
+    // Frequency detector, squaring the phase change between samples removes the modulation
+    std::complex<float> diff = sample*std::conj(_prev);
+    _fll += diff*diff;
+
+    // Symbol timing, strobes the signal (linear interpolation) at every half symbol,
+    // alternating between mid-symbol and symbol samples.
+    bool strobe = false;
+    _count += 1;
+    if (_count >= _half) {
+      _count -= _half;
+      // The strobe was _count samples ago
+      std::complex<float> value = sample - _count*(sample - _prev);
+      if (_mid) { _midSample = value; }
+      else { bit = _processSymbol(value); strobe = true; }
+      _mid = !_mid;
+    }
+    _prev = sample;
+    return strobe;
+  }
+
+protected:
+  /** Processes a symbol sample and returns the decoded bit. */
+  inline uint8_t _processSymbol(const std::complex<float> &symbol) {
+    // Gardner timing error
+    float nrm = std::norm(symbol) + std::norm(_last);
+    float err = 0;
+    if (0 != nrm) { err = std::real((_last - symbol)*std::conj(_midSample))/nrm; }
+    err = std::max(-1.0f, std::min(1.0f, err));
+    // Adjust strobe timing
+    _count -= _gain_omega*err*_omega;
+    // Frequency aid, pulls the PLL towards the carrier by the residual rotation over the last
+    // symbol. The squared phase change is unambiguous up to a quarter of the decimated rate.
+    if (0 != std::norm(_fll)) { _F -= _gain_F*std::arg(_fll)/(2*_decim); }
+    _fll = 0;
+    // Update carrier PLL
+    _updatePLL(symbol);
+    // Decode bit: no phase change -> 1
+    uint8_t bit = (std::real(symbol*std::conj(_last)) > 0);
+    _last = symbol;
+    return bit;
+  }
+
+  /** Computes the phase error. */
+  inline float _phaseError(const std::complex<float> &value) const {
+    float r2 = value.real()*value.real();
+    float i2 = value.imag()*value.imag();
+    float nrm2 = r2+i2;
+    if (0 == nrm2) { return 0; }
+    return -value.real()*value.imag()/nrm2;
+  }
+
+  /** Updates the PLL (@c _F and the NCO). */
+  inline void _updatePLL(const std::complex<float> &sample) {
+    float phi = _phaseError(sample);
+    // Frequency in radians per input sample
+    _F += _beta*phi/_sps;
+    _F = std::min(_Fmax, std::max(_Fmin, _F));
+    // Update NCO phase and phase increment
+    _phase += uint32_t(int32_t((_alpha*phi)*(double(1u<<31)/M_PI)));
+    _inc = int32_t((_F0+_F)*(double(1u<<31)/M_PI));
+  }
+
+protected:
+  /** Holds the number of samples per symbol after decimation. */
+  static const size_t _superSample = 16;
+  /** The NCO LUT (shared by all instances). */
+  const std::complex<float> *_lut;
+  /** The matched filter taps (shared by all instances). */
+  const float *_mfTaps;
+  /** Center frequency of the NCO. */
+  float _F0;
+  /** Frequency of the carrier PLL relative to @c _F0. */
+  float _F;
+  /** Lower frequency limit of the carrier PLL. */
+  float _Fmin;
+  /** Upper frequency limit of the carrier PLL. */
+  float _Fmax;
+  /** Gain factor of the carrier PLL. */
+  float _alpha;
+  /** Gain factor of the carrier PLL. */
+  float _beta;
+  /** NCO phase. */
+  uint32_t _phase;
+  /** NCO phase increment. */
+  int32_t _inc;
+  /** Input samples per symbol. */
+  float _sps;
+  /** Decimation factor. */
+  int _decim;
+  /** Normalization of the decimator. */
+  float _norm;
+  /** Sum over the current decimator block. */
+  std::complex<float> _sum;
+  /** Weighted sum over the current decimator block. */
+  std::complex<float> _wsum;
+  /** Contribution of the previous decimator block. */
+  std::complex<float> _tail;
+  /** Index within the current decimator block. */
+  int _j;
+  /** Samples per symbol (decimated). */
+  float _omega;
+  /** Half symbol period (decimated samples). */
+  float _half;
+  /** Decimated samples since the last strobe. */
+  float _count;
+  /** Gain of the timing correction. */
+  float _gain_omega;
+  /** Gain of the frequency aid. */
+  float _gain_F;
+  /** Accumulated squared phase changes between decimated samples over the current symbol. */
+  std::complex<float> _fll;
+  /** If @c true, the next strobe is a mid-symbol one. */
+  bool _mid;
+  /** The previous decimated sample. */
+  std::complex<float> _prev;
+  /** The last symbol. */
+  std::complex<float> _last;
+  /** The last mid-symbol sample. */
+  std::complex<float> _midSample;
+  /** The matched filter history. */
+  std::complex<float> _mfHist[2*SDR_BPSK31_MF_LENGTH];
+  /** The current index into the matched filter history. */
+  size_t _mfIdx;
+};
+
+
 /** A simple BPSK31 "demodulator". This node consumes a complex input stream with a sample rate of
- * at least 2000Hz and produces a bitstream with 31.25 Hz "sample rate". Use the @c Varicode node
+ * at least 500Hz and produces a bitstream with 31.25 Hz "sample rate". Use the @c Varicode node
  * to decode this bitstream to ASCII chars. The BPSK31 signal should be centered around 0Hz. This
  * node uses a simple PLL to adjust for small detunings.
  * @ingroup demods */
@@ -19,12 +208,7 @@ class BPSK31: public Sink< std::complex<Scalar> >, public Source
 public:
   /** Constructs a new BPSK31 demodulator.
    *
-   * This node first subsamples the input signal to a multiple of 31.25 Hz (by default to
-   * 2000Hz = 64*31.25) using an interpolating sub-sampler. Therefore, the input signal must be
-   * filtered sufficiently well to avoid artifacts of the interpolating sub-sampler.
-   * Then, the phase-constellation of the signal is determined as either -pi or pi while the
-   * frequency of the carrier is tracked using a simple PLL. Finally, the BPSK31 bit stream is
-   * decoded by detecting a phase-change (0) or not (1).
+   * See @c BPSK31Demod for details about the demodulation.
    *
    * @note This node uses floating point arithmetic, hence it should not be used on streams with
    *       a high sample rate! Which is not neccessary as it only decodes a BPSK signal with approx.
@@ -33,39 +217,14 @@ public:
    * @param dF Specfies the (relative anglular) frequency range of the PLL to adjust for small
    *        deviations of the BPSK31 signal from 0Hz. */
   BPSK31(double dF=0.1)
-    : Sink< std::complex<Scalar> >(), Source(),
-      _P(0), _F(0), _Fmin(-dF), _Fmax(dF)
+    : Sink< std::complex<Scalar> >(), Source(), _demod(dF)
   {
-    // Assemble carrier PLL gains:
-    double damping = std::sqrt(2)/2;
-    double bw = M_PI/100;
-    double tmp = 1. + 2*damping*bw + bw*bw;
-    _alpha = 4*damping*bw/tmp;
-    _beta  = 4*bw*bw/tmp;
-
-    // Init delay line for the interpolating sub-sampler
-    _dl = Buffer< std::complex<float> >(2*8); _dl_idx = 0;
-    for (size_t i=0; i<16; i++) { _dl[i] = 0; }
-    _mu = 0.25; _gain_mu = 0.01;
-
-    // constant phase shift of the signal
-    _theta = 0;
-
-    // Phase detection:
-    _omega = _min_omega = _max_omega = 0;
-    _omega_rel = 0.001; _gain_omega = 0.001;
-    _p_0T = _p_1T = _p_2T = 0;
-    _c_0T = _c_1T = _c_2T = 0;
-
-    // Super-sample (64 phase samples per symbol)
-    _superSample = 64;
+    // pass...
   }
 
   /** Destructor. */
   virtual ~BPSK31() {
     // unreference buffers
-    _dl.unref();
-    _hist.unref();
     _buffer.unref();
   }
 
@@ -82,76 +241,23 @@ public:
       throw err;
     }
 
-    // Check input sample rate
-    double Fs = src_cfg.sampleRate();
-    if (2000 > Fs) {
-      ConfigError err;
-      err << "Can not configure BPSK31: Input sample rate too low! The BPSK31 node requires at "
-          << "least a sample rate of 2000Hz, got " << Fs << "Hz";
-      throw err;
-    }
-
-    // Compute samples per symbol
-    _omega = Fs/(_superSample*31.25);
-    // Obtain limits for the sub-sample rate
-    _min_omega = _omega*(1.0 - _omega_rel);
-    _max_omega = _omega*(1.0 + _omega_rel);
-
-    // Decoding history, contains up to 64 phases (if in sync)
-    _hist = Buffer<float>(_superSample);
-    _hist_idx = 0;
-    _last_constellation = 1;
+    // Configure demodulator, checks input sample rate
+    _demod.config(src_cfg.sampleRate());
 
     // Output buffer
-    size_t bsize = 1 + int(Fs/31.25);
+    size_t bsize = 2 + int(src_cfg.bufferSize()/_demod.samplesPerSymbol());
     _buffer = Buffer<uint8_t>(bsize);
 
     // This node sends a bit-stream with 31.25 baud.
-    this->setConfig(Config(Traits<uint8_t>::scalarId, 31.25, src_cfg.bufferSize(), 1));
+    this->setConfig(Config(Traits<uint8_t>::scalarId, 31.25, bsize, 1));
   }
 
 
   virtual void process(const Buffer< std::complex<Scalar> > &buffer, bool allow_overwrite) {
-    size_t i=0, o=0;
-    while (i<buffer.size()) {
-      // First, fill sampler...
-      while ( (_mu > 1) && (i<buffer.size()) ) {
-        _updateSampler(buffer[i]); i++;
-      }
-      // Then, ...
-      if (i<buffer.size()) {
-        // Subsample
-        std::complex<float> sample = interpolate(_dl.sub(_dl_idx, 8), _mu);
-        // Update error tracking
-        _errorTracking(sample);
-        // Update carrier PLL
-        _updatePLL(sample);
-        // done. real(sample) constains phase of symbol
-
-        // Now fill history with phase constellation and try to decode a bit
-        _hist[_hist_idx] = std::real(sample);
-        // Check if there is a constellation transition at the current time
-        if ((_hist_idx>1) && (_hasTransition())) {
-          if (_hist_idx<(_superSample/2)) {
-            // If less than superSample values in hist -> drop
-            _hist_idx = 0;
-          } else {
-            // Otherwise decode
-            int cconst = _currentContellation();
-            _buffer[o++] = (_last_constellation == cconst);
-            _last_constellation = cconst;
-            _hist_idx = 0;
-          }
-        } else if (_hist_idx == (_superSample-1)) {
-          // If the symbol is complete:
-          int cconst = _currentContellation();
-          _buffer[o++] = (_last_constellation == cconst);
-          _last_constellation = cconst;
-          _hist_idx = 0;
-        } else {
-          // Next sample
-          _hist_idx++;
-        }
+    size_t o=0;
+    for (size_t i=0; i<buffer.size(); i++) {
+      if (_demod.process(std::complex<float>(buffer[i].real(), buffer[i].imag()), _buffer[o])) {
+        o++;
       }
     }
     // If at least 1 bit was decoded -> send result
@@ -160,143 +266,23 @@ public:
 
 
 protected:
-  /** Returns @c true if there is a phase transition at the current sample. */
-  inline bool _hasTransition() const {
-    return ((_hist[_hist_idx-1]>=0) && (_hist[_hist_idx]<=0)) ||
-        ((_hist[_hist_idx-1]<=0) && (_hist[_hist_idx]>=0));
-  }
-
-  /** Returns the current constellation. */
-  inline int _currentContellation() const {
-    float value = 0;
-    for (size_t i=0; i<=_hist_idx; i++) { value += _hist[i]; }
-    return (value > 0) ? 1 : -1;
-  }
-
-  /** Computes the phase error. */
-  inline float _phaseError(const std::complex<float> &value) const {
-    float r2 = value.real()*value.real();
-    float i2 = value.imag()*value.imag();
-    float nrm2 = r2+i2;
-    if (0 == nrm2) { return 0; }
-    return -value.real()*value.imag()/nrm2;
-  }
-
-  /** Updates the PLL (@c _F and @c _P). */
-  inline void _updatePLL(const std::complex<float> &sample) {
-    float phi = _phaseError(sample);
-    _F += _beta*phi;
-    _P += _F + _alpha*phi;
-    while (_P>( 2*M_PI)) { _P -= 2*M_PI; }
-    while (_P<(-2*M_PI)) { _P += 2*M_PI; }
-    _F = std::min(_Fmax, std::max(_Fmin, _F));
-    //std::cerr << "Update PLL: P=" << _P << "; F=" << _F << ", err= " << phi << std::endl;
-  }
-
-  /** Updates the sub-sampler. */
-  inline void _updateSampler(const std::complex<Scalar> &value) {
-    // decrease fractional sub-sample counter
-    _mu-=1;
-    // Update phase
-    _P += _F;
-    // Limit phase
-    while (_P>( 2*M_PI)) { _P -= 2*M_PI; }
-    while (_P<(-2*M_PI)) { _P += 2*M_PI; }
-    // Calc down-conversion factor (consider look-up table)
-    std::complex<float> fac = std::exp(std::complex<float>(0, _P+_theta));
-    // Down-convert singal
-    std::complex<float> sample = fac * std::complex<float>(value.real(), value.imag());
-    // store sample into delay line
-    _dl[_dl_idx] = sample;
-    _dl[_dl_idx+8] = sample;
-    _dl_idx = (_dl_idx + 1) % 8;
-  }
-
-  /** Updates the PPL state (@c _mu  and @c _omega). */
-  inline void _errorTracking(const std::complex<float> &sample) {
-    // Update last 2 constellation and phases
-    _p_2T = _p_1T; _p_1T = _p_0T; _p_0T = sample;
-    _c_2T = _c_1T; _c_1T = _c_0T; _c_0T = (sample.real() > 0) ? -1 : 1;
-    // Compute difference between phase and constellation
-    std::complex<float> x = (_c_0T - _c_2T) * std::conj(_p_1T);
-    std::complex<float> y = (_p_0T - _p_2T) * std::conj(_c_1T);
-    // Get phase error
-    float err = std::real(y-x);
-    if (err >  1.0) { err = 1.0; }
-    if (err < -1.0) { err = -1.0; }
-    // Update symbol rate (approx 31.25*64)
-    _omega += _gain_omega * err;
-    // Limit omega on _omega_mid +/- _omega*_omega_rel
-    _omega = std::max(_min_omega, std::min(_max_omega, _omega));
-    // Update mu as +_omega (samples per symbol) and a small correction term
-    _mu += _omega + _gain_mu * err;
-  }
-
-
-protected:
-  /** Holds the number of phase constellations per bit. */
-  size_t _superSample;
-  /** Phase of the carrier PLL. */
-  float _P;
-  /** Frequency of the carrier PLL. */
-  float _F;
-  /** Lower frequency limit of the carrier PLL. */
-  float _Fmin;
-  /** Upper frequency limit of the carrier PLL. */
-  float _Fmax;
-  /** Gain factor of the carrier PLL. */
-  float _alpha;
-  /** Gain factor of the carrier PLL. */
-  float _beta;
-  /** The delay line for the interpolating sub-sampler. */
-  Buffer< std::complex<float> > _dl;
-  /** The current index of the delay line. */
-  size_t _dl_idx;
-  /** Holds the fractional sub-sampling counter. */
-  float _mu;
-  /** Gain factor of the sub-sampler. */
-  float _gain_mu;
-  /** Constant phase shift between real axis and first constellation. (Currently unused). */
-  float _theta;
-  /** Current sub-sample rate. */
-  float _omega;
-  /** Relative error of the subsample rate. */
-  float _omega_rel;
-  /** Minimum of the sub-sample rate. */
-  float _min_omega;
-  /** Maximum of the sub-sample rate. */
-  float _max_omega;
-  /** Gain of the sub-sample rate correction. */
-  float _gain_omega;
-  /** Phase at T = 0 (samples). */
-  std::complex<float> _p_0T;
-  /** Phase at T=-1 (samples). */
-  std::complex<float> _p_1T;
-  /** Phase at T=-2 (samples). */
-  std::complex<float> _p_2T;
-  /** Constellation at T=0 (samples). */
-  std::complex<float> _c_0T;
-  /** Constellation at T=-1 (samples). */
-  std::complex<float> _c_1T;
-  /** Constellation at T=-2 (samples). */
-  std::complex<float> _c_2T;
-  /** The last @c _superSample phases. */
-  Buffer<float> _hist;
-  /** Current phase history index. */
-  size_t _hist_idx;
-  /** The last output constellation. */
-  int _last_constellation;
+  /** The demodulator. */
+  BPSK31Demod _demod;
   /** Output buffer. */
   Buffer<uint8_t> _buffer;
 };
 
 
 
-/** Simple varicode (Huffman code) decoder node. It consumes a bit-stream (uint8_t)
+/** Simple varicode (Huffman code) decoder node. It consumes a bit-stream (uint8_t or packed bits)
  * and produces a uint8_t stream of ascii chars. Non-printable chars (except for new-line) are
  * ignored. The output stream has no samplerate!
+ *
+ * The code table is a dense table shared by all instances, indexed directly by the received
+ * code. Beside the node interface, the decoder can be used directly on bit buffers using the
+ * @c decode methods.
  * @ingroup datanodes */
-class Varicode: public Sink<uint8_t>, public Source
+class Varicode: public BitSink, public Source
 {
 public:
   /** Constructor. */
@@ -307,17 +293,55 @@ public:
   virtual void config(const Config &src_cfg);
   /** Converts the input bit stream to ASCII chars. */
   virtual void process(const Buffer<uint8_t> &buffer, bool allow_overwrite);
+  /** Converts the input bit stream (packed bits) to ASCII chars. */
+  virtual void processBits(const BitBuffer &buffer, bool allow_overwrite);
+
+  /** Resets the state of the decoder. */
+  inline void reset() { _value = 0; }
+
+  /** Decodes the given bits (one per byte) and returns the received chars. The decoder state is
+   * kept between calls, hence a bit stream can be decoded in chunks. */
+  std::string decode(const Buffer<uint8_t> &bits);
+  /** Decodes the given packed bits and returns the received chars. The decoder state is kept
+   * between calls, hence a bit stream can be decoded in chunks. */
+  std::string decode(const BitBuffer &bits);
+  /** Decodes the given bits (one per byte) and stores the received chars in @c out, which must
+   * hold at least 1+bits.size()/3 chars. Returns the number of chars received. */
+  size_t decode(const Buffer<uint8_t> &bits, char *out);
+  /** Decodes the given packed bits and stores the received chars in @c out, which must hold at
+   * least 1+bits.size()/3 chars. Returns the number of chars received. */
+  size_t decode(const BitBuffer &bits, char *out);
+
+  /** Shifts a single bit into the given shift register. Returns the decoded char or 0 if no
+   * char has been completed yet. This allows to share a single decoder between several
+   * bit streams. */
+  inline char decode(uint16_t &value, uint8_t bit) const {
+    value = (value << 1) | (bit&0x01);
+    // A char is terminated by two 0s
+    if (0 != (value&0x03)) { return 0; }
+    value >>= 2;
+    char c = 0;
+    if (value) {
+      if (value < SDR_VARICODE_TABLE_SIZE) { c = _code_table[value]; }
+      if (0 == c) { _unknown(value); }
+    }
+    value = 0;
+    return c;
+  }
+
+protected:
+  /** Logs an unknown code. */
+  void _unknown(uint16_t value) const;
 
 protected:
   /** The shift register of the last received bits. */
   uint16_t _value;
   /** The output buffer. */
   Buffer<uint8_t> _buffer;
-  /** The conversion table. */
-  std::map<uint16_t, char> _code_table;
+  /** The conversion table (shared by all instances), 0 marks invalid codes. */
+  const char *_code_table;
 };
 
-
 }
 
 
@@ -0,0 +1,304 @@
+#include "psk31skimmer.hh"
+#include "logger.hh"
+#include <algorithm>
+#include <limits>
+
+using namespace sdr;
+
+
+/* ********************************************************************************************* *
+ * Implementation of PSK31Skimmer::Channel
+ * ********************************************************************************************* */
+PSK31Skimmer::Channel::Channel(double Fs, size_t bin, double F0, double F, size_t id)
+  : Fs(Fs), bin(bin), F0(F0), id(id), demod((2*M_PI*20)/Fs), varicode(0), misses(0), text()
+{
+  demod.config(Fs);
+  // Tune to the residual offset of the carrier within the sub-band
+  demod.reset((2*M_PI*(F-F0))/Fs);
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of PSK31Skimmer
+ * ********************************************************************************************* */
+PSK31Skimmer::PSK31Skimmer(double Fmin, double Fmax, size_t maxChannels, double threshold)
+  : Sink<int16_t>(), _Fmin(Fmin), _Fmax(Fmax), _maxChannels(maxChannels), _threshold(threshold),
+    _Fs(0), _N(0), _kmin(0), _kmax(0), _width(0), _separation(0), _hold(0), _frames(0),
+    _spawned(0), _plan(0), _fftIdx(0), _M(0), _D(0), _L(0), _bankIdx(0), _bankPhase(0),
+    _bankCount(0), _bankPlan(0), _varicode()
+{
+  // pass...
+}
+
+PSK31Skimmer::~PSK31Skimmer() {
+  for (size_t i=0; i<_channels.size(); i++) { delete _channels[i]; }
+  if (_plan) { delete _plan; }
+  if (_bankPlan) { delete _bankPlan; }
+  _window.unref();
+  _fftIn.unref();
+  _fftOut.unref();
+  _spectrum.unref();
+  _power.unref();
+  _bankTaps.unref();
+  _bankHist.unref();
+  _bankSum.unref();
+  _bankIn.unref();
+  _bankOut.unref();
+}
+
+void
+PSK31Skimmer::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId<int16_t>() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure PSK31Skimmer: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId<int16_t>();
+    throw err;
+  }
+  // Check sample rate
+  _Fs = src_cfg.sampleRate();
+  if (BPSK31Demod::minSampleRate() > _Fs) {
+    ConfigError err;
+    err << "Can not configure PSK31Skimmer: Input sample rate too low! The skimmer requires at "
+        << "least a sample rate of " << BPSK31Demod::minSampleRate() << "Hz, got " << _Fs << "Hz";
+    throw err;
+  }
+
+  // Retire all channels
+  while (_channels.size()) { _retire(_channels.size()-1); }
+
+  // FFT size, resolution of at least 8Hz
+  _N = 64;
+  while (_N < _Fs/8) { _N <<= 1; }
+  double df = _Fs/_N;
+  _kmin = std::max(1, int(std::ceil(_Fmin/df)));
+  _kmax = std::min(int(_N/2)-1, int(std::floor(_Fmax/df)));
+  if (_kmin >= _kmax) {
+    ConfigError err;
+    err << "Can not configure PSK31Skimmer: Empty pass band [" << _Fmin << "Hz, " << _Fmax
+        << "Hz] at a sample rate of " << _Fs << "Hz.";
+    throw err;
+  }
+  // BPSK31 signals are about 40Hz wide and should be at least 40Hz apart
+  _width      = std::max(1, int(std::round(20/df)));
+  _separation = std::max(int(_width), int(std::round(40/df)));
+  // Retire channels after the carrier vanished for approx. 3s
+  _hold = std::max(2, int((3*_Fs)/_N));
+  _frames = 0;
+
+  // Assemble window & FFT
+  _window = Buffer<float>(_N);
+  for (size_t i=0; i<_N; i++) { _window[i] = 0.5 - 0.5*std::cos((2*M_PI*i)/_N); }
+  _fftIn  = Buffer< std::complex<float> >(_N);
+  _fftOut = Buffer< std::complex<float> >(_N);
+  if (_plan) { delete _plan; }
+  _plan = new FFTPlan<float>(_fftIn, _fftOut, FFT::FORWARD);
+  _fftIdx = 0;
+  _spectrum = Buffer<float>(_N/2);
+  _power = Buffer<float>(_N/2);
+  for (size_t i=0; i<_N/2; i++) { _spectrum[i] = _power[i] = 0; }
+
+  // Filter bank, decimates to the sample rate of the demodulator and is 2x oversampled, hence a
+  // sub-band covers about +/-125Hz around its center plus the bandwidth of a BPSK31 signal.
+  _D = std::max(1, int(_Fs/BPSK31Demod::minSampleRate()));
+  _M = 2*_D;
+  _L = 10*_M;
+  // Prototype filter: Blackman windowed sinc with its cutoff at the sub-band spacing. It is
+  // symmetric, hence the reversed order equals the original one.
+  _bankTaps = Buffer<float>(_L);
+  double norm = 0;
+  for (size_t i=0; i<_L; i++) {
+    double t = i - (_L-1)/2.;
+    _bankTaps[i] = std::sin((2*M_PI*t)/_M)/(M_PI*t);
+    _bankTaps[i] *= 0.42 - 0.5*std::cos((2*M_PI*i)/(_L-1)) + 0.08*std::cos((4*M_PI*i)/(_L-1));
+    norm += _bankTaps[i];
+  }
+  for (size_t i=0; i<_L; i++) { _bankTaps[i] /= norm; }
+  _bankHist = Buffer<float>(2*_L);
+  for (size_t i=0; i<2*_L; i++) { _bankHist[i] = 0; }
+  _bankIdx = _bankPhase = _bankCount = 0;
+  _bankSum = Buffer<float>(_M);
+  _bankIn  = Buffer< std::complex<float> >(_M);
+  _bankOut = Buffer< std::complex<float> >(_M);
+  if (_bankPlan) { delete _bankPlan; }
+  _bankPlan = new FFTPlan<float>(_bankIn, _bankOut, FFT::FORWARD);
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Config PSK31Skimmer node: " << std::endl
+      << " sample rate: " << _Fs << "Hz" << std::endl
+      << " pass band: [" << _kmin*df << "Hz, " << _kmax*df << "Hz]" << std::endl
+      << " FFT size: " << _N << " (" << df << "Hz resolution)" << std::endl
+      << " filter bank: " << _M << " sub-bands, " << _L << " taps" << std::endl
+      << " max. channels: " << _maxChannels;
+  Logger::get().log(msg);
+}
+
+void
+PSK31Skimmer::process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
+  uint8_t bit;
+  for (size_t i=0; i<buffer.size(); i++) {
+    float value = buffer[i];
+    // Update spectrum
+    _fftIn[_fftIdx] = _window[_fftIdx]*value;
+    if (_N == (++_fftIdx)) {
+      (*_plan)(); _fftIdx = 0;
+      _updateSpectrum();
+    }
+    // Update filter bank
+    _bankHist[_bankIdx] = _bankHist[_bankIdx+_L] = value;
+    _bankIdx = (_bankIdx+1) % _L;
+    _bankPhase = (_bankPhase+1) % _M;
+    if (_D != (++_bankCount)) { continue; }
+    _bankCount = 0;
+    _updateBank();
+    // Demodulate & decode every channel at the decimated rate
+    for (size_t c=0; c<_channels.size(); c++) {
+      Channel *channel = _channels[c];
+      if (! channel->demod.process(_bankOut[channel->bin], bit)) { continue; }
+      if (char ch = _varicode.decode(channel->varicode, bit)) {
+        channel->text.push_back(ch);
+      }
+    }
+  }
+
+  for (size_t c=0; c<_channels.size(); c++) {
+    Channel *channel = _channels[c];
+    if (channel->text.size()) {
+      handleText(channel->id, channel->frequency(), channel->text);
+      channel->text.clear();
+    }
+  }
+}
+
+void
+PSK31Skimmer::handleText(size_t id, double F, const std::string &text) {
+  // pass...
+}
+
+void
+PSK31Skimmer::_updateSpectrum() {
+  // Update averaged power spectrum
+  for (size_t k=0; k<_N/2; k++) {
+    float P = std::norm(_fftOut[k]);
+    if (0 == _frames) { _spectrum[k] = P; }
+    else { _spectrum[k] += 0.3*(P-_spectrum[k]); }
+  }
+  _frames++;
+
+  // Power within the bandwidth of a BPSK31 signal around each bin of the pass band
+  float sum = 0;
+  for (size_t k=_kmin-std::min(_kmin, _width); k<std::min(_kmin+_width, _N/2); k++) {
+    sum += _spectrum[k];
+  }
+  for (size_t k=_kmin; k<=_kmax; k++) {
+    if ((k+_width) < _N/2) { sum += _spectrum[k+_width]; }
+    _power[k] = sum;
+    if (k >= _width) { sum -= _spectrum[k-_width]; }
+  }
+
+  // Estimate noise floor within the bandwidth of a BPSK31 signal as the 10% quantile of the
+  // spectrum over the pass band. A crowded band may be covered by signals almost completely.
+  _noise.assign(&_spectrum[_kmin], &_spectrum[_kmax]+1);
+  std::nth_element(_noise.begin(), _noise.begin()+_noise.size()/10, _noise.end());
+  float noise = (2*_width+1)*_noise[_noise.size()/10];
+  noise = std::max(noise, std::numeric_limits<float>::min());
+
+  double df = _Fs/_N;
+  // Retire channels whose carrier vanished or left the pass band
+  for (int i=_channels.size()-1; i>=0; i--) {
+    int k = std::round(_channels[i]->frequency()/df);
+    if ((k < int(_kmin)) || (k > int(_kmax))) { _retire(i); continue; }
+    if (_power[k] < 0.5*_threshold*noise) { _channels[i]->misses++; }
+    else { _channels[i]->misses = 0; }
+    if (_channels[i]->misses > _hold) { _retire(i); }
+  }
+  // Retire channels that are locked to the same carrier, keeps the older one
+  for (int i=_channels.size()-1; i>0; i--) {
+    for (int j=0; j<i; j++) {
+      if (std::abs(_channels[i]->frequency()-_channels[j]->frequency()) < (_width*df)/2) {
+        _retire(i); break;
+      }
+    }
+  }
+
+  // Wait for a few spectra before spawning channels
+  if (_frames < 4) { return; }
+  // Search for new carriers
+  for (size_t k=_kmin; (k<=_kmax) && (_channels.size()<_maxChannels); k++) {
+    if (_power[k] < _threshold*noise) { continue; }
+    // Check for local maximum
+    bool isMax = true;
+    size_t lo = std::max(_kmin, k-std::min(k, _separation));
+    size_t hi = std::min(_kmax, k+_separation);
+    for (size_t j=lo; isMax && (j<k); j++) { isMax = (_power[j] < _power[k]); }
+    for (size_t j=k+1; isMax && (j<=hi); j++) { isMax = (_power[j] <= _power[k]); }
+    if (! isMax) { continue; }
+    // Estimate carrier frequency as the centroid of the signal
+    float F = 0, P = 0;
+    for (size_t j=k-std::min(k, _width); (j<=k+_width) && (j<_N/2); j++) {
+      F += j*_spectrum[j]; P += _spectrum[j];
+    }
+    F = (F/P)*df;
+    // Check if there is a channel already
+    bool known = false;
+    for (size_t i=0; (!known) && (i<_channels.size()); i++) {
+      known = (std::abs(_channels[i]->frequency()-F) < _separation*df);
+    }
+    if (known) { continue; }
+    // Spawn channel on the closest sub-band
+    size_t bin = std::min(_M/2, size_t(std::round((F*_M)/_Fs)));
+    _channels.push_back(new Channel(_Fs/_D, bin, (bin*_Fs)/_M, F, _spawned++));
+    LogMessage msg(LOG_DEBUG);
+    msg << "PSK31Skimmer: Spawned channel #" << _channels.back()->id << " at " << F << "Hz.";
+    Logger::get().log(msg);
+  }
+}
+
+void
+PSK31Skimmer::_updateBank() {
+  // Filter the history with the prototype filter and fold it to _M samples
+  const float *taps = (const float *)_bankTaps.data();
+  const float *hist = ((const float *)_bankHist.data()) + _bankIdx;
+  float *sum = (float *)_bankSum.data();
+  for (size_t m=0; m<_M; m++) { sum[m] = 0; }
+  for (size_t j=0; j<_L; j+=_M) {
+    for (size_t m=0; m<_M; m++) { sum[m] += taps[j+m]*hist[j+m]; }
+  }
+  // Rotate by the number of samples received, keeps the phase of the down-converted sub-bands
+  // continuous between outputs
+  std::complex<float> *in = (std::complex<float> *)_bankIn.data();
+  for (size_t m=0; m<(_M-_bankPhase); m++) { in[_bankPhase+m] = sum[m]; }
+  for (size_t m=(_M-_bankPhase); m<_M; m++) { in[_bankPhase+m-_M] = sum[m]; }
+  // Down-convert all sub-bands at once
+  (*_bankPlan)();
+}
+
+void
+PSK31Skimmer::_retire(size_t i) {
+  LogMessage msg(LOG_DEBUG);
+  msg << "PSK31Skimmer: Retired channel #" << _channels[i]->id
+      << " at " << _channels[i]->frequency() << "Hz.";
+  Logger::get().log(msg);
+  // Pass on the text received so far
+  Channel *channel = _channels[i];
+  if (channel->text.size()) { handleText(channel->id, channel->frequency(), channel->text); }
+  delete channel;
+  _channels.erase(_channels.begin()+i);
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of PSK31SkimmerDump
+ * ********************************************************************************************* */
+PSK31SkimmerDump::PSK31SkimmerDump(std::ostream &stream, double Fmin, double Fmax)
+  : PSK31Skimmer(Fmin, Fmax), _stream(stream)
+{
+  // pass...
+}
+
+void
+PSK31SkimmerDump::handleText(size_t id, double F, const std::string &text) {
+  _stream << "PSK31 #" << id << " @" << int(F+0.5) << "Hz: " << text << std::endl;
+}
@@ -0,0 +1,202 @@
+#ifndef __SDR_PSK31SKIMMER_HH__
+#define __SDR_PSK31SKIMMER_HH__
+
+#include "node.hh"
+#include "psk31.hh"
+#include "fftplan.hh"
+#include <string>
+#include <vector>
+#include <iostream>
+
+
+namespace sdr {
+
+/** A PSK31 band skimmer. This node consumes a real audio signal (e.g. the output of an USB
+ * demodulator) and decodes all BPSK31 signals found within the specified pass band
+ * simultaneously.
+ *
+ * The node periodically computes the (averaged) power spectrum of the input signal to detect
+ * BPSK31 carriers. For every detected carrier, a lightweight demodulator channel (see
+ * @c BPSK31Demod) is spawned which tracks the carrier. Channels are retired once their carrier
+ * has vanished from the spectrum for a while.
+ *
+ * The down-conversion is shared by all channels: A polyphase FFT filter bank splits the pass
+ * band into @c M sub-bands (about 250Hz apart), each down-converted to 0Hz and decimated by
+ * @c M/2 to the sample rate of the demodulator (at least 500Hz). Hence the cost of the filter
+ * bank does not depend on the number of channels. Every channel picks the sub-band closest to
+ * its carrier and only removes the residual offset of the carrier at the decimated rate. All
+ * channels share the NCO table and the matched filter of the demodulator as well as a single
+ * @c Varicode table.
+ *
+ * The decoded text is passed to @c handleText together with the current carrier frequency of
+ * the channel. Re-implement this method to process the decoded text.
+ * @ingroup datanodes */
+class PSK31Skimmer: public Sink<int16_t>
+{
+protected:
+  /** A single demodulator channel. */
+  class Channel
+  {
+  public:
+    /** Constructor.
+     * @param Fs Specifies the sample rate of the sub-band.
+     * @param bin Specifies the sub-band of the filter bank.
+     * @param F0 Specifies the center frequency of the sub-band in Hz.
+     * @param F Specifies the carrier frequency in Hz.
+     * @param id Specifies the unique ID of the channel. */
+    Channel(double Fs, size_t bin, double F0, double F, size_t id);
+
+    /** Returns the current carrier frequency in Hz. */
+    inline double frequency() const { return F0 + demod.carrier()*Fs/(2*M_PI); }
+
+  public:
+    /** The sample rate of the sub-band. */
+    double Fs;
+    /** The sub-band of the filter bank. */
+    size_t bin;
+    /** The center frequency of the sub-band. */
+    double F0;
+    /** The unique ID of the channel. */
+    size_t id;
+    /** The demodulator. */
+    BPSK31Demod demod;
+    /** The varicode shift register. */
+    uint16_t varicode;
+    /** Number of successive spectra in which the carrier was missing. */
+    size_t misses;
+    /** The text received during the current buffer. */
+    std::string text;
+  };
+
+public:
+  /** Constructor.
+   * @param Fmin Specifies the lower edge of the pass band in Hz.
+   * @param Fmax Specifies the upper edge of the pass band in Hz.
+   * @param maxChannels Specifies the maximum number of concurrent channels.
+   * @param threshold Specifies the minimum signal to noise ratio (linear power ratio) of a
+   *        carrier to spawn a channel. */
+  PSK31Skimmer(double Fmin=200, double Fmax=3000, size_t maxChannels=64, double threshold=10);
+  /** Destructor. */
+  virtual ~PSK31Skimmer();
+
+  virtual void config(const Config &src_cfg);
+  virtual void process(const Buffer<int16_t> &buffer, bool allow_overwrite);
+
+  /** Returns the number of active channels. */
+  inline size_t numChannels() const { return _channels.size(); }
+  /** Returns the current carrier frequency of the specified channel. */
+  inline double channelFrequency(size_t i) const { return _channels[i]->frequency(); }
+  /** Returns the unique ID of the specified channel. */
+  inline size_t channelId(size_t i) const { return _channels[i]->id; }
+
+  /** Gets called for every piece of text decoded by a channel.
+   * @param id Specifies the unique ID of the channel.
+   * @param F Specifies the current carrier frequency of the channel in Hz.
+   * @param text The decoded text. */
+  virtual void handleText(size_t id, double F, const std::string &text);
+
+protected:
+  /** Processes a complete spectrum, spawns and retires channels. */
+  void _updateSpectrum();
+  /** Computes the next output sample of every sub-band of the filter bank. */
+  void _updateBank();
+  /** Removes the specified channel. */
+  void _retire(size_t i);
+
+protected:
+  /** Lower edge of the pass band. */
+  double _Fmin;
+  /** Upper edge of the pass band. */
+  double _Fmax;
+  /** Maximum number of channels. */
+  size_t _maxChannels;
+  /** Detection threshold. */
+  float _threshold;
+  /** The sample rate. */
+  double _Fs;
+  /** The FFT size. */
+  size_t _N;
+  /** The index of the first bin of the pass band. */
+  size_t _kmin;
+  /** The index of the last bin of the pass band. */
+  size_t _kmax;
+  /** Half width of a BPSK31 signal in bins. */
+  size_t _width;
+  /** Minimum separation of two channels in bins. */
+  size_t _separation;
+  /** Number of spectra a carrier may be missing before the channel gets retired. */
+  size_t _hold;
+  /** The number of spectra computed so far. */
+  size_t _frames;
+  /** The number of channels spawned so far, used as channel IDs. */
+  size_t _spawned;
+  /** The window function. */
+  Buffer<float> _window;
+  /** FFT input buffer. */
+  Buffer< std::complex<float> > _fftIn;
+  /** FFT output buffer. */
+  Buffer< std::complex<float> > _fftOut;
+  /** The FFT plan. */
+  FFTPlan<float> *_plan;
+  /** The current index into the FFT input buffer. */
+  size_t _fftIdx;
+  /** The averaged power spectrum. */
+  Buffer<float> _spectrum;
+  /** The power within the bandwidth of a BPSK31 signal for each bin. */
+  Buffer<float> _power;
+  /** Temporary buffer to estimate the noise floor. */
+  std::vector<float> _noise;
+  /** The number of sub-bands of the filter bank. */
+  size_t _M;
+  /** The decimation of the filter bank (@c _M/2). */
+  size_t _D;
+  /** The number of taps of the prototype filter, a multiple of @c _M. */
+  size_t _L;
+  /** The (symmetric) prototype filter taps. */
+  Buffer<float> _bankTaps;
+  /** The last @c _L input samples, stored twice to obtain a contiguous history. */
+  Buffer<float> _bankHist;
+  /** The current index into the history. */
+  size_t _bankIdx;
+  /** The number of input samples received modulo @c _M. */
+  size_t _bankPhase;
+  /** The number of input samples since the last output of the filter bank. */
+  size_t _bankCount;
+  /** The filtered history, folded to @c _M samples. */
+  Buffer<float> _bankSum;
+  /** FFT input buffer of the filter bank. */
+  Buffer< std::complex<float> > _bankIn;
+  /** The current output sample of every sub-band. */
+  Buffer< std::complex<float> > _bankOut;
+  /** The FFT plan of the filter bank. */
+  FFTPlan<float> *_bankPlan;
+  /** The shared varicode table. */
+  Varicode _varicode;
+  /** The active channels. */
+  std::vector<Channel *> _channels;
+};
+
+
+/** Simple PSK31 skimmer, dumping the decoded text, tagged with the carrier frequency, into the
+ * given stream.
+ * @ingroup datanodes */
+class PSK31SkimmerDump: public PSK31Skimmer
+{
+public:
+  /** Constructor.
+   * @param stream Specifies the stream, the received text is serialized into.
+   * @param Fmin Specifies the lower edge of the pass band in Hz.
+   * @param Fmax Specifies the upper edge of the pass band in Hz. */
+  PSK31SkimmerDump(std::ostream &stream, double Fmin=200, double Fmax=3000);
+
+  /** Dumps the received text. */
+  void handleText(size_t id, double F, const std::string &text);
+
+protected:
+  /** The output stream. */
+  std::ostream &_stream;
+};
+
+}
+
+#endif // __SDR_PSK31SKIMMER_HH__
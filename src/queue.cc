@@ -37,7 +37,9 @@ Queue::send(const RawBuffer &buffer, SinkBase *sink, bool allow_overwrite) {
   // Refrerence buffer
   pthread_mutex_lock(&_queue_lock);
   buffer.ref();
-  _queue.push_back(Message(buffer, sink, allow_overwrite));
+  // Take the time of arrival only if the latency of the sink is monitored
+  int64_t received = sink->isMonitored() ? BufferMeta::now() : 0;
+  _queue.push_back(Message(buffer, sink, allow_overwrite, received));
   pthread_cond_signal(&_queue_cond);
   pthread_mutex_unlock(&_queue_lock);
 }
@@ -100,7 +102,7 @@ Queue::_main()
       Message msg(_queue.front()); _queue.pop_front();
       pthread_mutex_unlock(&_queue_lock);
       // Process message
-      msg.sink()->handleBuffer(msg.buffer(), msg.allowOverwrite());
+      msg.sink()->deliver(msg.buffer(), msg.allowOverwrite(), msg.received());
       // Mark buffer unused
       msg.buffer().unref();
     }
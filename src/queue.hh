@@ -57,16 +57,18 @@ public:
   class Message {
   public:
     /** Constructor. */
-    Message(const RawBuffer &buffer, SinkBase *sink, bool allow_overwrite)
-      : _buffer(buffer), _sink(sink), _allow_overwrite(allow_overwrite) { }
+    Message(const RawBuffer &buffer, SinkBase *sink, bool allow_overwrite, int64_t received=0)
+      : _buffer(buffer), _sink(sink), _allow_overwrite(allow_overwrite), _received(received) { }
     /** Copy constructor. */
     Message(const Message &other)
-      : _buffer(other._buffer), _sink(other._sink), _allow_overwrite(other._allow_overwrite) { }
+      : _buffer(other._buffer), _sink(other._sink), _allow_overwrite(other._allow_overwrite),
+        _received(other._received) { }
     /** Assignment operator. */
     const Message &operator= (const Message &other) {
       _buffer = other._buffer;
       _sink   = other._sink;
       _allow_overwrite = other._allow_overwrite;
+      _received = other._received;
       return *this;
     }
     /** Returns the buffer of the message. **/
@@ -77,6 +79,8 @@ public:
     inline SinkBase *sink() const { return _sink; }
     /** If true, the sender allows to overwrite the content of the buffer. **/
     inline bool allowOverwrite() const { return _allow_overwrite; }
+    /** Returns the time (in ns) the message was queued, 0 if the sink is not monitored. */
+    inline int64_t received() const { return _received; }
 
   protected:
     /** The buffer being send. */
@@ -85,6 +89,8 @@ public:
     SinkBase *_sink;
     /** If true, the sender allows to overwrite the buffer. */
     bool _allow_overwrite;
+    /** The time the message was queued. */
+    int64_t _received;
   };
 
 protected:
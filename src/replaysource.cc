@@ -0,0 +1,224 @@
+#include "replaysource.hh"
+#include "iqfile.hh"
+#include "logger.hh"
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace sdr;
+
+
+/** Returns the monotonic time in seconds. */
+static double
+_replay_now() {
+  struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+/** Sleeps until the given monotonic time. */
+static void
+_replay_sleep_until(double t) {
+  struct timespec ts;
+  ts.tv_sec = time_t(t); ts.tv_nsec = long(1e9*(t-ts.tv_sec));
+  while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0)) { }
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of ReplaySource
+ * ********************************************************************************************* */
+ReplaySource::ReplaySource(const std::string &filename, size_t buffer_size, size_t num_buffers)
+  : Source(), _frequency(0), _sample_rate(0), _type(Config::Type_UNDEFINED),
+    _buffer_size(buffer_size), _buffers(), _next(0), _map(0), _map_size(0), _sample_size(2),
+    _offset(0), _jitter(0), _max_speed(false), _loop(false), _running(false), _started(false),
+    _buffers_sent(0), _samples_sent(0), _overruns(0), _samples_lost(0)
+{
+  IQFileMeta meta; std::string base = IQFileMeta::basename(filename);
+  meta.load(base + ".sigmf-meta");
+  _frequency = meta.frequency; _sample_rate = meta.sampleRate;
+  _open(base + ".sigmf-data", meta.type, num_buffers);
+}
+
+ReplaySource::ReplaySource(const std::string &filename, Config::Type type, double sample_rate,
+                           size_t buffer_size, size_t num_buffers)
+  : Source(), _frequency(0), _sample_rate(sample_rate), _type(Config::Type_UNDEFINED),
+    _buffer_size(buffer_size), _buffers(), _next(0), _map(0), _map_size(0), _sample_size(2),
+    _offset(0), _jitter(0), _max_speed(false), _loop(false), _running(false), _started(false),
+    _buffers_sent(0), _samples_sent(0), _overruns(0), _samples_lost(0)
+{
+  _open(filename, type, num_buffers);
+}
+
+ReplaySource::~ReplaySource() {
+  stop();
+  if (_map) { munmap(_map, _map_size); }
+  for (size_t i=0; i<_buffers.size(); i++) { _buffers[i].unref(); }
+}
+
+void
+ReplaySource::_open(const std::string &filename, Config::Type type, size_t num_buffers) {
+  switch (type) {
+  case Config::Type_cu8: _sample_size = 2; break;
+  case Config::Type_cs16: _sample_size = 4; break;
+  default: {
+    ConfigError err;
+    err << "Can not configure ReplaySource: Unsupported type " << type
+        << ", expected complex uint8 or complex int16.";
+    throw err;
+  }
+  }
+  _type = type;
+
+  // Map the recording
+  struct stat info; int fd = ::open(filename.c_str(), O_RDONLY);
+  if ((0 > fd) || (0 != fstat(fd, &info))) {
+    if (0 <= fd) { ::close(fd); }
+    RuntimeError err;
+    err << "Can not open recording '" << filename << "': " << strerror(errno);
+    throw err;
+  }
+  _map_size = (info.st_size/_sample_size)*_sample_size;
+  if (_map_size) { _map = (char *)mmap(0, _map_size, PROT_READ, MAP_PRIVATE, fd, 0); }
+  ::close(fd);
+  if ((MAP_FAILED == _map) || (0 == _map)) {
+    _map = 0;
+    RuntimeError err;
+    err << "Can not map recording '" << filename << "'.";
+    throw err;
+  }
+  madvise(_map, _map_size, MADV_SEQUENTIAL);
+
+  // Allocate ring of buffers
+  for (size_t i=0; i<num_buffers; i++) {
+    _buffers.push_back(Buffer< std::complex<uint8_t> >(_buffer_size));
+  }
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured ReplaySource:" << std::endl
+      << " file: " << filename << std::endl
+      << " type: " << _type << std::endl
+      << " sample-rate: " << _sample_rate << std::endl
+      << " duration: " << (_map_size/_sample_size)/_sample_rate << "s" << std::endl
+      << " buffer-size: " << _buffer_size << std::endl
+      << " num-buffers: " << num_buffers;
+  Logger::get().log(msg);
+
+  // Propergate config
+  this->setConfig(Config(Config::Type_cu8, _sample_rate, _buffer_size, num_buffers));
+}
+
+void
+ReplaySource::start() {
+  if (_running) { return; }
+  // Join thread if it has stopped itself
+  if (_started) { void *p; pthread_join(_thread, &p); }
+  _running = _started = true;
+  pthread_create(&_thread, 0, ReplaySource::__thread_start, this);
+}
+
+void
+ReplaySource::stop() {
+  _running = false;
+  // Wait for the thread to exit, no buffers get sent after this method returned.
+  if (_started) { void *p; pthread_join(_thread, &p); _started = false; }
+}
+
+size_t
+ReplaySource::_read(std::complex<uint8_t> *out, size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    if (_offset >= _map_size) {
+      if (! _loop) { break; }
+      _offset = 0;
+    }
+    size_t m = std::min(n-done, (_map_size-_offset)/_sample_size);
+    if (out && (Config::Type_cu8 == _type)) {
+      memcpy(out+done, _map+_offset, 2*m);
+    } else if (out) {
+      // Convert complex int16 to the unsigned 8bit samples of the device
+      const int16_t *in = (const int16_t *)(_map+_offset);
+      uint8_t *o = (uint8_t *)(out+done);
+      for (size_t i=0; i<2*m; i++) { o[i] = (in[i]>>8) + 128; }
+    }
+    _offset += m*_sample_size; done += m;
+  }
+  return done;
+}
+
+void
+ReplaySource::_main() {
+  double period = _buffer_size/_sample_rate, start = _replay_now();
+  unsigned int seed = time(0);
+  // The number of buffer periods passed
+  uint64_t k = 0;
+
+  while (_running) {
+    size_t n = _buffer_size;
+    if (! _max_speed) {
+      // The k-th buffer is complete once its last sample got "received"
+      double deadline = start + (k+1)*period, now = _replay_now();
+      if (now > (deadline + _buffers.size()*period)) {
+        // Fell behind by more than the ring -> the device drops these samples
+        uint64_t m = uint64_t((now-start)/period) - k - 1;
+        n = _read(0, m*_buffer_size); k += m;
+        __sync_fetch_and_add(&_overruns, 1); __sync_fetch_and_add(&_samples_lost, n);
+#ifdef SDR_DEBUG
+        LogMessage msg(LOG_WARNING);
+        msg << "ReplaySource: Overrun, replay fell behind, " << n << " samples lost.";
+        Logger::get().log(msg);
+#endif
+        if (n < m*_buffer_size) { break; }
+        continue;
+      }
+      if (_jitter > 0) { deadline += _jitter*(rand_r(&seed)/(RAND_MAX+1.0)); }
+      if (now < deadline) { _replay_sleep_until(deadline); }
+    }
+
+    Buffer< std::complex<uint8_t> > &buffer = _buffers[_next];
+    if (! buffer.isUnused()) {
+      // Wait for the consumer in max-speed mode
+      if (_max_speed) { usleep(100); continue; }
+      // Otherwise, the samples of this buffer are lost
+      n = _read(0, _buffer_size); k++;
+      __sync_fetch_and_add(&_overruns, 1); __sync_fetch_and_add(&_samples_lost, n);
+#ifdef SDR_DEBUG
+      LogMessage msg(LOG_WARNING);
+      msg << "ReplaySource: Overrun, buffer still in use, " << n << " samples lost.";
+      Logger::get().log(msg);
+#endif
+      if (n < _buffer_size) { break; }
+      continue;
+    }
+
+    // The buffer is released (atomically) by the consumer, do not touch it before
+    __sync_synchronize();
+    uint64_t index = _samples_sent + _samples_lost;
+    n = _read((std::complex<uint8_t> *)buffer.ptr(), _buffer_size); k++;
+    if (n) {
+      // Stamp the buffer as if it just got received
+      Buffer< std::complex<uint8_t> > out = buffer.head(n);
+      out.setMeta(BufferMeta(index, BufferMeta::now() - int64_t(1e9*n/_sample_rate), _sample_rate));
+      this->send(out);
+      __sync_fetch_and_add(&_buffers_sent, 1); __sync_fetch_and_add(&_samples_sent, n);
+      _next = (_next+1) % _buffers.size();
+    }
+    // End of recording
+    if (n < _buffer_size) { break; }
+  }
+
+  if (_running) {
+    _running = false;
+    signalEOS();
+  }
+}
+
+void *
+ReplaySource::__thread_start(void *ptr) {
+  reinterpret_cast<ReplaySource *>(ptr)->_main();
+  return 0;
+}
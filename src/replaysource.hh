@@ -0,0 +1,144 @@
+#ifndef __SDR_REPLAYSOURCE_HH__
+#define __SDR_REPLAYSOURCE_HH__
+
+#include "node.hh"
+#include <pthread.h>
+#include <vector>
+
+
+namespace sdr {
+
+/** Replays a recorded I/Q file like a RTL2832 device would deliver it. This allows to test
+ * and benchmark complete processing graphs (e.g. in CI) without the hardware.
+ *
+ * Like the @c RTLSource, this source emits @c std::complex<uint8_t> buffers of a fixed size from
+ * a separate thread at the sample rate of the recording. Complex int16 recordings are converted.
+ * The buffers are taken from a ring of buffers, like the transfer buffers of the device. If the
+ * next buffer of the ring is still in use, the consumer fell behind and the samples of this
+ * buffer are lost (an overrun). The same happens if the replay thread itself falls behind by more
+ * than the size of the ring (e.g. if the graph is connected directly).
+ *
+ * The timing may be disturbed by a random jitter. In the max-speed mode, the buffers are emitted
+ * as fast as the consumer takes them, i.e. the source waits for the next buffer of the ring to
+ * become unused instead of overrunning. This allows to measure the throughput of a graph.
+ *
+ * The recording is either a SigMF-style recording (see @c IQFileMeta), providing the sample type,
+ * rate and center frequency, or a raw file of the given type and rate.
+ * @ingroup sources */
+class ReplaySource: public Source
+{
+public:
+  /** Constructs a replay source of a SigMF-style recording.
+   * @param filename Specifies the recording.
+   * @param buffer_size Specifies the size of the buffers in samples.
+   * @param num_buffers Specifies the number of buffers in the ring.
+   * @throws RuntimeError If the recording can not be opened. */
+  ReplaySource(const std::string &filename, size_t buffer_size=131072, size_t num_buffers=15);
+  /** Constructs a replay source of a raw recording.
+   * @param filename Specifies the file.
+   * @param type Specifies the sample type, either @c Config::Type_cu8 or @c Config::Type_cs16.
+   * @param sample_rate Specifies the sample rate.
+   * @param buffer_size Specifies the size of the buffers in samples.
+   * @param num_buffers Specifies the number of buffers in the ring.
+   * @throws RuntimeError If the file can not be opened.
+   * @throws ConfigError If the type is not supported. */
+  ReplaySource(const std::string &filename, Config::Type type, double sample_rate,
+               size_t buffer_size=131072, size_t num_buffers=15);
+  /** Destructor. */
+  virtual ~ReplaySource();
+
+  /** Returns the center frequency of the recording. */
+  inline double frequency() const { return _frequency; }
+  /** Returns the sample rate. */
+  inline double sampleRate() const { return _sample_rate; }
+
+  /** Returns the maximum jitter in seconds. */
+  inline double jitter() const { return _jitter; }
+  /** Sets the maximum jitter in seconds, each buffer gets delayed randomly by up to this
+   * amount. */
+  inline void setJitter(double jitter) { _jitter = jitter; }
+  /** Returns @c true if the max-speed mode is enabled. */
+  inline bool maxSpeed() const { return _max_speed; }
+  /** Enables or disables the max-speed mode. */
+  inline void setMaxSpeed(bool enable) { _max_speed = enable; }
+  /** Returns @c true if the recording gets replayed in a loop. */
+  inline bool loop() const { return _loop; }
+  /** Enables or disables replaying the recording in a loop. Otherwise, the EOS signal is emitted
+   * at the end of the recording. */
+  inline void setLoop(bool enable) { _loop = enable; }
+
+  /** Starts the replay. */
+  void start();
+  /** Stops the replay. */
+  void stop();
+  /** Returns @c true while the replay thread is running. */
+  inline bool isRunning() const { return _running; }
+
+  /** Returns the number of buffers sent. */
+  inline uint64_t buffers() const { return _buffers_sent; }
+  /** Returns the number of samples sent. */
+  inline uint64_t samples() const { return _samples_sent; }
+  /** Returns the number of overruns. */
+  inline uint64_t overruns() const { return _overruns; }
+  /** Returns the number of samples lost due to overruns. */
+  inline uint64_t lostSamples() const { return _samples_lost; }
+
+protected:
+  /** Maps the given file. */
+  void _open(const std::string &filename, Config::Type type, size_t num_buffers);
+  /** Advances the file position by @c n samples, copies them into the given buffer if not 0.
+   * Returns the number of samples, which is less than @c n at the end of the recording. */
+  size_t _read(std::complex<uint8_t> *out, size_t n);
+  /** The replay loop. */
+  void _main();
+
+protected:
+  /** The center frequency. */
+  double _frequency;
+  /** The sample rate. */
+  double _sample_rate;
+  /** The sample type of the recording. */
+  Config::Type _type;
+  /** The buffer size. */
+  size_t _buffer_size;
+  /** The ring of buffers. */
+  std::vector< Buffer< std::complex<uint8_t> > > _buffers;
+  /** The index of the next buffer. */
+  size_t _next;
+  /** The memory mapping of the recording. */
+  char *_map;
+  /** The size of the mapping. */
+  size_t _map_size;
+  /** The size of a sample of the recording in bytes. */
+  size_t _sample_size;
+  /** The offset of the next sample within the mapping. */
+  size_t _offset;
+  /** The maximum jitter. */
+  double _jitter;
+  /** If @c true, the buffers are emitted as fast as possible. */
+  bool _max_speed;
+  /** If @c true, the recording is replayed in a loop. */
+  bool _loop;
+  /** While @c true, the replay thread runs. */
+  volatile bool _running;
+  /** If @c true, the replay thread has been started and needs to be joined. */
+  bool _started;
+  /** The thread object. */
+  pthread_t _thread;
+  /** The number of buffers sent, updated atomically by the replay thread. */
+  volatile uint64_t _buffers_sent;
+  /** The number of samples sent, updated atomically by the replay thread. */
+  volatile uint64_t _samples_sent;
+  /** The number of overruns, updated atomically by the replay thread. */
+  volatile uint64_t _overruns;
+  /** The number of samples lost, updated atomically by the replay thread. */
+  volatile uint64_t _samples_lost;
+
+private:
+  /** The pthread function. */
+  static void *__thread_start(void *ptr);
+};
+
+}
+
+#endif // __SDR_REPLAYSOURCE_HH__
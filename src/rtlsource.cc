@@ -4,9 +4,9 @@
 using namespace sdr;
 
 
-RTLSource::RTLSource(double frequency, double sample_rate, size_t device_idx)
-  : Source(), _frequency(frequency), _sample_rate(sample_rate), _agc_enabled(true), _gains(),
-    _buffer_size(131072), _device(0)
+RTLSource::RTLSource(double frequency, double sample_rate, size_t device_idx, size_t num_buffers)
+  : DeviceSource< std::complex<uint8_t> >(131072, num_buffers), _frequency(frequency),
+    _sample_rate(sample_rate), _agc_enabled(true), _gains(), _device(0)
 {
   {
     LogMessage msg(LOG_DEBUG);
@@ -53,7 +53,7 @@ RTLSource::RTLSource(double frequency, double sample_rate, size_t device_idx)
   rtlsdr_reset_buffer(_device);
 
   // Propergate config:
-  this->setConfig(Config(Config::typeId< std::complex<uint8_t> >(), _sample_rate, _buffer_size, 15));
+  _configure(_sample_rate);
 }
 
 
@@ -85,7 +85,7 @@ RTLSource::setSampleRate(double sample_rate) {
   rtlsdr_reset_buffer(_device);
   _sample_rate = rtlsdr_get_sample_rate(_device);
 
-  this->setConfig(Config(Config::Type_cu8, _sample_rate, _buffer_size, 15));
+  _configure(_sample_rate);
 }
 
 void
@@ -141,5 +141,6 @@ RTLSource::__rtl_sdr_parallel_main(void *ctx) {
 void
 RTLSource::__rtl_sdr_callback(unsigned char *buffer, uint32_t len, void *ctx) {
   RTLSource *self = reinterpret_cast<RTLSource *>(ctx);
-  self->send(Buffer< std::complex<uint8_t> >((std::complex<uint8_t> *)buffer, len/2));
+  // Copy into the ring, the buffer gets reused by librtlsdr once this callback returns
+  self->receive((const std::complex<uint8_t> *)buffer, len/2);
 }
@@ -3,7 +3,7 @@
 
 #include <rtl-sdr.h>
 #include <pthread.h>
-#include "node.hh"
+#include "devicesource.hh"
 
 
 namespace sdr {
@@ -12,8 +12,11 @@ namespace sdr {
  * This source runs in its own thread, hence the user does not need to trigger the reception of
  * the next data chunk explicitly. The reception is started by calling the @c start method and
  * stopped by calling the @c stop method.
+ *
+ * The samples are copied from the transfer buffers of librtlsdr into a ring of buffers owned by
+ * the source (see @c DeviceSource), as librtlsdr reuses its buffers once the callback returns.
  * @ingroup sources */
-class RTLSource: public Source
+class RTLSource: public DeviceSource< std::complex<uint8_t> >
 {
 public:
   /** Constructor.
@@ -24,8 +27,10 @@ public:
    * @param frequency Specifies the tuner frequency.
    * @param sample_rate Specifies the sample rate in Hz.
    * @param device_idx Specifies the device to be used. The @c numDevices
-   *        and @c deviceName static method can be used to select the desired device index. */
-  RTLSource(double frequency, double sample_rate=1e6, size_t device_idx=0);
+   *        and @c deviceName static method can be used to select the desired device index.
+   * @param num_buffers Specifies the number of buffers in the ring of the source. */
+  RTLSource(double frequency, double sample_rate=1e6, size_t device_idx=0,
+            size_t num_buffers=15);
 
   /** Destructor. */
   virtual ~RTLSource();
@@ -83,8 +88,6 @@ protected:
   bool _agc_enabled;
   /** A vector of gain factors supported by the device. */
   std::vector<double> _gains;
-  /** The buffer size. */
-  size_t _buffer_size;
   /** The RTL2832 device object. */
   rtlsdr_dev_t *_device;
   /** The thread object. */
@@ -0,0 +1,409 @@
+#include "rttyskimmer.hh"
+#include "logger.hh"
+#include <algorithm>
+#include <limits>
+
+using namespace sdr;
+
+
+/** The supported baud rates. */
+static const float rtty_baud_rates[] = { 45.45, 50, 75 };
+/** The number of supported baud rates. */
+#define RTTY_NUM_BAUD_RATES 3
+/** The supported shifts. */
+static const float rtty_shifts[] = { 170, 425, 850 };
+/** The number of supported shifts. */
+#define RTTY_NUM_SHIFTS 3
+/** The framing error rate below which the text of a channel is reported. */
+#define RTTY_MAX_ERROR_RATE 0.2
+/** The number of frames or framing errors after which a channel that never decoded reliably is
+ * considered as failed. */
+#define RTTY_FAIL_EVENTS 32
+
+
+/* ********************************************************************************************* *
+ * Implementation of RTTYSkimmer::Decoder
+ * ********************************************************************************************* */
+RTTYSkimmer::Decoder::Decoder(float baud, Baudot::StopBits stopBits)
+  : Sink<uint8_t>(), baud(baud), bits(2*baud, BitStream::NORMAL), baudot(stopBits), text(),
+    timing(0), errorRate(0.5), frames(0), framingErrors(0)
+{
+  bits.connect(&baudot, true);
+  baudot.connect(this, true);
+}
+
+RTTYSkimmer::Decoder::~Decoder() {
+  // pass...
+}
+
+void
+RTTYSkimmer::Decoder::config(const Config &src_cfg) {
+  // pass...
+}
+
+void
+RTTYSkimmer::Decoder::process(const Buffer<uint8_t> &buffer, bool allow_overwrite) {
+  for (size_t i=0; i<buffer.size(); i++) {
+    if (buffer[i]) { text.push_back(buffer[i]); }
+  }
+  // Keep only the last 256 chars until the baud rate is known
+  if (text.size() > 256) { text.erase(0, text.size()-256); }
+}
+
+void
+RTTYSkimmer::Decoder::update() {
+  for (; frames < baudot.frames(); frames++) { errorRate -= 0.05f*errorRate; }
+  for (; framingErrors < baudot.framingErrors(); framingErrors++) {
+    errorRate += 0.05f*(1-errorRate);
+  }
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of RTTYSkimmer::Channel
+ * ********************************************************************************************* */
+RTTYSkimmer::Channel::Channel(size_t id, float Fmark, float Fspace, float df,
+                              Baudot::StopBits stopBits)
+  : Source(), id(id), Fmark(Fmark), Fspace(Fspace), mark(Fmark/df), space(Fspace/df),
+    rate(0), count(0), last(0), misses(0), nsymbols(0), decoding(false)
+{
+  for (size_t i=0; i<RTTY_NUM_BAUD_RATES; i++) {
+    decoders.push_back(new Decoder(rtty_baud_rates[i], stopBits));
+    this->connect(&(decoders.back()->bits), true);
+  }
+}
+
+RTTYSkimmer::Channel::~Channel() {
+  for (size_t i=0; i<decoders.size(); i++) { delete decoders[i]; }
+  symbols.unref();
+}
+
+void
+RTTYSkimmer::Channel::config(double rate, size_t bufferSize) {
+  this->rate = rate;
+  symbols = Buffer<uint8_t>(bufferSize);
+  nsymbols = 0;
+  this->setConfig(Config(Traits<uint8_t>::scalarId, rate, bufferSize, 1));
+}
+
+void
+RTTYSkimmer::Channel::flush() {
+  if (0 == nsymbols) { return; }
+  this->send(symbols.head(nsymbols));
+  nsymbols = 0;
+}
+
+size_t
+RTTYSkimmer::Channel::best() const {
+  size_t best = 0;
+  for (size_t i=1; i<decoders.size(); i++) {
+    if (std::abs(decoders[i]->timing) > std::abs(decoders[best]->timing)) { best = i; }
+  }
+  return best;
+}
+
+bool
+RTTYSkimmer::Channel::failed() const {
+  if (decoding) { return false; }
+  for (size_t i=0; i<decoders.size(); i++) {
+    if (decoders[i]->events() >= RTTY_FAIL_EVENTS) { return true; }
+  }
+  return false;
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of RTTYSkimmer
+ * ********************************************************************************************* */
+RTTYSkimmer::RTTYSkimmer(double Fmin, double Fmax, size_t maxChannels, double threshold,
+                         bool reverse, Baudot::StopBits stopBits)
+  : Sink<int16_t>(), _Fmin(Fmin), _Fmax(Fmax), _maxChannels(maxChannels), _threshold(threshold),
+    _reverse(reverse), _stopBits(stopBits), _Fs(0), _bufferSize(0), _N(0), _W(0), _hop(1),
+    _kmin(0), _kmax(0), _interval(1), _hold(0), _frames(0), _spawned(0), _histIdx(0), _hopIdx(0),
+    _plan(0)
+{
+  // pass...
+}
+
+RTTYSkimmer::~RTTYSkimmer() {
+  for (size_t i=0; i<_channels.size(); i++) { delete _channels[i]; }
+  if (_plan) { delete _plan; }
+  _window.unref();
+  _history.unref();
+  _fftIn.unref();
+  _fftOut.unref();
+  _power.unref();
+  _spectrum.unref();
+}
+
+void
+RTTYSkimmer::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId<int16_t>() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure RTTYSkimmer: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId<int16_t>();
+    throw err;
+  }
+
+  // Retire all channels
+  while (_channels.size()) { _retire(_channels.size()-1); }
+  _rejected.clear();
+
+  _Fs = src_cfg.sampleRate();
+  // Window of 16ms, i.e. about one bit at 75 baud, zero-padded to twice the next power of 2
+  _W = std::max(8, int(0.016*_Fs));
+  _N = 1;
+  while (_N < _W) { _N <<= 1; }
+  _N *= 2;
+  // Approx. 2000 spectra per second
+  _hop = std::max(1, int(std::round(_Fs/2000)));
+  double df = _Fs/_N;
+  _kmin = std::max(1, int(std::ceil(_Fmin/df)));
+  _kmax = std::min(int(_N/2)-2, int(std::floor(_Fmax/df)));
+  if (_kmin >= _kmax) {
+    ConfigError err;
+    err << "Can not configure RTTYSkimmer: Empty pass band [" << _Fmin << "Hz, " << _Fmax
+        << "Hz] at a sample rate of " << _Fs << "Hz.";
+    throw err;
+  }
+  // Detect signals 4 times a second, retire channels after approx. 3s
+  _interval = std::max(1, int((0.25*_Fs)/_hop));
+  _hold = 12;
+  _frames = 0;
+  _bufferSize = 2 + src_cfg.bufferSize()/_hop;
+
+  // Assemble window & FFT
+  _window = Buffer<float>(_W);
+  _history = Buffer<float>(_W);
+  for (size_t i=0; i<_W; i++) {
+    _window[i] = 0.5 - 0.5*std::cos((2*M_PI*i)/_W);
+    _history[i] = 0;
+  }
+  _histIdx = _hopIdx = 0;
+  _fftIn  = Buffer< std::complex<float> >(_N);
+  _fftOut = Buffer< std::complex<float> >(_N);
+  for (size_t i=0; i<_N; i++) { _fftIn[i] = 0; }
+  if (_plan) { delete _plan; }
+  _plan = new FFTPlan<float>(_fftIn, _fftOut, FFT::FORWARD);
+  _power = Buffer<float>(_N/2);
+  _spectrum = Buffer<float>(_N/2);
+  for (size_t i=0; i<_N/2; i++) { _power[i] = _spectrum[i] = 0; }
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Config RTTYSkimmer node: " << std::endl
+      << " sample rate: " << _Fs << "Hz" << std::endl
+      << " pass band: [" << _kmin*df << "Hz, " << _kmax*df << "Hz]" << std::endl
+      << " FFT size: " << _N << " (" << df << "Hz resolution)" << std::endl
+      << " window: " << _W << ", hop: " << _hop << std::endl
+      << " max. channels: " << _maxChannels;
+  Logger::get().log(msg);
+}
+
+void
+RTTYSkimmer::process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
+  // Compute short-time spectra & slice symbols of all channels
+  for (size_t i=0; i<buffer.size(); i++) {
+    _history[_histIdx] = buffer[i];
+    _histIdx = (_histIdx+1) % _W;
+    if (_hop == (++_hopIdx)) {
+      _hopIdx = 0;
+      for (size_t j=0, k=_histIdx; j<_W; j++, k++) {
+        if (_W == k) { k = 0; }
+        _fftIn[j] = _window[j]*_history[k];
+      }
+      (*_plan)();
+      _processFrame();
+    }
+  }
+
+  // Decode symbols & pass text of the matching decoder once it decodes reliably
+  for (size_t c=0; c<_channels.size(); c++) {
+    Channel *channel = _channels[c];
+    channel->flush();
+    for (size_t i=0; i<channel->decoders.size(); i++) { channel->decoders[i]->update(); }
+    Decoder *decoder = channel->decoders[channel->best()];
+    if ((std::abs(decoder->timing) < 0.4) || (decoder->errorRate > RTTY_MAX_ERROR_RATE)) {
+      continue;
+    }
+    channel->decoding = true;
+    if (0 == decoder->text.size()) { continue; }
+    handleText(channel->id, channel->Fmark, channel->Fspace, decoder->baud, decoder->text);
+    for (size_t i=0; i<channel->decoders.size(); i++) { channel->decoders[i]->text.clear(); }
+  }
+}
+
+void
+RTTYSkimmer::handleText(size_t id, float Fmark, float Fspace, float baud,
+                        const std::string &text) {
+  // pass...
+}
+
+void
+RTTYSkimmer::_processFrame() {
+  // Update power spectrum & average it over approx. 1s
+  float alpha = _hop/_Fs;
+  for (size_t k=0; k<_N/2; k++) {
+    _power[k] = std::norm(_fftOut[k]);
+    if (0 == _frames) { _spectrum[k] = _power[k]; }
+    else { _spectrum[k] += alpha*(_power[k]-_spectrum[k]); }
+  }
+  _frames++;
+
+  // Slice symbols of every channel
+  for (size_t c=0; c<_channels.size(); c++) {
+    Channel *channel = _channels[c];
+    float Pm = _power[channel->mark] + _power[channel->mark+1];
+    float Ps = _power[channel->space] + _power[channel->space+1];
+    uint8_t symbol = (Pm > Ps);
+    // Track the timing of symbol transitions for each baud rate. Due to the 1.5 stop bits,
+    // transitions happen at multiples of half bits.
+    if (symbol != channel->last) {
+      for (size_t i=0; i<channel->decoders.size(); i++) {
+        Decoder *decoder = channel->decoders[i];
+        double t = (2*decoder->baud*channel->count)/channel->rate;
+        std::complex<float> phase = std::polar(1.0f, float(2*M_PI*(t-std::floor(t))));
+        decoder->timing += 0.05f*(phase - decoder->timing);
+      }
+    }
+    channel->last = symbol;
+    channel->count++;
+    channel->symbols[channel->nsymbols++] = symbol;
+    if (channel->nsymbols == channel->symbols.size()) { channel->flush(); }
+  }
+
+  if (0 == (_frames % _interval)) { _detect(); }
+}
+
+float
+RTTYSkimmer::_peakFrequency(size_t k) const {
+  // Parabolic interpolation of the peak
+  float l = _spectrum[k-1], c = _spectrum[k], r = _spectrum[k+1];
+  float d = l - 2*c + r;
+  float delta = (0 != d) ? 0.5*(l-r)/d : 0;
+  return (k + delta)*_Fs/_N;
+}
+
+void
+RTTYSkimmer::_detect() {
+  // Estimate noise floor as the 5% quantile of the spectrum over the pass band. A crowded band
+  // may be covered by signals and their skirts almost completely.
+  _noise.assign(&_spectrum[_kmin], &_spectrum[_kmax]+1);
+  std::nth_element(_noise.begin(), _noise.begin()+_noise.size()/20, _noise.end());
+  float noise = std::max(_noise[_noise.size()/20], std::numeric_limits<float>::min());
+
+  // Forget about failed channels after approx. 30s
+  for (int i=_rejected.size()-1; i>=0; i--) {
+    if (_rejected[i].until <= _frames) { _rejected.erase(_rejected.begin()+i); }
+  }
+
+  // Retire channels that fail to decode and channels whose tones vanished
+  for (int i=_channels.size()-1; i>=0; i--) {
+    Channel *channel = _channels[i];
+    if (channel->failed()) {
+      Rejected rejected;
+      rejected.Fmark = channel->Fmark; rejected.Fspace = channel->Fspace;
+      rejected.until = _frames + 120*_interval;
+      _rejected.push_back(rejected);
+      _retire(i);
+      continue;
+    }
+    float Pm = _spectrum[channel->mark] + _spectrum[channel->mark+1];
+    float Ps = _spectrum[channel->space] + _spectrum[channel->space+1];
+    if (std::max(Pm, Ps) < _threshold*noise) { channel->misses++; }
+    else { channel->misses = 0; }
+    if (channel->misses > _hold) { _retire(i); }
+  }
+
+  // Wait for the spectrum to settle before spawning channels
+  if ((_frames*_hop) < _Fs) { return; }
+  double df = _Fs/_N;
+  // Collect peaks, those belonging to a channel already are marked as used (zero power)
+  std::vector<float> peaks, power;
+  for (size_t k=_kmin; k<=_kmax; k++) {
+    if ((_spectrum[k] < _threshold*noise) ||
+        (_spectrum[k] < _spectrum[k-1]) || (_spectrum[k] <= _spectrum[k+1])) { continue; }
+    float F = _peakFrequency(k);
+    bool known = false;
+    for (size_t i=0; (!known) && (i<_channels.size()); i++) {
+      known = (std::abs(_channels[i]->Fmark-F) < 2*df) || (std::abs(_channels[i]->Fspace-F) < 2*df);
+    }
+    peaks.push_back(F); power.push_back(known ? 0 : _spectrum[k]);
+  }
+
+  // Search for pairs of neighbouring peaks with one of the supported shifts and similar power.
+  // The tones of a signal never enclose another peak, this avoids pairing the tones of two
+  // adjacent signals with a wider shift. In a crowded band, however, the gap between two signals
+  // may match a shift too. Hence, isolated pairs are accepted first, i.e. pairs whose tones can
+  // not be paired with their other neighbours. The remaining chains of peaks are then paired up
+  // from the lowest peak on. Wrong pairs fail to decode, get retired and are skipped next time.
+  for (int pass=0; pass<2; pass++) {
+    for (size_t i=0; (i+1)<peaks.size(); i++) {
+      size_t j = i+1;
+      if ((0 == power[i]) || (0 == power[j]) || (! _isPair(peaks[i], peaks[j]))) { continue; }
+      if ((power[i] > 10*power[j]) || (power[j] > 10*power[i])) { continue; }
+      bool isolated = ((0 == i) || (0 == power[i-1]) || (! _isPair(peaks[i-1], peaks[i]))) &&
+          (((j+1) == peaks.size()) || (0 == power[j+1]) || (! _isPair(peaks[j], peaks[j+1])));
+      if ((0 == pass) && (! isolated)) { continue; }
+      if (_channels.size() >= _maxChannels) { return; }
+      float Fmark = _reverse ? peaks[i] : peaks[j];
+      float Fspace = _reverse ? peaks[j] : peaks[i];
+      Channel *channel = new Channel(_spawned++, Fmark, Fspace, df, _stopBits);
+      channel->config(_Fs/_hop, _bufferSize);
+      _channels.push_back(channel);
+      LogMessage msg(LOG_DEBUG);
+      msg << "RTTYSkimmer: Spawned channel #" << channel->id
+          << " mark " << Fmark << "Hz, space " << Fspace << "Hz.";
+      Logger::get().log(msg);
+      // Mark peaks as used
+      power[i] = power[j] = 0;
+    }
+  }
+}
+
+bool
+RTTYSkimmer::_isPair(float Flow, float Fhigh) const {
+  // The peak frequencies are interpolated, hence the tolerance may be well below the bin width
+  double df = _Fs/_N, tol = std::max(0.3*df, 10.);
+  bool shift = false;
+  for (size_t s=0; (!shift) && (s<RTTY_NUM_SHIFTS); s++) {
+    shift = (std::abs(Fhigh-Flow-rtty_shifts[s]) <= tol);
+  }
+  if (! shift) { return false; }
+  // Check if the tones belong to a channel that failed recently
+  float Fmark = _reverse ? Flow : Fhigh, Fspace = _reverse ? Fhigh : Flow;
+  for (size_t i=0; i<_rejected.size(); i++) {
+    if ((std::abs(_rejected[i].Fmark-Fmark) < 2*df) &&
+        (std::abs(_rejected[i].Fspace-Fspace) < 2*df)) { return false; }
+  }
+  return true;
+}
+
+void
+RTTYSkimmer::_retire(size_t i) {
+  LogMessage msg(LOG_DEBUG);
+  msg << "RTTYSkimmer: Retired channel #" << _channels[i]->id
+      << " mark " << _channels[i]->Fmark << "Hz, space " << _channels[i]->Fspace << "Hz.";
+  Logger::get().log(msg);
+  delete _channels[i];
+  _channels.erase(_channels.begin()+i);
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of RTTYSkimmerDump
+ * ********************************************************************************************* */
+RTTYSkimmerDump::RTTYSkimmerDump(std::ostream &stream, double Fmin, double Fmax)
+  : RTTYSkimmer(Fmin, Fmax), _stream(stream)
+{
+  // pass...
+}
+
+void
+RTTYSkimmerDump::handleText(size_t id, float Fmark, float Fspace, float baud,
+                            const std::string &text) {
+  _stream << "RTTY #" << id << " @" << int(Fmark+0.5) << "/" << int(Fspace+0.5) << "Hz, "
+          << baud << "Bd: " << text << std::endl;
+}
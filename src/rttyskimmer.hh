@@ -0,0 +1,268 @@
+#ifndef __SDR_RTTYSKIMMER_HH__
+#define __SDR_RTTYSKIMMER_HH__
+
+#include "node.hh"
+#include "fsk.hh"
+#include "baudot.hh"
+#include "fftplan.hh"
+#include <string>
+#include <vector>
+#include <iostream>
+
+
+namespace sdr {
+
+/** A RTTY band skimmer. This node consumes a real audio signal (e.g. the output of an USB
+ * demodulator) and decodes all RTTY signals with a shift of 170, 425 or 850Hz and a baud rate of
+ * 45.45, 50 or 75 baud within the specified pass band simultaneously.
+ *
+ * The node computes a short-time FFT of the input signal at a rate of approx. 2kHz. This FFT
+ * serves as a channelized front-end shared by all signals: The averaged power spectrum is used
+ * to detect pairs of tones with one of the supported shifts and the mark and space powers of
+ * every detected signal are simply taken from the corresponding FFT bins. Hence, the mixing work
+ * does not depend on the number of signals. Isolated pairs are accepted first, i.e. pairs whose
+ * tones can not be paired with another neighbouring peak as well. In a crowded band, this avoids
+ * pairing the tones of adjacent signals. Ambiguous chains of peaks are paired up tentatively.
+ *
+ * For every detected signal, a channel is spawned that slices the symbols and feeds them into a
+ * @c BitStream and @c Baudot decoder for every supported baud rate. The baud rate of a signal is
+ * determined from the timing of the symbol transitions and only the text of the matching decoder
+ * is passed to @c handleText, once its framing error rate is low. Channels that keep failing to
+ * decode (e.g. tones of different signals paired up) are retired and their tones are not paired
+ * again for a while. Channels are also retired once their tones have vanished from the spectrum
+ * for a while.
+ * @ingroup datanodes */
+class RTTYSkimmer: public Sink<int16_t>
+{
+protected:
+  /** The decoder chain of a channel for a single baud rate. */
+  class Decoder: public Sink<uint8_t>
+  {
+  public:
+    /** Constructor. */
+    Decoder(float baud, Baudot::StopBits stopBits);
+    /** Destructor. */
+    virtual ~Decoder();
+
+    void config(const Config &src_cfg);
+    /** Collects the decoded text. */
+    void process(const Buffer<uint8_t> &buffer, bool allow_overwrite);
+    /** Updates the framing error rate from the frames received since the last call. */
+    void update();
+    /** Returns the number of frames and framing errors received so far. */
+    inline size_t events() const { return frames + framingErrors; }
+
+  public:
+    /** The baud rate. */
+    float baud;
+    /** The bit clock recovery, samples two bits per baud. */
+    BitStream bits;
+    /** The baudot decoder. */
+    Baudot baudot;
+    /** The text received but not yet passed to @c handleText. */
+    std::string text;
+    /** Averaged phase of the symbol transitions relative to half bits. */
+    std::complex<float> timing;
+    /** Averaged framing error rate. */
+    float errorRate;
+    /** The number of frames received so far. */
+    size_t frames;
+    /** The number of framing errors received so far. */
+    size_t framingErrors;
+  };
+
+  /** A single RTTY signal. */
+  class Channel: public Source
+  {
+  public:
+    /** Constructor. */
+    Channel(size_t id, float Fmark, float Fspace, float df, Baudot::StopBits stopBits);
+    /** Destructor. */
+    virtual ~Channel();
+
+    /** Configures the decoders. */
+    void config(double rate, size_t bufferSize);
+    /** Sends the symbols received so far to the decoders. */
+    void flush();
+    /** Returns the index of the decoder matching the signal best. */
+    size_t best() const;
+    /** Returns @c true if the channel never decoded reliably, although its decoders received
+     * enough frames or framing errors. */
+    bool failed() const;
+
+  public:
+    /** The unique ID of the channel. */
+    size_t id;
+    /** The mark frequency. */
+    float Fmark;
+    /** The space frequency. */
+    float Fspace;
+    /** The index of the (lower) FFT bin of the mark tone. */
+    size_t mark;
+    /** The index of the (lower) FFT bin of the space tone. */
+    size_t space;
+    /** The symbol rate. */
+    double rate;
+    /** Number of symbols received. */
+    size_t count;
+    /** The last symbol. */
+    uint8_t last;
+    /** Number of successive detection passes in which the tones were missing. */
+    size_t misses;
+    /** The symbols received during the current buffer. */
+    Buffer<uint8_t> symbols;
+    /** Number of symbols in the buffer. */
+    size_t nsymbols;
+    /** The decoders, one for each baud rate. */
+    std::vector<Decoder *> decoders;
+    /** Set once the channel decoded reliably. */
+    bool decoding;
+  };
+
+public:
+  /** Constructor.
+   * @param Fmin Specifies the lower edge of the pass band in Hz.
+   * @param Fmax Specifies the upper edge of the pass band in Hz.
+   * @param maxChannels Specifies the maximum number of concurrent channels.
+   * @param threshold Specifies the minimum signal to noise ratio (linear power ratio) of the
+   *        tones of a signal to spawn a channel.
+   * @param reverse If @c true, the mark tone is the lower one.
+   * @param stopBits Specifies the number of stop bits. */
+  RTTYSkimmer(double Fmin=200, double Fmax=3000, size_t maxChannels=32, double threshold=10,
+              bool reverse=false, Baudot::StopBits stopBits=Baudot::STOP15);
+  /** Destructor. */
+  virtual ~RTTYSkimmer();
+
+  virtual void config(const Config &src_cfg);
+  virtual void process(const Buffer<int16_t> &buffer, bool allow_overwrite);
+
+  /** Returns the number of active channels. */
+  inline size_t numChannels() const { return _channels.size(); }
+  /** Returns the unique ID of the specified channel. */
+  inline size_t channelId(size_t i) const { return _channels[i]->id; }
+  /** Returns the mark frequency of the specified channel. */
+  inline float markFrequency(size_t i) const { return _channels[i]->Fmark; }
+  /** Returns the space frequency of the specified channel. */
+  inline float spaceFrequency(size_t i) const { return _channels[i]->Fspace; }
+
+  /** Gets called for every piece of text decoded by a channel.
+   * @param id Specifies the unique ID of the channel.
+   * @param Fmark Specifies the mark frequency of the channel in Hz.
+   * @param Fspace Specifies the space frequency of the channel in Hz.
+   * @param baud Specifies the detected baud rate.
+   * @param text The decoded text. */
+  virtual void handleText(size_t id, float Fmark, float Fspace, float baud,
+                          const std::string &text);
+
+protected:
+  /** Processes a single short-time spectrum. */
+  void _processFrame();
+  /** Detects new signals and retires vanished ones. */
+  void _detect();
+  /** Estimates the frequency of the peak in the averaged spectrum at the given bin. */
+  float _peakFrequency(size_t k) const;
+  /** Removes the specified channel. */
+  void _retire(size_t i);
+  /** Returns @c true if the given pair of tones may form a signal, i.e. if their distance
+   * matches one of the supported shifts and they do not belong to a channel that failed
+   * recently. */
+  bool _isPair(float Flow, float Fhigh) const;
+
+protected:
+  /** The tones of a channel that failed to decode. */
+  class Rejected
+  {
+  public:
+    /** The mark frequency. */
+    float Fmark;
+    /** The space frequency. */
+    float Fspace;
+    /** The frame until which the tones must not be paired again. */
+    size_t until;
+  };
+
+protected:
+  /** Lower edge of the pass band. */
+  double _Fmin;
+  /** Upper edge of the pass band. */
+  double _Fmax;
+  /** Maximum number of channels. */
+  size_t _maxChannels;
+  /** Detection threshold. */
+  float _threshold;
+  /** If @c true, the mark tone is the lower one. */
+  bool _reverse;
+  /** The number of stop bits. */
+  Baudot::StopBits _stopBits;
+  /** The sample rate. */
+  double _Fs;
+  /** The input buffer size. */
+  size_t _bufferSize;
+  /** The FFT size. */
+  size_t _N;
+  /** The window length. */
+  size_t _W;
+  /** The hop size, i.e. the number of samples between two spectra. */
+  size_t _hop;
+  /** The index of the first bin of the pass band. */
+  size_t _kmin;
+  /** The index of the last bin of the pass band. */
+  size_t _kmax;
+  /** Number of spectra between two detection passes. */
+  size_t _interval;
+  /** Number of detection passes the tones may be missing before a channel gets retired. */
+  size_t _hold;
+  /** The number of spectra computed so far. */
+  size_t _frames;
+  /** The number of channels spawned so far, used as channel IDs. */
+  size_t _spawned;
+  /** The window function. */
+  Buffer<float> _window;
+  /** The last @c _W input samples. */
+  Buffer<float> _history;
+  /** The current index into the history. */
+  size_t _histIdx;
+  /** The number of samples since the last spectrum. */
+  size_t _hopIdx;
+  /** FFT input buffer. */
+  Buffer< std::complex<float> > _fftIn;
+  /** FFT output buffer. */
+  Buffer< std::complex<float> > _fftOut;
+  /** The FFT plan. */
+  FFTPlan<float> *_plan;
+  /** The current power spectrum. */
+  Buffer<float> _power;
+  /** The averaged power spectrum. */
+  Buffer<float> _spectrum;
+  /** Temporary buffer to estimate the noise floor. */
+  std::vector<float> _noise;
+  /** The active channels. */
+  std::vector<Channel *> _channels;
+  /** The tones of the channels that failed recently. */
+  std::vector<Rejected> _rejected;
+};
+
+
+/** Simple RTTY skimmer, dumping the decoded text, tagged with the signal frequencies, into the
+ * given stream.
+ * @ingroup datanodes */
+class RTTYSkimmerDump: public RTTYSkimmer
+{
+public:
+  /** Constructor.
+   * @param stream Specifies the stream, the received text is serialized into.
+   * @param Fmin Specifies the lower edge of the pass band in Hz.
+   * @param Fmax Specifies the upper edge of the pass band in Hz. */
+  RTTYSkimmerDump(std::ostream &stream, double Fmin=200, double Fmax=3000);
+
+  /** Dumps the received text. */
+  void handleText(size_t id, float Fmark, float Fspace, float baud, const std::string &text);
+
+protected:
+  /** The output stream. */
+  std::ostream &_stream;
+};
+
+}
+
+#endif // __SDR_RTTYSKIMMER_HH__
@@ -277,10 +277,16 @@
 #include "logger.hh"
 #include "options.hh"
 
+#include "convert.hh"
 #include "utils.hh"
 #include "siggen.hh"
 #include "buffernode.hh"
+#include "filewriter.hh"
 #include "wavfile.hh"
+#include "iqfile.hh"
+#include "replaysource.hh"
+#include "devicesource.hh"
+#include "latency.hh"
 #include "firfilter.hh"
 #include "autocast.hh"
 #include "freqshift.hh"
@@ -299,6 +305,8 @@
 
 #ifdef SDR_WITH_FFTW
 #include "filternode.hh"
+#include "psk31skimmer.hh"
+#include "rttyskimmer.hh"
 #endif
 
 #ifdef SDR_WITH_PORTAUDIO
@@ -6,6 +6,9 @@
 #include "traits.hh"
 #include "interpolate.hh"
 #include "logger.hh"
+#include "convert.hh"
+#include <cmath>
+#include <vector>
 
 
 namespace sdr {
@@ -90,14 +93,17 @@ public:
 protected:
   /** Performs the sub-sampling from @c in into @c out. */
   void _process(const Buffer<Scalar> &in, const Buffer<Scalar> &out) {
-    size_t j=0;
+    size_t j=0, first=0;
     for (size_t i=0; i<in.size(); i++) {
       _last += in[i]; _left++;
       if (_n <= _left) {
+        if (0 == j) { first = i; }
         out[j] = _last/SScalar(_n); j++; _last=0; _left=0;
       }
     }
-    this->send(out.head(j), true);
+    Buffer<Scalar> res = out.head(j);
+    res.setMeta(in.meta().resample(1, _n, first));
+    this->send(res, true);
   }
 
 
@@ -165,15 +171,18 @@ public:
   /** Performs the sub-sampling. @c in and @c out may refer to the same buffer allowing for an
    * in-place operation. Returns a view on the output buffer containing the sub-samples. */
   inline Buffer<Scalar> subsample(const Buffer<Scalar> &in, const Buffer<Scalar> &out) {
-    size_t oidx = 0;
+    size_t oidx = 0, first = 0;
     for (size_t i=0; i<in.size(); i++) {
       _avg += in[i]; _sample_count += (1<<16);
       if (_sample_count >= _period) {
+        if (0 == oidx) { first = i; }
         out[oidx] = _avg/SScalar(_sample_count/(1<<16));
         _sample_count=0; _avg = 0; oidx++;
       }
     }
-    return out.head(oidx);
+    Buffer<Scalar> res = out.head(oidx);
+    res.setMeta(in.meta().resample(1./frac(), first));
+    return res;
   }
 
 protected:
@@ -227,8 +236,8 @@ public:
       throw err;
     }
 
-    // Allocate buffer
-    size_t bufSize = std::ceil(src_cfg.bufferSize() * src_cfg.sampleRate()/_frac);
+    // Allocate buffer, a buffer of N input samples results into at most ceil(N/frac)+1 outputs
+    size_t bufSize = std::ceil(src_cfg.bufferSize()/_frac)+1;
     _buffer = Buffer<oScalar>(bufSize);
 
     // Allocate & init delay line
@@ -257,7 +266,7 @@ public:
       return;
     }
 
-    size_t i=0, o=0;
+    size_t i=0, o=0, first=0;
     while (i<buffer.size()) {
       // First, fill sampler...
       while ( (_mu >= 1) && (i<buffer.size()) ) {
@@ -265,12 +274,15 @@ public:
         _dl_idx = (_dl_idx + 1) % 8; _mu -= 1;
       }
       while (_mu <= 1) {
+        if (0 == o) { first = i-1; }
         // Interpolate
         _buffer[o] = interpolate(_dl.sub(_dl_idx,8), _mu);
         _mu += _frac; o++;
       }
     }
-    this->send(_buffer.head(o));
+    Buffer<oScalar> res = _buffer.head(o);
+    res.setMeta(buffer.meta().resample(1./_frac, first));
+    this->send(res);
   }
 
 
@@ -287,5 +299,233 @@ protected:
   Buffer<oScalar> _buffer;
 };
 
+
+/** Maps a scalar type to the floating point type used by the @c Resampler. */
+template <class Scalar> class ResamplerFloat { public: typedef float Type; };
+/** Maps a complex scalar type to the floating point type used by the @c Resampler. */
+template <class Scalar> class ResamplerFloat< std::complex<Scalar> > {
+public: typedef std::complex<float> Type; };
+
+
+/** A rational polyphase resampler. This node changes the sample rate by the exact factor
+ * L/M, e.g. from 1.024MS/s to 48kS/s (L=3, M=64) or 22.05kS/s (L=441, M=20480).
+ *
+ * Conceptually, the input is up-sampled by L (inserting zeros), low-pass filtered and
+ * down-sampled by M. The low-pass filter (a Blackman windowed sinc with its cutoff at the lower
+ * of both Nyquist frequencies) is split into L phases of @c K taps each, hence every output
+ * sample is a single inner product of @c K taps with the last @c K input samples. The phase
+ * and the input position are stepped by integers, hence the resampler does not drift, no
+ * matter how long it runs. The inner products are performed in floating point by the
+ * vectorized kernels of @c Convert. Supported sample types are @c int16_t, @c float and their
+ * complex counterparts.
+ * @ingroup filters */
+template <class Scalar>
+class Resampler: public Sink<Scalar>, public Source
+{
+public:
+  /** The floating point type, the filter operates on. */
+  typedef typename ResamplerFloat<Scalar>::Type FScalar;
+
+public:
+  /** Constructs a resampler by the fraction L/M.
+   * @param L Specifies the up-sampling factor.
+   * @param M Specifies the down-sampling factor.
+   * @param taps Specifies the length of the filter in periods of the lower of both sample
+   *        rates. Longer filters have a sharper transition band. */
+  Resampler(size_t L, size_t M, size_t taps=32)
+    : Sink<Scalar>(), Source(), _oFs(0), _L(L), _M(M), _taps(taps), _K(0), _phase(0), _need(0)
+  {
+    if ((0 == _L) || (0 == _M) || (0 == _taps)) {
+      ConfigError err;
+      err << "Can not configure Resampler node: Invalid fraction " << _L << "/" << _M
+          << " or number of taps " << _taps << ".";
+      throw err;
+    }
+  }
+
+  /** Constructs a resampler by the output sample rate. The fraction L/M is determined by the
+   * input sample rate, both rates are rounded to integer multiples of 1Hz. */
+  Resampler(double oFs)
+    : Sink<Scalar>(), Source(), _oFs(oFs), _L(1), _M(1), _taps(32), _K(0), _phase(0), _need(0)
+  {
+    if (_oFs < 1) {
+      ConfigError err;
+      err << "Can not configure Resampler node: Invalid output sample rate " << _oFs << ".";
+      throw err;
+    }
+  }
+
+  /** Destructor. */
+  virtual ~Resampler() {
+    // pass...
+  }
+
+  /** Returns the up-sampling factor. */
+  inline size_t up() const { return _L; }
+  /** Returns the down-sampling factor. */
+  inline size_t down() const { return _M; }
+  /** Returns the number of taps per phase. */
+  inline size_t tapsPerPhase() const { return _K; }
+
+  /** Configures the resampler. */
+  virtual void config(const Config &src_cfg) {
+    // Requires type, sample rate and buffer size
+    if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+    // check buffer type
+    if (Config::typeId<Scalar>() != src_cfg.type()) {
+      ConfigError err;
+      err << "Can not configure Resampler node: Invalid buffer type " << src_cfg.type()
+          << ", expected " << Config::typeId<Scalar>();
+      throw err;
+    }
+
+    // If the output rate is given, determine the fraction from the rates
+    if (_oFs > 0) {
+      _L = std::floor(_oFs+0.5); _M = std::floor(src_cfg.sampleRate()+0.5);
+      if (0 == _M) {
+        ConfigError err;
+        err << "Can not configure Resampler node: Invalid input sample rate "
+            << src_cfg.sampleRate() << ".";
+        throw err;
+      }
+    }
+    // Reduce fraction
+    size_t a = _L, b = _M;
+    while (b) { size_t t = a % b; a = b; b = t; }
+    _L /= a; _M /= a;
+
+    // Design filter bank
+    _design();
+
+    // Allocate & init delay line
+    _dl = Buffer<FScalar>(2*_K); _dl_idx = 0;
+    for (size_t i=0; i<2*_K; i++) { _dl[i] = 0; }
+    _phase = 0; _need = 1;
+
+    // A buffer of N input samples results into at most ceil(N*L/M) outputs
+    size_t bufSize = (src_cfg.bufferSize()*_L + _M - 1)/_M + 1;
+    _buffer = Buffer<Scalar>(bufSize);
+    double oFs = (src_cfg.sampleRate()*_L)/_M;
+
+    LogMessage msg(LOG_DEBUG);
+    msg << "Configure Resampler node:" << std::endl
+        << " by: " << _L << "/" << _M << std::endl
+        << " taps: " << _K << " per phase" << std::endl
+        << " type: " << src_cfg.type() << std::endl
+        << " sample-rate: " << src_cfg.sampleRate() << " -> " << oFs << std::endl
+        << " buffer-size: " << src_cfg.bufferSize() << " -> " << bufSize;
+    Logger::get().log(msg);
+
+    // Propergate config
+    this->setConfig(Config(src_cfg.type(), oFs, bufSize, 1));
+  }
+
+  /** Performs the resampling. */
+  virtual void process(const Buffer<Scalar> &buffer, bool allow_overwrite) {
+    if (! _buffer.isUnused()) {
+#ifdef SDR_DEBUG
+      LogMessage msg(LOG_WARNING);
+      msg << "Resampler: Drop buffer, output buffer still in use.";
+      Logger::get().log(msg);
+#endif
+      return;
+    }
+
+    size_t o = 0, first = 0;
+    for (size_t i=0; i<buffer.size(); i++) {
+      // Store sample in delay line, the last K samples are contiguous at _dl[_dl_idx+1]
+      _dl[_dl_idx] = _dl[_dl_idx+_K] = _load(buffer[i]);
+      _dl_idx = (_dl_idx + 1) % _K; _need--;
+      if ((0 == _need) && (0 == o)) { first = i; }
+      // Emit all output samples which depend on this input sample
+      while (0 == _need) {
+        const float *h = ((const float *)_bank.data()) + _phase*_K;
+        _store(Convert::dot(h, ((const FScalar *)_dl.data()) + _dl_idx, _K), _buffer[o]); o++;
+        _phase += _M; _need = _phase / _L; _phase %= _L;
+      }
+    }
+    Buffer<Scalar> res = _buffer.head(o);
+    res.setMeta(buffer.meta().resample(_L, _M, first));
+    this->send(res);
+  }
+
+protected:
+  /** Designs the polyphase filter bank. */
+  void _design() {
+    // Total length of the prototype filter
+    size_t N = _taps*std::max(_L, _M);
+    _K = (N + _L - 1)/_L; N = _K*_L;
+    // Cutoff in cycles per (up-sampled) sample
+    double fc = 0.5/std::max(_L, _M);
+    _bank = Buffer<float>(N);
+    for (size_t p=0; p<_L; p++) {
+      double sum = 0;
+      std::vector<double> h(_K);
+      for (size_t k=0; k<_K; k++) {
+        // Tap k of phase p is tap k*L+p of the prototype filter
+        double n = k*_L + p, t = n - (N-1)/2.;
+        double x = 2*M_PI*fc*t;
+        double v = (0 == t) ? 1 : std::sin(x)/x;
+        v *= 0.42 - 0.5*std::cos(2*M_PI*n/(N-1)) + 0.08*std::cos(4*M_PI*n/(N-1));
+        h[k] = v; sum += v;
+      }
+      // Normalize phases to unit DC gain and store taps in reversed order, i.e. such that
+      // tap K-1-k gets applied to the k-th last input sample.
+      for (size_t k=0; k<_K; k++) { _bank[p*_K + _K-1-k] = h[k]/sum; }
+    }
+  }
+
+  /** Converts a sample to floating point. */
+  static inline float _load(const int16_t &x) { return x; }
+  /** Converts a sample to floating point. */
+  static inline float _load(const float &x) { return x; }
+  /** Converts a sample to floating point. */
+  static inline std::complex<float> _load(const std::complex<int16_t> &x) {
+    return std::complex<float>(x.real(), x.imag());
+  }
+  /** Converts a sample to floating point. */
+  static inline std::complex<float> _load(const std::complex<float> &x) { return x; }
+
+  /** Rounds and saturates a value to int16. */
+  static inline int16_t _round(float x) {
+    x = std::floor(x+0.5f);
+    return (x > 32767) ? 32767 : ((x < -32768) ? -32768 : int16_t(x));
+  }
+  /** Converts a filtered value back to the sample type. */
+  static inline void _store(float x, int16_t &y) { y = _round(x); }
+  /** Converts a filtered value back to the sample type. */
+  static inline void _store(float x, float &y) { y = x; }
+  /** Converts a filtered value back to the sample type. */
+  static inline void _store(const std::complex<float> &x, std::complex<int16_t> &y) {
+    y = std::complex<int16_t>(_round(x.real()), _round(x.imag()));
+  }
+  /** Converts a filtered value back to the sample type. */
+  static inline void _store(const std::complex<float> &x, std::complex<float> &y) { y = x; }
+
+protected:
+  /** The output sample rate, if specified. */
+  double _oFs;
+  /** The up-sampling factor. */
+  size_t _L;
+  /** The down-sampling factor. */
+  size_t _M;
+  /** The filter length in periods of the lower sample rate. */
+  size_t _taps;
+  /** The number of taps per phase. */
+  size_t _K;
+  /** The current phase. */
+  size_t _phase;
+  /** The number of input samples needed until the next output sample. */
+  size_t _need;
+  /** The filter bank, @c _K taps for each of the @c _L phases. */
+  Buffer<float> _bank;
+  /** The doubled delay line, holding the last @c _K input samples. */
+  Buffer<FScalar> _dl;
+  /** Index of the delay-line. */
+  size_t _dl_idx;
+  /** The output buffer. */
+  Buffer<Scalar> _buffer;
+};
+
 }
 #endif // __SDR_SUBSAMPLE_HH__
@@ -77,25 +77,15 @@ UnsignedToSigned::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
 void
 UnsignedToSigned::_process_int8(const RawBuffer &in, const RawBuffer &out) {
   size_t num = in.bytesLen();
-  uint8_t *in_ptr = (uint8_t *) in.data();
-  int8_t *out_ptr = (int8_t *) out.data();
-  //std::cerr << "UnsingedToSigned: Process " << Buffer<uint8_t>(in) << std::endl;
-  for (size_t i=0; i<num; i++, in_ptr++, out_ptr++) {
-    *out_ptr = int16_t(*in_ptr) - 128;
-  }
-  //std::cerr << " -> " << Buffer<int8_t>(RawBuffer(out, 0, num)) << std::endl;
+  Convert::uint8ToInt8((uint8_t *) in.data(), (int8_t *) out.data(), num);
   this->send(RawBuffer(out, 0, num), true);
 }
 
 void
 UnsignedToSigned::_process_int16(const RawBuffer &in, const RawBuffer &out) {
   size_t num = in.bytesLen()/2;
-  uint16_t *in_ptr = (uint16_t *) in.data();
-  int16_t *out_ptr = (int16_t *) out.data();
-  for (size_t i=0; i<num; i++, in_ptr++, out_ptr++) {
-    *out_ptr = int32_t(*in_ptr) - 32768;
-  }
-  this->send(RawBuffer(out, 0, num), true);
+  Convert::uint16ToInt16((uint16_t *) in.data(), (int16_t *) out.data(), num);
+  this->send(RawBuffer(out, 0, 2*num), true);
 }
 
 
@@ -171,19 +161,15 @@ SignedToUnsigned::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
 void
 SignedToUnsigned::_process_int8(const RawBuffer &in, const RawBuffer &out) {
   size_t num = in.bytesLen();
-  for (size_t i=0; i<num; i++) {
-    ((uint8_t *)out.data())[i] = int(((int8_t *)in.data())[i]) + 128;
-  }
+  Convert::int8ToUint8((int8_t *)in.data(), (uint8_t *)out.data(), num);
   this->send(RawBuffer(out, 0, num), true);
 }
 
 void
 SignedToUnsigned::_process_int16(const RawBuffer &in, const RawBuffer &out) {
   size_t num = in.bytesLen()/2;
-  for (size_t i=0; i<num; i++) {
-    ((uint16_t *)out.data())[i] = int32_t( ((int16_t *)in.data())[i] ) + 32768;
-  }
-  this->send(RawBuffer(out, 0, num), true);
+  Convert::int16ToUint16((int16_t *)in.data(), (uint16_t *)out.data(), num);
+  this->send(RawBuffer(out, 0, 2*num), true);
 }
 
 
@@ -6,7 +6,10 @@
 #include "traits.hh"
 #include "operators.hh"
 #include "logger.hh"
+#include "convert.hh"
 #include <ctime>
+#include <cmath>
+#include <limits>
 
 
 namespace sdr {
@@ -341,12 +344,15 @@ protected:
   /** Internal used method to perform the type-case out-of-place. */
   inline void _process(const Buffer<iScalar> &in, const Buffer<oScalar> &out) {
     if (_do_scale) {
-      for (size_t i=0; i<in.size(); i++) {
-        out[i] = _scale*( cast<iScalar,oScalar>(in[i]) + cast<iScalar, oScalar>(_shift) );
+      // Use conversion kernel if there is one for this type combination
+      if (! Convert::scaled(in, out, _scale, _shift)) {
+        for (size_t i=0; i<in.size(); i++) {
+          out[i] = _scale*( cast<iScalar,oScalar>(in[i]) + cast<iScalar, oScalar>(_shift) );
+        }
       }
     } else {
       for (size_t i=0; i<in.size(); i++) {
-        out[i] = in[i]+_shift;
+        out[i] = cast<iScalar, oScalar>(in[i]+_shift);
       }
     }
     this->send(out.head(in.size()));
@@ -653,15 +659,27 @@ protected:
 
 
 /** An automatic gain control node.
+ *
+ * The AGC tracks the envelope (mean magnitude) of the input signal per sub-block of
+ * @c blockSize samples rather than per sample. The envelope follows rising levels with the
+ * attack time-constant and falling levels with the decay time-constant. The gain is updated
+ * once per sub-block and interpolated linearly across it, hence the inner loops are free of
+ * divisions and branches. For real and complex float samples, they are performed by the
+ * @c Convert kernels. If the input buffer may be overwritten, the gain is applied in-place.
  * @ingroup filters */
 template <class Scalar>
 class AGC: public Sink<Scalar>, public Source
 {
 public:
-  /** Constructor. */
-  AGC(double tau=0.1, double target=0)
-    : Sink<Scalar>(), Source(), _enabled(true), _tau(tau), _lambda(0), _sd(0),
-      _target(target), _gain(1), _sample_rate(0)
+  /** Constructor.
+   * @param tau Specifies the attack and decay time-constant in seconds.
+   * @param target Specifies the target level of the output signal. If 0, the target level is
+   *        determined by the scalar type.
+   * @param blockSize Specifies the number of samples per envelope update. */
+  AGC(double tau=0.1, double target=0, size_t blockSize=32)
+    : Sink<Scalar>(), Source(), _enabled(true), _attack(tau), _decay(tau), _attackFactor(0),
+      _decayFactor(0), _sd(0), _target(target), _gain(1),
+      _blockSize(std::max(size_t(1), blockSize)), _sample_rate(0)
   {
     if (0 == target) {
       // Determine target by scalar type
@@ -681,6 +699,7 @@ public:
       case Config::Type_cf32:
       case Config::Type_cf64:
         _target = 0.5; break;
+      case Config::Type_bits:
       case Config::Type_UNDEFINED: {
         ConfigError err; err << "Can not configure AGC node: Unsupported type."; throw err;
       }
@@ -709,16 +728,42 @@ public:
     _gain = gain;
   }
 
-  /** Returns the time-constant of the AGC. */
+  /** Returns the time-constant of the AGC, i.e. the decay time-constant. */
   inline double tau() const {
-    return _tau;
+    return _decay;
   }
 
-  /** Sets the time-constant of the AGC. */
+  /** Sets the attack and decay time-constant of the AGC. */
   inline void setTau(double tau) {
-    // calc decay factor
-    _tau = tau;
-    _lambda = exp(-1./(_tau*_sample_rate));
+    _attack = _decay = tau;
+    _updateFactors();
+  }
+
+  /** Returns the attack time-constant. */
+  inline double attack() const {
+    return _attack;
+  }
+
+  /** Sets the attack time-constant, i.e. the time-constant for rising signal levels. */
+  inline void setAttack(double tau) {
+    _attack = tau;
+    _updateFactors();
+  }
+
+  /** Returns the decay time-constant. */
+  inline double decay() const {
+    return _decay;
+  }
+
+  /** Sets the decay time-constant, i.e. the time-constant for falling signal levels. */
+  inline void setDecay(double tau) {
+    _decay = tau;
+    _updateFactors();
+  }
+
+  /** Returns the number of samples per envelope update. */
+  inline size_t blockSize() const {
+    return _blockSize;
   }
 
   /** Configures the AGC node. */
@@ -732,9 +777,9 @@ public:
       throw err;
     }
 
-    // calc decay factor
+    // calc decay factors
     _sample_rate = src_cfg.sampleRate();
-    _lambda = exp(-1./(_tau*src_cfg.sampleRate()));
+    _updateFactors();
     // reset variance
     _sd = _target;
 
@@ -745,14 +790,14 @@ public:
     msg << "Configured AGC:" << std::endl
         << " type: " << src_cfg.type() << std::endl
         << " sample-rate: " << src_cfg.sampleRate() << std::endl
-        << " tau: " << _tau << std::endl
-        << " lambda [1/s]: " << pow(_lambda, src_cfg.sampleRate()) << std::endl
-        << " lambda [1/sam]: " << _lambda << std::endl
+        << " attack: " << _attack << "s" << std::endl
+        << " decay: " << _decay << "s" << std::endl
+        << " block size: " << _blockSize << std::endl
         << " target value: " << _target;
     Logger::get().log(msg);
 
     // Propergate config
-    this->setConfig(Config(Config::typeId<Scalar>(), src_cfg.sampleRate(), 
+    this->setConfig(Config(Config::typeId<Scalar>(), src_cfg.sampleRate(),
                     src_cfg.bufferSize(), 1));
   }
 
@@ -763,29 +808,121 @@ public:
     if ((! _enabled) && (0 == _gain) ) {
       this->send(buffer, allow_overwrite); return;
     }
-    // Update signal ampl
-    for (size_t i=0; i<buffer.size(); i++) {
-      _sd = _lambda*_sd + (1-_lambda)*std::abs(buffer[i]);
-      if (_enabled) { _gain = _target/(4*_sd); }
-      _buffer[i] = _gain*buffer[i];
+    // Select output buffer, drop buffer if the output buffer is still in use
+    Buffer<Scalar> out;
+    if (allow_overwrite) { out = buffer; }
+    else if (_buffer.isUnused()) { out = _buffer.head(buffer.size()); }
+    else {
+#ifdef SDR_DEBUG
+      LogMessage msg(LOG_WARNING);
+      msg << "AGC: Drop buffer: Output buffer still in use.";
+      Logger::get().log(msg);
+#endif
+      return;
     }
-    this->send(_buffer);
+
+    const Scalar *in = (const Scalar *)buffer.data();
+    Scalar *res = (Scalar *)out.data();
+    for (size_t offset=0; offset<buffer.size(); offset+=_blockSize) {
+      size_t n = std::min(_blockSize, buffer.size()-offset);
+      // Mean magnitude of the sub-block
+      float level = _absSum(in+offset, n)/n;
+      // Update envelope
+      float factor = (level > _sd) ? _attackFactor : _decayFactor;
+      if (n != _blockSize) { factor = std::pow(factor, float(n)/_blockSize); }
+      _sd = level + factor*(_sd-level);
+      // Interpolate gain linearly across the sub-block
+      float gain = _gain, dgain = 0;
+      if (_enabled) {
+        _gain = _target/(4*std::max(_sd, std::numeric_limits<float>::min()));
+        dgain = (_gain-gain)/n;
+      }
+      _ramp(in+offset, res+offset, n, gain, dgain);
+    }
+    this->send(out, true);
   }
 
 
+protected:
+  /** Updates the envelope factors per sub-block from the time-constants. */
+  inline void _updateFactors() {
+    if (0 == _sample_rate) { return; }
+    _attackFactor = std::exp(-double(_blockSize)/(_attack*_sample_rate));
+    _decayFactor  = std::exp(-double(_blockSize)/(_decay*_sample_rate));
+  }
+
+  /** Returns the sum of the magnitudes of real values. */
+  template <class T>
+  static inline float _absSum(const T *in, size_t N) {
+    float res = 0;
+    for (size_t i=0; i<N; i++) { res += std::abs(float(in[i])); }
+    return res;
+  }
+
+  /** Returns the sum of the magnitudes of complex values. */
+  template <class T>
+  static inline float _absSum(const std::complex<T> *in, size_t N) {
+    float res = 0;
+    for (size_t i=0; i<N; i++) { res += std::abs(std::complex<float>(in[i].real(), in[i].imag())); }
+    return res;
+  }
+
+  /** Returns the sum of the magnitudes of real floats. */
+  static inline float _absSum(const float *in, size_t N) {
+    return Convert::absSum(in, N);
+  }
+
+  /** Returns the sum of the magnitudes of complex floats. */
+  static inline float _absSum(const std::complex<float> *in, size_t N) {
+    return Convert::absSum(in, N);
+  }
+
+  /** Scales real values by a linear gain ramp. */
+  template <class T>
+  static inline void _ramp(const T *in, T *out, size_t N, float gain, float dgain) {
+    for (size_t i=0; i<N; i++) { out[i] = T((gain+(i+1)*dgain)*in[i]); }
+  }
+
+  /** Scales complex values by a linear gain ramp. */
+  template <class T>
+  static inline void _ramp(const std::complex<T> *in, std::complex<T> *out, size_t N,
+                           float gain, float dgain) {
+    for (size_t i=0; i<N; i++) {
+      float g = gain+(i+1)*dgain;
+      out[i] = std::complex<T>(g*in[i].real(), g*in[i].imag());
+    }
+  }
+
+  /** Scales real floats by a linear gain ramp. */
+  static inline void _ramp(const float *in, float *out, size_t N, float gain, float dgain) {
+    Convert::ramp(in, out, N, gain, dgain);
+  }
+
+  /** Scales complex floats by a linear gain ramp. */
+  static inline void _ramp(const std::complex<float> *in, std::complex<float> *out, size_t N,
+                           float gain, float dgain) {
+    Convert::ramp(in, out, N, gain, dgain);
+  }
+
 protected:
   /** If true, the automatic gain adjustment is enabled. */
   bool _enabled;
-  /** The time-constant of the AGC. */
-  float _tau;
-  /** One over the time-constant. */
-  float _lambda;
-  /** The averaged std. dev. of the input signal. */
+  /** The attack time-constant of the AGC. */
+  float _attack;
+  /** The decay time-constant of the AGC. */
+  float _decay;
+  /** Envelope factor per sub-block for rising levels. */
+  float _attackFactor;
+  /** Envelope factor per sub-block for falling levels. */
+  float _decayFactor;
+  /** The averaged magnitude of the input signal. */
   float _sd;
   /** The target level of the output signal. */
   float _target;
   /** The current gain factor. */
   float _gain;
+  /** The number of samples per envelope update. */
+  size_t _blockSize;
   /** The current sample-rate. */
   double _sample_rate;
   /** The output buffer. */
@@ -825,7 +962,7 @@ public:
     size_t N = std::min(buffer.size(), _buffer.size());
     memcpy(_buffer.ptr(), buffer.data(), N*sizeof(Scalar));
     // Store view
-    _view = _buffer.head(N);
+    _view = _buffer.head(N); _view.setMeta(buffer.meta());
   }
 
   /** Retunrs a reference to the last received buffer. */
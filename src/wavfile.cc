@@ -2,58 +2,148 @@
 #include "config.hh"
 #include "logger.hh"
 #include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/** The amount of data advised to be read ahead for mapped files. */
+#define WAVSOURCE_READAHEAD (8u<<20)
+/** The size of the header written by the WavWriter (RIFF, JUNK/ds64, fmt & data headers). */
+#define WAVWRITER_HEADER_SIZE 80
 
 
 using namespace sdr;
 
-WavSource::WavSource(size_t buffer_size)
+
+/* ********************************************************************************************* *
+ * Implementation of WavWriter
+ * ********************************************************************************************* */
+WavWriter::WavWriter(const std::string &filename, uint16_t bitsPerSample, uint16_t numChannels,
+                     bool rf64, size_t ringSize)
+  : FileWriter(ringSize), _rf64(rf64), _bitsPerSample(bitsPerSample), _numChannels(numChannels),
+    _sampleRate(0)
+{
+  _open(filename, WAVWRITER_HEADER_SIZE);
+}
+
+WavWriter::~WavWriter() {
+  close();
+}
+
+void
+WavWriter::setSampleRate(uint32_t rate) {
+  // Read by the writer thread in _update
+  __sync_lock_test_and_set(&_sampleRate, rate);
+}
+
+void
+WavWriter::_update(bool final) {
+  // Chunks are padded to an even size
+  if (final && (_dataSize % 2)) { ::write(_fd, "\x00", 1); }
+
+  uint64_t riffSize = WAVWRITER_HEADER_SIZE-8 + _dataSize + (_dataSize%2);
+  bool rf64 = _rf64 || (riffSize > 0xffffffffu);
+  uint16_t blockAlign = _numChannels*(_bitsPerSample/8);
+  uint64_t frames = _dataSize/blockAlign;
+  uint32_t sampleRate = _sampleRate; __sync_synchronize();
+  uint32_t val4; uint16_t val2;
+  char header[WAVWRITER_HEADER_SIZE], *ptr = header;
+
+  memcpy(ptr, rf64 ? "RF64" : "RIFF", 4); ptr += 4;
+  val4 = rf64 ? 0xffffffffu : riffSize; memcpy(ptr, &val4, 4); ptr += 4;
+  memcpy(ptr, "WAVE", 4); ptr += 4;
+
+  // ds64 chunk or a JUNK chunk reserving its space
+  memcpy(ptr, rf64 ? "ds64" : "JUNK", 4); ptr += 4;
+  val4 = 28; memcpy(ptr, &val4, 4); ptr += 4;
+  if (rf64) {
+    memcpy(ptr, &riffSize, 8); ptr += 8;
+    memcpy(ptr, &_dataSize, 8); ptr += 8;
+    memcpy(ptr, &frames, 8); ptr += 8;
+    val4 = 0; memcpy(ptr, &val4, 4); ptr += 4; // table length
+  } else {
+    memset(ptr, 0, 28); ptr += 28;
+  }
+
+  memcpy(ptr, "fmt ", 4); ptr += 4;
+  val4 = 16; memcpy(ptr, &val4, 4); ptr += 4;  // sub header size = 16
+  val2 = 1;  memcpy(ptr, &val2, 2); ptr += 2;  // format PCM = 1
+  memcpy(ptr, &_numChannels, 2); ptr += 2;
+  val4 = sampleRate; memcpy(ptr, &val4, 4); ptr += 4;
+  val4 = sampleRate*blockAlign; memcpy(ptr, &val4, 4); ptr += 4; // byte rate
+  memcpy(ptr, &blockAlign, 2); ptr += 2;
+  memcpy(ptr, &_bitsPerSample, 2); ptr += 2;
+
+  memcpy(ptr, "data", 4); ptr += 4;
+  val4 = rf64 ? 0xffffffffu : _dataSize; memcpy(ptr, &val4, 4); ptr += 4;
+
+  if (WAVWRITER_HEADER_SIZE != pwrite(_fd, header, WAVWRITER_HEADER_SIZE, 0)) {
+    LogMessage msg(LOG_ERROR);
+    msg << "WavWriter: Can not write header: " << strerror(errno);
+    Logger::get().log(msg);
+  }
+}
+
+
+/* ********************************************************************************************* *
+ * Implementation of WavSource
+ * ********************************************************************************************* */
+
+WavSource::WavSource(size_t buffer_size, bool mapped)
   : Source(), _file(), _buffer(), _buffer_size(buffer_size),
-    _frame_count(0), _type(Config::Type_UNDEFINED), _sample_rate(0), _frames_left(0)
+    _frame_count(0), _type(Config::Type_UNDEFINED), _sample_rate(0), _frames_left(0),
+    _mapped(mapped), _frame_size(0), _map(), _map_size(0), _map_offset(0), _map_advised(0)
 {
   // pass..
 }
 
-WavSource::WavSource(const std::string &filename, size_t buffer_size)
+WavSource::WavSource(const std::string &filename, size_t buffer_size, bool mapped)
   : Source(), _file(), _buffer(), _buffer_size(buffer_size),
-    _frame_count(0), _type(Config::Type_UNDEFINED), _sample_rate(0), _frames_left(0)
+    _frame_count(0), _type(Config::Type_UNDEFINED), _sample_rate(0), _frames_left(0),
+    _mapped(mapped), _frame_size(0), _map(), _map_size(0), _map_offset(0), _map_advised(0)
 {
   open(filename);
 }
 
 WavSource::~WavSource() {
-  _file.close();
+  close();
 }
 
 bool
 WavSource::isOpen() const {
-  return _file.is_open();
+  return _file.is_open() || (! _map.isEmpty());
 }
 
 void
 WavSource::open(const std::string &filename)
 {
-  if (_file.is_open()) { _file.close(); }
-  _file.open(filename.c_str(), std::ios_base::in);
+  close();
+  _file.open(filename.c_str(), std::ios_base::in|std::ios_base::binary);
   if (! _file.is_open()) { return; }
 
   // Read header and configure source
   char str[5]; str[4] = 0;
   uint16_t val2; uint32_t val4;
-  uint16_t n_chanels;
-  uint32_t sample_rate;
-  uint16_t block_align, bits_per_sample;
-  uint32_t chunk_offset, chunk_size;
+  uint16_t n_chanels = 0;
+  uint32_t sample_rate = 0;
+  uint16_t block_align = 0, bits_per_sample = 0;
+  uint32_t chunk_size;
+  uint64_t chunk_offset, data_size = 0;
+  bool rf64 = false, has_fmt = false;
 
   /*
-   * Read Header
+   * Read Header, RF64 files have the same layout but carry the 64bit sizes in a ds64 chunk.
    */
   chunk_offset = 0;
   _file.read(str, 4);
-  if (0 != strncmp(str, "RIFF", 4)) {
+  if ((0 != strncmp(str, "RIFF", 4)) && (0 != strncmp(str, "RF64", 4))) {
     RuntimeError err;
     err << "File '" << filename << "' is not a WAV file.";
     throw err;
   }
+  rf64 = (0 == strncmp(str, "RF64", 4));
 
   _file.read((char *)&chunk_size, 4); // Read file-size (unused)
   _file.read(str, 4);  // Read "WAVE" (unused)
@@ -63,79 +153,78 @@ WavSource::open(const std::string &filename)
     throw err;
   }
 
-
   /*
-   * Read Format part
+   * Search for the data chunk, reading the ds64 and fmt chunks on the way.
    */
   chunk_offset = 12;
-  _file.read(str, 4);   // Read "fmt " (unused)
-  if (0 != strncmp(str, "fmt ", 4)) {
-    RuntimeError err;
-    err << "'File 'fmt' header missing in file " << filename << "' @" << _file.tellg();
-    throw err;
-  }
-  _file.read((char *)&chunk_size, 4); // Subheader size (unused)
-
-  _file.read((char *)&val2, 2); // Format
-  if (1 != val2) {
-    RuntimeError err;
-    err << "Unsupported WAV data format: " << val2
-        << " of file " << filename << ". Expected " << 1;
-    throw err;
-  }
-
-  _file.read((char *)&n_chanels, 2); // Read # chanels
-  if ((1 != n_chanels) && (2 != n_chanels)) {
-    RuntimeError err;
-    err << "Unsupported number of chanels: " << n_chanels
-        << " of file " << filename << ". Expected 1 or 2.";
-    throw err;
-  }
+  _file.read(str, 4);
+  _file.read((char *)&chunk_size, 4);
+  while ((0 != strncmp(str, "data", 4)) && (! _file.eof())) {
+    if (0 == strncmp(str, "ds64", 4)) {
+      uint64_t val8;
+      _file.read((char *)&val8, 8); // RIFF size (unused)
+      _file.read((char *)&data_size, 8);
+    } else if (0 == strncmp(str, "fmt ", 4)) {
+      _file.read((char *)&val2, 2); // Format
+      if (1 != val2) {
+        RuntimeError err;
+        err << "Unsupported WAV data format: " << val2
+            << " of file " << filename << ". Expected " << 1;
+        throw err;
+      }
 
-  _file.read((char *)&sample_rate, 4); // Read sample-rate
-  _file.read((char *)&val4, 4);        // Read byte-rate (unused)
-  _file.read((char *)&block_align, 2);
-  _file.read((char *)&bits_per_sample, 2);
+      _file.read((char *)&n_chanels, 2); // Read # chanels
+      if ((1 != n_chanels) && (2 != n_chanels)) {
+        RuntimeError err;
+        err << "Unsupported number of chanels: " << n_chanels
+            << " of file " << filename << ". Expected 1 or 2.";
+        throw err;
+      }
 
-  // Check sample format
-  if ((16 != bits_per_sample) && (8 != bits_per_sample)){
-    RuntimeError err;
-    err << "Unsupported sample format: " << bits_per_sample
-        << "b of file " << filename << ". Expected 16b or 8b.";
-    throw err;
-  }
-  if (block_align != n_chanels*(bits_per_sample/8)) {
-    RuntimeError err;
-    err << "Unsupported alignment: " << block_align
-        << "byte of file " << filename << ". Expected " << (bits_per_sample/8) << "byte.";
-    throw err;
-  }
-  // Seek to end of header
-  chunk_offset += 8+chunk_size;
-  _file.seekg(chunk_offset);
+      _file.read((char *)&sample_rate, 4); // Read sample-rate
+      _file.read((char *)&val4, 4);        // Read byte-rate (unused)
+      _file.read((char *)&block_align, 2);
+      _file.read((char *)&bits_per_sample, 2);
 
-  // Search for data chunk
-  _file.read(str, 4);
-  while ((0 != strncmp(str, "data", 4)) || _file.eof()) {
-    // read chunk size
-    _file.read((char*)&chunk_size, 4);
-    chunk_offset += (8+chunk_size);
+      // Check sample format
+      if ((16 != bits_per_sample) && (8 != bits_per_sample)){
+        RuntimeError err;
+        err << "Unsupported sample format: " << bits_per_sample
+            << "b of file " << filename << ". Expected 16b or 8b.";
+        throw err;
+      }
+      if (block_align != n_chanels*(bits_per_sample/8)) {
+        RuntimeError err;
+        err << "Unsupported alignment: " << block_align
+            << "byte of file " << filename << ". Expected " << (bits_per_sample/8) << "byte.";
+        throw err;
+      }
+      has_fmt = true;
+    }
+    // Seek to next chunk, chunks are padded to an even size
+    chunk_offset += 8 + chunk_size + (chunk_size % 2);
     _file.seekg(chunk_offset);
     _file.read(str, 4);
+    _file.read((char *)&chunk_size, 4);
   }
   if (_file.eof()) {
     RuntimeError err;
     err << "WAV file '" << filename << "' contains no 'data' chunk.";
     throw err;
   }
+  if (! has_fmt) {
+    RuntimeError err;
+    err << "'File 'fmt' header missing in file " << filename << "'.";
+    throw err;
+  }
 
   /*
    * Read data part.
    */
-  _file.read((char *)&chunk_size, 4); // read frame count
+  if ((! rf64) || (0xffffffffu != chunk_size)) { data_size = chunk_size; }
 
   // Configure source
-  _frame_count = chunk_size/(n_chanels*(bits_per_sample/8));
+  _frame_count = data_size/block_align;
   if ((1 == n_chanels) && (8 == bits_per_sample)) { _type = Config::Type_u8; }
   else if ((1==n_chanels) && (16 == bits_per_sample)) { _type = Config::Type_s16; }
   else if ((2==n_chanels) && ( 8 == bits_per_sample)) { _type = Config::Type_cu8; }
@@ -146,10 +235,41 @@ WavSource::open(const std::string &filename)
 
   _sample_rate = sample_rate;
   _frames_left = _frame_count;
+  _frame_size = block_align;
+
+  // Map file
+  if (_mapped) {
+    size_t data_offset = chunk_offset+8;
+    struct stat info; int fd = ::open(filename.c_str(), O_RDONLY);
+    if ((0 > fd) || (0 != fstat(fd, &info))) {
+      if (0 <= fd) { ::close(fd); }
+      close();
+      RuntimeError err;
+      err << "Can not map WAV file '" << filename << "': " << strerror(errno);
+      throw err;
+    }
+    // The mapping stays valid once the file gets closed
+    _map_size = info.st_size;
+    _map = RawBuffer::map(fd, _map_size);
+    ::close(fd);
+    if (_map.isEmpty()) {
+      close();
+      RuntimeError err;
+      err << "Can not map WAV file '" << filename << "': " << strerror(errno);
+      throw err;
+    }
+    // The data is read front to back
+    madvise(_map.ptr(), _map_size, MADV_SEQUENTIAL);
+    _map_offset = _map_advised = data_offset;
+    // The data chunk may be truncated
+    if (data_offset > _map_size) { _frames_left = 0; }
+    else { _frames_left = std::min(_frame_count, (_map_size-data_offset)/block_align); }
+    _file.close();
+  }
 
   LogMessage msg(LOG_DEBUG);
   msg << "Configured WavSource:" << std::endl
-      << " file: " << filename << std::endl
+      << " file: " << filename << (isMapped() ? " (mapped)" : "") << std::endl
       << " type: "  << _type << std::endl
       << " sample-rate: " << _sample_rate << std::endl
       << " frame-count: " << _frame_count << std::endl
@@ -160,6 +280,12 @@ WavSource::open(const std::string &filename)
   // unreference buffer if not empty
   if (! _buffer.isEmpty()) { _buffer.unref(); }
 
+  // Propergate config, mapped files need no buffer
+  if (isMapped()) {
+    this->setConfig(Config(_type, _sample_rate, _buffer_size, 1));
+    return;
+  }
+
   // Allocate buffer and propergate config
   switch (_type) {
   case Config::Type_u8:
@@ -187,6 +313,8 @@ WavSource::open(const std::string &filename)
 void
 WavSource::close() {
   _file.close(); _frames_left = 0;
+  // The file gets unmapped once all views sent are released
+  if (isMapped()) { _map.unref(); _map = RawBuffer(); _map_size = 0; }
 }
 
 
@@ -201,7 +329,7 @@ WavSource::next()
   //Logger::get().log(LogMessage(LOG_DEBUG, "WavSource: Read next buffer"));
 
   if ((0 == _frames_left)) {
-    // Close file
+    // Close file, a mapping is kept as there may be buffers in flight
     _file.close();
     signalEOS();
     return;
@@ -210,6 +338,21 @@ WavSource::next()
   // Determine the number of frames to read
   size_t n_frames = std::min(_frames_left, _buffer_size);
 
+  // Send a view into the mapping, the view keeps the mapping alive
+  if (isMapped()) {
+    size_t n_bytes = n_frames*_frame_size;
+    // Advise the kernel to read the next chunk ahead
+    if ((_map_advised < _map_size) && ((_map_offset+WAVSOURCE_READAHEAD/2) > _map_advised)) {
+      size_t page = sysconf(_SC_PAGESIZE), start = (_map_advised/page)*page;
+      size_t len = std::min(_map_advised+WAVSOURCE_READAHEAD, _map_size) - start;
+      madvise(_map.ptr()+start, len, MADV_WILLNEED);
+      _map_advised = start+len;
+    }
+    this->send(RawBuffer(_map, _map_offset, n_bytes), false);
+    _map_offset += n_bytes; _frames_left -= n_frames;
+    return;
+  }
+
   switch (_type) {
   case Config::Type_u8:
     _file.read(_buffer.ptr(), n_frames*sizeof(uint8_t));
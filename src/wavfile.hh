@@ -2,64 +2,71 @@
 #define __SDR_WAVFILE_HH__
 
 #include "node.hh"
+#include "filewriter.hh"
 #include <fstream>
 
 namespace sdr {
 
-/** Stores the received buffers into a WAV file.
+/** Asynchronous writer of WAV files, used by @c WavSink.
+ *
+ * The header is rewritten periodically, hence the file remains readable if the process gets
+ * killed. Once the file grows beyond 4GiB, the header is turned into a RF64 (EBU Tech 3306)
+ * header. To this end, the space of the @c ds64 chunk is reserved by a @c JUNK chunk in front of
+ * the @c fmt chunk.
+ * @ingroup sinks */
+class WavWriter: public FileWriter
+{
+public:
+  /** Constructor.
+   * @param filename Specifies the file name, the WAV data is stored into.
+   * @param bitsPerSample Specifies the number of bits per sample (8 or 16).
+   * @param numChannels Specifies the number of channels (1 or 2).
+   * @param rf64 If @c true, a RF64 header is written irrespective of the file size.
+   * @param ringSize Specifies the size of the ring buffer in bytes.
+   * @throws ConfigError If the specified file can not be opened for output. */
+  WavWriter(const std::string &filename, uint16_t bitsPerSample, uint16_t numChannels,
+            bool rf64=false, size_t ringSize=(32u<<20));
+  /** Destructor, closes the file if not done yet. */
+  virtual ~WavWriter();
+
+  /** Sets the sample rate. */
+  void setSampleRate(uint32_t rate);
+
+protected:
+  /** (Re-) Writes the header. */
+  virtual void _update(bool final);
+
+protected:
+  /** If @c true, a RF64 header is written irrespective of the file size. */
+  bool _rf64;
+  /** The number of bits per sample. */
+  uint16_t _bitsPerSample;
+  /** The number of channels. */
+  uint16_t _numChannels;
+  /** The sample rate, set by the queue thread and read by the writer thread. */
+  volatile uint32_t _sampleRate;
+};
+
+
+/** Stores the received buffers into a WAV file. The data is written asynchronously by a
+ * @c WavWriter, files larger than 4GiB are stored in the RF64 format.
  * @ingroup sinks */
 template <class Scalar>
 class WavSink: public Sink<Scalar>
 {
 public:
-  /** Constructor, @c filename specifies the file name, the WAV data is stored into.
+  /** Constructor, @c filename specifies the file name, the WAV data is stored into. If @c rf64
+   * is @c true, a RF64 header is written irrespective of the file size.
    * @throws ConfigError If the specified file can not be opened for output. */
-  WavSink(const std::string &filename)
-    : Sink<Scalar>(), _file(filename.c_str(), std::ios_base::out|std::ios_base::binary),
-      _frameCount(0), _sampleRate(0)
+  WavSink(const std::string &filename, bool rf64=false)
+    : Sink<Scalar>(), _writer(filename, _bitsPerSample(), _numChannels(), rf64)
   {
-    if (!_file.is_open()) {
-      ConfigError err;
-      err << "Can not open wav file for output: " << filename;
-      throw err;
-    }
-    // Fill first 36+8 bytes with 0, the headers are written once close() gets called.
-    for (size_t i=0; i<44; i++) { _file.write("\x00", 1); }
-
-    // check format
-    switch (Config::typeId<Scalar>()) {
-    case Config::Type_u8:
-    case Config::Type_s8:
-      _bitsPerSample = 8;
-      _numChanels = 1;
-      break;
-    case Config::Type_cu8:
-    case Config::Type_cs8:
-      _bitsPerSample = 8;
-      _numChanels = 2;
-      break;
-    case Config::Type_u16:
-    case Config::Type_s16:
-      _bitsPerSample = 16;
-      _numChanels = 1;
-      break;
-    case Config::Type_cu16:
-    case Config::Type_cs16:
-      _bitsPerSample = 16;
-      _numChanels = 2;
-      break;
-    default:
-      ConfigError err;
-      err << "WAV format only allows (real) integer typed data.";
-      throw err;
-    }
+    // pass...
   }
 
   /** Destructor, closes the file if not done yet. */
   virtual ~WavSink() {
-    if (_file.is_open()) {
-      this->close();
-    }
+    this->close();
   }
 
   /** Configures the sink. */
@@ -74,69 +81,81 @@ public:
       throw err;
     }
     // Store sample rate
-    _sampleRate = src_cfg.sampleRate();
+    _writer.setSampleRate(src_cfg.sampleRate());
   }
 
   /** Completes the WAV header and closes the file. */
   void close() {
-    if (! _file.is_open()) { return; }
-    uint32_t val4;
-    uint16_t val2;
-
-    _file.seekp(0);
-    _file.write("RIFF", 4);
-    val4 = (uint32_t)(36u+2u*_frameCount); _file.write((char *)&val4, 4);
-    _file.write("WAVE", 4);
-
-    _file.write("fmt ", 4);
-    val4 = 16; _file.write((char *)&val4, 4);  // sub header size = 16
-    val2 = 1;  _file.write((char *)&val2, 2);  // format PCM = 1
-    _file.write((char *)&_numChanels, 2);  // num chanels = 1
-    _file.write((char *)&_sampleRate, 4);
-    val4 = _numChanels*_sampleRate*(_bitsPerSample/8);
-    _file.write((char *)&val4, 4); // byte rate
-    val2 = _numChanels*(_bitsPerSample/8);
-    _file.write((char *)&val2, 2);  // block align
-    _file.write((char *)&_bitsPerSample, 2);  // bits per sample
-
-    _file.write("data", 4);
-    val4 = _numChanels*_frameCount*(_bitsPerSample/8); _file.write((char *)&val4, 4);
-    _file.close();
+    _writer.close();
   }
 
   /** Writes some data into the WAV file. */
   virtual void process(const Buffer<Scalar> &buffer, bool allow_overwrite) {
-    if (! _file.is_open()) { return; }
-    _file.write(buffer.data(), buffer.size()*sizeof(Scalar));
-    _frameCount += buffer.size();
+    _writer.write(buffer.data(), buffer.size()*sizeof(Scalar));
+  }
+
+protected:
+  /** Returns the number of bits per sample of the template type.
+   * @throws ConfigError If the type is not supported by the WAV format. */
+  static uint16_t _bitsPerSample() {
+    switch (Config::typeId<Scalar>()) {
+    case Config::Type_u8:
+    case Config::Type_s8:
+    case Config::Type_cu8:
+    case Config::Type_cs8:
+      return 8;
+    case Config::Type_u16:
+    case Config::Type_s16:
+    case Config::Type_cu16:
+    case Config::Type_cs16:
+      return 16;
+    default:
+      break;
+    }
+    ConfigError err;
+    err << "WAV format only allows (real) integer typed data.";
+    throw err;
   }
 
+  /** Returns the number of channels of the template type. */
+  static uint16_t _numChannels() {
+    switch (Config::typeId<Scalar>()) {
+    case Config::Type_cu8:
+    case Config::Type_cs8:
+    case Config::Type_cu16:
+    case Config::Type_cs16:
+      return 2;
+    default:
+      break;
+    }
+    return 1;
+  }
 
 protected:
-  /** The file output stream. */
-  std::fstream _file;
-  /** The number of bits per sample (depends on the template type). */
-  uint16_t _bitsPerSample;
-  /** The total number of frame counts. */
-  uint32_t _frameCount;
-  /** The sample rate. */
-  uint32_t _sampleRate;
-  /** The number of chanels. */
-  uint16_t _numChanels;
+  /** The asynchronous writer. */
+  WavWriter _writer;
 };
 
 
 
 /** A simple imput source that reads from a wav file. Some data is read from the file on every call
  * to  @c next until the end of file is reached.
+ *
+ * If the source is constructed with @c mapped=true, the file gets mapped into memory (read-only)
+ * and the buffers emitted by @c next are views into the mapping instead of copies. Hence there
+ * is no limit on the number of buffers in flight, but these buffers are only valid until the file
+ * gets closed (i.e. until @c close, @c open or the destructor gets called). As the mapping is
+ * read-only, all buffers are sent with @c allow_overwrite=false.
  * @ingroup sources */
 class WavSource: public Source
 {
 public:
-  /** Constructor, @c buffer_size specified the output buffer size. */
-  WavSource(size_t buffer_size=1024);
-  /** Constructor with file name, @c buffer_size specified the output buffer size. */
-  WavSource(const std::string &filename, size_t buffer_size=1024);
+  /** Constructor, @c buffer_size specified the output buffer size. If @c mapped is @c true, the
+   * files get mapped into memory. */
+  WavSource(size_t buffer_size=1024, bool mapped=false);
+  /** Constructor with file name, @c buffer_size specified the output buffer size. If @c mapped is
+   * @c true, the file gets mapped into memory. */
+  WavSource(const std::string &filename, size_t buffer_size=1024, bool mapped=false);
   /** Destructor. */
   virtual ~WavSource();
 
@@ -149,6 +168,8 @@ public:
 
   /** Returns true, if the input is real (stereo files are handled as I/Q signals). */
   bool isReal() const;
+  /** Returns @c true if the file is mapped into memory. */
+  inline bool isMapped() const { return ! _map.isEmpty(); }
 
   /** Read the next data. */
   void next();
@@ -169,6 +190,19 @@ protected:
   double _sample_rate;
   /** The number of frames left to be read. */
   size_t _frames_left;
+
+  /** If @c true, files get mapped into memory. */
+  bool _mapped;
+  /** The size of a frame in bytes. */
+  size_t _frame_size;
+  /** The memory mapping of the file, empty if not mapped. */
+  RawBuffer _map;
+  /** The size of the mapping. */
+  size_t _map_size;
+  /** The offset of the next frame within the mapping. */
+  size_t _map_offset;
+  /** The end of the region advised to be read ahead. */
+  size_t _map_advised;
 };
 
 }
@@ -0,0 +1,68 @@
+/** Benchmarks the sample conversion and inner product kernels of every implementation supported
+ * by the CPU and of the calibrated selection (auto). Build it with the flags of the library: at
+ * -O3 the compiler vectorizes some of the generic loops (e.g. u8 -> s8), at -O2 it does not. */
+#include "convert.hh"
+#include "cputime.hh"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace sdr;
+using namespace UnitTest;
+
+
+/** Number of samples per call. */
+#define BENCH_BLOCK 16384
+/** Number of calls per kernel. */
+#define BENCH_REPEAT 4000
+
+/** Input & output buffers. */
+static uint8_t u8[BENCH_BLOCK], o8[BENCH_BLOCK];
+static uint16_t u16[BENCH_BLOCK], o16[BENCH_BLOCK];
+static int16_t s16[BENCH_BLOCK];
+static float f32[BENCH_BLOCK];
+static float table[256];
+
+static void u8_s8() { Convert::uint8ToInt8(u8, (int8_t *)o8, BENCH_BLOCK); }
+static void u16_s16() { Convert::uint16ToInt16(u16, (int16_t *)o16, BENCH_BLOCK); }
+static void u8_s16() { Convert::uint8ToInt16(u8, s16, BENCH_BLOCK); }
+static void s8_s16() { Convert::int8ToInt16((int8_t *)u8, s16, BENCH_BLOCK); }
+static void s16_f32() { Convert::int16ToFloat(s16, f32, BENCH_BLOCK, 1./32768); }
+static void f32_s16() { Convert::floatToInt16(f32, s16, BENCH_BLOCK, 0.5); }
+static void u8_f32() { Convert::lookup(u8, f32, BENCH_BLOCK, table); }
+static void dot() { Convert::dot(f32, f32, BENCH_BLOCK); }
+
+/** Times the given kernel and prints the throughput in MS/s. */
+static void bench(const char *label, void (*func)()) {
+  CpuTime clock; clock.start();
+  for (size_t i=0; i<BENCH_REPEAT; i++) { func(); }
+  double dt = clock.stop();
+  std::cout << "  " << std::setw(18) << std::left << label
+            << std::setw(10) << std::right << std::fixed << std::setprecision(1)
+            << (double(BENCH_BLOCK)*BENCH_REPEAT)/(dt*1e6) << " MS/s" << std::endl;
+}
+
+
+int main(int argc, char *argv[]) {
+  for (size_t i=0; i<BENCH_BLOCK; i++) {
+    u8[i] = std::rand(); u16[i] = std::rand(); f32[i] = (std::rand()%65536)-32768;
+  }
+  Convert::uint8Table(table, 1./128, -1);
+
+  Convert::Implementation impls[] = {
+    Convert::GENERIC, Convert::SSE2, Convert::AVX2, Convert::AUTO };
+  for (size_t j=0; j<4; j++) {
+    if (! Convert::setImplementation(impls[j])) { continue; }
+    std::cout << Convert::name(impls[j]) << ":" << std::endl;
+    bench("u8 -> s8", u8_s8);
+    bench("u16 -> s16", u16_s16);
+    bench("u8 -> s16", u8_s16);
+    bench("s8 -> s16", s8_s16);
+    bench("s16 -> f32", s16_f32);
+    bench("f32 -> s16", f32_s16);
+    bench("u8 -> f32 (LUT)", u8_f32);
+    bench("f32 . f32", dot);
+  }
+
+  return 0;
+}
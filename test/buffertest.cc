@@ -122,6 +122,37 @@ BufferTest::testRawRingBuffer() {
 }
 
 
+void
+BufferTest::testBitBuffer() {
+  BitBuffer bits(40);
+
+  // Check empty buffer
+  UT_ASSERT_EQUAL(bits.size(), size_t(0));
+  UT_ASSERT_EQUAL(bits.capacity(), size_t(64));
+
+  // Append 0x7cd215d8 followed by 1 0 1
+  for (int i=31; i>=0; i--) { bits.append((0x7cd215d8 >> i) & 0x01); }
+  bits.append(1); bits.append(0); bits.append(1);
+  UT_ASSERT_EQUAL(bits.size(), size_t(35));
+  UT_ASSERT_EQUAL(bits.numWords(), size_t(2));
+  UT_ASSERT_EQUAL(bits.word(0), uint32_t(0x7cd215d8));
+  UT_ASSERT_EQUAL(bits.word(1), uint32_t(0xa0000000));
+  UT_ASSERT(bits[1]); UT_ASSERT(!bits[33]);
+
+  // Check unaligned access
+  UT_ASSERT_EQUAL(bits.bits(4, 8), uint64_t(0xcd));
+  UT_ASSERT_EQUAL(bits.bits(3, 32), uint64_t(0xe690aec5));
+
+  // Check that the size survives the pass as a raw buffer
+  RawBuffer raw(bits);
+  UT_ASSERT_EQUAL(BitBuffer(raw).size(), size_t(35));
+
+  bits.clear();
+  UT_ASSERT_EQUAL(bits.size(), size_t(0));
+  bits.unref();
+}
+
+
 TestSuite *
 BufferTest::suite() {
   TestSuite *suite = new TestSuite("Buffer Tests");
@@ -132,5 +163,7 @@ BufferTest::suite() {
                    "re-interprete case", &BufferTest::testReinterprete));
   suite->addTest(new TestCaller<BufferTest>(
                    "raw ring buffer", &BufferTest::testRawRingBuffer));
+  suite->addTest(new TestCaller<BufferTest>(
+                   "packed bit buffer", &BufferTest::testBitBuffer));
   return suite;
 }
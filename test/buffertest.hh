@@ -13,6 +13,7 @@ public:
   void testRefcount();
   void testReinterprete();
   void testRawRingBuffer();
+  void testBitBuffer();
 
 
 public:
@@ -2,6 +2,18 @@
 #include "config.hh"
 #include "utils.hh"
 #include "combine.hh"
+#include "convert.hh"
+#include "autocast.hh"
+#include "baseband.hh"
+#include "subsample.hh"
+#include "wavfile.hh"
+#include "iqfile.hh"
+#include "replaysource.hh"
+#include "devicesource.hh"
+#include "http.hh"
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
 
 using namespace sdr;
 using namespace UnitTest;
@@ -74,6 +86,691 @@ CoreUtilsTest::testInterleave() {
   UT_ASSERT_EQUAL(sink.buffer()[5], (int16_t)6);
 }
 
+void
+CoreUtilsTest::testAGC() {
+  // AGC with 10ms attack, 100ms decay and a target level of 1
+  AGC<float> agc(0.1, 1, 16);
+  agc.setAttack(0.01);
+  DebugStore<float> sink;
+  agc.connect(&sink, true);
+  agc.config(Config(Config::Type_f32, 1000, 100, 1));
+
+  // Weak sine, amplitude 0.01 -> mean magnitude 0.02/pi
+  Buffer<float> buffer(100);
+  for (size_t j=0; j<10; j++) {
+    for (size_t i=0; i<buffer.size(); i++) { buffer[i] = 0.01*std::sin(0.1*i); }
+    agc.handleBuffer(buffer, false);
+  }
+  // Gain settles at target/(4*mean magnitude), as with the per-sample AGC
+  UT_ASSERT(std::abs(agc.gain()-M_PI/0.08) < 1);
+  // Input is left untouched
+  UT_ASSERT(std::abs(buffer[10]-0.01*std::sin(1.0)) < 1e-6);
+  UT_ASSERT(std::abs(sink.buffer()[10]-M_PI/0.08*buffer[10]) < 0.01);
+
+  // Strong sine, amplitude 1, processed in-place
+  for (size_t i=0; i<buffer.size(); i++) { buffer[i] = std::sin(0.1*i); }
+  agc.handleBuffer(buffer, true);
+  UT_ASSERT(sink.buffer()[99] == buffer[99]);
+  UT_ASSERT(std::abs(buffer[99]) < 0.5*std::abs(std::sin(9.9)));
+  // Fast attack: gain dropped within 100ms
+  UT_ASSERT(std::abs(agc.gain()-M_PI/8) < 0.01);
+
+  // Complex carrier, magnitude 0.1
+  AGC< std::complex<float> > cagc(0.01, 1, 16);
+  DebugStore< std::complex<float> > csink;
+  cagc.connect(&csink, true);
+  cagc.config(Config(Config::Type_cf32, 1000, 100, 1));
+  Buffer< std::complex<float> > cbuffer(100);
+  for (size_t j=0; j<5; j++) {
+    for (size_t i=0; i<cbuffer.size(); i++) { cbuffer[i] = std::polar(0.1f, 0.3f*i); }
+    cagc.handleBuffer(cbuffer, false);
+  }
+  UT_ASSERT(std::abs(cagc.gain()-2.5) < 1e-3);
+  UT_ASSERT(std::abs(std::abs(csink.buffer()[99])-0.25) < 1e-3);
+}
+
+void
+CoreUtilsTest::testConvert() {
+  // Odd length to exercise the tails of the vectorized kernels
+  const size_t N = 259;
+  uint8_t u8[N], o8[N]; uint16_t u16[N], o16[N]; int16_t s16[N], i16[N]; float f32[N], table[256];
+  for (size_t i=0; i<N; i++) { u8[i] = i; u16[i] = 257*i; s16[i] = 257*i-32768; }
+  Convert::uint8Table(table, 0.5, -64);
+
+  Convert::Implementation impls[] = {
+    Convert::GENERIC, Convert::SSE2, Convert::AVX2, Convert::AUTO };
+  Convert::Implementation selected = Convert::implementation();
+  UT_ASSERT_EQUAL(int(selected), int(Convert::AUTO));
+  for (size_t j=0; j<4; j++) {
+    if (! Convert::setImplementation(impls[j])) { continue; }
+    Convert::uint8ToInt8(u8, (int8_t *)o8, N);
+    for (size_t i=0; i<N; i++) { UT_ASSERT_EQUAL(int(int8_t(o8[i])), int(u8[i])-128); }
+    Convert::uint16ToInt16(u16, (int16_t *)o16, N);
+    for (size_t i=0; i<N; i++) { UT_ASSERT_EQUAL(int(int16_t(o16[i])), int(u16[i])-32768); }
+    Convert::uint8ToInt16(u8, i16, N);
+    for (size_t i=0; i<N; i++) { UT_ASSERT_EQUAL(int(i16[i]), (int(u8[i])-128)*256); }
+    Convert::int8ToInt16((int8_t *)u8, i16, N);
+    for (size_t i=0; i<N; i++) { UT_ASSERT_EQUAL(int(i16[i]), int(int8_t(u8[i]))*256); }
+    Convert::int16ToFloat(s16, f32, N, 0.5, 1);
+    for (size_t i=0; i<N; i++) { UT_ASSERT_EQUAL(f32[i], 0.5f*s16[i]+1); }
+    // Saturates
+    Convert::floatToInt16(f32, i16, N, 4, 0);
+    for (size_t i=0; i<N; i++) {
+      UT_ASSERT_EQUAL(int(i16[i]), int(std::min(32767.f, std::max(-32768.f, 4*f32[i]))));
+    }
+    Convert::lookup(u8, f32, N, table);
+    for (size_t i=0; i<N; i++) { UT_ASSERT_EQUAL(f32[i], 0.5f*u8[i]-64); }
+    // f32 holds 0.5*u8-64, read as reals and as 129 complex values
+    UT_ASSERT(std::abs(Convert::absSum(f32, N)-8382.5) < 1e-2);
+    float cabs = 0;
+    for (size_t i=0; i<N/2; i++) { cabs += std::sqrt(f32[2*i]*f32[2*i]+f32[2*i+1]*f32[2*i+1]); }
+    UT_ASSERT(std::abs(Convert::absSum((const std::complex<float> *)f32, N/2)-cabs) < 1e-2);
+    float r32[N];
+    Convert::ramp(f32, r32, N, 1, 0.01);
+    for (size_t i=0; i<N; i++) { UT_ASSERT(std::abs(r32[i]-(1+0.01f*(i+1))*f32[i]) < 1e-3); }
+    Convert::ramp((const std::complex<float> *)f32, (std::complex<float> *)r32, N/2, 1, 0.01);
+    for (size_t i=0; i<N-1; i++) {
+      UT_ASSERT(std::abs(r32[i]-(1+0.01f*(i/2+1))*f32[i]) < 1e-3);
+    }
+  }
+  Convert::setImplementation(selected);
+}
+
+void
+CoreUtilsTest::testBaseBand8bit() {
+  // Some complex uint8 samples as received from a RTL2832
+  Buffer< std::complex<uint8_t> > input(64);
+  for (size_t i=0; i<input.size(); i++) {
+    input[i] = std::complex<uint8_t>((37*i)%256, (101*i+13)%256);
+  }
+
+  // Reference: cast to complex int16 first
+  AutoCast< std::complex<int16_t> > cast;
+  IQBaseBand<int16_t> refBaseBand(1e3, 4e3, 15, 4);
+  DebugStore< std::complex<int16_t> > refSink;
+  cast.connect(&refBaseBand, true); refBaseBand.connect(&refSink, true);
+  cast.config(Config(Config::Type_cu8, 16e3, input.size(), 1));
+  cast.handleBuffer(input, false);
+
+  // Process complex uint8 directly
+  IQBaseBand<int16_t> baseBand(1e3, 4e3, 15, 4);
+  DebugStore< std::complex<int16_t> > sink;
+  baseBand.connect(&sink, true);
+  baseBand.config(Config(Config::Type_cu8, 16e3, input.size(), 1));
+  baseBand.handleBuffer(input, false);
+
+  UT_ASSERT(0 < sink.buffer().size());
+  UT_ASSERT_EQUAL(sink.buffer().size(), refSink.buffer().size());
+  for (size_t i=0; i<sink.buffer().size(); i++) {
+    UT_ASSERT(sink.buffer()[i] == refSink.buffer()[i]);
+  }
+}
+
+void
+CoreUtilsTest::testResampler() {
+  // 1.024MS/s -> 48kS/s
+  Resampler< std::complex<float> > resampler(48e3);
+  DebugStore< std::complex<float> > sink;
+  resampler.connect(&sink, true);
+  resampler.config(Config(Config::Type_cf32, 1.024e6, 4096, 1));
+  UT_ASSERT_EQUAL(resampler.up(), size_t(3));
+  UT_ASSERT_EQUAL(resampler.down(), size_t(64));
+
+  // A 1kHz tone passes, a 30kHz tone gets suppressed
+  Buffer< std::complex<float> > input(4096);
+  size_t count = 0; double maxErr = 0;
+  for (size_t j=0; j<16; j++) {
+    for (size_t i=0; i<input.size(); i++) {
+      double t = (j*input.size()+i)/1.024e6;
+      input[i] = std::exp(std::complex<float>(0, 2*M_PI*1e3*t))
+          + std::exp(std::complex<float>(0, 2*M_PI*30e3*t));
+    }
+    resampler.handleBuffer(input, false);
+    for (size_t i=0; i<sink.buffer().size(); i++, count++) {
+      // Skip transient and compare with the 1kHz tone delayed by the filter
+      if (count < 1024) { continue; }
+      double t = count/48e3 - (resampler.tapsPerPhase()*3-1)/(2*3*1.024e6);
+      std::complex<float> ref = std::exp(std::complex<float>(0, 2*M_PI*1e3*t));
+      maxErr = std::max(maxErr, double(std::abs(sink.buffer()[i]-ref)));
+    }
+  }
+  // Exact number of output samples
+  UT_ASSERT_EQUAL(count, size_t(16*4096*3/64));
+  UT_ASSERT(maxErr < 1e-2);
+}
+
+/** Keeps the last buffers received, like a consumer falling behind. */
+template <class Scalar>
+class HoldingSink: public Sink<Scalar>
+{
+public:
+  HoldingSink(): _held() { }
+  virtual ~HoldingSink() { release(); }
+  void release() {
+    for (size_t i=0; i<_held.size(); i++) { _held[i].unref(); }
+    _held.clear();
+  }
+  inline const std::vector< Buffer<Scalar> > &held() const { return _held; }
+  virtual void config(const Config &src_cfg) { }
+  virtual void process(const Buffer<Scalar> &buffer, bool allow_overwrite) {
+    buffer.ref(); _held.push_back(buffer);
+  }
+protected:
+  std::vector< Buffer<Scalar> > _held;
+};
+
+void
+CoreUtilsTest::testWavFile() {
+  char filename[] = "/tmp/sdrtestXXXXXX";
+  int fd = mkstemp(filename); UT_ASSERT(0 <= fd); close(fd);
+
+  Buffer< std::complex<int16_t> > data(1000);
+  for (size_t i=0; i<data.size(); i++) {
+    data[i] = std::complex<int16_t>(i, -int(i));
+  }
+
+  // Write as RIFF & RF64, read back by stream and as views into a mapping
+  for (size_t k=0; k<4; k++) {
+    {
+      WavSink< std::complex<int16_t> > sink(filename, k/2);
+      sink.config(Config(Config::Type_cs16, 8e3, data.size(), 1));
+      sink.handleBuffer(data, false);
+    }
+
+    WavSource src(filename, 300, k%2);
+    UT_ASSERT(src.isOpen());
+    UT_ASSERT_EQUAL(src.isMapped(), bool(k%2));
+    DebugStore< std::complex<int16_t> > sink;
+    src.connect(&sink, true);
+    size_t count = 0;
+    for (size_t j=0; j<4; j++) {
+      src.next();
+      for (size_t i=0; i<sink.buffer().size(); i++, count++) {
+        UT_ASSERT(data[count] == sink.buffer()[i]);
+      }
+    }
+    UT_ASSERT_EQUAL(count, data.size());
+  }
+
+  // Views into the mapping remain valid after the source got closed
+  {
+    HoldingSink< std::complex<int16_t> > sink;
+    WavSource src(filename, 300, true);
+    src.connect(&sink, true);
+    src.next(); src.next();
+    src.close();
+    UT_ASSERT_EQUAL(sink.held().size(), size_t(2));
+    UT_ASSERT(data[299] == sink.held()[0][299]);
+    UT_ASSERT(data[599] == sink.held()[1][299]);
+  }
+  unlink(filename);
+}
+
+void
+CoreUtilsTest::testIQFile() {
+  char filename[] = "/tmp/sdrtestXXXXXX";
+  int fd = mkstemp(filename); UT_ASSERT(0 <= fd); close(fd); unlink(filename);
+
+  Buffer< std::complex<int16_t> > data(1000);
+  for (size_t i=0; i<data.size(); i++) {
+    data[i] = std::complex<int16_t>(i, -int(i));
+  }
+  {
+    IQFileSink< std::complex<int16_t> > sink(filename, 145e6, 0.01);
+    sink.config(Config(Config::Type_cs16, 100e3, data.size(), 1));
+    for (size_t i=0; i<3; i++) { sink.handleBuffer(data, false); usleep(20000); }
+  }
+
+  // The source gets configured from the metadata
+  IQFileSource src(filename, 600);
+  UT_ASSERT(src.isOpen());
+  UT_ASSERT_EQUAL(src.meta().type, Config::Type_cs16);
+  UT_ASSERT_EQUAL(src.meta().sampleRate, 100e3);
+  UT_ASSERT_EQUAL(src.frequency(), 145e6);
+  UT_ASSERT_EQUAL(src.sampleCount(), uint64_t(3*data.size()));
+  UT_ASSERT(1 < src.meta().index.size());
+
+  // Seek to the last index entry by time, the 20ms gaps are covered by the index
+  const std::pair<double, uint64_t> &last = src.meta().index.back();
+  UT_ASSERT(last.second >= data.size());
+  UT_ASSERT(src.seek(last.first - src.startTime() + 1e-6));
+  UT_ASSERT_EQUAL(src.position(), last.second);
+  UT_ASSERT(! src.seek(1));
+
+  DebugStore< std::complex<int16_t> > sink;
+  src.connect(&sink, true);
+  UT_ASSERT(src.seek(0));
+  size_t count = 0;
+  for (size_t j=0; j<5; j++) {
+    src.next();
+    for (size_t i=0; i<sink.buffer().size(); i++, count++) {
+      UT_ASSERT(data[count % data.size()] == sink.buffer()[i]);
+    }
+  }
+  UT_ASSERT_EQUAL(count, 3*data.size());
+
+  // Views into the mapping remain valid after the recording got closed
+  HoldingSink< std::complex<int16_t> > holder;
+  src.connect(&holder, true);
+  UT_ASSERT(src.seek(0));
+  src.next();
+  src.close();
+  UT_ASSERT_EQUAL(holder.held().size(), size_t(1));
+  UT_ASSERT(data[599] == holder.held()[0][599]);
+
+  // A recording without samples can not be replayed
+  {
+    IQFileSink< std::complex<int16_t> > sink(filename, 145e6, 0.01);
+    sink.config(Config(Config::Type_cs16, 100e3, data.size(), 1));
+  }
+  UT_ASSERT_THROW(src.open(filename), RuntimeError);
+  UT_ASSERT(! src.isOpen());
+  unlink((std::string(filename)+".sigmf-data").c_str());
+  unlink((std::string(filename)+".sigmf-meta").c_str());
+}
+
+
+void
+CoreUtilsTest::testReplaySource() {
+  char filename[] = "/tmp/sdrtestXXXXXX";
+  int fd = mkstemp(filename); UT_ASSERT(0 <= fd);
+  int16_t data[2000];
+  for (size_t i=0; i<2000; i++) { data[i] = (i%256)<<8; }
+  UT_ASSERT_EQUAL(write(fd, data, sizeof(data)), ssize_t(sizeof(data))); close(fd);
+
+  // Complex int16 recording, replayed as fast as possible
+  ReplaySource src(filename, Config::Type_cs16, 1e6, 300, 2);
+  DebugStore< std::complex<uint8_t> > sink;
+  src.connect(&sink, true);
+  src.setMaxSpeed(true);
+  src.start();
+  while (src.isRunning()) { usleep(1000); }
+  src.stop();
+  UT_ASSERT_EQUAL(src.buffers(), uint64_t(4));
+  UT_ASSERT_EQUAL(src.samples(), uint64_t(1000));
+  UT_ASSERT_EQUAL(src.overruns(), uint64_t(0));
+  UT_ASSERT_EQUAL(sink.buffer().size(), size_t(100));
+  for (size_t i=0; i<100; i++) {
+    UT_ASSERT(std::complex<uint8_t>(((1800+2*i)%256)+128, ((1801+2*i)%256)+128)
+              == sink.buffer()[i]);
+  }
+
+  // A consumer holding the buffers causes overruns in real-time mode (10ms per buffer, long
+  // enough to not fall behind by more than the ring size on a loaded machine)
+  ReplaySource src2(filename, Config::Type_cs16, 1e4, 100, 2);
+  HoldingSink< std::complex<uint8_t> > holder;
+  src2.connect(&holder, true);
+  src2.start();
+  while (src2.isRunning()) { usleep(1000); }
+  src2.stop();
+  UT_ASSERT_EQUAL(src2.buffers(), uint64_t(2));
+  UT_ASSERT(0 < src2.overruns());
+  UT_ASSERT_EQUAL(src2.samples()+src2.lostSamples(), uint64_t(1000));
+
+  unlink(filename);
+}
+
+
+void
+CoreUtilsTest::testDeviceSource() {
+  // Fake driver transfer buffer, gets overwritten after each callback
+  std::complex<uint8_t> transfer[250];
+  DeviceSource< std::complex<uint8_t> > src(100, 3);
+  UT_ASSERT_EQUAL(src.numBuffers(), size_t(3));
+
+  // Directly connected sinks return the buffers to the ring immediately
+  DebugStore< std::complex<uint8_t> > store;
+  src.connect(&store, true);
+  for (size_t j=0; j<10; j++) {
+    for (size_t i=0; i<250; i++) { transfer[i] = std::complex<uint8_t>(j, i); }
+    src.receive(transfer, 250);
+    for (size_t i=0; i<250; i++) { transfer[i] = 0; }
+    UT_ASSERT_EQUAL(store.buffer().size(), size_t(50));
+    UT_ASSERT(std::complex<uint8_t>(j, 249) == store.buffer()[49]);
+  }
+  UT_ASSERT_EQUAL(src.samplesReceived(), uint64_t(2500));
+  UT_ASSERT_EQUAL(src.overruns(), uint64_t(0));
+  src.disconnect(&store);
+
+  // A consumer holding the buffers causes an overrun once the ring is exhausted
+  HoldingSink< std::complex<uint8_t> > holder;
+  src.connect(&holder, true);
+  src.resetCounters();
+  src.receive(transfer, 250);
+  src.receive(transfer, 250);
+  UT_ASSERT_EQUAL(src.overruns(), uint64_t(1));
+  UT_ASSERT_EQUAL(src.samplesDropped(), uint64_t(250));
+  // Released buffers are available again
+  holder.release();
+  src.receive(transfer, 250);
+  UT_ASSERT_EQUAL(src.overruns(), uint64_t(1));
+}
+
+
+void
+CoreUtilsTest::testBufferMeta() {
+  // Views advance the metadata
+  Buffer<int16_t> buffer(100);
+  buffer.setMeta(BufferMeta(1000, 1000000000, 1e6));
+  UT_ASSERT_EQUAL(buffer.sub(10, 10).meta().index(), uint64_t(1010));
+  UT_ASSERT_EQUAL(buffer.sub(10, 10).meta().time(), int64_t(1000010000));
+  buffer.unref();
+
+  // Source -> Scale (implicit) -> SubSample (resamples) -> store
+  DeviceSource<int16_t> src(100, 2, 1e6);
+  Scale<int16_t> scale(2);
+  SubSample<int16_t> sub(size_t(4));
+  DebugStore<int16_t> store;
+  src.connect(&scale, true); scale.connect(&sub, true); sub.connect(&store, true);
+
+  int16_t data[100];
+  for (size_t i=0; i<100; i++) { data[i] = i; }
+  int64_t before = BufferMeta::now();
+  src.receive(data, 100);
+  src.receive(data, 100);
+  const BufferMeta &meta = store.buffer().meta();
+  UT_ASSERT(meta.isValid());
+  UT_ASSERT_EQUAL(meta.sampleRate(), 250e3);
+  // The first output sample gets completed by the input sample 103
+  UT_ASSERT_EQUAL(meta.index(), uint64_t(103/4));
+  UT_ASSERT(meta.time() >= before-200000);
+  UT_ASSERT(meta.time() <= BufferMeta::now());
+  UT_ASSERT(! BufferMeta::current().isValid());
+
+  // Exact multiples are not truncated to the index below (e.g. 49*(1./49) < 1)
+  for (uint64_t n=2; n<64; n++) {
+    for (uint64_t k=0; k<200; k++) {
+      UT_ASSERT_EQUAL(BufferMeta(k*n, 0, 1e6).resample(1, n, 0).index(), k);
+      UT_ASSERT_EQUAL(BufferMeta(k*n-1, 0, 1e6).resample(1, n, 1).index(), k);
+      UT_ASSERT_EQUAL(BufferMeta(k*n, 0, 1e6).resample(1./n).index(), k);
+    }
+  }
+  UT_ASSERT_EQUAL(BufferMeta(64, 0, 1.024e6).resample(3, 64, 0).index(), uint64_t(3));
+  UT_ASSERT_EQUAL(BufferMeta(64, 0, 1.024e6).resample(3, 64, 0).sampleRate(), 48e3);
+
+  // Decimation by 49, the first output sample gets completed by the input sample 49
+  Buffer<int16_t> input(98);
+  for (size_t i=0; i<98; i++) { input[i] = 0; }
+  input.setMeta(BufferMeta(1, 0, 49e3));
+  SubSample<int16_t> sub49(size_t(49));
+  DebugStore<int16_t> store49;
+  sub49.connect(&store49, true);
+  sub49.config(Config(Config::Type_s16, 49e3, 98, 1));
+  sub49.handleBuffer(input, false);
+  UT_ASSERT_EQUAL(store49.buffer().size(), size_t(2));
+  UT_ASSERT_EQUAL(store49.buffer().meta().index(), uint64_t(1));
+  UT_ASSERT_EQUAL(store49.buffer().meta().sampleRate(), 1e3);
+  input.unref();
+}
+
+void
+CoreUtilsTest::testLatencyHistogram() {
+  // Small values are exact, larger ones within 1/32
+  UT_ASSERT_EQUAL(LatencyHistogram::bucket(63), size_t(63));
+  UT_ASSERT_EQUAL(LatencyHistogram::upperBound(LatencyHistogram::bucket(63)), uint64_t(63));
+  for (uint64_t v=64; v<(uint64_t(1)<<40); v = v*3+1) {
+    size_t b = LatencyHistogram::bucket(v);
+    UT_ASSERT(LatencyHistogram::lowerBound(b) <= v);
+    UT_ASSERT(LatencyHistogram::upperBound(b) >= v);
+    UT_ASSERT((LatencyHistogram::upperBound(b)-v) <= v/32);
+  }
+  UT_ASSERT(LatencyHistogram::bucket(~uint64_t(0)) < LatencyHistogram::NumBuckets);
+
+  LatencyHistogram hist;
+  for (int64_t i=1; i<=1000; i++) { hist.record(i*1000); }
+  hist.record(-5);
+  UT_ASSERT_EQUAL(hist.count(), uint64_t(1001));
+  UT_ASSERT_EQUAL(hist.min(), uint64_t(0));
+  UT_ASSERT_EQUAL(hist.max(), uint64_t(1000000));
+  UT_ASSERT(hist.percentile(0.5) >= 500000);
+  UT_ASSERT(hist.percentile(0.5) <= 500000*33/32);
+  UT_ASSERT(hist.percentile(0.99) >= 990000);
+  UT_ASSERT(hist.percentile(0.99) <= 990000*33/32);
+  UT_ASSERT_EQUAL(hist.percentile(1.0), uint64_t(1000000));
+  hist.reset();
+  UT_ASSERT_EQUAL(hist.count(), uint64_t(0));
+  UT_ASSERT_EQUAL(hist.percentile(0.5), uint64_t(0));
+
+  // Monitored sinks record the capture-to-sink latency and residence time
+  LatencyMonitor::get().histogram("test.store.latency")->reset();
+  LatencyMonitor::get().histogram("test.store.residence")->reset();
+  DeviceSource<int16_t> src(100, 2, 1e6);
+  DebugStore<int16_t> store;
+  store.monitorLatency("test.store");
+  src.connect(&store, true);
+  int16_t data[100];
+  for (size_t i=0; i<100; i++) { data[i] = i; }
+  src.receive(data, 100);
+  src.receive(data, 100);
+  const LatencyHistogram *latency = LatencyMonitor::get().histogram("test.store.latency");
+  UT_ASSERT_EQUAL(latency->count(), uint64_t(2));
+  // The first sample of a buffer got captured 100us before it was received
+  UT_ASSERT(latency->min() >= 100000);
+  UT_ASSERT_EQUAL(LatencyMonitor::get().histogram("test.store.residence")->count(), uint64_t(2));
+}
+
+void
+CoreUtilsTest::testHttpParser() {
+  std::string request = "POST /spots?x=1 HTTP/1.1\r\nHost: localhost \r\ncontent-length: 4\r\n"
+      "Content-Type: application/json\r\n\r\n[42]GET / HTTP/1.0\r\n";
+  size_t length = request.find("GET");
+
+  // Feed the request byte by byte
+  http::RequestParser parser;
+  for (size_t i=1; i<length; i++) {
+    UT_ASSERT_EQUAL(parser.parse(request.c_str(), i), http::RequestParser::INCOMPLETE);
+  }
+  UT_ASSERT_EQUAL(parser.parse(request.c_str(), length), http::RequestParser::COMPLETE);
+  UT_ASSERT_EQUAL(parser.length(), length);
+
+  // Parse at once, followed by an incomplete request
+  http::RequestParser other;
+  UT_ASSERT_EQUAL(other.parse(request.c_str(), request.size()), http::RequestParser::COMPLETE);
+  UT_ASSERT_EQUAL(other.length(), length);
+  UT_ASSERT_EQUAL(other.method(), http::HTTP_POST);
+  UT_ASSERT_EQUAL(other.version(), http::HTTP_1_1);
+  UT_ASSERT(other.url().str(request.c_str()) == std::string("/spots?x=1"));
+  UT_ASSERT_EQUAL(other.numHeaders(), size_t(3));
+  UT_ASSERT(other.headerName(0).str(request.c_str()) == std::string("Host"));
+  UT_ASSERT(other.headerValue(0).str(request.c_str()) == std::string("localhost"));
+  UT_ASSERT(other.body().str(request.c_str()) == std::string("[42]"));
+
+  // Next request
+  other.reset();
+  std::string next = request.substr(length);
+  UT_ASSERT_EQUAL(other.parse(next.c_str(), next.size()), http::RequestParser::INCOMPLETE);
+  next += "\r\n";
+  UT_ASSERT_EQUAL(other.parse(next.c_str(), next.size()), http::RequestParser::COMPLETE);
+  UT_ASSERT_EQUAL(other.method(), http::HTTP_GET);
+  UT_ASSERT_EQUAL(other.version(), http::HTTP_1_0);
+  UT_ASSERT_EQUAL(other.body().length, size_t(0));
+
+  // Invalid requests
+  other.reset();
+  std::string invalid = "PUT / HTTP/1.1\r\n";
+  UT_ASSERT_EQUAL(other.parse(invalid.c_str(), invalid.size()), http::RequestParser::INVALID);
+  other.reset();
+  invalid = "GET / HTTP/1.1\r\nBad Header: x\r\n";
+  UT_ASSERT_EQUAL(other.parse(invalid.c_str(), invalid.size()), http::RequestParser::INVALID);
+
+  // Content lengths, which are not numbers or would not fit into the input buffer
+  const char *lengths[] = { "-1", "18446744073709551615", "18446744073709551617", "4x", "0x10",
+                            "", "1048577" };
+  for (size_t i=0; i<7; i++) {
+    other.reset();
+    invalid = std::string("POST / HTTP/1.1\r\nContent-Length: ") + lengths[i] + "\r\n\r\n";
+    UT_ASSERT_EQUAL(other.parse(invalid.c_str(), invalid.size()), http::RequestParser::INVALID);
+  }
+
+  // Control characters in JSON strings get escaped and survive a round trip
+  std::string text;
+  http::JSON(std::string("a\"\\\n\t\x01\x1f" "b")).serialize(text);
+  UT_ASSERT(text == "\"a\\\"\\\\\\n\\u0009\\u0001\\u001fb\"");
+  http::JSON obj;
+  UT_ASSERT(http::JSON::parse(text, obj));
+  UT_ASSERT(obj.isString());
+  UT_ASSERT(obj.asString() == std::string("a\"\\\n\t\x01\x1f" "b"));
+  UT_ASSERT(http::JSON::parse("\"\\u00e9\"", obj));
+  UT_ASSERT(obj.asString() == "\xc3\xa9");
+  UT_ASSERT(! http::JSON::parse("\"\\u00g9\"", obj));
+}
+
+/** Trivial JSON echo method. */
+class JSONEcho
+{
+public:
+  bool echo(const http::JSON &request, http::JSON &result) {
+    result = request;
+    return true;
+  }
+};
+
+void
+CoreUtilsTest::testHttpServer() {
+  JSONEcho echo;
+  http::Server server(0, 2);
+  server.addStatic("/hello", "hello");
+  server.addJSON("/echo", &echo, &JSONEcho::echo);
+  server.start();
+  UT_ASSERT(0 != server.port());
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  addr.sin_port = htons(server.port());
+  struct timeval timeout; timeout.tv_sec = 2; timeout.tv_usec = 0;
+
+  // More clients than workers, each sending two pipelined requests over a kept-alive connection.
+  // The body of the POST request is not read by the handler and gets skipped.
+  std::string request = "POST /hello HTTP/1.1\r\nContent-Length: 4\r\n\r\nbody"
+      "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  int clients[5];
+  for (size_t i=0; i<5; i++) {
+    clients[i] = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(clients[i], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    UT_ASSERT(0 == connect(clients[i], (struct sockaddr *)&addr, sizeof(addr)));
+    UT_ASSERT_EQUAL(write(clients[i], request.c_str(), request.size()), ssize_t(request.size()));
+  }
+  for (size_t i=0; i<5; i++) {
+    std::string response; char buffer[1024];
+    size_t count = 0;
+    while (count < 2) {
+      ssize_t res = read(clients[i], buffer, sizeof(buffer));
+      if (res <= 0) { break; }
+      response.append(buffer, res);
+      count = 0;
+      for (size_t idx = response.find("\r\n\r\nhello"); std::string::npos != idx;
+           idx = response.find("\r\n\r\nhello", idx+1)) {
+        count++;
+      }
+    }
+    UT_ASSERT_EQUAL(count, size_t(2));
+    UT_ASSERT_EQUAL(response.find("HTTP/1.1 200"), size_t(0));
+  }
+  UT_ASSERT_EQUAL(server.numConnections(), size_t(5));
+
+  // HTTP/1.0 requests close the connection after the response
+  std::string request10 = "GET /hello HTTP/1.0\r\n\r\n";
+  UT_ASSERT_EQUAL(write(clients[0], request10.c_str(), request10.size()),
+                  ssize_t(request10.size()));
+  char buffer[1024]; ssize_t res; std::string response;
+  while (0 < (res = read(clients[0], buffer, sizeof(buffer)))) { response.append(buffer, res); }
+  UT_ASSERT_EQUAL(res, ssize_t(0));
+  UT_ASSERT(std::string::npos != response.find("\r\n\r\nhello"));
+
+  // Header names are case-insensitive
+  std::string post = "POST /echo HTTP/1.1\r\ncontent-type: application/json\r\n"
+      "content-length: 4\r\n\r\n[42]";
+  UT_ASSERT_EQUAL(write(clients[1], post.c_str(), post.size()), ssize_t(post.size()));
+  response.clear();
+  while (std::string::npos == response.find("\r\n\r\n[42]")) {
+    if (0 >= (res = read(clients[1], buffer, sizeof(buffer)))) { break; }
+    response.append(buffer, res);
+  }
+  UT_ASSERT(0 == response.find("HTTP/1.1 200"));
+  UT_ASSERT(std::string::npos != response.find("\r\n\r\n[42]"));
+
+  for (size_t i=0; i<5; i++) { close(clients[i]); }
+  server.stop(true);
+  UT_ASSERT_EQUAL(server.numConnections(), size_t(0));
+}
+
+
+void
+CoreUtilsTest::testEventStream() {
+  http::Server server(0, 2);
+  LatencyHistogram latency;
+  http::EventStream events(4, &latency);
+  server.addHandler("/events", &events, &http::EventStream::handle);
+  server.start();
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  addr.sin_port = htons(server.port());
+  struct timeval timeout; timeout.tv_sec = 2; timeout.tv_usec = 0;
+
+  // Subscribe two clients
+  std::string request = "GET /events HTTP/1.1\r\n\r\n";
+  int clients[2];
+  for (size_t i=0; i<2; i++) {
+    clients[i] = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(clients[i], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    UT_ASSERT(0 == connect(clients[i], (struct sockaddr *)&addr, sizeof(addr)));
+    UT_ASSERT_EQUAL(write(clients[i], request.c_str(), request.size()), ssize_t(request.size()));
+  }
+  for (size_t i=0; (i<2000) && (2 != events.numClients()); i++) { usleep(1000); }
+  UT_ASSERT_EQUAL(events.numClients(), size_t(2));
+
+  // Publish much more than the clients take, publishing never blocks and the oldest events
+  // get dropped
+  std::string payload(4096, 'x');
+  for (size_t i=0; i<20000; i++) {
+    std::stringstream data; data << i << payload;
+    events.publish(data.str());
+  }
+  std::vector<http::EventStream::ClientStats> stats = events.clientStats();
+  UT_ASSERT_EQUAL(stats.size(), size_t(2));
+  UT_ASSERT(stats[0].queued <= 4);
+  UT_ASSERT((stats[0].dropped + stats[1].dropped) > 0);
+
+  // The first client receives the latest event
+  std::string received; char buffer[65536]; ssize_t res;
+  while (std::string::npos == received.find("data: 19999x")) {
+    if (0 >= (res = read(clients[0], buffer, sizeof(buffer)))) { break; }
+    received.append(buffer, res);
+    if (received.size() > 65536) { received.erase(0, received.size()-65536); }
+  }
+  UT_ASSERT(std::string::npos != received.find("data: 19999x"));
+  for (size_t i=0; (i<2000) && (0 == latency.count()); i++) { usleep(1000); }
+  UT_ASSERT(0 < latency.count());
+  UT_ASSERT(20000*2 > latency.count());
+
+  // The latency is measured from the given time until the event has been sent
+  latency.reset();
+  events.publish("late", "", BufferMeta::now()-1000000000);
+  while (std::string::npos == received.find("data: late")) {
+    if (0 >= (res = read(clients[0], buffer, sizeof(buffer)))) { break; }
+    received.append(buffer, res);
+  }
+  UT_ASSERT(std::string::npos != received.find("data: late"));
+  for (size_t i=0; (i<2000) && (0 == latency.count()); i++) { usleep(1000); }
+  UT_ASSERT(0 < latency.count());
+  UT_ASSERT(1000000000 <= latency.max());
+
+  // Disconnected clients get removed
+  close(clients[1]);
+  for (size_t i=0; (i<2000) && (1 != events.numClients()); i++) {
+    events.publish("ping"); usleep(1000);
+  }
+  UT_ASSERT_EQUAL(events.numClients(), size_t(1));
+
+  close(clients[0]);
+  server.stop(true);
+}
+
 
 TestSuite *
 CoreUtilsTest::suite() {
@@ -85,6 +782,32 @@ CoreUtilsTest::suite() {
                    "cast uint16_t -> int16_t", &CoreUtilsTest::testUChar2Char));
   suite->addTest(new TestCaller<CoreUtilsTest>(
                    "Interleave", &CoreUtilsTest::testInterleave));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "AGC", &CoreUtilsTest::testAGC));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "conversion kernels", &CoreUtilsTest::testConvert));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "IQBaseBand 8bit input", &CoreUtilsTest::testBaseBand8bit));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "Resampler", &CoreUtilsTest::testResampler));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "WAV file round trip", &CoreUtilsTest::testWavFile));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "I/Q file round trip", &CoreUtilsTest::testIQFile));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "replay source", &CoreUtilsTest::testReplaySource));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "device source buffer ring", &CoreUtilsTest::testDeviceSource));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "buffer metadata", &CoreUtilsTest::testBufferMeta));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "latency histogram", &CoreUtilsTest::testLatencyHistogram));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "http request parser", &CoreUtilsTest::testHttpParser));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "http server", &CoreUtilsTest::testHttpServer));
+  suite->addTest(new TestCaller<CoreUtilsTest>(
+                   "event stream", &CoreUtilsTest::testEventStream));
 
   return suite;
 }
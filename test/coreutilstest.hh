@@ -11,6 +11,19 @@ public:
   void testUChar2Char();
   void testUShort2Short();
   void testInterleave();
+  void testAGC();
+  void testConvert();
+  void testBaseBand8bit();
+  void testResampler();
+  void testWavFile();
+  void testIQFile();
+  void testReplaySource();
+  void testDeviceSource();
+  void testBufferMeta();
+  void testLatencyHistogram();
+  void testHttpParser();
+  void testHttpServer();
+  void testEventStream();
 
 public:
   static UnitTest::TestSuite *suite();
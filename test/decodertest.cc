@@ -0,0 +1,861 @@
+#include "decodertest.hh"
+#include "config.hh"
+#include "bch31_21.hh"
+#include "pocsag.hh"
+#include "fsk.hh"
+#include "psk31.hh"
+#include "ax25.hh"
+#include "baudot.hh"
+#ifdef SDR_WITH_FFTW
+#include "rttyskimmer.hh"
+#include "psk31skimmer.hh"
+#endif
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <set>
+
+using namespace sdr;
+using namespace UnitTest;
+
+DecoderTest::~DecoderTest() { }
+
+
+void
+DecoderTest::testBCHRepair() {
+  // POCSAG sync word and idle word are valid code words
+  uint32_t word = 0x7cd215d8;
+  UT_ASSERT_EQUAL(pocsag_repair(word), 0);
+  UT_ASSERT_EQUAL(word, uint32_t(0x7cd215d8));
+
+  // Single bit errors, including the parity bit
+  for (int i=0; i<32; i++) {
+    word = 0x7cd215d8 ^ (1u<<i);
+    UT_ASSERT_EQUAL(pocsag_repair(word), 0);
+    UT_ASSERT_EQUAL(word, uint32_t(0x7cd215d8));
+  }
+
+  // Double bit errors, including the parity bit
+  for (int i=0; i<32; i++) {
+    for (int j=i+1; j<32; j++) {
+      word = 0x7A89C197 ^ (1u<<i) ^ (1u<<j);
+      UT_ASSERT_EQUAL(pocsag_repair(word), 0);
+      UT_ASSERT_EQUAL(word, uint32_t(0x7A89C197));
+    }
+  }
+
+  // Three bit errors with even parity are detected
+  word = 0x7cd215d8 ^ 0x00000007;
+  UT_ASSERT_EQUAL(pocsag_repair(word), 1);
+
+  // Batch API
+  uint32_t words[3] = { 0x7cd215d8^0x100, 0x7A89C197^0x80000001, 0x7cd215d8^0x7 };
+  uint8_t failed[3];
+  UT_ASSERT_EQUAL(pocsag_repair(words, 3, failed), size_t(1));
+  UT_ASSERT_EQUAL(words[0], uint32_t(0x7cd215d8));
+  UT_ASSERT_EQUAL(words[1], uint32_t(0x7A89C197));
+  UT_ASSERT_EQUAL(int(failed[0]), 0);
+  UT_ASSERT_EQUAL(int(failed[1]), 0);
+  UT_ASSERT_EQUAL(int(failed[2]), 1);
+}
+
+
+void
+DecoderTest::testSyncWordSearch() {
+  SyncWordSearch sync(0x7cd215d8, 2);
+  BitBuffer a(100), b(100);
+  size_t offset = 0;
+
+  // 70 bits of preamble followed by the first 20 bits of the sync word
+  for (size_t i=0; i<70; i++) { a.append(i&1); }
+  for (int i=31; i>=12; i--) { a.append((0x7cd215d8 >> i) & 0x01); }
+  UT_ASSERT(! sync.search(a, offset));
+  UT_ASSERT_EQUAL(offset, a.size());
+
+  // Remaining 12 bits of the sync word with 2 bit errors, sync word ends at the last bit
+  for (int i=11; i>=0; i--) { b.append(((0x7cd215d8 ^ 0x81) >> i) & 0x01); }
+  offset = 0;
+  UT_ASSERT(sync.search(b, offset));
+  UT_ASSERT_EQUAL(offset, size_t(12));
+
+  // 3 bit errors are rejected
+  sync.reset(); b.clear(); offset = 0;
+  for (int i=31; i>=0; i--) { b.append(((0x7cd215d8 ^ 0x181) >> i) & 0x01); }
+  UT_ASSERT(! sync.search(b, offset));
+
+  a.unref(); b.unref();
+}
+
+
+
+/** Collects the received POCSAG messages. */
+class POCSAGCollector: public POCSAG
+{
+public:
+  void handleMessages() {
+    while (_queue.size()) { messages.push_back(_queue.front()); _queue.pop_front(); }
+  }
+
+  std::vector<Message> messages;
+};
+
+/** A demodulated (NRZ) POCSAG signal carrying text messages at different baud rates. The bit
+ * clock may be off by the relative error @c clock. */
+class POCSAGSignal
+{
+public:
+  POCSAGSignal(double Fs, double clock)
+    : _Fs(Fs), _clock(clock), _t(0)
+  {
+    // pass...
+  }
+
+  /** Returns the code word (BCH(31,21) and even parity) of the given 21 data bits. */
+  static uint32_t codeword(uint32_t data) {
+    uint32_t word = data << 10, rem = word;
+    for (int i=30; i>=10; i--) {
+      if (rem & (1u<<i)) { rem ^= (0x769u << (i-10)); }
+    }
+    word |= rem;
+    return (word << 1) | (__builtin_popcount(word) & 1);
+  }
+
+  /** Appends a transmission of a single text message (7-bit chars, LSB first). */
+  void addTransmission(float baud, uint32_t addr, uint8_t func, const std::string &text) {
+    // Idle words up to the frame of the address
+    std::vector<uint32_t> words(2*(addr & 7), 0x7A89C197);
+    words.push_back(codeword(((addr >> 3) << 2) | func));
+    uint32_t data = 0; size_t nbits = 0;
+    for (size_t i=0; i<text.size(); i++) {
+      for (int j=0; j<7; j++) {
+        data = (data << 1) | ((text[i] >> j) & 1);
+        if (20 == ++nbits) { words.push_back(codeword((1u << 20) | data)); data = 0; nbits = 0; }
+      }
+    }
+    while (words.size() % 16) { words.push_back(0x7A89C197); }
+
+    for (size_t i=0; i<576; i++) { _bit(baud, 1-(i&1)); }
+    for (size_t i=0; i<words.size(); i++) {
+      if (0 == (i % 16)) { _word(baud, 0x7cd215d8); }
+      _word(baud, words[i]);
+    }
+  }
+
+  /** Appends silence of the given duration. */
+  void addSilence(double secs) {
+    samples.resize(samples.size() + size_t(secs*_Fs), 0);
+  }
+
+  /** The samples. */
+  std::vector<int16_t> samples;
+
+protected:
+  void _word(float baud, uint32_t word) {
+    for (int i=31; i>=0; i--) { _bit(baud, (word >> i) & 1); }
+  }
+
+  void _bit(float baud, int bit) {
+    for (_t += _Fs/(baud*(1+_clock)); _t >= 1; _t -= 1) { samples.push_back(bit ? 8000 : -8000); }
+  }
+
+protected:
+  double _Fs;
+  double _clock;
+  double _t;
+};
+
+void
+DecoderTest::testPOCSAGMultiRate() {
+  double Fs = 22050;
+  // Every code word is valid
+  UT_ASSERT_EQUAL(POCSAGSignal::codeword(0x7cd215d8 >> 11), uint32_t(0x7cd215d8));
+  UT_ASSERT_EQUAL(POCSAGSignal::codeword(0x7A89C197 >> 11), uint32_t(0x7A89C197));
+
+  // Three transmissions with a bit clock 0.1% too fast, the first two span two batches
+  POCSAGSignal signal(Fs, 1e-3);
+  const char *text[3] = { "SLOW PAGE AT 512 BAUD SPANNING 2 BATCHES",
+                          "A PAGE AT 1200 BAUD, THE MOST COMMON ONE",
+                          "FAST PAGE AT 2400 BAUD FROM ANOTHER SITE" };
+  float baud[3] = { 512, 1200, 2400 };
+  uint32_t addr[3] = { 1234567, 234566, 345672 };
+  signal.addSilence(0.1);
+  for (size_t i=0; i<3; i++) {
+    signal.addTransmission(baud[i], addr[i], 3, text[i]);
+    signal.addSilence(0.2);
+  }
+
+  POCSAGCollector receiver;
+  POCSAGMultiRate multi(&receiver);
+  multi.config(Config(Config::Type_s16, Fs, 1024, 1));
+  Buffer<int16_t> buffer(1024);
+  for (size_t n=0; n+1024<=signal.samples.size(); n+=1024) {
+    for (size_t i=0; i<1024; i++) { buffer[i] = signal.samples[n+i]; }
+    multi.process(buffer, false);
+  }
+
+  // Every message is received once, tagged with its baud rate
+  UT_ASSERT_EQUAL(receiver.messages.size(), size_t(3));
+  for (size_t i=0; i<3; i++) {
+    const POCSAG::Message &msg = receiver.messages[i];
+    UT_ASSERT_EQUAL(msg.address(), addr[i]);
+    UT_ASSERT_EQUAL(int(msg.function()), 3);
+    UT_ASSERT_EQUAL(msg.baud(), baud[i]);
+    UT_ASSERT(msg.asText() == std::string(text[i]));
+  }
+
+  buffer.unref();
+}
+
+/** Appends the given word to the bit sequence (MSB first). */
+static void
+append_word(std::vector<uint8_t> &bits, uint32_t word) {
+  for (int i=31; i>=0; i--) { bits.push_back((word >> i) & 1); }
+}
+
+void
+DecoderTest::testPOCSAGBackToBack() {
+  // Two single-batch transmissions, the second one follows with a preamble of only 16 bits,
+  // hence its sync word starts within the (failed) continuation check of the first one.
+  std::vector<uint8_t> bits;
+  uint32_t addr[2] = { 1000, 2001 };
+  for (size_t t=0; t<2; t++) {
+    for (size_t i=0; i<(t ? 16 : 576); i++) { bits.push_back(1-(i&1)); }
+    append_word(bits, 0x7cd215d8);
+    for (size_t w=0; w<16; w++) {
+      if (w == 2*(addr[t] & 7)) {
+        append_word(bits, POCSAGSignal::codeword(((addr[t] >> 3) << 2) | 3));
+      } else {
+        append_word(bits, 0x7A89C197);
+      }
+    }
+  }
+  for (size_t i=0; i<64; i++) { bits.push_back(i&1); }
+
+  // Word-parallel (packed, in blocks of 100 bits) and bit-serial
+  for (size_t packed=0; packed<2; packed++) {
+    POCSAGCollector receiver;
+    receiver.config(Config(packed ? Config::Type_bits : Config::Type_u8, 1200, 100, 1));
+    for (size_t n=0; n<bits.size(); n+=100) {
+      size_t len = std::min(size_t(100), bits.size()-n);
+      if (packed) {
+        BitBuffer buffer(len);
+        for (size_t i=0; i<len; i++) { buffer.append(bits[n+i]); }
+        receiver.processBits(buffer, false);
+        buffer.unref();
+      } else {
+        Buffer<uint8_t> buffer(len);
+        for (size_t i=0; i<len; i++) { buffer[i] = bits[n+i]; }
+        receiver.process(buffer, false);
+        buffer.unref();
+      }
+    }
+    UT_ASSERT_EQUAL(receiver.messages.size(), size_t(2));
+    for (size_t i=0; i<receiver.messages.size(); i++) {
+      UT_ASSERT_EQUAL(receiver.messages[i].address(), addr[i]);
+    }
+  }
+}
+
+void
+DecoderTest::testVaricode() {
+  // "Hi e" followed by an unknown code (all ones), preceded by an idle sequence
+  const char *bits = "0000" "10101010100" "110100" "100" "1100" "111111111111111100" "1100";
+  Buffer<uint8_t> unpacked(64);
+  BitBuffer packed(64);
+  size_t n = 0;
+  for (; bits[n]; n++) { unpacked[n] = ('1' == bits[n]); packed.append('1' == bits[n]); }
+
+  // Decode at once
+  Varicode varicode;
+  UT_ASSERT(varicode.decode(unpacked.head(n)) == std::string("Hi ee"));
+  // Decode packed bits in chunks, the state is kept between calls
+  varicode.reset();
+  UT_ASSERT(varicode.decode(unpacked.head(7)) == std::string());
+  UT_ASSERT(varicode.decode(unpacked.sub(7, n-7)) == std::string("Hi ee"));
+  varicode.reset();
+  UT_ASSERT(varicode.decode(packed) == std::string("Hi ee"));
+
+  unpacked.unref(); packed.unref();
+}
+
+
+/** Collects the received chars. */
+class TextSink: public Sink<uint8_t>
+{
+public:
+  void config(const Config &src_cfg) { }
+  void process(const Buffer<uint8_t> &buffer, bool allow_overwrite) {
+    text.append((const char *)buffer.ptr(), buffer.size());
+  }
+
+  std::string text;
+};
+
+/** A BPSK31 signal carrying the given text a number of times, preceded by an idle sequence
+ * (phase reversals). The symbol clock may be off by the relative error @c clock. */
+class PSK31Signal
+{
+public:
+  PSK31Signal(double F, const char *text, size_t repeat, double clock=0)
+    : F(F), clock(clock), idx(0)
+  {
+    std::vector<uint8_t> bits(64, 0);
+    Varicode varicode;
+    for (size_t r=0; r<repeat; r++) {
+      for (const char *c=text; *c; c++) {
+        // Search the code of the char, the code is followed by two 0s
+        for (int code=1; code<SDR_VARICODE_TABLE_SIZE; code++) {
+          Buffer<uint8_t> buffer(16);
+          size_t n = 0;
+          for (int j=31-__builtin_clz(code); j>=0; j--) { buffer[n++] = (code>>j)&1; }
+          buffer[n++] = 0; buffer[n++] = 0;
+          varicode.reset();
+          bool found = (varicode.decode(buffer.head(n)) == std::string(1, *c));
+          if (found) { bits.insert(bits.end(), buffer.ptr(), buffer.ptr()+n); }
+          buffer.unref();
+          if (found) { break; }
+        }
+      }
+    }
+    // A 0 is sent as a phase reversal
+    symbols.push_back(1);
+    for (size_t i=0; i<bits.size(); i++) {
+      symbols.push_back(bits[i] ? symbols.back() : -symbols.back());
+    }
+  }
+
+  /** Returns the next sample (complex) at the given sample rate, 0 once all symbols are sent. */
+  std::complex<float> next(double Fs) {
+    double t = double(idx++)/Fs, u = t*31.25*(1+clock);
+    size_t n = size_t(u);
+    if ((n+1) >= symbols.size()) { return 0; }
+    // Cosine shaped transitions between the symbols
+    double a = 0.5*std::cos(M_PI*(u-n));
+    return float(symbols[n]*(0.5+a) + symbols[n+1]*(0.5-a)) * std::polar(1.f, float(2*M_PI*F*t));
+  }
+
+  double F, clock;
+  size_t idx;
+  std::vector<int> symbols;
+};
+
+
+void
+DecoderTest::testBPSK31() {
+  // Complex base band signals at 2kHz with a symbol clock 0.02% too fast, detuned slightly and
+  // far beyond the capture range of the Costas loop
+  double Fs = 2000;
+  double detune[] = {3, -20};
+  for (size_t k=0; k<2; k++) {
+    PSK31Signal signal(detune[k], "CQ CQ DE ALPHA K ", 3, 2e-4);
+    BPSK31<float> demod;
+    Varicode varicode;
+    TextSink sink;
+    demod.connect(&varicode, true);
+    varicode.connect(&sink, true);
+    demod.config(Config(Config::Type_cf32, Fs, 512, 1));
+    Buffer< std::complex<float> > buffer(512);
+    for (size_t n=0; n<15*Fs; n+=buffer.size()) {
+      for (size_t i=0; i<buffer.size(); i++) { buffer[i] = 0.5f*signal.next(Fs); }
+      demod.process(buffer, false);
+    }
+
+    // The second transmission is received without bit errors
+    UT_ASSERT(std::string::npos != sink.text.find("K CQ CQ DE ALPHA K CQ"));
+
+    buffer.unref();
+  }
+}
+
+
+/** Holds references to all received bit buffers, like a queue that has not delivered them yet. */
+class HoldingBitSink: public BitSink
+{
+public:
+  virtual ~HoldingBitSink() {
+    for (size_t i=0; i<_held.size(); i++) { _held[i].unref(); }
+    for (size_t i=0; i<_heldBytes.size(); i++) { _heldBytes[i].unref(); }
+  }
+
+  void config(const Config &src_cfg) {
+    if (src_cfg.hasType()) { configBits(src_cfg, "HoldingBitSink"); }
+  }
+  void process(const Buffer<uint8_t> &buffer, bool allow_overwrite) {
+    buffer.ref(); _heldBytes.push_back(buffer);
+  }
+  void processBits(const BitBuffer &buffer, bool allow_overwrite) {
+    buffer.ref(); _held.push_back(buffer);
+  }
+
+  inline const std::vector<BitBuffer> &held() const { return _held; }
+  inline const std::vector< Buffer<uint8_t> > &heldBytes() const { return _heldBytes; }
+
+protected:
+  std::vector<BitBuffer> _held;
+  std::vector< Buffer<uint8_t> > _heldBytes;
+};
+
+void
+DecoderTest::testBitStreamBuffers() {
+  // 10 symbols per bit, all mark followed by all space
+  ASKDetector<int16_t> symbols(false, true);
+  BitStream bits(100, BitStream::NORMAL, true);
+  HoldingBitSink holder;
+  symbols.connect(&bits, true);
+  bits.connect(&holder, true);
+  symbols.config(Config(Config::Type_s16, 1000, 200, 1));
+
+  Buffer<int16_t> mark(200), space(200);
+  for (size_t i=0; i<200; i++) { mark[i] = 1000; space[i] = -1000; }
+  symbols.process(mark, false);
+  symbols.process(space, false);
+  symbols.process(space, false);
+
+  // Each received buffer keeps its bits, even though the stream went on
+  UT_ASSERT_EQUAL(holder.held().size(), size_t(3));
+  const BitBuffer &first = holder.held()[0];
+  UT_ASSERT(first.size() >= 19);
+  for (size_t i=0; i<first.size(); i++) { UT_ASSERT(first[i]); }
+  const BitBuffer &last = holder.held()[2];
+  UT_ASSERT(last.size() >= 19);
+  for (size_t i=0; i<last.size(); i++) { UT_ASSERT(! last[i]); }
+
+  mark.unref(); space.unref();
+}
+
+void
+DecoderTest::testFSKDetectorBankBuffers() {
+  // Two modems on the same tones, one emitting packed bits
+  FSKDetectorBank bank;
+  HoldingBitSink bytes, bits;
+  bank.addModem(1200, 1200, 2200)->connect(&bytes, true);
+  bank.addModem(1200, 1200, 2200, 1, true)->connect(&bits, true);
+  bank.config(Config(Config::Type_s16, 9600, 200, 1));
+
+  // A mark tone followed by two buffers of the space tone
+  Buffer<int16_t> mark(200), space(200);
+  for (size_t i=0; i<200; i++) {
+    mark[i]  = int16_t(1000*std::sin(2*M_PI*1200*i/9600.));
+    space[i] = int16_t(1000*std::sin(2*M_PI*2200*(i+200)/9600.));
+  }
+  bank.process(mark, false);
+  bank.process(space, false);
+  bank.process(space, false);
+
+  // Each received buffer keeps its symbols, even though the stream went on
+  UT_ASSERT_EQUAL(bytes.heldBytes().size(), size_t(3));
+  UT_ASSERT_EQUAL(bits.held().size(), size_t(3));
+  for (size_t i=8; i<200; i++) { UT_ASSERT(bytes.heldBytes()[0][i]); }
+  for (size_t i=8; i<200; i++) { UT_ASSERT(! bytes.heldBytes()[2][i]); }
+  // Packed symbols equal the unpacked ones
+  for (size_t b=0; b<3; b++) {
+    UT_ASSERT_EQUAL(bits.held()[b].size(), size_t(200));
+    for (size_t i=0; i<200; i++) {
+      UT_ASSERT_EQUAL(bits.held()[b][i], bool(bytes.heldBytes()[b][i]));
+    }
+  }
+
+  mark.unref(); space.unref();
+}
+
+
+
+/** Appends an address to an AX.25 frame. */
+static void
+pack_call(std::vector<uint8_t> &frame, const char *call, int ssid, bool last) {
+  for (size_t i=0; i<6; i++) { frame.push_back(uint8_t((*call ? *call++ : ' ') << 1)); }
+  frame.push_back(uint8_t(0x60 | (ssid << 1) | (last ? 1 : 0)));
+}
+
+void
+DecoderTest::testAX25Address() {
+  std::vector<uint8_t> frame;
+  pack_call(frame, "APRS", 0, false);
+  pack_call(frame, "N0CALL", 1, false);
+  pack_call(frame, "WIDE1", 1, true);
+  frame.push_back(0x03); frame.push_back(0xf0);
+  frame.push_back('!'); frame.push_back('x');
+
+  AX25::Message msg(&frame[0], frame.size());
+  UT_ASSERT(msg.to().call() == std::string("APRS"));
+  UT_ASSERT(msg.from().call() == std::string("N0CALL"));
+  UT_ASSERT_EQUAL(msg.from().ssid(), size_t(1));
+  UT_ASSERT_EQUAL(msg.via().size(), size_t(1));
+  UT_ASSERT(msg.via()[0].call() == std::string("WIDE1"));
+  UT_ASSERT_EQUAL(msg.payload().size(), size_t(4));
+
+  // The address field is never terminated, the remaining 4 bytes are no address
+  frame.clear();
+  pack_call(frame, "APRS", 0, false);
+  pack_call(frame, "N0CALL", 1, false);
+  pack_call(frame, "WIDE1", 1, false);
+  frame.push_back(0x03); frame.push_back(0xf0);
+  frame.push_back('!'); frame.push_back('x');
+  AX25::Message trunc(&frame[0], frame.size());
+  UT_ASSERT_EQUAL(trunc.via().size(), size_t(1));
+  UT_ASSERT_EQUAL(trunc.payload().size(), size_t(4));
+
+  // Too short for the source address
+  AX25::Message empty(&frame[0], 10);
+  UT_ASSERT_EQUAL(empty.via().size(), size_t(0));
+  UT_ASSERT_EQUAL(empty.payload().size(), size_t(0));
+}
+
+
+
+/** Collects the payloads of the received AX.25 messages. */
+class AX25Collector: public AX25
+{
+public:
+  void handleAX25Message(const Message &message) { payloads.push_back(message.payload()); }
+
+  std::vector<std::string> payloads;
+};
+
+/** A Bell 202 AFSK signal (1200 baud, mark 1200Hz, space 2200Hz) carrying AX.25 UI frames. */
+class AFSKSignal
+{
+public:
+  AFSKSignal(double Fs)
+    : _Fs(Fs), _phase(0), _mark(true), _t(0)
+  {
+    // pass...
+  }
+
+  /** Appends a frame with the given payload, preceded by some flags. */
+  void addFrame(const std::string &payload) {
+    std::vector<uint8_t> frame;
+    pack_call(frame, "APRS", 0, false);
+    pack_call(frame, "N0CALL", 1, true);
+    frame.push_back(0x03); frame.push_back(0xf0);
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    // FCS: complemented CRC-CCITT (LSB first)
+    uint16_t crc = 0xffff;
+    for (size_t i=0; i<frame.size(); i++) {
+      crc ^= frame[i];
+      for (int j=0; j<8; j++) { crc = (crc & 1) ? ((crc >> 1) ^ 0x8408) : (crc >> 1); }
+    }
+    crc = ~crc;
+    frame.push_back(crc & 0xff); frame.push_back(crc >> 8);
+
+    for (size_t i=0; i<16; i++) { _flag(); }
+    // Frame with bit stuffing
+    int ones = 0;
+    for (size_t i=0; i<frame.size(); i++) {
+      for (int j=0; j<8; j++) {
+        int bit = (frame[i] >> j) & 1;
+        _bit(bit);
+        if (! bit) { ones = 0; }
+        else if (5 == ++ones) { _bit(0); ones = 0; }
+      }
+    }
+    _flag(); _flag();
+  }
+
+  /** Appends silence of the given duration. */
+  void addSilence(double secs) {
+    samples.resize(samples.size() + size_t(secs*_Fs), 0);
+  }
+
+  /** Adds uniform noise with the given peak amplitude to all samples. */
+  void addNoise(int amplitude) {
+    for (size_t i=0; i<samples.size(); i++) {
+      samples[i] += int16_t(amplitude*(2*(std::rand()/double(RAND_MAX))-1));
+    }
+  }
+
+  /** The samples. */
+  std::vector<int16_t> samples;
+
+protected:
+  /** Appends a flag. */
+  void _flag() {
+    for (int j=0; j<8; j++) { _bit((0x7e >> j) & 1); }
+  }
+
+  /** Appends a bit, NRZI encoded (0 -> change tone, 1 -> keep tone). */
+  void _bit(int bit) {
+    if (! bit) { _mark = !_mark; }
+    for (_t += _Fs/1200; _t >= 1; _t -= 1) {
+      _phase += 2*M_PI*(_mark ? 1200 : 2200)/_Fs;
+      samples.push_back(int16_t(2000*std::sin(_phase)));
+    }
+  }
+
+protected:
+  double _Fs;
+  double _phase;
+  bool _mark;
+  double _t;
+};
+
+/** Processes the samples in blocks of 1024. */
+static void
+process_afsk(AX25Diversity &node, double Fs, const std::vector<int16_t> &samples) {
+  node.config(Config(Config::Type_s16, Fs, 1024, 1));
+  Buffer<int16_t> buffer(1024);
+  for (size_t n=0; n+1024<=samples.size(); n+=1024) {
+    for (size_t i=0; i<1024; i++) { buffer[i] = samples[n+i]; }
+    node.process(buffer, false);
+  }
+  buffer.unref();
+}
+
+void
+DecoderTest::testAX25Diversity() {
+  double Fs = 9600;
+
+  // A clean signal: Every variant receives every frame, the repetition within the window is
+  // forwarded once, the one after the window again.
+  AFSKSignal clean(Fs);
+  clean.addSilence(0.1);
+  clean.addFrame("!one"); clean.addSilence(0.2);
+  clean.addFrame("!two"); clean.addSilence(0.2);
+  clean.addFrame("!two"); clean.addSilence(2);
+  clean.addFrame("!two"); clean.addSilence(0.2);
+  AX25Collector receiver;
+  AX25Diversity diversity(&receiver);
+  process_afsk(diversity, Fs, clean.samples);
+
+  UT_ASSERT_EQUAL(diversity.numVariants(), size_t(5));
+  UT_ASSERT_EQUAL(diversity.frames(), size_t(3));
+  UT_ASSERT_EQUAL(receiver.payloads.size(), size_t(3));
+  UT_ASSERT(receiver.payloads[0] == std::string("\x03\xf0!one"));
+  UT_ASSERT(receiver.payloads[1] == std::string("\x03\xf0!two"));
+  UT_ASSERT(receiver.payloads[2] == std::string("\x03\xf0!two"));
+  size_t wins = 0;
+  for (size_t i=0; i<diversity.numVariants(); i++) {
+    UT_ASSERT_EQUAL(diversity.decoded(i), size_t(4));
+    wins += diversity.wins(i);
+  }
+  UT_ASSERT_EQUAL(wins, size_t(3));
+
+  // A noisy signal: The variants lose different frames, together they receive more frames than
+  // any single one, each only once.
+  AFSKSignal noisy(Fs);
+  noisy.addSilence(0.1);
+  for (size_t i=0; i<40; i++) {
+    std::stringstream payload; payload << "!msg" << i;
+    noisy.addFrame(payload.str()); noisy.addSilence(0.05);
+  }
+  std::srand(1);
+  noisy.addNoise(1500);
+  AX25Collector noisyReceiver;
+  AX25Diversity noisyDiversity(&noisyReceiver);
+  process_afsk(noisyDiversity, Fs, noisy.samples);
+
+  std::set<std::string> unique(noisyReceiver.payloads.begin(), noisyReceiver.payloads.end());
+  UT_ASSERT_EQUAL(noisyReceiver.payloads.size(), noisyDiversity.frames());
+  UT_ASSERT_EQUAL(unique.size(), noisyDiversity.frames());
+  wins = 0;
+  for (size_t i=0; i<noisyDiversity.numVariants(); i++) {
+    UT_ASSERT(noisyDiversity.decoded(i) < noisyDiversity.frames());
+    UT_ASSERT(noisyDiversity.wins(i) <= noisyDiversity.decoded(i));
+    wins += noisyDiversity.wins(i);
+  }
+  UT_ASSERT_EQUAL(wins, noisyDiversity.frames());
+}
+
+/** Returns the ITA2 code of the given letter (spaces for unknown chars). */
+static int
+ita2_code(char c) {
+  static const char *letters = "_E_A SIU_DRJNFCKTZLWHYPQOBG_MXV_";
+  for (int i=0; i<32; i++) { if ('_' != letters[i] && c == letters[i]) { return i; } }
+  return 4;
+}
+
+/** Appends the half bits of a frame with 1.5 stop bits, the LSB is sent first. */
+static void
+ita2_frame(std::vector<uint8_t> &hbits, int code) {
+  hbits.push_back(0); hbits.push_back(0);
+  for (int j=0; j<5; j++) { hbits.push_back((code>>j)&1); hbits.push_back((code>>j)&1); }
+  hbits.push_back(1); hbits.push_back(1); hbits.push_back(1);
+}
+
+void
+DecoderTest::testBaudot() {
+  std::vector<uint8_t> hbits(8, 1);
+  const char *text = "RYRY CQ";
+  for (const char *c=text; *c; c++) { ita2_frame(hbits, ita2_code(*c)); }
+  // A start bit followed by a space instead of the stop bits
+  hbits.insert(hbits.end(), 2, 0);
+  hbits.insert(hbits.end(), 10, 1);
+  hbits.insert(hbits.end(), 3, 0);
+  hbits.insert(hbits.end(), 8, 1);
+
+  Baudot baudot(Baudot::STOP15);
+  TextSink sink;
+  baudot.connect(&sink, true);
+  baudot.config(Config(Config::Type_u8, 2*45.45, hbits.size(), 1));
+  Buffer<uint8_t> buffer(hbits.size());
+  for (size_t i=0; i<hbits.size(); i++) { buffer[i] = hbits[i]; }
+  baudot.process(buffer, false);
+
+  // The LSB is sent first, i.e. Q=10111 is not received as X=11101
+  UT_ASSERT(sink.text == std::string("RYRY CQ"));
+  // The first frame follows the idle period
+  UT_ASSERT_EQUAL(baudot.frames(), size_t(6));
+  UT_ASSERT_EQUAL(baudot.framingErrors(), size_t(1));
+
+  buffer.unref();
+}
+
+
+#ifdef SDR_WITH_FFTW
+/** Collects the text decoded by the skimmer for each pair of tones. */
+class RTTYCollector: public RTTYSkimmer
+{
+public:
+  RTTYCollector() : RTTYSkimmer(100, 1000) { }
+
+  void handleText(size_t id, float Fmark, float Fspace, float baud, const std::string &text) {
+    texts[int(Fspace/10+0.5)] += text;
+  }
+
+  /** The received text by the space frequency in 10Hz. */
+  std::map<int, std::string> texts;
+};
+
+/** Continuous phase 45.45 baud FSK signal with 170Hz shift. */
+class RTTYSignal
+{
+public:
+  RTTYSignal(double Fspace, const char *text, size_t offset)
+    : Fspace(Fspace), phase(0), idx(offset)
+  {
+    for (const char *c=text; *c; c++) { ita2_frame(hbits, ita2_code(*c)); }
+  }
+
+  float next(double Fs) {
+    bool mark = hbits[size_t(idx*2*45.45/Fs) % hbits.size()]; idx++;
+    phase += 2*M_PI*(mark ? Fspace+170 : Fspace)/Fs;
+    return std::sin(phase);
+  }
+
+  double Fspace, phase;
+  size_t idx;
+  std::vector<uint8_t> hbits;
+};
+
+void
+DecoderTest::testRTTYSkimmer() {
+  // Two signals 320Hz apart and a carrier 170Hz below the first one. The gaps between the
+  // signals and the carrier match the shift nearly, the carrier and the space tone of the first
+  // signal match exactly. Hence, the pairs are ambiguous.
+  double Fs = 8000;
+  RTTYSignal a(300, "CQ CQ DE ALPHA K ", 0), b(620, "CQ CQ DE BRAVO K ", 3000);
+  RTTYCollector skimmer;
+  skimmer.config(Config(Config::Type_s16, Fs, 1024, 1));
+  Buffer<int16_t> buffer(1024);
+  double carrier = 0;
+  for (size_t n=0; n<40*Fs; n+=buffer.size()) {
+    for (size_t i=0; i<buffer.size(); i++) {
+      carrier += 2*M_PI*130/Fs;
+      buffer[i] = 4000*(a.next(Fs) + b.next(Fs) + std::sin(carrier));
+    }
+    skimmer.process(buffer, false);
+  }
+
+  // Only the text of the signals is reported, the mispaired carrier never decodes
+  UT_ASSERT_EQUAL(skimmer.texts.size(), size_t(2));
+  UT_ASSERT(std::string::npos != skimmer.texts[30].find("CQ CQ DE ALPHA K CQ"));
+  UT_ASSERT(std::string::npos != skimmer.texts[62].find("CQ CQ DE BRAVO K CQ"));
+  UT_ASSERT_EQUAL(skimmer.numChannels(), size_t(2));
+
+  buffer.unref();
+}
+
+
+/** Collects the text decoded by the PSK31 skimmer for each channel. */
+class PSK31Collector: public PSK31Skimmer
+{
+public:
+  PSK31Collector() : PSK31Skimmer(200, 1500) { }
+
+  void handleText(size_t id, double F, const std::string &text) {
+    texts[id] += text; freqs[id] = F;
+  }
+
+  /** The received text by channel ID. */
+  std::map<size_t, std::string> texts;
+  /** The last carrier frequency by channel ID. */
+  std::map<size_t, double> freqs;
+};
+
+void
+DecoderTest::testPSK31Skimmer() {
+  // At 8kHz, the sub-bands of the filter bank are 250Hz apart. The first two signals share the
+  // sub-band at 500Hz, the third one is close to the edge of the sub-band at 750Hz.
+  double Fs = 8000;
+  PSK31Signal sigs[3] = { PSK31Signal(500, "CQ CQ DE ALPHA K ", 3, 1e-4),
+                          PSK31Signal(620, "CQ CQ DE BRAVO K ", 3, -1e-4),
+                          PSK31Signal(872, "CQ CQ DE CHARLIE K ", 3) };
+  const char *expected[3] = {
+    "CQ CQ DE ALPHA K CQ", "CQ CQ DE BRAVO K CQ", "CQ CQ DE CHARLIE K CQ" };
+  PSK31Collector skimmer;
+  skimmer.config(Config(Config::Type_s16, Fs, 1024, 1));
+  Buffer<int16_t> buffer(1024);
+  std::srand(1);
+  // Stop just before the end of the shortest signal
+  for (size_t n=0; n<15*Fs; n+=buffer.size()) {
+    for (size_t i=0; i<buffer.size(); i++) {
+      float value = 0;
+      for (size_t j=0; j<3; j++) { value += sigs[j].next(Fs).real(); }
+      buffer[i] = 3000*value + (std::rand()%1001) - 500;
+    }
+    skimmer.process(buffer, false);
+  }
+
+  // Every signal is decoded by exactly one channel, tracking its carrier
+  UT_ASSERT_EQUAL(skimmer.texts.size(), size_t(3));
+  for (size_t j=0; j<3; j++) {
+    size_t found = 0;
+    std::map<size_t, std::string>::iterator item = skimmer.texts.begin();
+    for (; item != skimmer.texts.end(); item++) {
+      if (std::string::npos == item->second.find(expected[j])) { continue; }
+      UT_ASSERT(std::abs(skimmer.freqs[item->first]-sigs[j].F) < 2);
+      found++;
+    }
+    UT_ASSERT_EQUAL(found, size_t(1));
+  }
+
+  buffer.unref();
+}
+#endif
+
+
+TestSuite *
+DecoderTest::suite() {
+  TestSuite *suite = new TestSuite("Decoders");
+
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "BCH(31,21) repair", &DecoderTest::testBCHRepair));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "sync word search", &DecoderTest::testSyncWordSearch));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "POCSAG multi-rate", &DecoderTest::testPOCSAGMultiRate));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "POCSAG back-to-back", &DecoderTest::testPOCSAGBackToBack));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "varicode", &DecoderTest::testVaricode));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "BPSK31", &DecoderTest::testBPSK31));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "AX.25 address field", &DecoderTest::testAX25Address));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "AX.25 diversity", &DecoderTest::testAX25Diversity));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "bit stream buffers", &DecoderTest::testBitStreamBuffers));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "FSK detector bank buffers", &DecoderTest::testFSKDetectorBankBuffers));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "baudot", &DecoderTest::testBaudot));
+#ifdef SDR_WITH_FFTW
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "RTTY skimmer", &DecoderTest::testRTTYSkimmer));
+  suite->addTest(new TestCaller<DecoderTest>(
+                   "PSK31 skimmer", &DecoderTest::testPSK31Skimmer));
+#endif
+
+  return suite;
+}
@@ -0,0 +1,32 @@
+#ifndef __SDR_TEST_DECODERTEST_HH__
+#define __SDR_TEST_DECODERTEST_HH__
+
+#include "unittest.hh"
+#include "config.hh"
+
+class DecoderTest : public UnitTest::TestCase
+{
+public:
+  virtual ~DecoderTest();
+
+  void testBCHRepair();
+  void testSyncWordSearch();
+  void testPOCSAGMultiRate();
+  void testPOCSAGBackToBack();
+  void testVaricode();
+  void testBPSK31();
+  void testAX25Address();
+  void testAX25Diversity();
+  void testBitStreamBuffers();
+  void testFSKDetectorBankBuffers();
+  void testBaudot();
+#ifdef SDR_WITH_FFTW
+  void testRTTYSkimmer();
+  void testPSK31Skimmer();
+#endif
+
+public:
+  static UnitTest::TestSuite *suite();
+};
+
+#endif // __SDR_TEST_DECODERTEST_HH__
@@ -2,6 +2,7 @@
 #include "coreutilstest.hh"
 #include "unittest.hh"
 #include "buffertest.hh"
+#include "decodertest.hh"
 #include <iostream>
 
 using namespace sdr;
@@ -14,6 +15,7 @@ int main(int argc, char *argv[]) {
   runner.addSuite(CoreTest::suite());
   runner.addSuite(BufferTest::suite());
   runner.addSuite(CoreUtilsTest::suite());
+  runner.addSuite(DecoderTest::suite());
 
   runner();
 